@@ -0,0 +1,144 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ZLIB */
+#include <zlib.h>
+
+/* Local */
+#include "apngwrite.h"
+#include "pngchunk.h"
+
+/* Bounding box of the pixels that differ from the canvas, a single pixel when nothing changed. */
+static void ChangedRegion(apng_writer_t *aWriter, const uint8_t *aRgb888, uint32_t aStride, uint32_t aRegion[4]) {
+	const uint32_t lRowBytes = aWriter->width * PNGCHUNK_BPP;
+	int32_t lTop, lBottom, lLeft = aWriter->width, lRight = -1, x, y;
+	for (lTop = 0; lTop < aWriter->height; ++lTop)
+		if (memcmp(aWriter->previous + lTop * lRowBytes, aRgb888 + lTop * aStride, lRowBytes))
+			break;
+	if (lTop == aWriter->height) {
+		aRegion[0] = aRegion[1] = 0;
+		aRegion[2] = aRegion[3] = 1;
+		return;
+	}
+	for (lBottom = aWriter->height - 1; lBottom > lTop; --lBottom)
+		if (memcmp(aWriter->previous + lBottom * lRowBytes, aRgb888 + lBottom * aStride, lRowBytes))
+			break;
+	for (y = lTop; y <= lBottom; ++y) {
+		const uint8_t *lOld = aWriter->previous + y * lRowBytes, *lNew = aRgb888 + y * aStride;
+		for (x = 0; x < lLeft; ++x)
+			if (memcmp(lOld + x * PNGCHUNK_BPP, lNew + x * PNGCHUNK_BPP, PNGCHUNK_BPP)) {
+				lLeft = x;
+				break;
+			}
+		for (x = aWriter->width - 1; x > lRight; --x)
+			if (memcmp(lOld + x * PNGCHUNK_BPP, lNew + x * PNGCHUNK_BPP, PNGCHUNK_BPP)) {
+				lRight = x;
+				break;
+			}
+	}
+	aRegion[0] = lLeft;
+	aRegion[1] = lTop;
+	aRegion[2] = lRight - lLeft + 1;
+	aRegion[3] = lBottom - lTop + 1;
+}
+
+static int32_t WritePending(apng_writer_t *aWriter, uint32_t aDelayMs) {
+	uint8_t lControl[26], lSequence[4];
+	PngPutU32(lControl + 0, aWriter->sequence++);
+	PngPutU32(lControl + 4, aWriter->region[2]);
+	PngPutU32(lControl + 8, aWriter->region[3]);
+	PngPutU32(lControl + 12, aWriter->region[0]);
+	PngPutU32(lControl + 16, aWriter->region[1]);
+	PngPutU16(lControl + 20, (aDelayMs > 0xFFFF) ? 0xFFFF : aDelayMs);
+	PngPutU16(lControl + 22, 1000);
+	lControl[24] = APNG_DISPOSE_OP_NONE;
+	lControl[25] = APNG_BLEND_OP_SOURCE;
+	if (PngWriteChunk(aWriter->file, "fcTL", lControl, sizeof(lControl), NULL, 0))
+		return -1;
+
+	/* The first frame is the default image for viewers without APNG support. */
+	if (aWriter->frames == 1)
+		return PngWriteChunk(aWriter->file, "IDAT", NULL, 0, aWriter->data, aWriter->size);
+	PngPutU32(lSequence, aWriter->sequence++);
+	return PngWriteChunk(aWriter->file, "fdAT", lSequence, sizeof(lSequence), aWriter->data, aWriter->size);
+}
+
+int32_t ApngWriterInit(apng_writer_t *aWriter, FILE *aFile, int32_t aWidth, int32_t aHeight, uint32_t aFrames, int32_t aCompression) {
+	uint8_t lHeader[13], lAnimation[8];
+
+	memset(aWriter, 0, sizeof(apng_writer_t));
+	aWriter->file = aFile;
+	aWriter->width = aWidth;
+	aWriter->height = aHeight;
+	if (deflateInit(&aWriter->stream, aCompression) != Z_OK)
+		return -1;
+	aWriter->capacity = deflateBound(&aWriter->stream, aHeight * (aWidth * PNGCHUNK_BPP + 1));
+	aWriter->previous = malloc(aWidth * aHeight * PNGCHUNK_BPP);
+	aWriter->filtered = malloc((aWidth * PNGCHUNK_BPP + 1) * 5);
+	aWriter->data = malloc(aWriter->capacity);
+	if (!aWriter->previous || !aWriter->filtered || !aWriter->data) {
+		ApngWriterClose(aWriter, 0);
+		return -1;
+	}
+
+	PngHeaderRgb(lHeader, aWidth, aHeight);
+	PngPutU32(lAnimation + 0, aFrames);
+	PngPutU32(lAnimation + 4, 0);   /* Loop forever. */
+	if (
+		fwrite(g_png_signature, sizeof(g_png_signature), 1, aFile) != 1 ||
+		PngWriteChunk(aFile, "IHDR", lHeader, sizeof(lHeader), NULL, 0) ||
+		PngWriteChunk(aFile, "acTL", lAnimation, sizeof(lAnimation), NULL, 0)
+	) {
+		ApngWriterClose(aWriter, 0);
+		return -1;
+	}
+	return 0;
+}
+
+int32_t ApngAddFrame(apng_writer_t *aWriter, const uint8_t *aRgb888, uint32_t aStride, uint32_t aTimeMs) {
+	const uint8_t *lPrior = NULL;
+	uint32_t lRegion[4] = { 0, 0, aWriter->width, aWriter->height };
+	uint32_t y;
+
+	if (aWriter->frames) {
+		ChangedRegion(aWriter, aRgb888, aStride, lRegion);
+		if (WritePending(aWriter, aTimeMs - aWriter->time_ms))
+			return -1;
+	}
+
+	deflateReset(&aWriter->stream);
+	aWriter->stream.next_out = aWriter->data;
+	aWriter->stream.avail_out = aWriter->capacity;
+	for (y = lRegion[1]; y < lRegion[1] + lRegion[3]; ++y) {
+		const uint8_t *lRow = aRgb888 + y * aStride + lRegion[0] * PNGCHUNK_BPP;
+		const uint32_t lBytes = lRegion[2] * PNGCHUNK_BPP;
+		aWriter->stream.next_in = (Bytef *) PngFilterRow(aWriter->filtered, lRow, lPrior, lBytes);
+		aWriter->stream.avail_in = lBytes + 1;
+		deflate(&aWriter->stream, Z_NO_FLUSH);
+		memcpy(aWriter->previous + (y * aWriter->width + lRegion[0]) * PNGCHUNK_BPP, lRow, lBytes);
+		lPrior = lRow;
+	}
+	if (deflate(&aWriter->stream, Z_FINISH) != Z_STREAM_END)
+		return -1;
+	aWriter->size = aWriter->capacity - aWriter->stream.avail_out;
+
+	memcpy(aWriter->region, lRegion, sizeof(lRegion));
+	aWriter->time_ms = aTimeMs;
+	++aWriter->frames;
+	return 0;
+}
+
+int32_t ApngWriterClose(apng_writer_t *aWriter, uint32_t aLastDelayMs) {
+	int32_t lError = 0;
+	if (aWriter->frames)
+		lError = WritePending(aWriter, aLastDelayMs) || PngWriteChunk(aWriter->file, "IEND", NULL, 0, NULL, 0);
+	deflateEnd(&aWriter->stream);
+	free(aWriter->previous);
+	free(aWriter->filtered);
+	free(aWriter->data);
+	aWriter->previous = aWriter->filtered = aWriter->data = NULL;
+	return (lError) ? -1 : 0;
+}
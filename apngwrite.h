@@ -0,0 +1,43 @@
+#ifndef APNGWRITE_H
+#define APNGWRITE_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/* ZLIB */
+#include <zlib.h>
+
+/*
+ * Animated PNG writer, stock libpng has no APNG support so the chunks are written here with zlib.
+ * Every frame after the first one is cropped to the bounding box of the pixels that changed and is drawn with
+ * APNG_DISPOSE_OP_NONE and APNG_BLEND_OP_SOURCE, so unchanged regions stay on the canvas and are never deflated again.
+ * See: https://wiki.mozilla.org/APNG_Specification
+ */
+#define APNG_DISPOSE_OP_NONE        (0)
+#define APNG_BLEND_OP_SOURCE        (0)
+
+typedef struct {
+	FILE *file;
+	z_stream stream;
+	int32_t width;
+	int32_t height;
+	uint32_t frames;
+	uint32_t sequence;
+	uint8_t *previous;   /* RGB888 canvas after the last added frame. */
+	uint8_t *filtered;   /* Five candidate filtered rows, one per PNG filter type. */
+	uint8_t *data;       /* Deflated pending frame. */
+	uint32_t capacity;
+	uint32_t size;
+	uint32_t time_ms;    /* Capture time of the pending frame. */
+	uint32_t region[4];  /* x, y, width, height of the pending frame. */
+} apng_writer_t;
+
+/* Writes the signature, IHDR and acTL for aFrames frames, aCompression is the zlib level 0-9. Returns 0 or -1. */
+int32_t ApngWriterInit(apng_writer_t *aWriter, FILE *aFile, int32_t aWidth, int32_t aHeight, uint32_t aFrames, int32_t aCompression);
+/* Deflates the changed region of aRgb888, the previous frame is written now that its delay is known. Returns 0 or -1. */
+int32_t ApngAddFrame(apng_writer_t *aWriter, const uint8_t *aRgb888, uint32_t aStride, uint32_t aTimeMs);
+/* Writes the last frame with aLastDelayMs and IEND. Returns 0 or -1 on write error. */
+int32_t ApngWriterClose(apng_writer_t *aWriter, uint32_t aLastDelayMs);
+
+#endif /* !APNGWRITE_H */
@@ -0,0 +1,127 @@
+/* C */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX */
+#include <unistd.h>
+
+/* Local */
+#include "avi.h"
+#include "fdio.h"
+
+#define AVI_INDEX_STEP      (256)
+
+static void FourCc(char aDst[4], const char *aSrc) {
+	memcpy(aDst, aSrc, 4);
+}
+
+int32_t AviWriterInit(avi_writer_t *aWriter, int32_t aFd, int32_t aWidth, int32_t aHeight, uint32_t aFps) {
+	avi_header_t *lHeader = &aWriter->header;
+	memset(aWriter, 0, sizeof(avi_writer_t));
+	aWriter->fd = aFd;
+
+	FourCc(lHeader->riff, "RIFF");
+	FourCc(lHeader->riff_type, "AVI ");
+	FourCc(lHeader->hdrl_list, "LIST");
+	lHeader->hdrl_size = (uint8_t *) &lHeader->movi_list - (uint8_t *) lHeader->hdrl;
+	FourCc(lHeader->hdrl, "hdrl");
+
+	FourCc(lHeader->avih, "avih");
+	lHeader->avih_size = (uint8_t *) lHeader->strl_list - (uint8_t *) &lHeader->micro_sec_per_frame;
+	lHeader->micro_sec_per_frame = 1000000 / aFps;
+	lHeader->flags = AVI_HAS_INDEX;
+	lHeader->streams = 1;
+	lHeader->width = aWidth;
+	lHeader->height = aHeight;
+
+	FourCc(lHeader->strl_list, "LIST");
+	lHeader->strl_size = (uint8_t *) lHeader->movi_list - (uint8_t *) lHeader->strl;
+	FourCc(lHeader->strl, "strl");
+
+	FourCc(lHeader->strh, "strh");
+	lHeader->strh_size = (uint8_t *) lHeader->strf - (uint8_t *) lHeader->fcc_type;
+	FourCc(lHeader->fcc_type, "vids");
+	FourCc(lHeader->fcc_handler, "MJPG");
+	lHeader->scale = 1;
+	lHeader->rate = aFps;
+	lHeader->quality = 0xFFFFFFFF;
+	lHeader->frame_rect[2] = aWidth;
+	lHeader->frame_rect[3] = aHeight;
+
+	FourCc(lHeader->strf, "strf");
+	lHeader->strf_size = (uint8_t *) lHeader->movi_list - (uint8_t *) &lHeader->bi_size;
+	lHeader->bi_size = lHeader->strf_size;
+	lHeader->bi_width = aWidth;
+	lHeader->bi_height = aHeight;
+	lHeader->bi_planes = 1;
+	lHeader->bi_bit_count = 24;
+	FourCc(lHeader->bi_compression, "MJPG");
+	lHeader->bi_size_image = aWidth * aHeight * 3;
+
+	FourCc(lHeader->movi_list, "LIST");
+	FourCc(lHeader->movi, "movi");
+	aWriter->movi_bytes = sizeof(lHeader->movi);
+
+	return FdWriteAll(aFd, lHeader, sizeof(avi_header_t));
+}
+
+int32_t AviWriteFrame(avi_writer_t *aWriter, const uint8_t *aJpeg, uint32_t aSize) {
+	static const uint8_t lPadding[1] = { 0x00 };
+	struct iovec lIov[3];
+	avi_index_t *lEntry;
+	uint32_t lChunk[2];
+
+	if (aWriter->frames == aWriter->capacity) {
+		avi_index_t *lIndex = realloc(aWriter->index, (aWriter->capacity + AVI_INDEX_STEP) * sizeof(avi_index_t));
+		if (!lIndex)
+			return -1;
+		aWriter->index = lIndex;
+		aWriter->capacity += AVI_INDEX_STEP;
+	}
+	lEntry = &aWriter->index[aWriter->frames];
+	FourCc(lEntry->chunk_id, "00dc");
+	lEntry->flags = (aSize) ? AVI_KEYFRAME : 0;
+	lEntry->offset = aWriter->movi_bytes;
+	lEntry->size = aSize;
+
+	/* RIFF chunks are padded to an even size. */
+	memcpy(&lChunk[0], "00dc", sizeof(uint32_t));
+	lChunk[1] = aSize;
+	lIov[0].iov_base = lChunk;
+	lIov[0].iov_len = sizeof(lChunk);
+	lIov[1].iov_base = (void *) aJpeg;
+	lIov[1].iov_len = aSize;
+	lIov[2].iov_base = (void *) lPadding;
+	lIov[2].iov_len = aSize & 1;
+	if (FdWriteVector(aWriter->fd, lIov, 3))
+		return -1;
+
+	aWriter->movi_bytes += sizeof(lChunk) + aSize + (aSize & 1);
+	if (aSize > aWriter->header.suggested_buffer_size)
+		aWriter->header.suggested_buffer_size = aWriter->header.stream_suggested_buffer_size = aSize;
+	++aWriter->frames;
+	return 0;
+}
+
+int32_t AviWriterClose(avi_writer_t *aWriter) {
+	avi_header_t *lHeader = &aWriter->header;
+	uint32_t lIndexBytes = aWriter->frames * sizeof(avi_index_t);
+	uint32_t lChunk[2];
+	int32_t lError;
+
+	memcpy(&lChunk[0], "idx1", sizeof(uint32_t));
+	lChunk[1] = lIndexBytes;
+	lError = FdWriteAll(aWriter->fd, lChunk, sizeof(lChunk)) || FdWriteAll(aWriter->fd, aWriter->index, lIndexBytes);
+
+	lHeader->movi_size = aWriter->movi_bytes;
+	lHeader->riff_size = sizeof(avi_header_t) - sizeof(lHeader->movi) + aWriter->movi_bytes + sizeof(lChunk) + lIndexBytes - 8;
+	lHeader->total_frames = lHeader->length = aWriter->frames;
+	lHeader->max_bytes_per_sec = lHeader->suggested_buffer_size * lHeader->rate;
+	if (!lError)
+		lError = lseek(aWriter->fd, 0, SEEK_SET) != 0 || FdWriteAll(aWriter->fd, lHeader, sizeof(avi_header_t));
+
+	free(aWriter->index);
+	aWriter->index = NULL;
+	return (lError) ? -1 : 0;
+}
@@ -0,0 +1,100 @@
+#ifndef AVI_H
+#define AVI_H
+
+/* C */
+#include <stdint.h>
+
+/*
+ * Minimal Motion JPEG AVI 1.0 writer: one video stream, every "00dc" chunk is a complete JPEG image.
+ * The headers are written up front and patched on close, so the output must be seekable.
+ * See: https://learn.microsoft.com/en-us/windows/win32/directshow/avi-riff-file-reference
+ */
+#define AVI_KEYFRAME        (0x00000010)
+#define AVI_HAS_INDEX       (0x00000010)
+
+#pragma pack(push, 1)
+typedef struct {
+	char riff[4];
+	uint32_t riff_size;
+	char riff_type[4];
+	char hdrl_list[4];
+	uint32_t hdrl_size;
+	char hdrl[4];
+	/* Main AVI header */
+	char avih[4];
+	uint32_t avih_size;
+	uint32_t micro_sec_per_frame;
+	uint32_t max_bytes_per_sec;
+	uint32_t padding_granularity;
+	uint32_t flags;
+	uint32_t total_frames;
+	uint32_t initial_frames;
+	uint32_t streams;
+	uint32_t suggested_buffer_size;
+	uint32_t width;
+	uint32_t height;
+	uint32_t reserved[4];
+	char strl_list[4];
+	uint32_t strl_size;
+	char strl[4];
+	/* Stream header */
+	char strh[4];
+	uint32_t strh_size;
+	char fcc_type[4];
+	char fcc_handler[4];
+	uint32_t stream_flags;
+	uint16_t priority;
+	uint16_t language;
+	uint32_t stream_initial_frames;
+	uint32_t scale;
+	uint32_t rate;
+	uint32_t start;
+	uint32_t length;
+	uint32_t stream_suggested_buffer_size;
+	uint32_t quality;
+	uint32_t sample_size;
+	int16_t frame_rect[4];
+	/* Stream format, BITMAPINFOHEADER */
+	char strf[4];
+	uint32_t strf_size;
+	uint32_t bi_size;
+	int32_t bi_width;
+	int32_t bi_height;
+	uint16_t bi_planes;
+	uint16_t bi_bit_count;
+	char bi_compression[4];
+	uint32_t bi_size_image;
+	int32_t bi_x_ppm;
+	int32_t bi_y_ppm;
+	uint32_t bi_clr_used;
+	uint32_t bi_clr_important;
+	char movi_list[4];
+	uint32_t movi_size;
+	char movi[4];
+} avi_header_t;
+
+typedef struct {
+	char chunk_id[4];
+	uint32_t flags;
+	uint32_t offset; /* From the "movi" fourcc. */
+	uint32_t size;
+} avi_index_t;
+#pragma pack(pop)
+
+typedef struct {
+	avi_header_t header;
+	int32_t fd;
+	uint32_t movi_bytes;
+	uint32_t frames;
+	uint32_t capacity;
+	avi_index_t *index;
+} avi_writer_t;
+
+/* Writes a placeholder header to aFd. Returns 0 or -1 on write error. */
+int32_t AviWriterInit(avi_writer_t *aWriter, int32_t aFd, int32_t aWidth, int32_t aHeight, uint32_t aFps);
+/* Appends one JPEG image, a zero aSize stores an empty chunk which players show as a repeat of the previous frame. */
+int32_t AviWriteFrame(avi_writer_t *aWriter, const uint8_t *aJpeg, uint32_t aSize);
+/* Appends the "idx1" index and rewrites the header with final sizes. Returns 0 or -1 on write error. */
+int32_t AviWriterClose(avi_writer_t *aWriter);
+
+#endif /* !AVI_H */
@@ -0,0 +1,699 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "convert.h"
+#include "fdio.h"
+#include "jpegwrite.h"
+#include "magxgrab.h"
+#include "parallel.h"
+#include "pngfast.h"
+#include "pngpar.h"
+#include "pngwrite.h"
+#include "profile.h"
+#include "rawdump.h"
+#include "scale.h"
+#include "timing.h"
+
+/*
+ * Host benchmark of the capture, conversion and encoding paths of the tools. Synthetic framebuffer files are
+ * generated for every pixel format and read back instead of /dev/fb, so it runs on any Linux box with "make bench".
+ */
+
+/* Defines */
+#define BENCH_DIRECTORY     "bench_data"
+#define BENCH_RUNS          (5)
+#define BENCH_RUNS_MAX      (100)
+#define BENCH_PATH_MAX      (256)
+
+typedef enum {
+	BENCH_ANY,
+	BENCH_16BIT,     /* fbdump -bmp16 writes the 16-bit framebuffer as is. */
+	BENCH_RGB666,    /* ograb layers are RGB666 only. */
+	BENCH_THREADED   /* Only worth running with more than one CPU. */
+} bench_need_t;
+
+typedef struct {
+	display_t display;
+	const char *content;
+	char path[BENCH_PATH_MAX];
+	char layer_path[BENCH_PATH_MAX];
+	char output[BENCH_PATH_MAX];
+	uint8_t *fb;
+	uint8_t *layer;
+	uint8_t *bitmap;
+} bench_frame_t;
+
+typedef struct {
+	const char *name;
+	bench_need_t need;
+	int32_t param;
+	/* Fills the convert and encode stage times, returns the output size or -1. */
+	int64_t (*run)(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]);
+} bench_case_t;
+
+typedef struct {
+	const char *name;
+	void (*pixel)(uint8_t aRgb[3], int32_t x, int32_t y, int32_t aWidth, int32_t aHeight);
+} bench_content_t;
+
+static int32_t ErrUsage(void) {
+	fprintf(
+		stderr,
+		"Usage:\n"
+		"\t./bench_HOST [directory] [--runs N] [--device profile]\n\n"
+		"Profiles: zn5, e680 and e398 by default, one pixel format each.\n\n"
+		"Example:\n"
+		"\t./bench_HOST\n"
+		"\t./bench_HOST /tmp/bench --runs 20 --device e680\n"
+	);
+	return 1;
+}
+
+static int32_t ErrFile(const char *aFileName, const char *aMode) {
+	fprintf(stderr, "Cannot open '%s' file for %s.\n", aFileName, aMode);
+	return 1;
+}
+
+static uint32_t g_random = 0x2545F491;
+
+static uint32_t Random(void) {
+	g_random ^= g_random << 13;
+	g_random ^= g_random >> 17;
+	g_random ^= g_random << 5;
+	return g_random;
+}
+
+static uint8_t Clamp(int32_t aValue) {
+	return (aValue < 0) ? 0 : (aValue > 255) ? 255 : aValue;
+}
+
+static void SetRgb(uint8_t aRgb[3], uint32_t aColor) {
+	aRgb[0] = aColor >> 16;
+	aRgb[1] = aColor >> 8;
+	aRgb[2] = aColor;
+}
+
+/* Status bar, list rows with icons and text-like glyph runs, soft key bar: long runs of a few colors. */
+static void PixelFlat(uint8_t aRgb[3], int32_t x, int32_t y, int32_t aWidth, int32_t aHeight) {
+	const int32_t lRow = (y - 20) / 40, lLine = (y - 20) % 40;
+	if (y < 20)
+		SetRgb(aRgb, (x > aWidth - 40 && (x / 4) % 2) ? 0xA0C0E0 : 0x202830);
+	else if (y >= aHeight - 30)
+		SetRgb(aRgb, (y == aHeight - 30) ? 0x808890 : 0x404850);
+	else if (lLine == 39)
+		SetRgb(aRgb, 0xC0C0C0);
+	else if (x >= 6 && x < 30 && lLine >= 8 && lLine < 32)
+		SetRgb(aRgb, 0x3070C0 + lRow * 0x101000);
+	else if (x >= 38 && x < aWidth - 20 && lLine >= 16 && lLine < 24 && (x / 6) % 3 != 2 && ((x / 18 + lRow * 7) * 2654435761U) >> 30)
+		SetRgb(aRgb, 0x303030);
+	else
+		SetRgb(aRgb, (lRow % 2) ? 0xE8EEF4 : 0xFFFFFF);
+}
+
+static void PixelGradient(uint8_t aRgb[3], int32_t x, int32_t y, int32_t aWidth, int32_t aHeight) {
+	aRgb[0] = x * 255 / (aWidth - 1);
+	aRgb[1] = y * 255 / (aHeight - 1);
+	aRgb[2] = 255 - (x + y) * 255 / (aWidth + aHeight - 2);
+}
+
+static void PixelNoise(uint8_t aRgb[3], int32_t x, int32_t y, int32_t aWidth, int32_t aHeight) {
+	uint32_t lRandom = Random();
+	(void) x; (void) y; (void) aWidth; (void) aHeight;
+	aRgb[0] = lRandom;
+	aRgb[1] = lRandom >> 8;
+	aRgb[2] = lRandom >> 16;
+}
+
+/* Smooth low-frequency shapes with a little sensor-like noise on top. */
+static void PixelPhoto(uint8_t aRgb[3], int32_t x, int32_t y, int32_t aWidth, int32_t aHeight) {
+	const double lRadius = hypot(x - aWidth / 3.0, y - aHeight / 2.0);
+	const double lWave = sin(x * 0.031 + y * 0.017), lRing = sin(lRadius * 0.05);
+	aRgb[0] = Clamp(120 + 60 * lWave + 45 * lRing + (int32_t) (Random() % 13) - 6);
+	aRgb[1] = Clamp(110 + 50 * sin(y * 0.023 - x * 0.011) + 35 * lRing + (int32_t) (Random() % 13) - 6);
+	aRgb[2] = Clamp(90 + 70 * lWave * lRing + 30 * sin(lRadius * 0.013) + (int32_t) (Random() % 13) - 6);
+}
+
+static const bench_content_t g_contents[] = {
+	{ "flat",     PixelFlat },
+	{ "gradient", PixelGradient },
+	{ "noise",    PixelNoise },
+	{ "photo",    PixelPhoto }
+};
+
+/* Inverse of the convert.c widening, the low bits are dropped. */
+static void PackPixel(uint8_t *aDst, pixel_format_t aFormat, const uint8_t aRgb[3]) {
+	uint32_t lValue;
+	switch (aFormat) {
+		case PIXEL_RGB666:
+			lValue = ((aRgb[0] >> 2) << 12) | ((aRgb[1] >> 2) << 6) | (aRgb[2] >> 2);
+			aDst[0] = lValue;
+			aDst[1] = lValue >> 8;
+			aDst[2] = lValue >> 16;
+			break;
+		case PIXEL_RGB565:
+			*(uint16_t *) aDst = ((aRgb[0] >> 3) << 11) | ((aRgb[1] >> 2) << 5) | (aRgb[2] >> 3);
+			break;
+		case PIXEL_RGB555:
+			*(uint16_t *) aDst = ((aRgb[0] >> 3) << 10) | ((aRgb[1] >> 3) << 5) | (aRgb[2] >> 3);
+			break;
+		default:
+			break;
+	}
+}
+
+/* aLayer makes the ograb overlay: a centered dialog box, every raw byte of its pixels is non-zero to stay opaque. */
+static int32_t WriteFramebuffer(const char *aPath, const display_t *aDisplay, const bench_content_t *aContent, int32_t aLayer) {
+	uint8_t *lFb = calloc(1, aDisplay->bytes);
+	uint8_t lRgb[3];
+	int32_t x, y, lError, lFd;
+	if (!lFb)
+		return -1;
+	for (y = 0; y < aDisplay->height; ++y)
+		for (x = 0; x < aDisplay->width; ++x) {
+			uint8_t *lPixel = lFb + y * aDisplay->stride + x * aDisplay->bpp;
+			if (aLayer) {
+				if (x < aDisplay->width / 8 || x >= aDisplay->width * 7 / 8 || y < aDisplay->height / 4 || y >= aDisplay->height * 3 / 4)
+					continue;
+				aContent->pixel(lRgb, aDisplay->width - 1 - x, y, aDisplay->width, aDisplay->height);
+				PackPixel(lPixel, aDisplay->format, lRgb);
+				lPixel[0] |= 1;
+				lPixel[1] |= 1;
+				lPixel[2] |= 1;
+			} else {
+				aContent->pixel(lRgb, x, y, aDisplay->width, aDisplay->height);
+				PackPixel(lPixel, aDisplay->format, lRgb);
+			}
+		}
+	lFd = open(aPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	lError = (lFd < 0) ? -1 : FdWriteAll(lFd, lFb, aDisplay->bytes);
+	if (lFd >= 0 && close(lFd))
+		lError = -1;
+	free(lFb);
+	return lError;
+}
+
+static int32_t ReadFramebuffer(const char *aPath, uint8_t *aFb, uint32_t aBytes) {
+	int32_t lFd = open(aPath, O_RDONLY), lError;
+	if (lFd < 0)
+		return -1;
+	lError = FdReadAll(lFd, aFb, aBytes);
+	close(lFd);
+	return lError;
+}
+
+static int64_t FileSize(const char *aPath) {
+	struct stat lStat;
+	return (stat(aPath, &lStat)) ? -1 : (int64_t) lStat.st_size;
+}
+
+/* Times the encoder that writes aFrame->bitmap or the raw framebuffer into aFrame->output. */
+static int64_t Finish(bench_frame_t *aFrame, FILE *aFile, int32_t aError, uint64_t aStart, uint64_t aStages[2]) {
+	if (fclose(aFile))
+		aError = -1;
+	aStages[1] = TimeMonotonicUs() - aStart;
+	return (aError) ? -1 : FileSize(aFrame->output);
+}
+
+static int64_t RunFbgrab(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	(void) aParam;
+	DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_BGR888, aFrame->fb);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	return Finish(aFrame, lFile, BmpWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, 24, NULL), lStart, aStages);
+}
+
+/*
+ * fbgrab with its snapshot: the frame is copied out with ConvertCopy() first and converted from the copy, both
+ * count as convert. The dump files are cached memory, so this is the cost of the copy, not the uncached read saved.
+ */
+static int64_t RunFbgrabSnapshot(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	uint8_t *lSnapshot = malloc(lDisplay->bytes);
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	(void) aParam;
+	if (!lSnapshot)
+		return -1;
+	ConvertCopy(lSnapshot, lDisplay->stride, aFrame->fb, lDisplay->stride, lDisplay->stride, lDisplay->height);
+	DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_BGR888, lSnapshot);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	free(lSnapshot);
+	lStart = TimeMonotonicUs();
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	return Finish(aFrame, lFile, BmpWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, 24, NULL), lStart, aStages);
+}
+
+/*
+ * fbgrab as it streams: bands of GRAB_STREAM_ROWS rows are converted from the bottom up into one small buffer and
+ * written right away, so the frame is never whole in memory.
+ */
+static int64_t RunFbgrabStream(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	const uint32_t lStride = lDisplay->width * 3;
+	uint64_t lStart;
+	FILE *lFile;
+	int32_t y, lCount, lError;
+	(void) aParam;
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	aStages[0] = aStages[1] = 0;
+	lError = BmpWriteHeaderFd(fileno(lFile), lDisplay->width, lDisplay->height, 24, NULL);
+	for (y = lDisplay->height; y > 0 && !lError; y -= lCount) {
+		lCount = (y < GRAB_STREAM_ROWS) ? y : GRAB_STREAM_ROWS;
+		lStart = TimeMonotonicUs();
+		ConvertFrame(
+			aFrame->bitmap, lStride, PIXEL_BGR888, aFrame->fb + (y - lCount) * lDisplay->stride, lDisplay->stride, lDisplay->format,
+			lDisplay->width, lCount
+		);
+		aStages[0] += TimeMonotonicUs() - lStart;
+		lStart = TimeMonotonicUs();
+		lError = BmpWriteRowsFd(fileno(lFile), aFrame->bitmap, lStride, lDisplay->width, lCount, 24);
+		aStages[1] += TimeMonotonicUs() - lStart;
+	}
+	/* Finish() adds the close to the write time of the bands. */
+	lStart = TimeMonotonicUs() - aStages[1];
+	return Finish(aFrame, lFile, lError, lStart, aStages);
+}
+
+/*
+ * fbgrab --thumb --thumb-size 1/aParam, the thumbnail is made in the conversion pass, a negative aParam scales the
+ * converted image in a second pass instead. Both BMP images go into the output, the size is their sum.
+ */
+static int64_t RunFbgrabThumb(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	const int32_t lFactor = (aParam < 0) ? -aParam : aParam;
+	const int32_t lWidth = lDisplay->width / lFactor, lHeight = lDisplay->height / lFactor;
+	scale_t lThumb;
+	uint64_t lStart;
+	FILE *lFile;
+	int32_t lError;
+	uint8_t *lThumbBitmap = malloc(lWidth * lHeight * 3);
+	if (!lThumbBitmap)
+		return -1;
+	lStart = TimeMonotonicUs();
+	if (aParam < 0) {
+		DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_BGR888, aFrame->fb);
+		lError = ScaleImage(aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, lThumbBitmap, lWidth * 3, lWidth, lHeight);
+	} else if (!(lError = ScaleInit(&lThumb, lDisplay->width, lDisplay->height, lThumbBitmap, lWidth * 3, lWidth, lHeight))) {
+		lError = ScaleConvertFrame(&lThumb, aFrame->bitmap, lDisplay->width * 3, PIXEL_BGR888, aFrame->fb, lDisplay->stride, lDisplay->format);
+		ScaleFree(&lThumb);
+	}
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (lError || !(lFile = fopen(aFrame->output, "wb"))) {
+		free(lThumbBitmap);
+		return -1;
+	}
+	lError = BmpWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, 24, NULL) ||
+		BmpWrite(lFile, lThumbBitmap, lWidth * 3, lWidth, lHeight, 24, NULL);
+	free(lThumbBitmap);
+	return Finish(aFrame, lFile, lError, lStart, aStages);
+}
+
+/* fbgrab --rect of a status bar, the top 1/aParam of the rows, only those are read and converted. */
+static int64_t RunFbgrabRect(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	const int32_t lHeight = lDisplay->height / aParam;
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	int32_t lError = ConvertFrame(
+		aFrame->bitmap, lDisplay->width * 3, PIXEL_BGR888, aFrame->fb, lDisplay->stride, lDisplay->format, lDisplay->width, lHeight
+	);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (lError || !(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	return Finish(aFrame, lFile, BmpWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lHeight, 24, NULL), lStart, aStages);
+}
+
+/* fbgrab --rotate, aParam is the transform_t, the turn is part of the conversion. */
+static int64_t RunFbgrabRotate(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	const int32_t lWidth = (TRANSFORM_TRANSPOSED(aParam)) ? lDisplay->height : lDisplay->width;
+	const int32_t lHeight = (TRANSFORM_TRANSPOSED(aParam)) ? lDisplay->width : lDisplay->height;
+	/* fbgrab allocates the band once with GrabSetTransform(), it is not timed. */
+	uint8_t *lBand = malloc(CONVERT_BAND_BYTES(lDisplay->width, 3));
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	int32_t lError;
+	if (!lBand)
+		return -1;
+	lError = ConvertTransform(
+		aFrame->bitmap, lWidth * 3, PIXEL_BGR888, aFrame->fb, lDisplay->stride, lDisplay->format, lDisplay->width, lDisplay->height,
+		(transform_t) aParam, lBand
+	);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	free(lBand);
+	lStart = TimeMonotonicUs();
+	if (lError || !(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	return Finish(aFrame, lFile, BmpWrite(lFile, aFrame->bitmap, lWidth * 3, lWidth, lHeight, 24, NULL), lStart, aStages);
+}
+
+static int64_t RunFbdumpRaw(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	(void) aParam;
+	aStages[0] = 0;
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	return Finish(aFrame, lFile, fwrite(aFrame->fb, aFrame->display.bytes, 1, lFile) != 1, lStart, aStages);
+}
+
+/* aParam is the rawdump_compression_t, packing counts as encode. */
+static int64_t RunFbdumpPacked(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	rawdump_header_t lHeader;
+	const uint8_t *lData;
+	uint64_t lStart;
+	int32_t lFd, lError;
+	RawDumpHeaderInit(&lHeader, &aFrame->display, 1, 0, 0);
+	uint8_t *lPacked = malloc(RawDumpPackBound(&lHeader));
+	if (!lPacked)
+		return -1;
+	lStart = TimeMonotonicUs();
+	lData = RawDumpPack(&lHeader, aFrame->fb, lPacked, (rawdump_compression_t) aParam);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if ((lFd = open(aFrame->output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		free(lPacked);
+		return -1;
+	}
+	lError = RawDumpWrite(lFd, &lHeader, lData);
+	if (close(lFd))
+		lError = -1;
+	aStages[1] = TimeMonotonicUs() - lStart;
+	free(lPacked);
+	return (lError) ? -1 : FileSize(aFrame->output);
+}
+
+static int64_t RunFbdumpBmp16(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	static const uint32_t mask_565[3] = { 0xF800, 0x07E0, 0x001F };
+	static const uint32_t mask_555[3] = { 0x7C00, 0x03E0, 0x001F };
+	const display_t *lDisplay = &aFrame->display;
+	uint64_t lStart = TimeMonotonicUs();
+	int32_t lFd;
+	(void) aParam;
+	aStages[0] = 0;
+	if ((lFd = open(aFrame->output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+	int32_t lError = BmpWriteFd(
+		lFd, aFrame->fb, lDisplay->stride, lDisplay->width, lDisplay->height, 16,
+		(lDisplay->format == PIXEL_RGB555) ? mask_555 : mask_565
+	);
+	if (close(lFd))
+		lError = -1;
+	aStages[1] = TimeMonotonicUs() - lStart;
+	return (lError) ? -1 : FileSize(aFrame->output);
+}
+
+static int64_t RunFbdumpBmp24(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	uint64_t lStart = TimeMonotonicUs();
+	int32_t lFd;
+	(void) aParam;
+	DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_BGR888, aFrame->fb);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if ((lFd = open(aFrame->output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		return -1;
+	int32_t lError = BmpWriteFd(lFd, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, 24, NULL);
+	if (close(lFd))
+		lError = -1;
+	aStages[1] = TimeMonotonicUs() - lStart;
+	return (lError) ? -1 : FileSize(aFrame->output);
+}
+
+static int64_t RunOgrab(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	overlay_t lOverlay;
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	(void) aParam;
+	lOverlay.keyed = 0;
+	lOverlay.key = 0x000000;
+	lOverlay.alpha = 255;
+	ConvertOverlay(
+		aFrame->bitmap, lDisplay->width * 3, aFrame->layer, aFrame->fb, lDisplay->stride,
+		lDisplay->width, lDisplay->height, &lOverlay
+	);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	return Finish(aFrame, lFile, BmpWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, 24, NULL), lStart, aStages);
+}
+
+/* aParam is the quality, negative runs the threaded band encoder. */
+static int64_t RunJgrab(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	int32_t lError = 0;
+	DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_RGB888, aFrame->fb);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	if (aParam < 0)
+		lError = JpegWriteParallel(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, -aParam, 0);
+	else
+		JpegWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, aParam);
+	return Finish(aFrame, lFile, lError, lStart, aStages);
+}
+
+/* aParam is the compression level, above 9 runs the threaded strip encoder at aParam - 10. */
+static int64_t RunPgrab(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	int32_t lError;
+	DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_RGB888, aFrame->fb);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	if (aParam > 9)
+		lError = PngWriteParallel(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, aParam - 10, 0);
+	else
+		lError = PngWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, aParam);
+	return Finish(aFrame, lFile, lError, lStart, aStages);
+}
+
+/* pgrab --fast, the built-in encoder has no level. */
+static int64_t RunPgrabFast(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	uint64_t lStart = TimeMonotonicUs();
+	FILE *lFile;
+	(void) aParam;
+	DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_RGB888, aFrame->fb);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (!(lFile = fopen(aFrame->output, "wb")))
+		return -1;
+	return Finish(aFrame, lFile, PngWriteFast(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height), lStart, aStages);
+}
+
+/* pgrab --palette at level aParam, the index pass counts as convert. Images of more than 256 colors stay RGB. */
+static int64_t RunPgrabPalette(bench_frame_t *aFrame, int32_t aParam, uint64_t aStages[2]) {
+	const display_t *lDisplay = &aFrame->display;
+	png_palette_t lPalette;
+	uint64_t lStart;
+	FILE *lFile;
+	int32_t lError, lIndexed;
+	uint8_t *lIndices = malloc(lDisplay->size);
+	if (!lIndices)
+		return -1;
+	lStart = TimeMonotonicUs();
+	DisplayConvert(lDisplay, aFrame->bitmap, PIXEL_RGB888, aFrame->fb);
+	lIndexed = !PngPaletteBuild(&lPalette, lIndices, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height);
+	aStages[0] = TimeMonotonicUs() - lStart;
+	lStart = TimeMonotonicUs();
+	if (!(lFile = fopen(aFrame->output, "wb"))) {
+		free(lIndices);
+		return -1;
+	}
+	if (lIndexed)
+		lError = PngWriteIndexed(lFile, &lPalette, lIndices, lDisplay->width, lDisplay->height, aParam);
+	else
+		lError = PngWrite(lFile, aFrame->bitmap, lDisplay->width * 3, lDisplay->width, lDisplay->height, aParam);
+	free(lIndices);
+	return Finish(aFrame, lFile, lError, lStart, aStages);
+}
+
+static const bench_case_t g_cases[] = {
+	{ "fbgrab",            BENCH_ANY,      0,   RunFbgrab },
+	{ "fbgrab snapshot",   BENCH_ANY,      0,   RunFbgrabSnapshot },
+	{ "fbgrab stream",     BENCH_ANY,      0,   RunFbgrabStream },
+	{ "fbgrab thumb 1/2",  BENCH_ANY,      2,   RunFbgrabThumb },
+	{ "fbgrab thumb 1/3",  BENCH_ANY,      3,   RunFbgrabThumb },
+	{ "fbgrab thumb 2pass", BENCH_ANY,     -2,  RunFbgrabThumb },
+	{ "fbgrab rect 1/8",   BENCH_ANY,      8,   RunFbgrabRect },
+	{ "fbgrab rotate 90",  BENCH_ANY,      TRANSFORM_ROTATE_90,  RunFbgrabRotate },
+	{ "fbgrab rotate 180", BENCH_ANY,      TRANSFORM_ROTATE_180, RunFbgrabRotate },
+	{ "fbdump raw",        BENCH_ANY,      0,   RunFbdumpRaw },
+	{ "fbdump rle",        BENCH_ANY,      RAWDUMP_RLE, RunFbdumpPacked },
+	{ "fbdump lz",         BENCH_ANY,      RAWDUMP_LZ,  RunFbdumpPacked },
+	{ "fbdump -bmp16",     BENCH_16BIT,    0,   RunFbdumpBmp16 },
+	{ "fbdump -bmp24",     BENCH_ANY,      0,   RunFbdumpBmp24 },
+	{ "ograb",             BENCH_RGB666,   0,   RunOgrab },
+	{ "jgrab 50",          BENCH_ANY,      50,  RunJgrab },
+	{ "jgrab 75",          BENCH_ANY,      75,  RunJgrab },
+	{ "jgrab 85",          BENCH_ANY,      85,  RunJgrab },
+	{ "jgrab 100",         BENCH_ANY,      100, RunJgrab },
+	{ "jgrab 100 threads", BENCH_THREADED, -100, RunJgrab },
+	{ "pgrab 0",           BENCH_ANY,      0,   RunPgrab },
+	{ "pgrab 1",           BENCH_ANY,      1,   RunPgrab },
+	{ "pgrab 2",           BENCH_ANY,      2,   RunPgrab },
+	{ "pgrab 3",           BENCH_ANY,      3,   RunPgrab },
+	{ "pgrab 4",           BENCH_ANY,      4,   RunPgrab },
+	{ "pgrab 5",           BENCH_ANY,      5,   RunPgrab },
+	{ "pgrab 6",           BENCH_ANY,      6,   RunPgrab },
+	{ "pgrab 7",           BENCH_ANY,      7,   RunPgrab },
+	{ "pgrab 8",           BENCH_ANY,      8,   RunPgrab },
+	{ "pgrab 9",           BENCH_ANY,      9,   RunPgrab },
+	{ "pgrab 9 threads",   BENCH_THREADED, 19,  RunPgrab },
+	{ "pgrab 6 palette",   BENCH_ANY,      6,   RunPgrabPalette },
+	{ "pgrab fast",        BENCH_ANY,      0,   RunPgrabFast }
+};
+
+static int32_t CaseApplies(const bench_case_t *aCase, const display_t *aDisplay) {
+	switch (aCase->need) {
+		case BENCH_16BIT:
+			return aDisplay->bpp == 2;
+		case BENCH_RGB666:
+			return aDisplay->format == PIXEL_RGB666;
+		case BENCH_THREADED:
+			return ParallelCpus() > 1;
+		default:
+			return 1;
+	}
+}
+
+static int CompareUs(const void *aLeft, const void *aRight) {
+	const uint64_t lLeft = *(const uint64_t *) aLeft, lRight = *(const uint64_t *) aRight;
+	return (lLeft > lRight) - (lLeft < lRight);
+}
+
+static uint64_t Median(uint64_t *aValues, int32_t aCount) {
+	qsort(aValues, aCount, sizeof(uint64_t), CompareUs);
+	return aValues[aCount / 2];
+}
+
+/* Every stage is reported as the median of aRuns, the read stage stands for the framebuffer copy of fbdump. */
+static int32_t RunCase(bench_frame_t *aFrame, const bench_case_t *aCase, int32_t aRuns) {
+	uint64_t lRead[BENCH_RUNS_MAX], lConvert[BENCH_RUNS_MAX], lEncode[BENCH_RUNS_MAX], lTotal[BENCH_RUNS_MAX];
+	uint64_t lStages[2], lMedian;
+	int64_t lSize = 0;
+	int32_t i;
+	for (i = 0; i < aRuns; ++i) {
+		uint64_t lStart = TimeMonotonicUs();
+		if (ReadFramebuffer(aFrame->path, aFrame->fb, aFrame->display.bytes))
+			return ErrFile(aFrame->path, "read");
+		lRead[i] = TimeMonotonicUs() - lStart;
+		if ((lSize = aCase->run(aFrame, aCase->param, lStages)) < 0)
+			return ErrFile(aFrame->output, "write");
+		lConvert[i] = lStages[0];
+		lEncode[i] = lStages[1];
+		lTotal[i] = lRead[i] + lStages[0] + lStages[1];
+	}
+	lMedian = Median(lTotal, aRuns);
+	printf(
+		"%-6s %-9s %-18s %9llu %9llu %9llu %9llu %9.1f %8.1f %9lld\n",
+		aFrame->display.name, aFrame->content, aCase->name,
+		(unsigned long long) Median(lRead, aRuns), (unsigned long long) Median(lConvert, aRuns),
+		(unsigned long long) Median(lEncode, aRuns), (unsigned long long) lMedian,
+		(lMedian) ? aFrame->display.bytes / (double) lMedian : 0.0, (lMedian) ? 1000000.0 / lMedian : 0.0, (long long) lSize
+	);
+	return 0;
+}
+
+static int32_t RunProfile(const char *aDirectory, const char *aProfile, int32_t aRuns) {
+	bench_frame_t lFrame;
+	uint32_t c, i;
+	int32_t lError = 0;
+
+	memset(&lFrame, 0, sizeof(bench_frame_t));
+	if (ProfileLoad(&lFrame.display, aProfile, -1) || !strcmp("auto", aProfile)) {
+		fprintf(stderr, "Error: unknown or unsupported device profile '%s'!\n", aProfile);
+		return 1;
+	}
+	lFrame.fb = malloc(lFrame.display.bytes);
+	lFrame.layer = malloc(lFrame.display.bytes);
+	lFrame.bitmap = malloc(lFrame.display.size * 4);
+	snprintf(lFrame.output, sizeof(lFrame.output), "%s/output.bin", aDirectory);
+	for (c = 0; c < sizeof(g_contents) / sizeof(g_contents[0]) && lFrame.fb && lFrame.layer && lFrame.bitmap && !lError; ++c) {
+		lFrame.content = g_contents[c].name;
+		snprintf(lFrame.path, sizeof(lFrame.path), "%s/%s_%s.dump", aDirectory, aProfile, lFrame.content);
+		snprintf(lFrame.layer_path, sizeof(lFrame.layer_path), "%s/%s_%s_layer.dump", aDirectory, aProfile, lFrame.content);
+		if (WriteFramebuffer(lFrame.path, &lFrame.display, &g_contents[c], 0))
+			return ErrFile(lFrame.path, "write");
+		if (lFrame.display.format == PIXEL_RGB666) {
+			if (WriteFramebuffer(lFrame.layer_path, &lFrame.display, &g_contents[c], 1))
+				return ErrFile(lFrame.layer_path, "write");
+			if (ReadFramebuffer(lFrame.layer_path, lFrame.layer, lFrame.display.bytes))
+				return ErrFile(lFrame.layer_path, "read");
+		}
+		for (i = 0; i < sizeof(g_cases) / sizeof(g_cases[0]) && !lError; ++i)
+			if (CaseApplies(&g_cases[i], &lFrame.display))
+				lError = RunCase(&lFrame, &g_cases[i], aRuns);
+	}
+	if (!lFrame.fb || !lFrame.layer || !lFrame.bitmap) {
+		fprintf(stderr, "Error: out of memory!\n");
+		lError = 1;
+	}
+	unlink(lFrame.output);
+	free(lFrame.fb);
+	free(lFrame.layer);
+	free(lFrame.bitmap);
+	return lError;
+}
+
+int main(int argc, char *argv[]) {
+	static const char *lProfiles[] = { "zn5", "e680", "e398" };
+	const char *lDirectory = BENCH_DIRECTORY, *lProfile = NULL;
+	int32_t lRuns = BENCH_RUNS, lError = 0, i;
+
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp("--runs", argv[i]) && i + 1 < argc)
+			lRuns = atoi(argv[++i]);
+		else if (!strcmp("--device", argv[i]) && i + 1 < argc)
+			lProfile = argv[++i];
+		else if (argv[i][0] != '-' && i == 1)
+			lDirectory = argv[i];
+		else
+			return ErrUsage();
+	}
+	if (lRuns < 1 || lRuns > BENCH_RUNS_MAX)
+		return ErrUsage();
+	if (mkdir(lDirectory, 0755) && errno != EEXIST)
+		return ErrFile(lDirectory, "write");
+
+	printf("Backend: %s, %d CPUs, median of %d runs, times in microseconds.\n\n", ConvertBackend(), ParallelCpus(), lRuns);
+	printf(
+		"%-6s %-9s %-18s %9s %9s %9s %9s %9s %8s %9s\n",
+		"device", "content", "path", "read", "convert", "encode", "total", "MB/s", "fps", "bytes"
+	);
+	if (lProfile)
+		return RunProfile(lDirectory, lProfile, lRuns);
+	for (i = 0; i < (int32_t) (sizeof(lProfiles) / sizeof(lProfiles[0])) && !lError; ++i)
+		lError = RunProfile(lDirectory, lProfiles[i], lRuns);
+	return lError;
+}
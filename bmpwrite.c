@@ -0,0 +1,104 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "fdio.h"
+
+void BmpHeaderInit(bmp_header_t *aHeader, int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, int32_t aMasked) {
+	uint32_t lRowBytes = aWidth * (aBitsPerPixel / 8);
+
+	memset(aHeader, 0, sizeof(bmp_header_t));
+	aHeader->file_magic = 0x4D42;
+	aHeader->bitmap_start = sizeof(bmp_header_t) + ((aMasked) ? sizeof(uint32_t) * 3 : 0);
+	aHeader->bitmap_size = ((lRowBytes + 3) & ~3) * aHeight;
+	aHeader->file_size = aHeader->bitmap_start + aHeader->bitmap_size;
+	aHeader->dib_header_size = 0x00000028;
+	aHeader->bitmap_width = aWidth;
+	aHeader->bitmap_height = aHeight;
+	aHeader->color_planes = 0x0001;
+	aHeader->bitmap_bpp = aBitsPerPixel;
+	aHeader->compression_method = (aMasked) ? BI_BITFIELDS : BI_RGB;
+}
+
+/* Queues aCount rows last first with their padding, full vectors are written on the way. */
+static int32_t GatherRows(
+	int32_t aFd, struct iovec *aIov, int32_t *aIovCount, const uint8_t *aPixels, uint32_t aStride, uint32_t aRowBytes, int32_t aCount
+) {
+	static const uint8_t lPadding[4] = { 0x00, 0x00, 0x00, 0x00 };
+	const uint32_t lPadBytes = ((aRowBytes + 3) & ~3) - aRowBytes;
+	int32_t y, lCount = *aIovCount;
+	for (y = aCount - 1; y >= 0; --y) {
+		if (lCount + 2 > FDIO_IOV_MAX) {
+			if (FdWriteVector(aFd, aIov, lCount))
+				return -1;
+			lCount = 0;
+		}
+		aIov[lCount].iov_base = (void *) (aPixels + y * aStride);
+		aIov[lCount].iov_len = aRowBytes;
+		++lCount;
+		if (lPadBytes) {
+			aIov[lCount].iov_base = (void *) lPadding;
+			aIov[lCount].iov_len = lPadBytes;
+			++lCount;
+		}
+	}
+	*aIovCount = lCount;
+	return 0;
+}
+
+int32_t BmpWriteFd(
+	int32_t aFd, const uint8_t *aPixels, uint32_t aStride,
+	int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, const uint32_t *aMasks
+) {
+	struct iovec lIov[FDIO_IOV_MAX];
+	bmp_header_t lBmpHeader;
+	int32_t lCount = 0;
+	uint32_t lMaskBytes = (aMasks) ? sizeof(uint32_t) * 3 : 0;
+
+	BmpHeaderInit(&lBmpHeader, aWidth, aHeight, aBitsPerPixel, aMasks != NULL);
+
+	lIov[lCount].iov_base = &lBmpHeader;
+	lIov[lCount].iov_len = sizeof(bmp_header_t);
+	++lCount;
+	if (aMasks) {
+		lIov[lCount].iov_base = (void *) aMasks;
+		lIov[lCount].iov_len = lMaskBytes;
+		++lCount;
+	}
+	if (GatherRows(aFd, lIov, &lCount, aPixels, aStride, aWidth * (aBitsPerPixel / 8), aHeight))
+		return -1;
+	return FdWriteVector(aFd, lIov, lCount);
+}
+
+int32_t BmpWriteHeaderFd(int32_t aFd, int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, const uint32_t *aMasks) {
+	struct iovec lIov[2];
+	bmp_header_t lBmpHeader;
+
+	BmpHeaderInit(&lBmpHeader, aWidth, aHeight, aBitsPerPixel, aMasks != NULL);
+	lIov[0].iov_base = &lBmpHeader;
+	lIov[0].iov_len = sizeof(bmp_header_t);
+	lIov[1].iov_base = (void *) aMasks;
+	lIov[1].iov_len = (aMasks) ? sizeof(uint32_t) * 3 : 0;
+	return FdWriteVector(aFd, lIov, (aMasks) ? 2 : 1);
+}
+
+int32_t BmpWriteRowsFd(int32_t aFd, const uint8_t *aPixels, uint32_t aStride, int32_t aWidth, int32_t aCount, uint16_t aBitsPerPixel) {
+	struct iovec lIov[FDIO_IOV_MAX];
+	int32_t lCount = 0;
+	if (GatherRows(aFd, lIov, &lCount, aPixels, aStride, aWidth * (aBitsPerPixel / 8), aCount))
+		return -1;
+	return FdWriteVector(aFd, lIov, lCount);
+}
+
+int32_t BmpWrite(
+	FILE *aFile, const uint8_t *aPixels, uint32_t aStride,
+	int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, const uint32_t *aMasks
+) {
+	/* Anything already buffered in the FILE must go out before the raw descriptor writes. */
+	if (fflush(aFile))
+		return -1;
+	return BmpWriteFd(fileno(aFile), aPixels, aStride, aWidth, aHeight, aBitsPerPixel, aMasks);
+}
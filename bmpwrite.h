@@ -0,0 +1,62 @@
+#ifndef BMPWRITE_H
+#define BMPWRITE_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/* Defines */
+#define BI_RGB              (0x00)
+#define BI_BITFIELDS        (0x03)
+
+/* See: https://en.wikipedia.org/wiki/BMP_file_format */
+#pragma pack(push, 1)
+typedef struct {
+	/* Bitmap file header */
+	uint16_t file_magic;
+	uint32_t file_size;
+	uint32_t bytes_reserved;
+	uint32_t bitmap_start;
+	/* DIB header (bitmap information header) */
+	uint32_t dib_header_size;
+	int32_t bitmap_width;
+	int32_t bitmap_height;
+	uint16_t color_planes;
+	uint16_t bitmap_bpp;
+	uint32_t compression_method;
+	uint32_t bitmap_size;
+	int32_t bitmap_width_ppm;
+	int32_t bitmap_height_ppm;
+	uint32_t num_of_colors;
+	uint32_t num_of_important_colors;
+} bmp_header_t;
+#pragma pack(pop)
+
+/* Fills the file and DIB headers, aMasked adds the 3 BI_BITFIELDS masks between the header and the pixels. */
+void BmpHeaderInit(bmp_header_t *aHeader, int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, int32_t aMasked);
+
+/*
+ * Writes a complete bottom-up BMP image: header, optional BI_BITFIELDS masks, then pixel rows padded to 4 bytes.
+ * aPixels holds top-down rows of aStride bytes already in BMP pixel order (BGR888 for 24 bpp, RGB565/RGB555 for 16 bpp).
+ * Rows are not copied, they are gathered with as few writev() calls as possible.
+ * aMasks is NULL for BI_RGB or points to 3 masks (red, green, blue). Returns 0 on success, -1 on write error.
+ */
+int32_t BmpWrite(
+	FILE *aFile, const uint8_t *aPixels, uint32_t aStride,
+	int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, const uint32_t *aMasks
+);
+
+/* Same as BmpWrite() for a raw descriptor, it does not allocate memory. */
+int32_t BmpWriteFd(
+	int32_t aFd, const uint8_t *aPixels, uint32_t aStride,
+	int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, const uint32_t *aMasks
+);
+
+/*
+ * Band by band writing for images that are never whole in memory: the header of the full image first, then bands of
+ * aCount top-down rows from the bottom of the image up, as BMP stores them. Each band goes out in one writev().
+ */
+int32_t BmpWriteHeaderFd(int32_t aFd, int32_t aWidth, int32_t aHeight, uint16_t aBitsPerPixel, const uint32_t *aMasks);
+int32_t BmpWriteRowsFd(int32_t aFd, const uint8_t *aPixels, uint32_t aStride, int32_t aWidth, int32_t aCount, uint16_t aBitsPerPixel);
+
+#endif /* !BMPWRITE_H */
@@ -0,0 +1,881 @@
+/* C */
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* SIMD */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Local */
+#include "convert.h"
+
+/*
+ * Scalar kernels, also used for the row tails of the SIMD kernels.
+ * Channels are widened by a plain shift with the low bits zeroed, it is the same as the old RGB666_TO_RGB888 macro.
+ * The Widen*() helpers ignore any bits above the pixel.
+ */
+static inline uint32_t WidenRgb666(uint32_t aPixel) {
+	return ((aPixel << 2) & 0x0000FC) | ((aPixel << 4) & 0x00FC00) | ((aPixel << 6) & 0xFC0000);
+}
+
+static inline uint32_t WidenRgb565(uint32_t aPixel) {
+	return ((aPixel << 8) & 0xF80000) | ((aPixel << 5) & 0x00FC00) | ((aPixel << 3) & 0x0000F8);
+}
+
+static inline uint32_t WidenRgb555(uint32_t aPixel) {
+	return ((aPixel << 9) & 0xF80000) | ((aPixel << 6) & 0x00F800) | ((aPixel << 3) & 0x0000F8);
+}
+
+static inline uint32_t DecodeRgb666(const uint8_t *aSrc) {
+	return WidenRgb666(aSrc[0] | (aSrc[1] << 8) | (aSrc[2] << 16));
+}
+
+static inline uint32_t DecodeRgb565(const uint8_t *aSrc) {
+	return WidenRgb565(*(const uint16_t *) aSrc);
+}
+
+static inline uint32_t DecodeRgb555(const uint8_t *aSrc) {
+	return WidenRgb555(*(const uint16_t *) aSrc);
+}
+
+static inline void StoreRgb888(uint8_t *aDst, uint32_t aPixel) {
+	aDst[0] = (uint8_t) (aPixel >> 16);
+	aDst[1] = (uint8_t) (aPixel >> 8);
+	aDst[2] = (uint8_t) (aPixel >> 0);
+}
+
+static inline void StoreBgr888(uint8_t *aDst, uint32_t aPixel) {
+	aDst[0] = (uint8_t) (aPixel >> 0);
+	aDst[1] = (uint8_t) (aPixel >> 8);
+	aDst[2] = (uint8_t) (aPixel >> 16);
+}
+
+static inline void StoreXrgb8888(uint8_t *aDst, uint32_t aPixel) {
+	*(uint32_t *) aDst = aPixel;
+}
+
+#define SCALAR_ROW(aName, aSrcBytes, aDecode, aDstBytes, aStore) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		for (i = 0; i < aCount; ++i, aSrc += (aSrcBytes), aDst += (aDstBytes)) \
+			aStore(aDst, aDecode(aSrc)); \
+	}
+
+SCALAR_ROW(Rgb666ToRgb888Scalar, 3, DecodeRgb666, 3, StoreRgb888)
+SCALAR_ROW(Rgb666ToBgr888Scalar, 3, DecodeRgb666, 3, StoreBgr888)
+SCALAR_ROW(Rgb666ToXrgb8888Scalar, 3, DecodeRgb666, 4, StoreXrgb8888)
+SCALAR_ROW(Rgb565ToRgb888Scalar, 2, DecodeRgb565, 3, StoreRgb888)
+SCALAR_ROW(Rgb565ToBgr888Scalar, 2, DecodeRgb565, 3, StoreBgr888)
+SCALAR_ROW(Rgb565ToXrgb8888Scalar, 2, DecodeRgb565, 4, StoreXrgb8888)
+SCALAR_ROW(Rgb555ToRgb888Scalar, 2, DecodeRgb555, 3, StoreRgb888)
+SCALAR_ROW(Rgb555ToBgr888Scalar, 2, DecodeRgb555, 3, StoreBgr888)
+SCALAR_ROW(Rgb555ToXrgb8888Scalar, 2, DecodeRgb555, 4, StoreXrgb8888)
+
+#if defined(__SSE2__)
+/*
+ * SSE2 kernels, 8 pixels per iteration.
+ * Pixels are decoded into 0x00RRGGBB dwords, or 0x00BBGGRR when aSwap is set so that RGB888 is a plain 24-bit pack.
+ * RGB666 rows read 4 bytes past the last converted pixel, so the loop stops 2 pixels early and leaves them to the tail.
+ */
+static inline void Sse2Decode16(const uint8_t *aSrc, int32_t a555, int32_t aSwap, __m128i *aLo, __m128i *aHi) {
+	const __m128i lPixels = _mm_loadu_si128((const __m128i *) aSrc);
+	const __m128i lMask5 = _mm_set1_epi16(0xF8);
+	__m128i r, g, b, bg;
+	if (a555) {
+		r = _mm_and_si128(_mm_srli_epi16(lPixels, 7), lMask5);
+		g = _mm_and_si128(_mm_srli_epi16(lPixels, 2), lMask5);
+	} else {
+		r = _mm_and_si128(_mm_srli_epi16(lPixels, 8), lMask5);
+		g = _mm_and_si128(_mm_srli_epi16(lPixels, 3), _mm_set1_epi16(0xFC));
+	}
+	b = _mm_and_si128(_mm_slli_epi16(lPixels, 3), lMask5);
+	if (aSwap) {
+		__m128i t = r;
+		r = b;
+		b = t;
+	}
+	bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+	*aLo = _mm_unpacklo_epi16(bg, r);
+	*aHi = _mm_unpackhi_epi16(bg, r);
+}
+
+/* Spreads 4 packed 24-bit pixels from bytes 0..11 into 4 dwords. */
+static inline __m128i Sse2Unpack24(__m128i aIn) {
+	const __m128i lBytes0To5 = _mm_set_epi32(0, 0, 0x0000FFFF, -1);
+	const __m128i lBytes8To13 = _mm_set_epi32(0x0000FFFF, -1, 0, 0);
+	const __m128i lLow24 = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+	__m128i q = _mm_or_si128(_mm_and_si128(aIn, lBytes0To5), _mm_and_si128(_mm_slli_si128(aIn, 2), lBytes8To13));
+	return _mm_or_si128(_mm_and_si128(q, lLow24), _mm_slli_epi64(_mm_and_si128(_mm_srli_epi64(q, 24), lLow24), 32));
+}
+
+/* Packs 4 dwords with a zero top byte into bytes 0..11. */
+static inline __m128i Sse2Pack24(__m128i aIn) {
+	const __m128i lBytes0To5 = _mm_set_epi32(0, 0, 0x0000FFFF, -1);
+	const __m128i lBytes6To11 = _mm_set_epi32(0, -1, (int32_t) 0xFFFF0000, 0);
+	const __m128i lLow24 = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+	__m128i q = _mm_or_si128(_mm_and_si128(aIn, lLow24), _mm_slli_epi64(_mm_srli_epi64(aIn, 32), 24));
+	return _mm_or_si128(_mm_and_si128(q, lBytes0To5), _mm_and_si128(_mm_srli_si128(q, 2), lBytes6To11));
+}
+
+static inline __m128i Sse2Rgb666(__m128i aPixels, int32_t aSwap) {
+	const __m128i lMaskB = _mm_set1_epi32(0x0000FC);
+	const __m128i lMaskG = _mm_set1_epi32(0x00FC00);
+	const __m128i lMaskR = _mm_set1_epi32(0xFC0000);
+	__m128i g = _mm_and_si128(_mm_slli_epi32(aPixels, 4), lMaskG);
+	if (aSwap)
+		return _mm_or_si128(g, _mm_or_si128(
+			_mm_and_si128(_mm_srli_epi32(aPixels, 10), lMaskB),
+			_mm_and_si128(_mm_slli_epi32(aPixels, 18), lMaskR)
+		));
+	return _mm_or_si128(g, _mm_or_si128(
+		_mm_and_si128(_mm_slli_epi32(aPixels, 2), lMaskB),
+		_mm_and_si128(_mm_slli_epi32(aPixels, 6), lMaskR)
+	));
+}
+
+static inline uint8_t *Sse2Store(uint8_t *aDst, __m128i aLo, __m128i aHi, int32_t aPack24) {
+	if (aPack24) {
+		__m128i lLo = Sse2Pack24(aLo);
+		__m128i lHi = Sse2Pack24(aHi);
+		_mm_storeu_si128((__m128i *) aDst, _mm_or_si128(lLo, _mm_slli_si128(lHi, 12)));
+		_mm_storel_epi64((__m128i *) (aDst + 16), _mm_srli_si128(lHi, 4));
+		return aDst + 24;
+	}
+	_mm_storeu_si128((__m128i *) aDst, aLo);
+	_mm_storeu_si128((__m128i *) (aDst + 16), aHi);
+	return aDst + 32;
+}
+#endif /* __SSE2__ */
+
+#if defined(__AVX2__)
+/* AVX2 kernels, 16 pixels per iteration for 16-bit sources and 8 for RGB666. */
+static inline void Avx2Decode16(const uint8_t *aSrc, int32_t a555, int32_t aSwap, __m256i *aLo, __m256i *aHi) {
+	const __m256i lPixels = _mm256_loadu_si256((const __m256i *) aSrc);
+	const __m256i lMask5 = _mm256_set1_epi16(0xF8);
+	__m256i r, g, b, bg, lLo, lHi;
+	if (a555) {
+		r = _mm256_and_si256(_mm256_srli_epi16(lPixels, 7), lMask5);
+		g = _mm256_and_si256(_mm256_srli_epi16(lPixels, 2), lMask5);
+	} else {
+		r = _mm256_and_si256(_mm256_srli_epi16(lPixels, 8), lMask5);
+		g = _mm256_and_si256(_mm256_srli_epi16(lPixels, 3), _mm256_set1_epi16(0xFC));
+	}
+	b = _mm256_and_si256(_mm256_slli_epi16(lPixels, 3), lMask5);
+	if (aSwap) {
+		__m256i t = r;
+		r = b;
+		b = t;
+	}
+	bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+	lLo = _mm256_unpacklo_epi16(bg, r);
+	lHi = _mm256_unpackhi_epi16(bg, r);
+	/* Unpacking works per 128-bit lane, put the pixels back in order. */
+	*aLo = _mm256_permute2x128_si256(lLo, lHi, 0x20);
+	*aHi = _mm256_permute2x128_si256(lLo, lHi, 0x31);
+}
+
+static inline __m256i Avx2Load24(const uint8_t *aSrc) {
+	const __m256i lBytes0To5 = _mm256_set_epi32(0, 0, 0x0000FFFF, -1, 0, 0, 0x0000FFFF, -1);
+	const __m256i lBytes8To13 = _mm256_set_epi32(0x0000FFFF, -1, 0, 0, 0x0000FFFF, -1, 0, 0);
+	const __m256i lLow24 = _mm256_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF, 0, 0x00FFFFFF, 0, 0x00FFFFFF);
+	__m256i lIn = _mm256_inserti128_si256(
+		_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) aSrc)),
+		_mm_loadu_si128((const __m128i *) (aSrc + 12)), 1
+	);
+	__m256i q = _mm256_or_si256(
+		_mm256_and_si256(lIn, lBytes0To5),
+		_mm256_and_si256(_mm256_slli_si256(lIn, 2), lBytes8To13)
+	);
+	return _mm256_or_si256(
+		_mm256_and_si256(q, lLow24),
+		_mm256_slli_epi64(_mm256_and_si256(_mm256_srli_epi64(q, 24), lLow24), 32)
+	);
+}
+
+static inline __m256i Avx2Rgb666(__m256i aPixels, int32_t aSwap) {
+	const __m256i lMaskB = _mm256_set1_epi32(0x0000FC);
+	const __m256i lMaskG = _mm256_set1_epi32(0x00FC00);
+	const __m256i lMaskR = _mm256_set1_epi32(0xFC0000);
+	__m256i g = _mm256_and_si256(_mm256_slli_epi32(aPixels, 4), lMaskG);
+	if (aSwap)
+		return _mm256_or_si256(g, _mm256_or_si256(
+			_mm256_and_si256(_mm256_srli_epi32(aPixels, 10), lMaskB),
+			_mm256_and_si256(_mm256_slli_epi32(aPixels, 18), lMaskR)
+		));
+	return _mm256_or_si256(g, _mm256_or_si256(
+		_mm256_and_si256(_mm256_slli_epi32(aPixels, 2), lMaskB),
+		_mm256_and_si256(_mm256_slli_epi32(aPixels, 6), lMaskR)
+	));
+}
+
+static inline uint8_t *Avx2Store(uint8_t *aDst, __m256i aPixels, int32_t aPack24) {
+	if (aPack24)
+		return Sse2Store(aDst, _mm256_castsi256_si128(aPixels), _mm256_extracti128_si256(aPixels, 1), 1);
+	_mm256_storeu_si256((__m256i *) aDst, aPixels);
+	return aDst + 32;
+}
+
+#define AVX2_ROW16(aName, a555, aSwap, aPack24, aTail) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		__m256i lLo, lHi; \
+		for (i = 0; i + 16 <= aCount; i += 16, aSrc += 32) { \
+			Avx2Decode16(aSrc, a555, aSwap, &lLo, &lHi); \
+			aDst = Avx2Store(aDst, lLo, aPack24); \
+			aDst = Avx2Store(aDst, lHi, aPack24); \
+		} \
+		aTail(aDst, aSrc, aCount - i); \
+	}
+
+#define AVX2_ROW24(aName, aSwap, aPack24, aTail) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		for (i = 0; i + 10 <= aCount; i += 8, aSrc += 24) \
+			aDst = Avx2Store(aDst, Avx2Rgb666(Avx2Load24(aSrc), aSwap), aPack24); \
+		aTail(aDst, aSrc, aCount - i); \
+	}
+
+AVX2_ROW24(Rgb666ToRgb888Simd, 1, 1, Rgb666ToRgb888Scalar)
+AVX2_ROW24(Rgb666ToBgr888Simd, 0, 1, Rgb666ToBgr888Scalar)
+AVX2_ROW24(Rgb666ToXrgb8888Simd, 0, 0, Rgb666ToXrgb8888Scalar)
+AVX2_ROW16(Rgb565ToRgb888Simd, 0, 1, 1, Rgb565ToRgb888Scalar)
+AVX2_ROW16(Rgb565ToBgr888Simd, 0, 0, 1, Rgb565ToBgr888Scalar)
+AVX2_ROW16(Rgb565ToXrgb8888Simd, 0, 0, 0, Rgb565ToXrgb8888Scalar)
+AVX2_ROW16(Rgb555ToRgb888Simd, 1, 1, 1, Rgb555ToRgb888Scalar)
+AVX2_ROW16(Rgb555ToBgr888Simd, 1, 0, 1, Rgb555ToBgr888Scalar)
+AVX2_ROW16(Rgb555ToXrgb8888Simd, 1, 0, 0, Rgb555ToXrgb8888Scalar)
+
+#define CONVERT_BACKEND "avx2"
+#elif defined(__SSE2__)
+#define SSE2_ROW16(aName, a555, aSwap, aPack24, aTail) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		__m128i lLo, lHi; \
+		for (i = 0; i + 8 <= aCount; i += 8, aSrc += 16) { \
+			Sse2Decode16(aSrc, a555, aSwap, &lLo, &lHi); \
+			aDst = Sse2Store(aDst, lLo, lHi, aPack24); \
+		} \
+		aTail(aDst, aSrc, aCount - i); \
+	}
+
+#define SSE2_ROW24(aName, aSwap, aPack24, aTail) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		__m128i lLo, lHi; \
+		for (i = 0; i + 10 <= aCount; i += 8, aSrc += 24) { \
+			lLo = Sse2Rgb666(Sse2Unpack24(_mm_loadu_si128((const __m128i *) aSrc)), aSwap); \
+			lHi = Sse2Rgb666(Sse2Unpack24(_mm_loadu_si128((const __m128i *) (aSrc + 12))), aSwap); \
+			aDst = Sse2Store(aDst, lLo, lHi, aPack24); \
+		} \
+		aTail(aDst, aSrc, aCount - i); \
+	}
+
+SSE2_ROW24(Rgb666ToRgb888Simd, 1, 1, Rgb666ToRgb888Scalar)
+SSE2_ROW24(Rgb666ToBgr888Simd, 0, 1, Rgb666ToBgr888Scalar)
+SSE2_ROW24(Rgb666ToXrgb8888Simd, 0, 0, Rgb666ToXrgb8888Scalar)
+SSE2_ROW16(Rgb565ToRgb888Simd, 0, 1, 1, Rgb565ToRgb888Scalar)
+SSE2_ROW16(Rgb565ToBgr888Simd, 0, 0, 1, Rgb565ToBgr888Scalar)
+SSE2_ROW16(Rgb565ToXrgb8888Simd, 0, 0, 0, Rgb565ToXrgb8888Scalar)
+SSE2_ROW16(Rgb555ToRgb888Simd, 1, 1, 1, Rgb555ToRgb888Scalar)
+SSE2_ROW16(Rgb555ToBgr888Simd, 1, 0, 1, Rgb555ToBgr888Scalar)
+SSE2_ROW16(Rgb555ToXrgb8888Simd, 1, 0, 0, Rgb555ToXrgb8888Scalar)
+
+#define CONVERT_BACKEND "sse2"
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+/* NEON kernels, 8 pixels per iteration, the structure loads and stores do all of the byte shuffling. */
+static inline void NeonWiden666(uint8x8x3_t aBytes, uint8x8_t *r, uint8x8_t *g, uint8x8_t *b) {
+	*b = vshl_n_u8(aBytes.val[0], 2);
+	*g = vorr_u8(vshl_n_u8(vshr_n_u8(aBytes.val[0], 6), 2), vshl_n_u8(aBytes.val[1], 4));
+	*r = vorr_u8(vshl_n_u8(vshr_n_u8(aBytes.val[1], 4), 2), vshl_n_u8(aBytes.val[2], 6));
+}
+
+static inline void NeonDecode666(const uint8_t *aSrc, uint8x8_t *r, uint8x8_t *g, uint8x8_t *b) {
+	NeonWiden666(vld3_u8(aSrc), r, g, b);
+}
+
+static inline void NeonDecode16(const uint8_t *aSrc, int32_t a555, uint8x8_t *r, uint8x8_t *g, uint8x8_t *b) {
+	uint16x8_t lPixels = vld1q_u16((const uint16_t *) aSrc);
+	if (a555) {
+		*r = vand_u8(vshrn_n_u16(lPixels, 7), vdup_n_u8(0xF8));
+		*g = vand_u8(vshrn_n_u16(lPixels, 2), vdup_n_u8(0xF8));
+	} else {
+		*r = vand_u8(vshrn_n_u16(lPixels, 8), vdup_n_u8(0xF8));
+		*g = vand_u8(vshrn_n_u16(lPixels, 3), vdup_n_u8(0xFC));
+	}
+	*b = vshl_n_u8(vmovn_u16(lPixels), 3);
+}
+
+static inline uint8_t *NeonStore(uint8_t *aDst, uint8x8_t r, uint8x8_t g, uint8x8_t b, pixel_format_t aFormat) {
+	if (aFormat == PIXEL_XRGB8888) {
+		uint8x8x4_t lOut;
+		lOut.val[0] = b;
+		lOut.val[1] = g;
+		lOut.val[2] = r;
+		lOut.val[3] = vdup_n_u8(0);
+		vst4_u8(aDst, lOut);
+		return aDst + 32;
+	} else {
+		uint8x8x3_t lOut;
+		lOut.val[0] = (aFormat == PIXEL_RGB888) ? r : b;
+		lOut.val[1] = g;
+		lOut.val[2] = (aFormat == PIXEL_RGB888) ? b : r;
+		vst3_u8(aDst, lOut);
+		return aDst + 24;
+	}
+}
+
+#define NEON_ROW24(aName, aFormat, aTail) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		uint8x8_t r, g, b; \
+		for (i = 0; i + 8 <= aCount; i += 8, aSrc += 24) { \
+			NeonDecode666(aSrc, &r, &g, &b); \
+			aDst = NeonStore(aDst, r, g, b, aFormat); \
+		} \
+		aTail(aDst, aSrc, aCount - i); \
+	}
+
+#define NEON_ROW16(aName, a555, aFormat, aTail) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		uint8x8_t r, g, b; \
+		for (i = 0; i + 8 <= aCount; i += 8, aSrc += 16) { \
+			NeonDecode16(aSrc, a555, &r, &g, &b); \
+			aDst = NeonStore(aDst, r, g, b, aFormat); \
+		} \
+		aTail(aDst, aSrc, aCount - i); \
+	}
+
+NEON_ROW24(Rgb666ToRgb888Simd, PIXEL_RGB888, Rgb666ToRgb888Scalar)
+NEON_ROW24(Rgb666ToBgr888Simd, PIXEL_BGR888, Rgb666ToBgr888Scalar)
+NEON_ROW24(Rgb666ToXrgb8888Simd, PIXEL_XRGB8888, Rgb666ToXrgb8888Scalar)
+NEON_ROW16(Rgb565ToRgb888Simd, 0, PIXEL_RGB888, Rgb565ToRgb888Scalar)
+NEON_ROW16(Rgb565ToBgr888Simd, 0, PIXEL_BGR888, Rgb565ToBgr888Scalar)
+NEON_ROW16(Rgb565ToXrgb8888Simd, 0, PIXEL_XRGB8888, Rgb565ToXrgb8888Scalar)
+NEON_ROW16(Rgb555ToRgb888Simd, 1, PIXEL_RGB888, Rgb555ToRgb888Scalar)
+NEON_ROW16(Rgb555ToBgr888Simd, 1, PIXEL_BGR888, Rgb555ToBgr888Scalar)
+NEON_ROW16(Rgb555ToXrgb8888Simd, 1, PIXEL_XRGB8888, Rgb555ToXrgb8888Scalar)
+
+#define CONVERT_BACKEND "neon"
+#else
+#define Rgb666ToRgb888Simd   Rgb666ToRgb888Scalar
+#define Rgb666ToBgr888Simd   Rgb666ToBgr888Scalar
+#define Rgb666ToXrgb8888Simd Rgb666ToXrgb8888Scalar
+#define Rgb565ToRgb888Simd   Rgb565ToRgb888Scalar
+#define Rgb565ToBgr888Simd   Rgb565ToBgr888Scalar
+#define Rgb565ToXrgb8888Simd Rgb565ToXrgb8888Scalar
+#define Rgb555ToRgb888Simd   Rgb555ToRgb888Scalar
+#define Rgb555ToBgr888Simd   Rgb555ToBgr888Scalar
+#define Rgb555ToXrgb8888Simd Rgb555ToXrgb8888Scalar
+
+#define CONVERT_BACKEND "scalar"
+#endif
+
+/*
+ * Whole frame converters for the known device geometries. Width, height and strides are constants, so the compiler
+ * knows every trip count. The plain C build converts 4 pixels per step from aligned 32-bit words (12 bytes of RGB666
+ * or 8 bytes of RGB565/RGB555) and needs no tail, the known widths are multiples of 4. The SIMD builds inline their
+ * row kernels together with their scalar tails: the SSE2 and AVX2 RGB666 kernels stop while 10 pixels are left, as
+ * their 16-byte loads read past the 24 bytes of a step, so the last 8 pixels of every row are converted by the
+ * scalar code. The other kernels end without a remainder at these widths.
+ */
+#if !defined(__SSE2__) && !defined(__ARM_NEON__) && !defined(__ARM_NEON)
+#define FIXED_ROW666(aName, aDstBytes, aStore) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		for (i = 0; i < aCount; i += 4, aSrc += 12, aDst += 4 * (aDstBytes)) { \
+			const uint32_t *lWords = (const uint32_t *) aSrc; \
+			aStore(aDst + 0 * (aDstBytes), WidenRgb666(lWords[0])); \
+			aStore(aDst + 1 * (aDstBytes), WidenRgb666((lWords[0] >> 24) | (lWords[1] << 8))); \
+			aStore(aDst + 2 * (aDstBytes), WidenRgb666((lWords[1] >> 16) | (lWords[2] << 16))); \
+			aStore(aDst + 3 * (aDstBytes), WidenRgb666(lWords[2] >> 8)); \
+		} \
+	}
+
+#define FIXED_ROW16(aName, aWiden, aDstBytes, aStore) \
+	static inline void aName(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount) { \
+		int32_t i; \
+		for (i = 0; i < aCount; i += 4, aSrc += 8, aDst += 4 * (aDstBytes)) { \
+			const uint32_t *lWords = (const uint32_t *) aSrc; \
+			aStore(aDst + 0 * (aDstBytes), aWiden(lWords[0] & 0xFFFF)); \
+			aStore(aDst + 1 * (aDstBytes), aWiden(lWords[0] >> 16)); \
+			aStore(aDst + 2 * (aDstBytes), aWiden(lWords[1] & 0xFFFF)); \
+			aStore(aDst + 3 * (aDstBytes), aWiden(lWords[1] >> 16)); \
+		} \
+	}
+
+FIXED_ROW666(Rgb666ToRgb888Fixed, 3, StoreRgb888)
+FIXED_ROW666(Rgb666ToBgr888Fixed, 3, StoreBgr888)
+FIXED_ROW666(Rgb666ToXrgb8888Fixed, 4, StoreXrgb8888)
+FIXED_ROW16(Rgb565ToRgb888Fixed, WidenRgb565, 3, StoreRgb888)
+FIXED_ROW16(Rgb565ToBgr888Fixed, WidenRgb565, 3, StoreBgr888)
+FIXED_ROW16(Rgb565ToXrgb8888Fixed, WidenRgb565, 4, StoreXrgb8888)
+FIXED_ROW16(Rgb555ToRgb888Fixed, WidenRgb555, 3, StoreRgb888)
+FIXED_ROW16(Rgb555ToBgr888Fixed, WidenRgb555, 3, StoreBgr888)
+FIXED_ROW16(Rgb555ToXrgb8888Fixed, WidenRgb555, 4, StoreXrgb8888)
+#else
+#define Rgb666ToRgb888Fixed   Rgb666ToRgb888Simd
+#define Rgb666ToBgr888Fixed   Rgb666ToBgr888Simd
+#define Rgb666ToXrgb8888Fixed Rgb666ToXrgb8888Simd
+#define Rgb565ToRgb888Fixed   Rgb565ToRgb888Simd
+#define Rgb565ToBgr888Fixed   Rgb565ToBgr888Simd
+#define Rgb565ToXrgb8888Fixed Rgb565ToXrgb8888Simd
+#define Rgb555ToRgb888Fixed   Rgb555ToRgb888Simd
+#define Rgb555ToBgr888Fixed   Rgb555ToBgr888Simd
+#define Rgb555ToXrgb8888Fixed Rgb555ToXrgb8888Simd
+#endif
+
+#define FIXED_FRAME(aName, aRow, aWidth, aHeight, aSrcBytes, aDstBytes) \
+	static void aName(uint8_t *aDst, const uint8_t *aSrc) { \
+		int32_t y; \
+		for (y = 0; y < (aHeight); ++y, aDst += (aWidth) * (aDstBytes), aSrc += (aWidth) * (aSrcBytes)) \
+			aRow(aDst, aSrc, (aWidth)); \
+	}
+
+FIXED_FRAME(Qvga666ToRgb888, Rgb666ToRgb888Fixed, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, 3, 3)
+FIXED_FRAME(Qvga666ToBgr888, Rgb666ToBgr888Fixed, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, 3, 3)
+FIXED_FRAME(Qvga666ToXrgb8888, Rgb666ToXrgb8888Fixed, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, 3, 4)
+FIXED_FRAME(Qvga565ToRgb888, Rgb565ToRgb888Fixed, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, 2, 3)
+FIXED_FRAME(Qvga565ToBgr888, Rgb565ToBgr888Fixed, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, 2, 3)
+FIXED_FRAME(Qvga565ToXrgb8888, Rgb565ToXrgb8888Fixed, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, 2, 4)
+FIXED_FRAME(E398555ToRgb888, Rgb555ToRgb888Fixed, SCREEN_E398_WIDTH, SCREEN_E398_HEIGHT, 2, 3)
+FIXED_FRAME(E398555ToBgr888, Rgb555ToBgr888Fixed, SCREEN_E398_WIDTH, SCREEN_E398_HEIGHT, 2, 3)
+FIXED_FRAME(E398555ToXrgb8888, Rgb555ToXrgb8888Fixed, SCREEN_E398_WIDTH, SCREEN_E398_HEIGHT, 2, 4)
+
+typedef struct {
+	pixel_format_t src;
+	int32_t width;
+	int32_t height;
+	convert_frame_t frames[3]; /* RGB888, BGR888, XRGB8888. */
+} fixed_frames_t;
+
+static const fixed_frames_t g_fixed_frames[] = {
+	{ PIXEL_RGB666, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, { Qvga666ToRgb888, Qvga666ToBgr888, Qvga666ToXrgb8888 } },
+	{ PIXEL_RGB565, SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, { Qvga565ToRgb888, Qvga565ToBgr888, Qvga565ToXrgb8888 } },
+	{ PIXEL_RGB555, SCREEN_E398_WIDTH, SCREEN_E398_HEIGHT, { E398555ToRgb888, E398555ToBgr888, E398555ToXrgb8888 } }
+};
+
+/*
+ * Overlay compositing, the opaque test is a mask and the layers are selected without a per-pixel branch.
+ * Channels are mixed as (top * alpha + bottom * (255 - alpha)) / 255 rounded, with the exact shift form of the
+ * division so that every backend gives the same bytes.
+ */
+static inline uint32_t BlendRgb(uint32_t aTop, uint32_t aBottom, uint32_t aAlpha) {
+	uint32_t lResult = 0, lShift;
+	for (lShift = 0; lShift < 24; lShift += 8) {
+		uint32_t x = ((aTop >> lShift) & 0xFF) * aAlpha + ((aBottom >> lShift) & 0xFF) * (255 - aAlpha) + 128;
+		lResult |= ((x + (x >> 8)) >> 8) << lShift;
+	}
+	return lResult;
+}
+
+static void OverlayRowScalar(uint8_t *aDst, const uint8_t *aTop, const uint8_t *aBottom, int32_t aCount, const overlay_t *aParams) {
+	const uint32_t lKey = aParams->key & 0xFCFCFC;
+	int32_t i;
+	for (i = 0; i < aCount; ++i, aTop += 3, aBottom += 3, aDst += 3) {
+		uint32_t lTop = DecodeRgb666(aTop), lBottom = DecodeRgb666(aBottom), lMask;
+		if (aParams->keyed)
+			lMask = -(uint32_t) (lTop != lKey);
+		else
+			lMask = -(uint32_t) (aTop[0] && aTop[1] && aTop[2]);
+		if (aParams->alpha != 255)
+			lTop = BlendRgb(lTop, lBottom, aParams->alpha);
+		StoreBgr888(aDst, (lTop & lMask) | (lBottom & ~lMask));
+	}
+}
+
+#if defined(__SSE2__)
+static inline __m128i Sse2Blend(__m128i aTop, __m128i aBottom, __m128i aAlpha, __m128i aInverse) {
+	const __m128i lZero = _mm_setzero_si128();
+	const __m128i lRound = _mm_set1_epi16(128);
+	__m128i lLo = _mm_add_epi16(_mm_add_epi16(
+		_mm_mullo_epi16(_mm_unpacklo_epi8(aTop, lZero), aAlpha),
+		_mm_mullo_epi16(_mm_unpacklo_epi8(aBottom, lZero), aInverse)
+	), lRound);
+	__m128i lHi = _mm_add_epi16(_mm_add_epi16(
+		_mm_mullo_epi16(_mm_unpackhi_epi8(aTop, lZero), aAlpha),
+		_mm_mullo_epi16(_mm_unpackhi_epi8(aBottom, lZero), aInverse)
+	), lRound);
+	lLo = _mm_srli_epi16(_mm_add_epi16(lLo, _mm_srli_epi16(lLo, 8)), 8);
+	lHi = _mm_srli_epi16(_mm_add_epi16(lHi, _mm_srli_epi16(lHi, 8)), 8);
+	return _mm_packus_epi16(lLo, lHi);
+}
+
+/* 4 pixels of both layers, the result is 0x00RRGGBB dwords which pack straight into BGR888. */
+static inline __m128i Sse2Overlay(const uint8_t *aTop, const uint8_t *aBottom, const overlay_t *aParams, __m128i aKey, __m128i aAlpha, __m128i aInverse) {
+	const __m128i lZero = _mm_setzero_si128();
+	__m128i lRaw = Sse2Unpack24(_mm_loadu_si128((const __m128i *) aTop));
+	__m128i lTop = Sse2Rgb666(lRaw, 0);
+	__m128i lBottom = Sse2Rgb666(Sse2Unpack24(_mm_loadu_si128((const __m128i *) aBottom)), 0);
+	__m128i lMask;
+	if (aParams->keyed)
+		lMask = _mm_xor_si128(_mm_cmpeq_epi32(lTop, aKey), _mm_set1_epi32(-1));
+	else
+		lMask = _mm_cmpeq_epi32(_mm_and_si128(_mm_cmpeq_epi8(lRaw, lZero), _mm_set1_epi32(0x00FFFFFF)), lZero);
+	if (aParams->alpha != 255)
+		lTop = Sse2Blend(lTop, lBottom, aAlpha, aInverse);
+	return _mm_or_si128(_mm_and_si128(lMask, lTop), _mm_andnot_si128(lMask, lBottom));
+}
+
+static void OverlayRowSimd(uint8_t *aDst, const uint8_t *aTop, const uint8_t *aBottom, int32_t aCount, const overlay_t *aParams) {
+	const __m128i lKey = _mm_set1_epi32(aParams->key & 0xFCFCFC);
+	const __m128i lAlpha = _mm_set1_epi16(aParams->alpha);
+	const __m128i lInverse = _mm_set1_epi16(255 - aParams->alpha);
+	int32_t i;
+	for (i = 0; i + 10 <= aCount; i += 8, aTop += 24, aBottom += 24) {
+		__m128i lLo = Sse2Overlay(aTop, aBottom, aParams, lKey, lAlpha, lInverse);
+		__m128i lHi = Sse2Overlay(aTop + 12, aBottom + 12, aParams, lKey, lAlpha, lInverse);
+		aDst = Sse2Store(aDst, lLo, lHi, 1);
+	}
+	OverlayRowScalar(aDst, aTop, aBottom, aCount - i, aParams);
+}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+static inline uint8x8_t NeonBlend(uint8x8_t aTop, uint8x8_t aBottom, uint8x8_t aAlpha, uint8x8_t aInverse) {
+	uint16x8_t x = vaddq_u16(vmlal_u8(vmull_u8(aTop, aAlpha), aBottom, aInverse), vdupq_n_u16(128));
+	return vshrn_n_u16(vaddq_u16(x, vshrq_n_u16(x, 8)), 8);
+}
+
+static void OverlayRowSimd(uint8_t *aDst, const uint8_t *aTop, const uint8_t *aBottom, int32_t aCount, const overlay_t *aParams) {
+	const uint32_t lKey = aParams->key & 0xFCFCFC;
+	const uint8x8_t lKeyR = vdup_n_u8(lKey >> 16), lKeyG = vdup_n_u8(lKey >> 8), lKeyB = vdup_n_u8(lKey);
+	const uint8x8_t lAlpha = vdup_n_u8(aParams->alpha), lInverse = vdup_n_u8(255 - aParams->alpha);
+	int32_t i;
+	for (i = 0; i + 8 <= aCount; i += 8, aTop += 24, aBottom += 24) {
+		uint8x8x3_t lRaw = vld3_u8(aTop);
+		uint8x8_t tr, tg, tb, br, bg, bb, lMask;
+		NeonWiden666(lRaw, &tr, &tg, &tb);
+		NeonDecode666(aBottom, &br, &bg, &bb);
+		if (aParams->keyed)
+			lMask = vmvn_u8(vand_u8(vand_u8(vceq_u8(tr, lKeyR), vceq_u8(tg, lKeyG)), vceq_u8(tb, lKeyB)));
+		else
+			lMask = vand_u8(vand_u8(vtst_u8(lRaw.val[0], lRaw.val[0]), vtst_u8(lRaw.val[1], lRaw.val[1])), vtst_u8(lRaw.val[2], lRaw.val[2]));
+		if (aParams->alpha != 255) {
+			tr = NeonBlend(tr, br, lAlpha, lInverse);
+			tg = NeonBlend(tg, bg, lAlpha, lInverse);
+			tb = NeonBlend(tb, bb, lAlpha, lInverse);
+		}
+		aDst = NeonStore(aDst, vbsl_u8(lMask, tr, br), vbsl_u8(lMask, tg, bg), vbsl_u8(lMask, tb, bb), PIXEL_BGR888);
+	}
+	OverlayRowScalar(aDst, aTop, aBottom, aCount - i, aParams);
+}
+#else
+#define OverlayRowSimd OverlayRowScalar
+#endif
+
+uint32_t PixelFormatBytes(pixel_format_t aFormat) {
+	switch (aFormat) {
+		case PIXEL_RGB565:
+		case PIXEL_RGB555:
+			return 2;
+		case PIXEL_RGB666:
+		case PIXEL_RGB888:
+		case PIXEL_BGR888:
+			return 3;
+		case PIXEL_XRGB8888:
+			return 4;
+	}
+	return 0;
+}
+
+convert_row_t ConvertGetRow(pixel_format_t aSrcFormat, pixel_format_t aDstFormat) {
+	/* Rows are source formats, columns are destination formats. */
+	static const convert_row_t lRows[3][3] = {
+		{ Rgb666ToRgb888Simd, Rgb666ToBgr888Simd, Rgb666ToXrgb8888Simd },
+		{ Rgb565ToRgb888Simd, Rgb565ToBgr888Simd, Rgb565ToXrgb8888Simd },
+		{ Rgb555ToRgb888Simd, Rgb555ToBgr888Simd, Rgb555ToXrgb8888Simd }
+	};
+	if (aSrcFormat > PIXEL_RGB555 || aDstFormat < PIXEL_RGB888 || aDstFormat > PIXEL_XRGB8888)
+		return NULL;
+	return lRows[aSrcFormat - PIXEL_RGB666][aDstFormat - PIXEL_RGB888];
+}
+
+int32_t ConvertFrame(
+	uint8_t *aDst, uint32_t aDstStride, pixel_format_t aDstFormat,
+	const uint8_t *aSrc, uint32_t aSrcStride, pixel_format_t aSrcFormat,
+	int32_t aWidth, int32_t aHeight
+) {
+	int32_t y;
+	convert_row_t lConvertRow = ConvertGetRow(aSrcFormat, aDstFormat);
+	if (!lConvertRow)
+		return -1;
+	for (y = 0; y < aHeight; ++y, aDst += aDstStride, aSrc += aSrcStride)
+		lConvertRow(aDst, aSrc, aWidth);
+	return 0;
+}
+
+convert_frame_t ConvertGetFrame(
+	pixel_format_t aSrcFormat, pixel_format_t aDstFormat, int32_t aWidth, int32_t aHeight, uint32_t aSrcStride
+) {
+	uint32_t i;
+	if (aDstFormat < PIXEL_RGB888 || aDstFormat > PIXEL_XRGB8888 || aSrcStride != aWidth * PixelFormatBytes(aSrcFormat))
+		return NULL;
+	for (i = 0; i < sizeof(g_fixed_frames) / sizeof(g_fixed_frames[0]); ++i)
+		if (g_fixed_frames[i].src == aSrcFormat && g_fixed_frames[i].width == aWidth && g_fixed_frames[i].height == aHeight)
+			return g_fixed_frames[i].frames[aDstFormat - PIXEL_RGB888];
+	return NULL;
+}
+
+void ConvertOverlay(
+	uint8_t *aDst, uint32_t aDstStride, const uint8_t *aOverlay, const uint8_t *aUnder, uint32_t aSrcStride,
+	int32_t aWidth, int32_t aHeight, const overlay_t *aParams
+) {
+	int32_t y;
+	for (y = 0; y < aHeight; ++y, aDst += aDstStride, aOverlay += aSrcStride, aUnder += aSrcStride)
+		OverlayRowSimd(aDst, aOverlay, aUnder, aWidth, aParams);
+}
+
+int32_t ConvertGetTransform(int32_t aDegrees, int32_t aMirror, transform_t *aTransform) {
+	if (aDegrees != 0 && aDegrees != 90 && aDegrees != 180 && aDegrees != 270)
+		return -1;
+	*aTransform = (transform_t) (aDegrees / 90 + ((aMirror) ? TRANSFORM_MIRROR : TRANSFORM_NONE));
+	return 0;
+}
+
+/* Fills aBand with aRows full source rows from aY on as packed destination pixels. */
+typedef void (*band_fill_t)(const void *aContext, uint8_t *aBand, uint32_t aBandStride, int32_t aY, int32_t aRows);
+
+typedef struct {
+	convert_row_t row;
+	const uint8_t *src;
+	uint32_t src_stride;
+	int32_t width;
+} convert_band_t;
+
+typedef struct {
+	const uint8_t *overlay;
+	const uint8_t *under;
+	uint32_t src_stride;
+	int32_t width;
+	const overlay_t *params;
+} overlay_band_t;
+
+static void FillConvertBand(const void *aContext, uint8_t *aBand, uint32_t aBandStride, int32_t aY, int32_t aRows) {
+	const convert_band_t *lContext = (const convert_band_t *) aContext;
+	const uint8_t *lSrc = lContext->src + aY * lContext->src_stride;
+	int32_t y;
+	for (y = 0; y < aRows; ++y, aBand += aBandStride, lSrc += lContext->src_stride)
+		lContext->row(aBand, lSrc, lContext->width);
+}
+
+static void FillOverlayBand(const void *aContext, uint8_t *aBand, uint32_t aBandStride, int32_t aY, int32_t aRows) {
+	const overlay_band_t *lContext = (const overlay_band_t *) aContext;
+	const uint32_t lOffset = aY * lContext->src_stride;
+	ConvertOverlay(
+		aBand, aBandStride, lContext->overlay + lOffset, lContext->under + lOffset, lContext->src_stride, lContext->width, aRows,
+		lContext->params
+	);
+}
+
+/* Moves a 3-byte pixel as a 4-byte word, the extra byte belongs to the next pixel of the run. */
+static inline void MovePixel(uint8_t *aDst, const uint8_t *aSrc) {
+	uint32_t lPixel;
+	memcpy(&lPixel, aSrc, 4);
+	memcpy(aDst, &lPixel, 4);
+}
+
+/*
+ * Copies aOuter runs of aInner pixels from a band into the image, the inner loop is the one that is contiguous in
+ * the destination. Runs are walked towards higher addresses, so every pixel but the last one of a run can be moved
+ * as a whole word, and four runs go side by side to keep several loads and stores in flight. The band holds at
+ * least one spare byte after its last pixel.
+ */
+static inline void CopyRuns(
+	uint8_t *aDst, ptrdiff_t aDstOuter, ptrdiff_t aDstInner, const uint8_t *aBand, ptrdiff_t aBandOuter, ptrdiff_t aBandInner,
+	int32_t aOuter, int32_t aInner, uint32_t aBytes
+) {
+	int32_t i, j, k;
+	if (aDstInner < 0) {
+		aDst += (aInner - 1) * aDstInner;
+		aBand += (aInner - 1) * aBandInner;
+		aDstInner = -aDstInner;
+		aBandInner = -aBandInner;
+	}
+	for (i = 0; i + 4 <= aOuter; i += 4, aDst += 4 * aDstOuter, aBand += 4 * aBandOuter) {
+		uint8_t *lDst = aDst;
+		const uint8_t *lBand = aBand;
+		for (j = 0; j < aInner - 1; ++j, lDst += aDstInner, lBand += aBandInner) {
+			MovePixel(lDst, lBand);
+			MovePixel(lDst + aDstOuter, lBand + aBandOuter);
+			MovePixel(lDst + 2 * aDstOuter, lBand + 2 * aBandOuter);
+			MovePixel(lDst + 3 * aDstOuter, lBand + 3 * aBandOuter);
+		}
+		for (k = 0; k < 4; ++k)
+			memcpy(lDst + k * aDstOuter, lBand + k * aBandOuter, aBytes);
+	}
+	for (; i < aOuter; ++i, aDst += aDstOuter, aBand += aBandOuter) {
+		uint8_t *lDst = aDst;
+		const uint8_t *lBand = aBand;
+		for (j = 0; j < aInner - 1; ++j, lDst += aDstInner, lBand += aBandInner)
+			MovePixel(lDst, lBand);
+		memcpy(lDst, lBand, aBytes);
+	}
+}
+
+/*
+ * Converts the source in bands of CONVERT_TILE full rows, with the same row kernels as a straight conversion, and
+ * puts every band into its transformed place while it is still in L1. A turned band becomes CONVERT_TILE columns of
+ * the image, written as one short run per destination row. Source pixel (x, y) lands at lOrigin + x * lStepX +
+ * y * lStepY. aBand holds CONVERT_BAND_BYTES(aWidth, aBytes).
+ */
+static void TransformBands(
+	uint8_t *aDst, uint32_t aDstStride, uint32_t aBytes, int32_t aWidth, int32_t aHeight, transform_t aTransform,
+	band_fill_t aFill, const void *aContext, uint8_t *aBand
+) {
+	const uint32_t aBandStride = aWidth * aBytes;
+	const int32_t lOutWidth = (TRANSFORM_TRANSPOSED(aTransform)) ? aHeight : aWidth;
+	/* Output column X = lXx * x + lXy * y + lX0 and row Y = lYx * x + lYy * y + lY0. */
+	int32_t lXx = 0, lXy = 0, lX0 = 0, lYx = 0, lYy = 0, lY0 = 0, y, lRows;
+	ptrdiff_t lStepX, lStepY;
+	uint8_t *lOrigin;
+
+	switch (aTransform & 3) {
+		case TRANSFORM_NONE:
+			lXx = lYy = 1;
+			break;
+		case TRANSFORM_ROTATE_90:
+			lXy = -1;
+			lX0 = aHeight - 1;
+			lYx = 1;
+			break;
+		case TRANSFORM_ROTATE_180:
+			lXx = lYy = -1;
+			lX0 = aWidth - 1;
+			lY0 = aHeight - 1;
+			break;
+		case TRANSFORM_ROTATE_270:
+			lXy = 1;
+			lYx = -1;
+			lY0 = aWidth - 1;
+			break;
+	}
+	if (aTransform & TRANSFORM_MIRROR) {
+		lXx = -lXx;
+		lXy = -lXy;
+		lX0 = lOutWidth - 1 - lX0;
+	}
+	lStepX = lXx * (ptrdiff_t) aBytes + lYx * (ptrdiff_t) aDstStride;
+	lStepY = lXy * (ptrdiff_t) aBytes + lYy * (ptrdiff_t) aDstStride;
+	lOrigin = aDst + lX0 * (ptrdiff_t) aBytes + lY0 * (ptrdiff_t) aDstStride;
+
+	for (y = 0; y < aHeight; y += CONVERT_TILE) {
+		uint8_t *lDst = lOrigin + y * lStepY;
+		lRows = (aHeight - y < CONVERT_TILE) ? aHeight - y : CONVERT_TILE;
+		aFill(aContext, aBand, aBandStride, y, lRows);
+		/* With a constant pixel size the compiler turns the pixel moves into plain loads and stores. */
+		if (TRANSFORM_TRANSPOSED(aTransform) && aBytes == 4)
+			CopyRuns(lDst, lStepX, lStepY, aBand, 4, aBandStride, aWidth, lRows, 4);
+		else if (TRANSFORM_TRANSPOSED(aTransform))
+			CopyRuns(lDst, lStepX, lStepY, aBand, 3, aBandStride, aWidth, lRows, 3);
+		else if (aBytes == 4)
+			CopyRuns(lDst, lStepY, lStepX, aBand, aBandStride, 4, lRows, aWidth, 4);
+		else
+			CopyRuns(lDst, lStepY, lStepX, aBand, aBandStride, 3, lRows, aWidth, 3);
+	}
+}
+
+int32_t ConvertTransform(
+	uint8_t *aDst, uint32_t aDstStride, pixel_format_t aDstFormat,
+	const uint8_t *aSrc, uint32_t aSrcStride, pixel_format_t aSrcFormat,
+	int32_t aWidth, int32_t aHeight, transform_t aTransform, uint8_t *aBand
+) {
+	convert_band_t lContext;
+	if (aTransform == TRANSFORM_NONE)
+		return ConvertFrame(aDst, aDstStride, aDstFormat, aSrc, aSrcStride, aSrcFormat, aWidth, aHeight);
+	if (!(lContext.row = ConvertGetRow(aSrcFormat, aDstFormat)))
+		return -1;
+	lContext.src = aSrc;
+	lContext.src_stride = aSrcStride;
+	lContext.width = aWidth;
+	TransformBands(aDst, aDstStride, PixelFormatBytes(aDstFormat), aWidth, aHeight, aTransform, FillConvertBand, &lContext, aBand);
+	return 0;
+}
+
+void ConvertOverlayTransform(
+	uint8_t *aDst, uint32_t aDstStride, const uint8_t *aOverlay, const uint8_t *aUnder, uint32_t aSrcStride,
+	int32_t aWidth, int32_t aHeight, const overlay_t *aParams, transform_t aTransform, uint8_t *aBand
+) {
+	overlay_band_t lContext;
+	if (aTransform == TRANSFORM_NONE) {
+		ConvertOverlay(aDst, aDstStride, aOverlay, aUnder, aSrcStride, aWidth, aHeight, aParams);
+		return;
+	}
+	lContext.overlay = aOverlay;
+	lContext.under = aUnder;
+	lContext.src_stride = aSrcStride;
+	lContext.width = aWidth;
+	lContext.params = aParams;
+	TransformBands(aDst, aDstStride, 3, aWidth, aHeight, aTransform, FillOverlayBand, &lContext, aBand);
+}
+
+/*
+ * Framebuffer copies in steps of COPY_STEP bytes read by aligned loads before anything is stored: four 16-byte loads
+ * of SSE2 or NEON, or 32-bit words the ARM builds group into ldm bursts, with the lines ahead prefetched.
+ */
+#define COPY_STEP           (64)
+#define COPY_PREFETCH       (4 * COPY_STEP)
+#if defined(__SSE2__) || defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define COPY_ALIGN          (16)
+#else
+#define COPY_ALIGN          (4)
+#endif
+
+static void CopyWide(uint8_t *aDst, const uint8_t *aSrc, uint32_t aBytes) {
+	uint32_t lHead = (uint32_t) (-(uintptr_t) aSrc & (COPY_ALIGN - 1));
+	if (lHead > aBytes)
+		lHead = aBytes;
+	memcpy(aDst, aSrc, lHead);
+	aDst += lHead;
+	aSrc += lHead;
+	aBytes -= lHead;
+	for (; aBytes >= COPY_STEP; aBytes -= COPY_STEP, aSrc += COPY_STEP, aDst += COPY_STEP) {
+		__builtin_prefetch(aSrc + COPY_PREFETCH);
+#if defined(__SSE2__)
+		const __m128i lA = _mm_load_si128((const __m128i *) aSrc);
+		const __m128i lB = _mm_load_si128((const __m128i *) (aSrc + 16));
+		const __m128i lC = _mm_load_si128((const __m128i *) (aSrc + 32));
+		const __m128i lD = _mm_load_si128((const __m128i *) (aSrc + 48));
+		_mm_storeu_si128((__m128i *) aDst, lA);
+		_mm_storeu_si128((__m128i *) (aDst + 16), lB);
+		_mm_storeu_si128((__m128i *) (aDst + 32), lC);
+		_mm_storeu_si128((__m128i *) (aDst + 48), lD);
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+		const uint8x16_t lA = vld1q_u8(aSrc);
+		const uint8x16_t lB = vld1q_u8(aSrc + 16);
+		const uint8x16_t lC = vld1q_u8(aSrc + 32);
+		const uint8x16_t lD = vld1q_u8(aSrc + 48);
+		vst1q_u8(aDst, lA);
+		vst1q_u8(aDst + 16, lB);
+		vst1q_u8(aDst + 32, lC);
+		vst1q_u8(aDst + 48, lD);
+#else
+		/* aDst may be unaligned for rectangles, the words are stored through memcpy(). */
+		const uint32_t *lSrc = (const uint32_t *) aSrc;
+		uint32_t lWords[COPY_STEP / 4];
+		uint32_t i;
+		for (i = 0; i < COPY_STEP / 4; ++i)
+			lWords[i] = lSrc[i];
+		memcpy(aDst, lWords, COPY_STEP);
+#endif
+	}
+	memcpy(aDst, aSrc, aBytes);
+}
+
+void ConvertCopy(uint8_t *aDst, uint32_t aDstStride, const uint8_t *aSrc, uint32_t aSrcStride, uint32_t aBytes, int32_t aRows) {
+	int32_t y;
+	if (aDstStride == aBytes && aSrcStride == aBytes) {
+		CopyWide(aDst, aSrc, aBytes * aRows);
+		return;
+	}
+	for (y = 0; y < aRows; ++y)
+		CopyWide(aDst + y * aDstStride, aSrc + y * aSrcStride, aBytes);
+}
+
+const char *ConvertBackend(void) {
+	return CONVERT_BACKEND;
+}
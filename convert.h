@@ -0,0 +1,127 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+/* C */
+#include <stdint.h>
+
+/*
+ * Framebuffer and bitmap pixel formats.
+ * Source formats are what MotoMAGX and EZX framebuffers contain, destination formats are what the writers consume.
+ */
+typedef enum {
+	PIXEL_RGB666,   /* 3 bytes, little-endian 18-bit word: B[5:0], G[11:6], R[17:12]. ZN5, E8, EM30. */
+	PIXEL_RGB565,   /* uint16_t: R[15:11], G[10:5], B[4:0]. E680. */
+	PIXEL_RGB555,   /* uint16_t: R[14:10], G[9:5], B[4:0]. E398. */
+	PIXEL_RGB888,   /* 3 bytes: R, G, B. JPEG and PNG order. */
+	PIXEL_BGR888,   /* 3 bytes: B, G, R. BMP order. */
+	PIXEL_XRGB8888  /* uint32_t: 0x00RRGGBB. */
+} pixel_format_t;
+
+/* Screen geometries with specialized whole frame converters, see ConvertGetFrame(). */
+#define SCREEN_QVGA_WIDTH   (240)   /* ZN5, E8, EM30, E680. */
+#define SCREEN_QVGA_HEIGHT  (320)
+#define SCREEN_E398_WIDTH   (176)
+#define SCREEN_E398_HEIGHT  (220)
+
+/* Converts aCount pixels of one row, aDst and aSrc must not overlap. */
+typedef void (*convert_row_t)(uint8_t *aDst, const uint8_t *aSrc, int32_t aCount);
+
+/* Converts a whole frame of a fixed geometry into packed destination rows. */
+typedef void (*convert_frame_t)(uint8_t *aDst, const uint8_t *aSrc);
+
+uint32_t PixelFormatBytes(pixel_format_t aFormat);
+
+/* Returns NULL if the conversion is not supported. */
+convert_row_t ConvertGetRow(pixel_format_t aSrcFormat, pixel_format_t aDstFormat);
+
+/* Returns 0 on success, -1 if the conversion is not supported. Strides are in bytes. */
+int32_t ConvertFrame(
+	uint8_t *aDst, uint32_t aDstStride, pixel_format_t aDstFormat,
+	const uint8_t *aSrc, uint32_t aSrcStride, pixel_format_t aSrcFormat,
+	int32_t aWidth, int32_t aHeight
+);
+
+/*
+ * Returns a converter compiled for this exact geometry with packed source rows, or NULL so that the caller falls
+ * back to ConvertFrame(). The source must be 4-byte aligned.
+ */
+convert_frame_t ConvertGetFrame(
+	pixel_format_t aSrcFormat, pixel_format_t aDstFormat, int32_t aWidth, int32_t aHeight, uint32_t aSrcStride
+);
+
+/*
+ * Orientation of converted images: the screen turned clockwise by 0, 90, 180 or 270 degrees, then optionally
+ * mirrored left to right. Odd values swap the width and the height of the image.
+ */
+typedef enum {
+	TRANSFORM_NONE,
+	TRANSFORM_ROTATE_90,
+	TRANSFORM_ROTATE_180,
+	TRANSFORM_ROTATE_270,
+	TRANSFORM_MIRROR,
+	TRANSFORM_MIRROR_90,
+	TRANSFORM_MIRROR_180,
+	TRANSFORM_MIRROR_270
+} transform_t;
+
+#define TRANSFORM_TRANSPOSED(aTransform) ((aTransform) & 1)
+/* The first image row comes from the last screen row, or the last column when transposed: 180 and 270 degrees. */
+#define TRANSFORM_REVERSED(aTransform)   ((aTransform) & 2)
+
+/* Rows per band of a transformed conversion, a band is turned while it is in L1. */
+#define CONVERT_TILE        (16)
+/* Size of the caller's band buffer of a transformed conversion of aWidth pixels wide rows into aBytes per pixel. */
+#define CONVERT_BAND_BYTES(aWidth, aBytes)  ((aWidth) * (aBytes) * CONVERT_TILE + 1)
+
+/* Returns 0 or -1 unless aDegrees is 0, 90, 180 or 270. */
+int32_t ConvertGetTransform(int32_t aDegrees, int32_t aMirror, transform_t *aTransform);
+
+/*
+ * ConvertFrame() of an aWidth x aHeight source into a transformed image. Bands of CONVERT_TILE source rows are
+ * converted by the row kernels into a small buffer and copied into their place in aDst while they are in L1, so a
+ * 90 or 270 degree turn reads the source once in row order and writes every destination row in runs of CONVERT_TILE
+ * pixels instead of striding over the whole frame in a second pass. aBand is that buffer, CONVERT_BAND_BYTES(aWidth,
+ * PixelFormatBytes(aDstFormat)) bytes owned by the caller, so repeated captures allocate nothing. Returns 0 on success,
+ * -1 if the conversion is not supported.
+ */
+int32_t ConvertTransform(
+	uint8_t *aDst, uint32_t aDstStride, pixel_format_t aDstFormat,
+	const uint8_t *aSrc, uint32_t aSrcStride, pixel_format_t aSrcFormat,
+	int32_t aWidth, int32_t aHeight, transform_t aTransform, uint8_t *aBand
+);
+
+/*
+ * Two layer compositing of RGB666 framebuffers, used by ograb for /dev/fb/0 on top of /dev/fb/1.
+ * Without a key the old rule applies: overlay pixels whose three bytes are all non-zero are opaque.
+ * With a key, overlay pixels of the key color are transparent and all others are opaque.
+ * Opaque overlay pixels are mixed with the underlay by alpha, 255 copies them.
+ */
+typedef struct {
+	int32_t keyed;
+	uint32_t key;      /* 0x00RRGGBB, compared with the low 2 bits of each channel cleared. */
+	uint8_t alpha;
+} overlay_t;
+
+/* Composes aOverlay over aUnder row by row straight into BGR888 rows, in one pass. Both sources are RGB666. */
+void ConvertOverlay(
+	uint8_t *aDst, uint32_t aDstStride, const uint8_t *aOverlay, const uint8_t *aUnder, uint32_t aSrcStride,
+	int32_t aWidth, int32_t aHeight, const overlay_t *aParams
+);
+
+/* ConvertOverlay() band by band into a transformed image, as ConvertTransform() does, aBand has CONVERT_BAND_BYTES(aWidth, 3). */
+void ConvertOverlayTransform(
+	uint8_t *aDst, uint32_t aDstStride, const uint8_t *aOverlay, const uint8_t *aUnder, uint32_t aSrcStride,
+	int32_t aWidth, int32_t aHeight, const overlay_t *aParams, transform_t aTransform, uint8_t *aBand
+);
+
+/*
+ * Copies aRows rows of aBytes out of the framebuffer into plain memory with the widest aligned loads of the kernel
+ * set, 64 bytes per step with the lines ahead prefetched, so uncached or write-combined memory is read in bursts
+ * instead of one bus access per converted pixel. Strides are in bytes, whole frames with packed rows go in one run.
+ */
+void ConvertCopy(uint8_t *aDst, uint32_t aDstStride, const uint8_t *aSrc, uint32_t aSrcStride, uint32_t aBytes, int32_t aRows);
+
+/* Name of the kernel set selected at compile time: "avx2", "sse2", "neon" or "scalar". */
+const char *ConvertBackend(void);
+
+#endif /* !CONVERT_H */
@@ -0,0 +1,230 @@
+/* C */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* POSIX */
+#include <unistd.h>
+
+/* Local */
+#include "delta.h"
+#include "fdio.h"
+
+/*
+ * Records are written in host byte order, every MotoMAGX, EZX and x86 emulator target is little-endian.
+ */
+
+static uint32_t DeltaTileCount(const delta_header_t *aHeader) {
+	uint32_t lTilesX = (aHeader->width + aHeader->tile_size - 1) / aHeader->tile_size;
+	uint32_t lTilesY = (aHeader->height + aHeader->tile_size - 1) / aHeader->tile_size;
+	return lTilesX * lTilesY;
+}
+
+/* Largest payload: every tile changed, also enough for a key frame. */
+static uint32_t DeltaPayloadMax(const delta_header_t *aHeader, uint32_t aBytes) {
+	return DeltaTileCount(aHeader) * sizeof(uint16_t) * 2 + aBytes;
+}
+
+int32_t DeltaEncoderInit(delta_encoder_t *aEncoder, int32_t aWidth, int32_t aHeight, pixel_format_t aFormat, uint32_t aKeyInterval) {
+	memset(aEncoder, 0, sizeof(delta_encoder_t));
+	memcpy(aEncoder->header.magic, DELTA_MAGIC, sizeof(aEncoder->header.magic));
+	aEncoder->header.version = DELTA_VERSION;
+	aEncoder->header.tile_size = DELTA_TILE_SIZE;
+	aEncoder->header.width = aWidth;
+	aEncoder->header.height = aHeight;
+	aEncoder->header.pixel_format = aFormat;
+	aEncoder->header.bytes_per_pixel = PixelFormatBytes(aFormat);
+	aEncoder->stride = aWidth * aEncoder->header.bytes_per_pixel;
+	aEncoder->bytes = aEncoder->stride * aHeight;
+	aEncoder->key_interval = aKeyInterval;
+	aEncoder->previous = malloc(aEncoder->bytes);
+	aEncoder->buffer = malloc(sizeof(delta_frame_t) + DeltaPayloadMax(&aEncoder->header, aEncoder->bytes));
+	if (!aEncoder->previous || !aEncoder->buffer) {
+		DeltaEncoderFree(aEncoder);
+		return -1;
+	}
+	return 0;
+}
+
+int32_t DeltaWriteHeader(delta_encoder_t *aEncoder, int32_t aFd) {
+	return FdWriteAll(aFd, &aEncoder->header, sizeof(delta_header_t));
+}
+
+int32_t DeltaEncodeFrame(delta_encoder_t *aEncoder, int32_t aFd, const uint8_t *aFrame, uint32_t aTimeMs) {
+	delta_frame_t *lFrame = (delta_frame_t *) aEncoder->buffer;
+	uint8_t *lOut = aEncoder->buffer + sizeof(delta_frame_t);
+	const uint32_t lTile = aEncoder->header.tile_size;
+	const uint32_t lBpp = aEncoder->header.bytes_per_pixel;
+	uint32_t lTileX, lTileY, y;
+
+	lFrame->index = aEncoder->frames;
+	lFrame->time_ms = aTimeMs;
+	lFrame->tiles = 0;
+	if (!aEncoder->frames || (aEncoder->key_interval && !(aEncoder->frames % aEncoder->key_interval))) {
+		lFrame->type = DELTA_FRAME_KEY;
+		memcpy(lOut, aFrame, aEncoder->bytes);
+		memcpy(aEncoder->previous, aFrame, aEncoder->bytes);
+		lOut += aEncoder->bytes;
+	} else {
+		lFrame->type = DELTA_FRAME_TILES;
+		for (lTileY = 0; lTileY * lTile < aEncoder->header.height; ++lTileY)
+			for (lTileX = 0; lTileX * lTile < aEncoder->header.width; ++lTileX) {
+				uint32_t lRows = aEncoder->header.height - lTileY * lTile;
+				uint32_t lRowBytes = (aEncoder->header.width - lTileX * lTile) * lBpp;
+				uint32_t lOffset = lTileY * lTile * aEncoder->stride + lTileX * lTile * lBpp;
+				if (lRows > lTile)
+					lRows = lTile;
+				if (lRowBytes > lTile * lBpp)
+					lRowBytes = lTile * lBpp;
+
+				/* Most tiles are unchanged, memcmp() bails out on the first different row. */
+				for (y = 0; y < lRows; ++y)
+					if (memcmp(aEncoder->previous + lOffset + y * aEncoder->stride, aFrame + lOffset + y * aEncoder->stride, lRowBytes))
+						break;
+				if (y == lRows)
+					continue;
+
+				/* Tile records follow rows of any length, so the coordinates are stored byte by byte. */
+				lOut[0] = lTileX;
+				lOut[1] = lTileX >> 8;
+				lOut[2] = lTileY;
+				lOut[3] = lTileY >> 8;
+				lOut += sizeof(uint16_t) * 2;
+				for (y = 0; y < lRows; ++y, lOut += lRowBytes) {
+					memcpy(lOut, aFrame + lOffset + y * aEncoder->stride, lRowBytes);
+					memcpy(aEncoder->previous + lOffset + y * aEncoder->stride, lOut, lRowBytes);
+				}
+				++lFrame->tiles;
+			}
+	}
+	lFrame->payload = lOut - (aEncoder->buffer + sizeof(delta_frame_t));
+	++aEncoder->frames;
+	return FdWriteAll(aFd, aEncoder->buffer, lOut - aEncoder->buffer);
+}
+
+void DeltaEncoderFree(delta_encoder_t *aEncoder) {
+	free(aEncoder->previous);
+	free(aEncoder->buffer);
+	aEncoder->previous = aEncoder->buffer = NULL;
+}
+
+int32_t DeltaDecoderOpen(delta_decoder_t *aDecoder, int32_t aFd) {
+	delta_header_t *lHeader = &aDecoder->header;
+	memset(aDecoder, 0, sizeof(delta_decoder_t));
+	aDecoder->fd = aFd;
+	if (FdReadAll(aFd, lHeader, sizeof(delta_header_t)))
+		return -1;
+	if (
+		memcmp(lHeader->magic, DELTA_MAGIC, sizeof(lHeader->magic)) || lHeader->version != DELTA_VERSION ||
+		!lHeader->tile_size || !lHeader->width || !lHeader->height || lHeader->pixel_format > PIXEL_XRGB8888 ||
+		lHeader->bytes_per_pixel != PixelFormatBytes((pixel_format_t) lHeader->pixel_format)
+	)
+		return -1;
+	aDecoder->stride = lHeader->width * lHeader->bytes_per_pixel;
+	aDecoder->bytes = aDecoder->stride * lHeader->height;
+	aDecoder->canvas = calloc(1, aDecoder->bytes);
+	aDecoder->buffer = malloc(DeltaPayloadMax(lHeader, aDecoder->bytes));
+	if (!aDecoder->canvas || !aDecoder->buffer) {
+		DeltaDecoderFree(aDecoder);
+		return -1;
+	}
+	return 0;
+}
+
+static int32_t DeltaReadFrameHeader(delta_decoder_t *aDecoder) {
+	uint8_t *lData = (uint8_t *) &aDecoder->frame;
+	uint32_t lDone = 0;
+	while (lDone < sizeof(delta_frame_t)) {
+		ssize_t lResult = read(aDecoder->fd, lData + lDone, sizeof(delta_frame_t) - lDone);
+		if (lResult < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (lResult == 0)
+			return (lDone) ? -1 : 0;
+		lDone += lResult;
+	}
+	return (aDecoder->frame.payload > DeltaPayloadMax(&aDecoder->header, aDecoder->bytes)) ? -1 : 1;
+}
+
+int32_t DeltaSkipFrame(delta_decoder_t *aDecoder) {
+	int32_t lResult = DeltaReadFrameHeader(aDecoder);
+	if (lResult <= 0)
+		return lResult;
+	if (lseek(aDecoder->fd, aDecoder->frame.payload, SEEK_CUR) < 0)
+		return (FdReadAll(aDecoder->fd, aDecoder->buffer, aDecoder->frame.payload)) ? -1 : 1;
+	return 1;
+}
+
+int32_t DeltaDecodeFrame(delta_decoder_t *aDecoder) {
+	const delta_frame_t *lFrame = &aDecoder->frame;
+	const uint32_t lTile = aDecoder->header.tile_size;
+	const uint32_t lBpp = aDecoder->header.bytes_per_pixel;
+	const uint8_t *lIn = aDecoder->buffer, *lEnd;
+	uint32_t i, y;
+	int32_t lResult = DeltaReadFrameHeader(aDecoder);
+	if (lResult <= 0)
+		return lResult;
+	if (FdReadAll(aDecoder->fd, aDecoder->buffer, lFrame->payload))
+		return -1;
+	lEnd = lIn + lFrame->payload;
+
+	if (lFrame->type == DELTA_FRAME_KEY) {
+		if (lFrame->payload != aDecoder->bytes)
+			return -1;
+		memcpy(aDecoder->canvas, lIn, aDecoder->bytes);
+		return 1;
+	}
+	for (i = 0; i < lFrame->tiles; ++i) {
+		uint32_t lTileX, lTileY, lRows, lRowBytes, lOffset;
+		if (lIn + sizeof(uint16_t) * 2 > lEnd)
+			return -1;
+		lTileX = lIn[0] | lIn[1] << 8;
+		lTileY = lIn[2] | lIn[3] << 8;
+		lIn += sizeof(uint16_t) * 2;
+		if (lTileX * lTile >= aDecoder->header.width || lTileY * lTile >= aDecoder->header.height)
+			return -1;
+		lRows = aDecoder->header.height - lTileY * lTile;
+		lRowBytes = (aDecoder->header.width - lTileX * lTile) * lBpp;
+		if (lRows > lTile)
+			lRows = lTile;
+		if (lRowBytes > lTile * lBpp)
+			lRowBytes = lTile * lBpp;
+		if (lIn + lRows * lRowBytes > lEnd)
+			return -1;
+		lOffset = lTileY * lTile * aDecoder->stride + lTileX * lTile * lBpp;
+		for (y = 0; y < lRows; ++y, lIn += lRowBytes)
+			memcpy(aDecoder->canvas + lOffset + y * aDecoder->stride, lIn, lRowBytes);
+	}
+	return 1;
+}
+
+int32_t DeltaSeekFrame(delta_decoder_t *aDecoder, uint32_t aIndex) {
+	const off_t lFirst = sizeof(delta_header_t);
+	int32_t lResult;
+	if (lseek(aDecoder->fd, lFirst, SEEK_SET) == lFirst) {
+		/* Walk the frame headers only and restart decoding from the last key frame before aIndex. */
+		off_t lKey = -1, lPosition = lFirst;
+		while ((lResult = DeltaSkipFrame(aDecoder)) == 1 && aDecoder->frame.index <= aIndex) {
+			if (aDecoder->frame.type == DELTA_FRAME_KEY)
+				lKey = lPosition;
+			lPosition = lseek(aDecoder->fd, 0, SEEK_CUR);
+		}
+		if (lResult < 0)
+			return -1;
+		if (lKey < 0 || lseek(aDecoder->fd, lKey, SEEK_SET) != lKey)
+			return 0;
+	}
+	while ((lResult = DeltaDecodeFrame(aDecoder)) == 1)
+		if (aDecoder->frame.index >= aIndex)
+			return (aDecoder->frame.index == aIndex) ? 1 : 0;
+	return lResult;
+}
+
+void DeltaDecoderFree(delta_decoder_t *aDecoder) {
+	free(aDecoder->canvas);
+	free(aDecoder->buffer);
+	aDecoder->canvas = aDecoder->buffer = NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+/* C */
+#include <stdint.h>
+
+/* Local */
+#include "convert.h"
+
+/*
+ * Dirty-tile screen recording: a file header, then frames which are either a full key frame or the list of
+ * tiles that changed since the previous frame. All fields are little-endian.
+ *
+ *   delta_header_t
+ *   delta_frame_t + payload    key frame: width * height * bytes_per_pixel bytes of raw framebuffer
+ *   delta_frame_t + payload    tile frame: "tiles" records of uint16_t tile_x, uint16_t tile_y and the tile rows,
+ *   ...                        tiles on the right and bottom edges are clipped to the frame
+ */
+#define DELTA_MAGIC         "MGXD"
+#define DELTA_VERSION       (1)
+#define DELTA_TILE_SIZE     (16)
+#define DELTA_FRAME_KEY     (0)
+#define DELTA_FRAME_TILES   (1)
+
+#pragma pack(push, 1)
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t tile_size;
+	uint16_t width;
+	uint16_t height;
+	uint16_t pixel_format; /* pixel_format_t */
+	uint16_t bytes_per_pixel;
+} delta_header_t;
+
+typedef struct {
+	uint32_t index;
+	uint32_t time_ms; /* Since the first frame. */
+	uint32_t payload; /* Bytes after this header. */
+	uint16_t type;
+	uint16_t tiles;
+} delta_frame_t;
+#pragma pack(pop)
+
+typedef struct {
+	delta_header_t header;
+	uint32_t stride;
+	uint32_t bytes;
+	uint32_t key_interval;
+	uint32_t frames;
+	uint8_t *previous;
+	uint8_t *buffer;
+} delta_encoder_t;
+
+typedef struct {
+	delta_header_t header;
+	delta_frame_t frame;
+	uint32_t stride;
+	uint32_t bytes;
+	int32_t fd;
+	uint8_t *canvas;
+	uint8_t *buffer;
+} delta_decoder_t;
+
+/* A key frame is forced every aKeyInterval frames, 0 means only the first one. Returns 0 or -1 if out of memory. */
+int32_t DeltaEncoderInit(delta_encoder_t *aEncoder, int32_t aWidth, int32_t aHeight, pixel_format_t aFormat, uint32_t aKeyInterval);
+int32_t DeltaWriteHeader(delta_encoder_t *aEncoder, int32_t aFd);
+/* Compares aFrame against the previous one tile by tile and writes one frame record, no memory is allocated. */
+int32_t DeltaEncodeFrame(delta_encoder_t *aEncoder, int32_t aFd, const uint8_t *aFrame, uint32_t aTimeMs);
+void DeltaEncoderFree(delta_encoder_t *aEncoder);
+
+/* Reads and checks the file header. Returns 0 or -1 on a bad header or if out of memory. */
+int32_t DeltaDecoderOpen(delta_decoder_t *aDecoder, int32_t aFd);
+/* Reads the next frame header only and skips its payload, the canvas is left as is. Returns 1, 0 at the end or -1. */
+int32_t DeltaSkipFrame(delta_decoder_t *aDecoder);
+/* Applies the next frame to the canvas. Returns 1, 0 at the end or -1. */
+int32_t DeltaDecodeFrame(delta_decoder_t *aDecoder);
+/* Rebuilds frame aIndex in the canvas, starting from the closest key frame when the input is seekable. Returns 1, 0 or -1. */
+int32_t DeltaSeekFrame(delta_decoder_t *aDecoder, uint32_t aIndex);
+void DeltaDecoderFree(delta_decoder_t *aDecoder);
+
+#endif /* !DELTA_H */
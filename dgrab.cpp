@@ -1,13 +1,35 @@
 // C
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Qt
 #include <qapplication.h>
 #include <qpixmap.h>
 #include <qwidget.h>
 
+// Local
+#include "qtagent.h"
+
+// Defines
+#define DGRAB_FIFO "/tmp/dgrab.fifo"
+
+static bool GrabDesktop(QPixmap *aPixmap, void *) {
+	bitBlt(aPixmap, 0, 0, QApplication::desktop(), 0, 0, aPixmap->width(), aPixmap->height(), Qt::CopyROP, true);
+	return true;
+}
+
 int main(int argc, char *argv[]) {
+	if (argc >= 2 && argc <= 4 && !strcmp("--agent", argv[1])) {
+		QApplication app(argc, argv);
+		QPixmap::setDefaultOptimization(QPixmap::BestOptim);
+		QPixmap screenPixmap(QApplication::desktop()->width(), QApplication::desktop()->height(), -1, QPixmap::BestOptim);
+		return AgentRun(&app, DGRAB_FIFO, GrabDesktop, NULL, &screenPixmap, (argc >= 3) ? argv[2] : NULL, (argc == 4) ? atoi(argv[3]) : -1);
+	}
 	if (argc >= 2 && argc <= 3) {
+		int result = AgentRequest(DGRAB_FIFO, argv[1], (argc == 3) ? atoi(argv[2]) : -1);
+		if (result >= 0)
+			return result;
 		QApplication app(argc, argv);
 		QPixmap::setDefaultOptimization(QPixmap::BestOptim);
 		QPixmap fullScreenPixmap = QPixmap::grabWindow(QApplication::desktop()->winId());
@@ -19,12 +41,18 @@ int main(int argc, char *argv[]) {
 		fprintf(
 			stderr,
 			"Usage:\n"
-			"\tdgrab screenshot.<format> <quality 0-100>\n\n"
+			"\tdgrab screenshot.<format> <quality 0-100>\n"
+			"\tdgrab --agent [screenshot.<format> [quality 0-100]]\n\n"
+			"Agent:\n"
+			"\t--agent keeps Qt running and takes screenshots on demand. While it runs, \"dgrab screenshot.<format>\"\n"
+			"\tasks it through " DGRAB_FIFO " instead of starting Qt, SIGUSR1 saves to the file given to --agent.\n"
+			"\tSIGINT or SIGTERM stops it.\n\n"
 			"Example:\n"
 			"\tdgrab screenshot.png\n"
 			"\tdgrab screenshot.bmp\n"
 			"\tdgrab screenshot.jpeg 100\n"
 			"\tdgrab screenshot.jpeg 25\n"
+			"\tdgrab --agent /tmp/last.png &\n"
 		);
 	return 0;
 }
@@ -0,0 +1,412 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "convert.h"
+#include "fdio.h"
+#include "jpegwrite.h"
+#include "parallel.h"
+#include "pngwrite.h"
+#include "profile.h"
+#include "rawdump.h"
+#include "stats.h"
+#include "timing.h"
+
+/*
+ * Offline converter for raw dumps taken on the handset: every thread takes the next file from a shared queue, so
+ * many small dumps keep all cores busy. Dumps with a "fbdump --header" header describe themselves, headerless ones
+ * use the --device profile and may hold several frames back to back.
+ */
+
+/* Defines */
+#define FBCONV_PATH_MAX     (256)
+
+typedef enum {
+	FBCONV_BMP,
+	FBCONV_PNG,
+	FBCONV_JPEG
+} fbconv_format_t;
+
+typedef struct {
+	char **files;
+	int32_t count;
+	int32_t next;
+	pthread_mutex_t lock;
+	fbconv_format_t format;
+	int32_t level;             /* PNG compression or JPEG quality. */
+	int32_t palette;           /* Indexed PNGs for images of up to 256 colors. */
+	transform_t transform;     /* Orientation of the images. */
+	const char *directory;     /* Output directory or NULL for next to the dump. */
+	const display_t *fallback; /* Layout of headerless dumps. */
+} fbconv_queue_t;
+
+typedef struct {
+	fbconv_queue_t *queue;
+	uint8_t *frame;
+	uint32_t frame_capacity;
+	uint8_t *bitmap;
+	uint32_t bitmap_capacity;
+	uint8_t *band;
+	uint32_t band_capacity;
+	uint8_t *packed;
+	uint32_t packed_capacity;
+	uint8_t *indices;
+	uint32_t indices_capacity;
+	png_palette_t colors;
+	jpeg_encoder_t jpeg;
+	int32_t jpeg_width;
+	int32_t jpeg_height;
+	uint32_t errors;
+	stats_t stats;
+} fbconv_worker_t;
+
+static const char *g_extensions[] = { ".bmp", ".png", ".jpg" };
+
+static int32_t ErrUsage(void) {
+	fprintf(
+		stderr,
+		"Usage:\n"
+		"\t./fbconv [--format bmp|png|jpg] [--level L] [--palette] [--rotate degrees] [--mirror] [--out directory]\n"
+		"\t         [--threads N] [--device profile] [--stats] <dump> [<dump> ...]\n\n"
+		"Converts raw framebuffer dumps in parallel, one file per thread at a time. Dumps written with\n"
+		"\"fbdump --header\" carry their geometry, pixel format and checksum, \"fbdump --compress\" ones are\n"
+		"unpacked on the way. Headerless dumps use the --device profile:\n"
+		"\t" PROFILE_NAMES " (default " DEVICE_PROFILE ", auto is not available here).\n"
+		"A dump with several frames gives numbered images: shot.raw becomes shot_0000.png, shot_0001.png, ...\n\n"
+		"\t--format     - output format (default png)\n"
+		"\t--level      - PNG compression 0-9 (default 6) or JPEG quality 0-100 (default 85)\n"
+		"\t--palette    - 1, 2, 4 or 8-bit indexed PNGs for images of at most 256 colors, RGB otherwise\n"
+		"\t--rotate     - turn the images clockwise by 90, 180 or 270 degrees while they are converted\n"
+		"\t--mirror     - mirror them left to right after the turn\n"
+		"\t--out        - write the images there instead of next to the dumps\n"
+		"\t--threads    - worker threads, default one per CPU\n\n"
+		"--stats prints stage times and counters to stderr as one JSON line.\n\n"
+		"Example:\n"
+		"\t./fbconv screen.mgxr\n"
+		"\t./fbconv --palette --out images dumps/*.mgxr\n"
+		"\t./fbconv --format jpg --level 90 --out images dumps/*.mgxr\n"
+		"\t./fbconv --device e680 --format bmp e680.raw\n"
+		"\t./fbconv --rotate 90 --out images dumps/*.mgxr\n"
+	);
+	return 1;
+}
+
+static int32_t ErrFile(const char *aFileName, const char *aMode) {
+	fprintf(stderr, "Cannot open '%s' file for %s.\n", aFileName, aMode);
+	return 1;
+}
+
+static int32_t ErrProfile(const char *aProfile) {
+	fprintf(stderr, "Error: unknown or unsupported device profile '%s'!\n", aProfile);
+	return 1;
+}
+
+/* Returns 0 or -1 if out of memory, buffers only grow. */
+static int32_t Reserve(uint8_t **aBuffer, uint32_t *aCapacity, uint32_t aBytes) {
+	uint8_t *lBuffer;
+	if (aBytes <= *aCapacity)
+		return 0;
+	if (!(lBuffer = realloc(*aBuffer, aBytes)))
+		return -1;
+	*aBuffer = lBuffer;
+	*aCapacity = aBytes;
+	return 0;
+}
+
+/* "dumps/shot.raw" becomes "<directory>/shot_0003.png", the index is left out for single frame dumps. */
+static void FormatImageName(char *aName, const fbconv_queue_t *aQueue, const char *aDump, int32_t aIndex) {
+	const char *lBase = strrchr(aDump, '/');
+	const char *lExtension;
+	int32_t lDirectory, lStem;
+
+	lBase = (lBase) ? lBase + 1 : aDump;
+	lExtension = strrchr(lBase, '.');
+	lStem = (lExtension && lExtension != lBase) ? (int32_t) (lExtension - lBase) : (int32_t) strlen(lBase);
+	lDirectory = (aQueue->directory) ? 0 : (int32_t) (lBase - aDump);
+	if (aIndex < 0)
+		snprintf(
+			aName, FBCONV_PATH_MAX, "%s%s%.*s%.*s%s", (aQueue->directory) ? aQueue->directory : "", (aQueue->directory) ? "/" : "",
+			lDirectory, aDump, lStem, lBase, g_extensions[aQueue->format]
+		);
+	else
+		snprintf(
+			aName, FBCONV_PATH_MAX, "%s%s%.*s%.*s_%04d%s", (aQueue->directory) ? aQueue->directory : "", (aQueue->directory) ? "/" : "",
+			lDirectory, aDump, lStem, lBase, aIndex, g_extensions[aQueue->format]
+		);
+}
+
+static int32_t WriteImage(fbconv_worker_t *aWorker, const char *aName, const display_t *aDisplay) {
+	const fbconv_queue_t *lQueue = aWorker->queue;
+	const int32_t lWidth = (TRANSFORM_TRANSPOSED(lQueue->transform)) ? aDisplay->height : aDisplay->width;
+	const int32_t lHeight = (TRANSFORM_TRANSPOSED(lQueue->transform)) ? aDisplay->width : aDisplay->height;
+	const pixel_format_t lFormat = (lQueue->format == FBCONV_BMP) ? PIXEL_BGR888 : PIXEL_RGB888;
+	uint64_t lBegin;
+	int32_t lError = 0, lIndexed = 0;
+
+	if (Reserve(&aWorker->bitmap, &aWorker->bitmap_capacity, aDisplay->size * 3))
+		return -1;
+	lBegin = StatsBegin(&aWorker->stats);
+	if (!lQueue->transform)
+		DisplayConvert(aDisplay, aWorker->bitmap, lFormat, aWorker->frame);
+	else if (
+		Reserve(&aWorker->band, &aWorker->band_capacity, CONVERT_BAND_BYTES(aDisplay->width, 3)) || ConvertTransform(
+			aWorker->bitmap, lWidth * 3, lFormat, aWorker->frame, aDisplay->stride, aDisplay->format, aDisplay->width, aDisplay->height,
+			lQueue->transform, aWorker->band
+		)
+	)
+		return -1;
+	if (lQueue->format == FBCONV_PNG && lQueue->palette && !Reserve(&aWorker->indices, &aWorker->indices_capacity, aDisplay->size))
+		lIndexed = !PngPaletteBuild(&aWorker->colors, aWorker->indices, aWorker->bitmap, lWidth * 3, lWidth, lHeight);
+	StatsEnd(&aWorker->stats, STATS_CONVERT, lBegin);
+
+	FILE *lImageFile = fopen(aName, "wb");
+	if (!lImageFile)
+		return -1;
+	StatsBuffer(&aWorker->stats, lImageFile, aDisplay->size * 3);
+	lBegin = StatsBegin(&aWorker->stats);
+	if (lQueue->format == FBCONV_BMP)
+		lError = BmpWrite(lImageFile, aWorker->bitmap, lWidth * 3, lWidth, lHeight, 24, NULL);
+	else if (lIndexed)
+		lError = PngWriteIndexed(lImageFile, &aWorker->colors, aWorker->indices, lWidth, lHeight, lQueue->level);
+	else if (lQueue->format == FBCONV_PNG)
+		lError = PngWrite(lImageFile, aWorker->bitmap, lWidth * 3, lWidth, lHeight, lQueue->level);
+	else {
+		/* The compressor is kept while the geometry stays the same. */
+		if (aWorker->jpeg_width != lWidth || aWorker->jpeg_height != lHeight) {
+			JpegEncoderFree(&aWorker->jpeg);
+			aWorker->jpeg_width = aWorker->jpeg_height = 0;
+			if (JpegEncoderInit(&aWorker->jpeg, lWidth, lHeight, lQueue->level))
+				lError = -1;
+			else {
+				aWorker->jpeg_width = lWidth;
+				aWorker->jpeg_height = lHeight;
+			}
+		}
+		if (!lError) {
+			JpegEncodeFrame(&aWorker->jpeg, aWorker->bitmap, lWidth * 3);
+			if (fwrite(aWorker->jpeg.buffer, aWorker->jpeg.size, 1, lImageFile) != 1)
+				lError = -1;
+		}
+	}
+	StatsEnd(&aWorker->stats, STATS_ENCODE, lBegin);
+	if (StatsFlush(&aWorker->stats, lImageFile))
+		lError = -1;
+	if (fclose(lImageFile))
+		lError = -1;
+	++aWorker->stats.frames;
+	return lError;
+}
+
+/* Reads the payload of the next frame into the worker buffer. Returns 0 or -1. */
+static int32_t ReadFrame(fbconv_worker_t *aWorker, int32_t aFd, uint32_t aBytes) {
+	uint64_t lBegin = StatsBegin(&aWorker->stats);
+	if (Reserve(&aWorker->frame, &aWorker->frame_capacity, aBytes) || FdReadAll(aFd, aWorker->frame, aBytes))
+		return -1;
+	StatsEnd(&aWorker->stats, STATS_READ, lBegin);
+	aWorker->stats.bytes_read += aBytes;
+	return 0;
+}
+
+/* Same for a frame with a header, packed frames are unpacked as part of the read. */
+static int32_t ReadRecord(fbconv_worker_t *aWorker, int32_t aFd, const rawdump_header_t *aHeader) {
+	uint64_t lBegin = StatsBegin(&aWorker->stats);
+	if (
+		Reserve(&aWorker->frame, &aWorker->frame_capacity, aHeader->bytes) ||
+		Reserve(&aWorker->packed, &aWorker->packed_capacity, aHeader->stored) ||
+		RawDumpReadPayload(aFd, aHeader, aWorker->frame, aWorker->packed)
+	)
+		return -1;
+	StatsEnd(&aWorker->stats, STATS_READ, lBegin);
+	aWorker->stats.bytes_read += aHeader->stored;
+	return 0;
+}
+
+static void ConvertDump(fbconv_worker_t *aWorker, const char *aDump) {
+	const display_t *lFallback = aWorker->queue->fallback;
+	char lName[FBCONV_PATH_MAX];
+	char lMagic[sizeof(RAWDUMP_MAGIC) - 1];
+	rawdump_header_t lHeader;
+	display_t lDisplay;
+	struct stat lStat;
+	int32_t lFd, lResult, lStream = 0, lIndex = 0, lFrames, i;
+
+	if ((lFd = open(aDump, O_RDONLY)) < 0 || fstat(lFd, &lStat)) {
+		ErrFile(aDump, "read");
+		++aWorker->errors;
+		if (lFd >= 0)
+			close(lFd);
+		return;
+	}
+
+	if (read(lFd, lMagic, sizeof(lMagic)) == sizeof(lMagic) && !memcmp(lMagic, RAWDUMP_MAGIC, sizeof(lMagic))) {
+		lseek(lFd, 0, SEEK_SET);
+		while ((lResult = RawDumpReadHeader(lFd, &lHeader)) == 1) {
+			/* More than one record makes a stream, its images are numbered. */
+			if (!lIndex)
+				lStream = lStat.st_size > (off_t) lHeader.header_size + lHeader.stored;
+			if (RawDumpDisplay(&lHeader, &lDisplay)) {
+				fprintf(stderr, "Error: '%s' has pixel format %u, it cannot be converted!\n", aDump, lHeader.pixel_format);
+				++aWorker->errors;
+				break;
+			}
+			if (ReadRecord(aWorker, lFd, &lHeader)) {
+				lResult = -1;
+				break;
+			}
+			if (RawDumpVerify(&lHeader, aWorker->frame)) {
+				fprintf(stderr, "Error: frame %d of '%s' fails its checksum!\n", lIndex, aDump);
+				++aWorker->errors;
+			} else {
+				FormatImageName(lName, aWorker->queue, aDump, (lStream) ? lIndex : -1);
+				if (WriteImage(aWorker, lName, &lDisplay)) {
+					ErrFile(lName, "write");
+					++aWorker->errors;
+				}
+			}
+			++lIndex;
+		}
+		if (lResult < 0) {
+			fprintf(stderr, "Error: '%s' is not a supported dump!\n", aDump);
+			++aWorker->errors;
+		}
+	} else if (!lStat.st_size || lStat.st_size % lFallback->bytes) {
+		fprintf(stderr, "Error: '%s' has no header and does not fit the %s profile!\n", aDump, lFallback->name);
+		++aWorker->errors;
+	} else {
+		lseek(lFd, 0, SEEK_SET);
+		lFrames = lStat.st_size / lFallback->bytes;
+		for (i = 0; i < lFrames; ++i) {
+			if (ReadFrame(aWorker, lFd, lFallback->bytes)) {
+				ErrFile(aDump, "read");
+				++aWorker->errors;
+				break;
+			}
+			FormatImageName(lName, aWorker->queue, aDump, (lFrames > 1) ? i : -1);
+			if (WriteImage(aWorker, lName, lFallback)) {
+				ErrFile(lName, "write");
+				++aWorker->errors;
+			}
+		}
+	}
+	close(lFd);
+}
+
+static void *ConvertWorker(void *aArg) {
+	fbconv_worker_t *lWorker = (fbconv_worker_t *) aArg;
+	fbconv_queue_t *lQueue = lWorker->queue;
+	int32_t lNext;
+	for (;;) {
+		pthread_mutex_lock(&lQueue->lock);
+		lNext = lQueue->next++;
+		pthread_mutex_unlock(&lQueue->lock);
+		if (lNext >= lQueue->count)
+			return NULL;
+		ConvertDump(lWorker, lQueue->files[lNext]);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int32_t i;
+	const char *lProfile = DEVICE_PROFILE;
+	int32_t lThreads = ParallelCpus(), lLevel = -1, lDegrees = 0, lMirror = 0, lStatsEnabled = 0;
+	fbconv_queue_t lQueue;
+	memset(&lQueue, 0, sizeof(fbconv_queue_t));
+	lQueue.format = FBCONV_PNG;
+	lQueue.files = argv + 1;
+	/* Dumps are packed to the front of argv as the options are taken out. */
+	for (i = 1; i < argc; ++i) {
+		if (!strcmp("--format", argv[i]) && i + 1 < argc) {
+			++i;
+			if (!strcmp("bmp", argv[i]))
+				lQueue.format = FBCONV_BMP;
+			else if (!strcmp("png", argv[i]))
+				lQueue.format = FBCONV_PNG;
+			else if (!strcmp("jpg", argv[i]) || !strcmp("jpeg", argv[i]))
+				lQueue.format = FBCONV_JPEG;
+			else
+				return ErrUsage();
+		} else if (!strcmp("--level", argv[i]) && i + 1 < argc)
+			lLevel = atoi(argv[++i]);
+		else if (!strcmp("--palette", argv[i]))
+			lQueue.palette = 1;
+		else if (!strcmp("--rotate", argv[i]) && i + 1 < argc)
+			lDegrees = atoi(argv[++i]);
+		else if (!strcmp("--mirror", argv[i]))
+			lMirror = 1;
+		else if (!strcmp("--out", argv[i]) && i + 1 < argc)
+			lQueue.directory = argv[++i];
+		else if (!strcmp("--threads", argv[i]) && i + 1 < argc)
+			lThreads = atoi(argv[++i]);
+		else if (!strcmp("--device", argv[i]) && i + 1 < argc)
+			lProfile = argv[++i];
+		else if (!strcmp("--stats", argv[i]))
+			lStatsEnabled = 1;
+		else if (argv[i][0] == '-')
+			return ErrUsage();
+		else
+			lQueue.files[lQueue.count++] = argv[i];
+	}
+	if (!lQueue.count || ConvertGetTransform(lDegrees, lMirror, &lQueue.transform))
+		return ErrUsage();
+	if (lLevel < 0)
+		lLevel = (lQueue.format == FBCONV_JPEG) ? 85 : 6;
+	lQueue.level = lLevel;
+
+	display_t lFallback;
+	if (ProfileLoad(&lFallback, lProfile, -1))
+		return ErrProfile(lProfile);
+	lQueue.fallback = &lFallback;
+
+	if (lThreads < 1)
+		lThreads = 1;
+	if (lThreads > lQueue.count)
+		lThreads = lQueue.count;
+	fbconv_worker_t *lWorkers = calloc(lThreads, sizeof(fbconv_worker_t));
+	if (!lWorkers) {
+		fprintf(stderr, "Cannot allocate %d workers.\n", lThreads);
+		return 1;
+	}
+
+	stats_t lStats;
+	StatsInit(&lStats, "fbconv", lStatsEnabled);
+	lStats.device = lFallback.name;
+	for (i = 0; i < lThreads; ++i) {
+		lWorkers[i].queue = &lQueue;
+		StatsInit(&lWorkers[i].stats, "fbconv", lStatsEnabled);
+	}
+
+	uint64_t lStart = TimeMonotonicUs();
+	pthread_mutex_init(&lQueue.lock, NULL);
+	ParallelRun(lWorkers, sizeof(fbconv_worker_t), lThreads, ConvertWorker);
+	pthread_mutex_destroy(&lQueue.lock);
+
+	uint32_t lErrors = 0;
+	for (i = 0; i < lThreads; ++i) {
+		StatsMerge(&lStats, &lWorkers[i].stats);
+		lErrors += lWorkers[i].errors;
+		JpegEncoderFree(&lWorkers[i].jpeg);
+		free(lWorkers[i].frame);
+		free(lWorkers[i].bitmap);
+		free(lWorkers[i].band);
+		free(lWorkers[i].packed);
+		free(lWorkers[i].indices);
+	}
+	free(lWorkers);
+
+	fprintf(
+		stderr, "Converted %u frames of %d dumps on %d threads in %llu ms, %u errors.\n",
+		lStats.frames, lQueue.count, lThreads, (unsigned long long) ((TimeMonotonicUs() - lStart) / 1000), lErrors
+	);
+	StatsPrint(&lStats, lErrors);
+	return (lErrors) ? 1 : 0;
+}
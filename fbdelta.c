@@ -0,0 +1,141 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "convert.h"
+#include "delta.h"
+#include "fdio.h"
+#include "pngwrite.h"
+
+static int32_t ErrUsage(void) {
+	fprintf(
+		stderr,
+		"Usage:\n"
+		"\t./fbdelta <recording> info\n"
+		"\t./fbdelta <recording> <frame|all> <BMP or PNG image file> [compression 0-9]\n\n"
+		"Rebuilds frames of a \"fbdump -delta\" recording, \"all\" needs one %%d, %%u or %%04d in the image file name.\n\n"
+		"Example:\n"
+		"\t./fbdelta record.fbd info\n"
+		"\t./fbdelta record.fbd 25 frame25.png 6\n"
+		"\t./fbdelta record.fbd 0 stdout > frame0.bmp\n"
+		"\t./fbdelta record.fbd all frame%%04d.bmp\n"
+	);
+	return 1;
+}
+
+static int32_t ErrFile(const char *aFileName, const char *aMode) {
+	fprintf(stderr, "Cannot open '%s' file for %s.\n", aFileName, aMode);
+	return 1;
+}
+
+static int32_t PrintInfo(delta_decoder_t *aDecoder) {
+	int32_t lResult;
+	uint64_t lBytes = sizeof(delta_header_t);
+	printf(
+		"%ux%u, pixel format %u, %u bytes per pixel, %ux%u tiles\n",
+		aDecoder->header.width, aDecoder->header.height, aDecoder->header.pixel_format,
+		aDecoder->header.bytes_per_pixel, aDecoder->header.tile_size, aDecoder->header.tile_size
+	);
+	while ((lResult = DeltaSkipFrame(aDecoder)) == 1) {
+		const delta_frame_t *lFrame = &aDecoder->frame;
+		printf(
+			"frame %u: %u ms, %s, %u tiles, %u bytes\n", lFrame->index, lFrame->time_ms,
+			(lFrame->type == DELTA_FRAME_KEY) ? "key" : "delta", lFrame->tiles, lFrame->payload
+		);
+		lBytes += sizeof(delta_frame_t) + lFrame->payload;
+	}
+	printf("%llu bytes\n", (unsigned long long) lBytes);
+	return (lResult < 0) ? 1 : 0;
+}
+
+static int32_t WriteFrame(delta_decoder_t *aDecoder, const char *aFileName, int32_t aCompression, uint8_t *aBitmap) {
+	const int32_t lWidth = aDecoder->header.width, lHeight = aDecoder->header.height;
+	const char *lExtension = strrchr(aFileName, '.');
+	int32_t lPng = lExtension && (!strcmp(".png", lExtension) || !strcmp(".PNG", lExtension));
+	int32_t lError;
+
+	FILE *lImageFile = NULL;
+	if (!strcmp("stdout", aFileName))
+		lImageFile = stdout;
+	else
+		lImageFile = fopen(aFileName, "wb");
+	if (!lImageFile)
+		return ErrFile(aFileName, "write");
+
+	ConvertFrame(
+		aBitmap, lWidth * 3, (lPng) ? PIXEL_RGB888 : PIXEL_BGR888,
+		aDecoder->canvas, aDecoder->stride, (pixel_format_t) aDecoder->header.pixel_format,
+		lWidth, lHeight
+	);
+	if (lPng)
+		lError = PngWrite(lImageFile, aBitmap, lWidth * 3, lWidth, lHeight, aCompression);
+	else
+		lError = BmpWrite(lImageFile, aBitmap, lWidth * 3, lWidth, lHeight, 24, NULL);
+	fclose(lImageFile);
+	return (lError) ? ErrFile(aFileName, "write") : 0;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3 || argc > 5 || (strcmp("info", argv[2]) && argc < 4))
+		return ErrUsage();
+	char lName[256];
+	if (!strcmp("all", argv[2]) && FdFrameName(lName, sizeof(lName), argv[3], 0))
+		return ErrUsage();
+
+	int32_t lFd = open(argv[1], O_RDONLY);
+	if (lFd < 0)
+		return ErrFile(argv[1], "read");
+
+	delta_decoder_t lDecoder;
+	if (DeltaDecoderOpen(&lDecoder, lFd)) {
+		fprintf(stderr, "Error: '%s' is not a supported recording!\n", argv[1]);
+		return 1;
+	}
+	if (!ConvertGetRow((pixel_format_t) lDecoder.header.pixel_format, PIXEL_BGR888)) {
+		fprintf(stderr, "Error: pixel format %u is not supported!\n", lDecoder.header.pixel_format);
+		return 1;
+	}
+
+	int32_t lError = 0, lResult = 0;
+	int32_t lCompression = (argc == 5) ? atoi(argv[4]) : 6;
+	uint8_t *lBitmap = malloc(lDecoder.header.width * lDecoder.header.height * 3);
+	if (!lBitmap) {
+		fprintf(stderr, "Error: cannot allocate %ux%u frame!\n", lDecoder.header.width, lDecoder.header.height);
+		DeltaDecoderFree(&lDecoder);
+		close(lFd);
+		return 1;
+	}
+	if (!strcmp("info", argv[2]))
+		lError = PrintInfo(&lDecoder);
+	else if (!strcmp("all", argv[2])) {
+		while (!lError && (lResult = DeltaDecodeFrame(&lDecoder)) == 1) {
+			FdFrameName(lName, sizeof(lName), argv[3], lDecoder.frame.index);
+			lError = WriteFrame(&lDecoder, lName, lCompression, lBitmap);
+		}
+		if (lResult < 0) {
+			fprintf(stderr, "Error: '%s' recording is corrupted!\n", argv[1]);
+			lError = 1;
+		}
+	} else {
+		lResult = DeltaSeekFrame(&lDecoder, atoi(argv[2]));
+		if (lResult == 1)
+			lError = WriteFrame(&lDecoder, argv[3], lCompression, lBitmap);
+		else {
+			fprintf(stderr, "Error: frame %s is %s!\n", argv[2], (lResult) ? "corrupted" : "not in the recording");
+			lError = 1;
+		}
+	}
+	free(lBitmap);
+	DeltaDecoderFree(&lDecoder);
+	close(lFd);
+
+	return lError;
+}
@@ -1,63 +1,122 @@
+/* splice() */
+#define _GNU_SOURCE
+
 /* C */
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 
 /* POSIX */
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/mman.h>
-#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <pthread.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "convert.h"
+#include "delta.h"
+#include "fdio.h"
+#include "magxgrab.h"
+#include "profile.h"
+#include "rawdump.h"
+#include "scale.h"
+#include "stats.h"
+#include "timing.h"
 
 /* Defines */
-#define SCR_WIDTH           (240)
-#define SCR_HEIGHT          (320)
-#define BI_BITFIELDS        (0x03)
+#define FRAME_RING_SIZE     (4)
+#define FRAME_NAME_MAX      (256)
 
+/* Preallocated frames shared by the capture loop and the writer thread. */
 typedef struct {
-	int32_t width;
-	int32_t height;
-	uint32_t size;
-	uint32_t depth;
-	uint8_t bpp;
-	uint32_t bytes;
-} display_t;
-
-/* See: https://en.wikipedia.org/wiki/BMP_file_format */
-#pragma pack(push, 1)
+	uint8_t *frames[FRAME_RING_SIZE];
+	uint32_t slots;
+	uint32_t times[FRAME_RING_SIZE];
+	uint32_t captured;
+	uint32_t written;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} frame_ring_t;
+
 typedef struct {
-	/* Bitmap file header */
-	uint16_t file_magic;
-	uint32_t file_size;
-	uint32_t bytes_reserved;
-	uint32_t bitmap_start;
-	/* DIB header (bitmap information header) */
-	uint32_t dib_header_size;
-	int32_t bitmap_width;
-	int32_t bitmap_height;
-	uint16_t color_planes;
-	uint16_t bitmap_bpp;
-	uint32_t compression_method;
-	uint32_t bitmap_size;
-	int32_t bitmap_width_ppm;
-	int32_t bitmap_height_ppm;
-	uint32_t num_of_colors;
-	uint32_t num_of_important_colors;
-} bmp_header_t;
-#pragma pack(pop)
+	const display_t *display;         /* The dumped image, cropped to rect. */
+	const grab_rect_t *rect;
+	transform_t transform;            /* -bmp24 orientation. */
+	const char *mode;
+	const char *path;
+	int32_t stream_fd;
+	uint32_t frames;
+	uint8_t *bitmap;
+	uint8_t *band;                    /* ConvertTransform() band of a turned -bmp24 burst. */
+	int32_t error;
+	frame_ring_t ring;
+	delta_encoder_t delta;
+	const rawdump_header_t *header;   /* Raw frame header template or NULL. */
+	int32_t checksum;
+	rawdump_compression_t compression;
+	uint8_t *packed;
+	uint64_t epoch_us;                /* Wall clock at the start of the burst. */
+	stats_t stats;   /* Writer thread side, merged after the join. */
+} burst_t;
 
 static int32_t ErrUsage(void) {
 	fprintf(
 		stderr,
 		"Usage:\n"
-		"\t./fbdump <device> <dumpfile> <bpp>\n\n"
+		"\t./fbdump <device> <dumpfile> <bpp> [-bmp16|-bmp24|-raw|-rawcopy|-delta] [--burst N] [--interval ms] [--stream]\n"
+		"\t         [--header] [--crc] [--compress rle|lz] [--rect x,y,w,h] [--rotate degrees] [--mirror]\n"
+		"\t         [--thumb file] [--thumb-size size] [--direct] [--device profile] [--stats]\n\n"
+		"Profiles: " PROFILE_NAMES " (default " DEVICE_PROFILE "), <bpp> picks the profile of the same\n"
+		"\tgeometry with that depth, 16 is E680 RGB565 on MotoMAGX. Raw dumps work for any <bpp>.\n\n"
+		"Modes:\n"
+		"\t-raw     - zero-copy raw dump (default), reports the framebuffer read time\n"
+		"\t-rawcopy - raw dump through a heap copy, reports the framebuffer read time\n"
+		"\t-delta   - burst only, dirty-tile recording with a key frame every --keyint frames (default 0, first only)\n"
+		"\t           use ./fbdelta to extract frames as BMP or PNG images\n\n"
+		"Raw header:\n"
+		"\t--header  - start raw dumps with a header of geometry, pixel format, layer and capture time,\n"
+		"\t            every frame of a --stream gets one, use ./fbconv to convert them on a build host\n"
+		"\t--crc     - add a CRC-32 of the frame to the header, implies --header, -raw copies the frame first\n"
+		"\t--compress - pack frames with pixel runs (rle) or LZ4 blocks (lz) to write less to flash, implies --header\n"
+		"\t            and copies the frame first, frames that do not shrink are stored as they are\n\n"
+		"Burst:\n"
+		"\t--burst N      - capture N frames keeping the framebuffer mapped\n"
+		"\t--interval ms  - time between frame starts, 0 is as fast as possible (default)\n"
+		"\t--stream       - concatenate frames into <dumpfile> instead of numbered files\n"
+		"\tNumbered files insert _0000, _0001, ... before the extension or use one %%d, %%u or %%04d.\n\n"
+		"Region:\n"
+		"\t--rect x,y,w,h - dump only this rectangle with packed rows, in every mode and frame of a burst,\n"
+		"\t                 -raw stays zero-copy for full width rectangles and copies the others\n\n"
+		"Orientation:\n"
+		"\t--rotate degrees  - -bmp24 only, turn the image clockwise by 90, 180 or 270 degrees while it is converted\n"
+		"\t--mirror          - -bmp24 only, mirror it left to right after the turn\n\n"
+		"Thumbnail:\n"
+		"\t--thumb file      - -bmp24 only, also write a reduced BMP image, made in the same pass as the full one\n"
+		"\t--thumb-size size - 1/N of the screen or WxH, a 0 side keeps the aspect ratio (default 1/4)\n\n"
+		"Snapshot:\n"
+		"\t--direct          - -bmp16 and -bmp24 convert straight from the framebuffer instead of a snapshot copied\n"
+		"\t                    out first, for the smallest heap\n\n"
+		"--stats prints stage times and counters to stderr as one JSON line, read_us is the copy of the frame.\n\n"
 		"Example:\n"
 		"\t./fbdump /dev/fb/0 screenshot.bmp 16 -bmp16\n"
-		"\t./fbdump /dev/fb/0 screenshot.bmp 16 -bmp24\n\n"
+		"\t./fbdump /dev/fb/0 screenshot.bmp 16 -bmp24\n"
+		"\t./fbdump /dev/fb/0 screenshot.bmp 24 -bmp24 --thumb thumbnail.bmp --thumb-size 1/2\n"
+		"\t./fbdump /dev/fb/0 landscape.bmp 24 -bmp24 --rotate 90\n\n"
 		"\t./fbdump /dev/fb/0 screenshot.raw 16\n"
 		"\t./fbdump /dev/fb/1 screenshot.raw 24\n"
 		"\t./fbdump /dev/fb/0 stdout 24 > screenshot.raw\n"
+		"\t./fbdump /dev/fb/0 stdout 24 -raw | gzip > screenshot.raw.gz\n"
+		"\t./fbdump /dev/fb/1 frame.bmp 24 -bmp24 --burst 50 --interval 40\n"
+		"\t./fbdump /dev/fb/1 anim.raw 24 --burst 100 --stream\n"
+		"\t./fbdump /dev/fb/1 screen.mgxr 24 --header --crc\n"
+		"\t./fbdump /dev/fb/1 statusbar.mgxr 24 --header --rect 0,0,240,24\n"
+		"\t./fbdump /dev/fb/1 anim.mgxr 24 --burst 100 --stream --compress lz\n"
+		"\t./fbdump /dev/fb/1 record.fbd 24 -delta --burst 1000 --interval 100 --keyint 100\n"
 	);
 	return 1;
 }
@@ -67,108 +126,461 @@ static int32_t ErrFile(const char *aFileName, const char *aMode) {
 	return 1;
 }
 
+static int32_t ErrDepth(const display_t *aDisplay) {
+	fprintf(stderr, "Error: BMP support for %d-bit depth not yet implemented!\n", aDisplay->depth);
+	return 1;
+}
+
+static int32_t ErrRect(const display_t *aDisplay) {
+	fprintf(stderr, "Error: the rectangle must lie inside the %dx%d screen!\n", aDisplay->width, aDisplay->height);
+	return 1;
+}
+
+static int32_t ErrProfile(const char *aProfile) {
+	fprintf(stderr, "Error: unknown or unsupported device profile '%s'!\n", aProfile);
+	return 1;
+}
+
 /* See https://github.com/iven/e680_fb2bmp/blob/master/src/main.c */
-static void WriteBmpHeader16(FILE *aWriteFile, const display_t *aDisplay) {
-	bmp_header_t lBmpHeader;
-	memset(&lBmpHeader, 0, sizeof(bmp_header_t));
-	lBmpHeader.file_magic = 0x4D42;
-	lBmpHeader.file_size = aDisplay->bytes + 14 + 40 + sizeof(uint32_t) * 3;
-	lBmpHeader.bitmap_start = 0x00000036;
-	lBmpHeader.dib_header_size = 0x00000028;
-	lBmpHeader.bitmap_width = aDisplay->width;
-	lBmpHeader.bitmap_height = aDisplay->height;
-	lBmpHeader.color_planes = 0x0001;
-	lBmpHeader.bitmap_bpp = aDisplay->depth;
-	lBmpHeader.compression_method = BI_BITFIELDS;
-	lBmpHeader.bitmap_size = aDisplay->bytes;
-	fwrite(&lBmpHeader, sizeof(bmp_header_t), 1, aWriteFile);
-}
-
-static void WriteBmpBitmap16(FILE *aWriteFile, const display_t *aDisplay, const uint8_t *aDump) {
-	if (aDisplay->depth == 16) {
-		/* RGB565 */
-		uint32_t mask_565[3] = { 0xF800, 0x07E0, 0x001F };
-		fwrite(mask_565, sizeof(uint32_t), 3, aWriteFile);
-		int32_t y, x;
-		uint16_t *lPixelPtr = (uint16_t *) aDump;
-		for (y = aDisplay->height - 1; y >= 0; --y)
-			for (x = 0; x < aDisplay->width; ++x) {
-				uint16_t lPixel = lPixelPtr[x + y * aDisplay->width];
-				fwrite(&lPixel, aDisplay->bpp, 1, aWriteFile);
-			}
-	} else
-		fprintf(stderr, "Error: BMP support for %d-bit depth not yet implemented!\n", aDisplay->depth);
-}
-
-static void WriteBmpHeader(FILE *aWriteFile, const display_t *aDisplay) {
-	bmp_header_t lBmpHeader;
-	memset(&lBmpHeader, 0, sizeof(bmp_header_t));
-	lBmpHeader.file_magic = 0x4D42;
-	lBmpHeader.file_size = aDisplay->size * 3 + 14 + 40;
-	lBmpHeader.bitmap_start = 0x00000036;
-	lBmpHeader.dib_header_size = 0x00000028;
-	lBmpHeader.bitmap_width = aDisplay->width;
-	lBmpHeader.bitmap_height = aDisplay->height;
-	lBmpHeader.color_planes = 0x0001;
-	lBmpHeader.bitmap_bpp = 24;
-	lBmpHeader.bitmap_size = aDisplay->size * 3;
-	fwrite(&lBmpHeader, sizeof(bmp_header_t), 1, aWriteFile);
-}
-
-static void WriteBmpBitmap(FILE *aWriteFile, const display_t *aDisplay, const uint8_t *aDump) {
-	if (aDisplay->depth == 16) {
-		int32_t y, x;
-		uint16_t *lPixelPtr = (uint16_t *) aDump;
-		for (y = aDisplay->height - 1; y >= 0; --y)
-			for (x = 0; x < aDisplay->width; ++x) {
-				uint16_t lPixel = lPixelPtr[x + y * aDisplay->width];
-
-				/* RGB565 => RGB888 */
-				uint8_t r = ((lPixel & 0xF800) >> 11) << 3;
-				uint8_t g = ((lPixel & 0x7E0) >> 5) << 2;
-				uint8_t b = (lPixel & 0x1F) << 3;
-
-				uint32_t lBmpPixel = r << 16 | g << 8 | b;
-				fwrite(&lBmpPixel, 3, 1, aWriteFile);
-			}
+static int32_t WriteBmpBitmap16(int32_t aFd, const display_t *aDisplay, const uint8_t *aDump) {
+	static const uint32_t mask_565[3] = { 0xF800, 0x07E0, 0x001F };
+	static const uint32_t mask_555[3] = { 0x7C00, 0x03E0, 0x001F };
+	return BmpWriteFd(
+		aFd, aDump, aDisplay->stride, aDisplay->width, aDisplay->height, 16,
+		(aDisplay->format == PIXEL_RGB555) ? mask_555 : mask_565
+	);
+}
+
+/*
+ * Burst frames are copies in the ring, aBitmapBgr888 is a scratch buffer of aDisplay->size * 3 bytes and aBand the
+ * band of a turn.
+ */
+static int32_t WriteBmpBitmap(
+	int32_t aFd, const display_t *aDisplay, const uint8_t *aDump, uint8_t *aBitmapBgr888, transform_t aTransform, uint8_t *aBand,
+	stats_t *aStats
+) {
+	const int32_t lWidth = (TRANSFORM_TRANSPOSED(aTransform)) ? aDisplay->height : aDisplay->width;
+	const int32_t lHeight = (TRANSFORM_TRANSPOSED(aTransform)) ? aDisplay->width : aDisplay->height;
+	uint64_t lBegin = StatsBegin(aStats);
+	int32_t lError;
+	if (aTransform) {
+		if (ConvertTransform(
+			aBitmapBgr888, lWidth * 3, PIXEL_BGR888, aDump, aDisplay->stride, aDisplay->format, aDisplay->width, aDisplay->height,
+			aTransform, aBand
+		))
+			return -1;
 	} else
-		fprintf(stderr, "Error: BMP support for %d-bit depth not yet implemented!\n", aDisplay->depth);
+		DisplayConvert(aDisplay, aBitmapBgr888, PIXEL_BGR888, aDump);
+	StatsEnd(aStats, STATS_CONVERT, lBegin);
+	lBegin = StatsBegin(aStats);
+	lError = BmpWriteFd(aFd, aBitmapBgr888, lWidth * 3, lWidth, lHeight, 24, NULL);
+	StatsEnd(aStats, STATS_WRITE, lBegin);
+	return lError;
+}
+
+/* The checksum and the packing are reported as encode, aPacked of RawDumpPackBound() bytes is only used to pack. */
+static int32_t WriteRawRecord(
+	int32_t aFd, rawdump_header_t *aHeader, const uint8_t *aFrame, int32_t aChecksum, rawdump_compression_t aCompression,
+	uint8_t *aPacked, stats_t *aStats
+) {
+	uint64_t lBegin = StatsBegin(aStats);
+	const uint8_t *lData;
+	int32_t lError;
+	if (aChecksum)
+		RawDumpSetChecksum(aHeader, aFrame);
+	lData = RawDumpPack(aHeader, aFrame, aPacked, aCompression);
+	StatsEnd(aStats, STATS_ENCODE, lBegin);
+	lBegin = StatsBegin(aStats);
+	lError = RawDumpWrite(aFd, aHeader, lData);
+	StatsEnd(aStats, STATS_WRITE, lBegin);
+	return lError;
+}
+
+static int32_t ErrOpen(const char *aDevice, const char *aProfile, int32_t aError) {
+	if (aError == GRAB_ERROR_PROFILE)
+		return ErrProfile(aProfile);
+	return ErrFile(aDevice, (aError == GRAB_ERROR_MMAP) ? "mmap" : "read");
+}
+
+/* "/dev/fb/1" is layer 1, devices not ending in a digit are unknown. */
+static uint16_t DeviceLayer(const char *aDevice) {
+	const size_t lLength = strlen(aDevice);
+	if (lLength && aDevice[lLength - 1] >= '0' && aDevice[lLength - 1] <= '9')
+		return aDevice[lLength - 1] - '0';
+	return RAWDUMP_LAYER_UNKNOWN;
 }
 
-static uint8_t *CreateDumpFromFile(uint8_t *a_fb_mmap, const display_t *aDisplay) {
+/* aDisplay is the aRect part of the screen, only its framebuffer rows and columns are read. */
+static uint8_t *CreateDumpFromFile(const magxgrab_t *aGrab, const display_t *aDisplay, const grab_rect_t *aRect) {
 	uint8_t *lBitmap = malloc(aDisplay->bytes);
-	memcpy(lBitmap, a_fb_mmap, aDisplay->bytes);
+	if (lBitmap && GrabCapture(aGrab, lBitmap, aDisplay->stride, aGrab->display.format, aRect)) {
+		free(lBitmap);
+		return NULL;
+	}
 	return lBitmap;
 }
 
-static void CreateDumpFromFb(FILE *aOutPutDumpFile, const display_t *aDisplay, uint8_t *aDump) {
-	fwrite(aDump, sizeof(char), aDisplay->bytes, aOutPutDumpFile);
+static int32_t CreateDumpFromFb(FILE *aOutPutDumpFile, const display_t *aDisplay, uint8_t *aDump) {
+	return (fwrite(aDump, sizeof(char), aDisplay->bytes, aOutPutDumpFile) != aDisplay->bytes) ? -1 : 0;
+}
+
+/*
+ * Raw dump of aBytes from aStart without an intermediate buffer: splice() into pipes and sendfile() into files let
+ * the kernel move the framebuffer pages, devices which refuse both are written straight from the mapping.
+ * Returns the name of the method which finished the transfer or NULL on write error.
+ */
+static const char *WriteDumpFromFb(int32_t aOutFd, int32_t a_fb_fd, const uint8_t *a_fb_mmap, uint32_t aStart, uint32_t aBytes) {
+	struct stat lStat;
+	off_t lOffset = aStart;
+	uint32_t lDone = 0;
+	ssize_t lResult;
+
+	if (!fstat(aOutFd, &lStat) && S_ISFIFO(lStat.st_mode)) {
+#if defined(SPLICE_F_MOVE)
+		while (lDone < aBytes && (lResult = splice(a_fb_fd, &lOffset, aOutFd, NULL, aBytes - lDone, SPLICE_F_MOVE)) > 0)
+			lDone += lResult;
+		if (lDone == aBytes)
+			return "splice";
+#endif
+	} else {
+		while (lDone < aBytes && (lResult = sendfile(aOutFd, a_fb_fd, &lOffset, aBytes - lDone)) > 0)
+			lDone += lResult;
+		if (lDone == aBytes)
+			return "sendfile";
+	}
+
+	return (FdWriteAll(aOutFd, a_fb_mmap + aStart + lDone, aBytes - lDone)) ? NULL : "write";
+}
+
+/* "shot.bmp" becomes "shot_0007.bmp", a path with an index pattern like "shot-%03d.bmp" goes to FdFrameName(). */
+static int32_t FormatFrameName(char *aName, const char *aPath, uint32_t aIndex) {
+	const char *lExtension = strrchr(aPath, '.');
+	if (strchr(aPath, '%'))
+		return FdFrameName(aName, FRAME_NAME_MAX, aPath, aIndex);
+	else if (lExtension && !strchr(lExtension, '/'))
+		snprintf(aName, FRAME_NAME_MAX, "%.*s_%04u%s", (int) (lExtension - aPath), aPath, aIndex, lExtension);
+	else
+		snprintf(aName, FRAME_NAME_MAX, "%s_%04u", aPath, aIndex);
+	return 0;
+}
+
+/* Delta frames compare and write in one pass, their time is reported as encode. */
+static int32_t WriteBurstFrame(burst_t *aBurst, uint32_t aIndex, const uint8_t *aFrame, uint32_t aTimeMs) {
+	char lName[FRAME_NAME_MAX];
+	int32_t lError, lFd = aBurst->stream_fd;
+	uint64_t lBegin;
+	if (lFd < 0) {
+		if (FormatFrameName(lName, aBurst->path, aIndex))
+			return ErrFile(aBurst->path, "write");
+		lFd = open(lName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (lFd < 0)
+			return ErrFile(lName, "write");
+	}
+	if (!strcmp("-bmp24", aBurst->mode))
+		lError = WriteBmpBitmap(lFd, aBurst->display, aFrame, aBurst->bitmap, aBurst->transform, aBurst->band, &aBurst->stats);
+	else if (aBurst->header) {
+		rawdump_header_t lHeader = *aBurst->header;
+		lHeader.time_us = aBurst->epoch_us + (uint64_t) aTimeMs * 1000;
+		lError = WriteRawRecord(lFd, &lHeader, aFrame, aBurst->checksum, aBurst->compression, aBurst->packed, &aBurst->stats);
+	} else {
+		lBegin = StatsBegin(&aBurst->stats);
+		if (!strcmp("-delta", aBurst->mode))
+			lError = DeltaEncodeFrame(&aBurst->delta, lFd, aFrame, aTimeMs);
+		else if (!strcmp("-bmp16", aBurst->mode))
+			lError = WriteBmpBitmap16(lFd, aBurst->display, aFrame);
+		else
+			lError = FdWriteAll(lFd, aFrame, aBurst->display->bytes);
+		StatsEnd(&aBurst->stats, (!strcmp("-delta", aBurst->mode)) ? STATS_ENCODE : STATS_WRITE, lBegin);
+	}
+	if (aBurst->stream_fd < 0) {
+		StatsOutput(&aBurst->stats, lFd);
+		close(lFd);
+	}
+	return lError;
+}
+
+static void *BurstWriterThread(void *aArg) {
+	burst_t *lBurst = (burst_t *) aArg;
+	frame_ring_t *lRing = &lBurst->ring;
+	uint32_t i;
+	int32_t lError;
+	/* The first failed frame ends the writer, the capture loop sees the error and stops too. */
+	for (i = 0; i < lBurst->frames && !lBurst->error; ++i) {
+		pthread_mutex_lock(&lRing->lock);
+		while (lRing->captured <= i)
+			pthread_cond_wait(&lRing->cond, &lRing->lock);
+		pthread_mutex_unlock(&lRing->lock);
+
+		lError = WriteBurstFrame(lBurst, i, lRing->frames[i % lRing->slots], lRing->times[i % lRing->slots]);
+
+		pthread_mutex_lock(&lRing->lock);
+		lBurst->error = lError;
+		lRing->written = i + 1;
+		pthread_cond_signal(&lRing->cond);
+		pthread_mutex_unlock(&lRing->lock);
+	}
+	return NULL;
+}
+
+static void BurstFree(burst_t *aBurst) {
+	uint32_t i;
+	for (i = 0; i < aBurst->ring.slots; ++i)
+		free(aBurst->ring.frames[i]);
+	free(aBurst->bitmap);
+	free(aBurst->band);
+	free(aBurst->packed);
+	DeltaEncoderFree(&aBurst->delta);
+}
+
+/*
+ * Burst capture: the framebuffer stays mapped and frames are copied into a ring of preallocated buffers on the
+ * capture schedule while a writer thread empties it, so a slow output only stalls capture when the ring is full.
+ * Nothing is allocated per frame.
+ */
+static int32_t RunBurst(burst_t *aBurst, const magxgrab_t *aGrab, uint32_t aInterval, uint32_t aKeyInterval, stats_t *aStats) {
+	frame_ring_t *lRing = &aBurst->ring;
+	pthread_t lWriter;
+	uint32_t i;
+	uint64_t lStart, lLate = 0;
+	int32_t lError = 0;
+
+	lRing->slots = (aBurst->frames < FRAME_RING_SIZE) ? aBurst->frames : FRAME_RING_SIZE;
+	lRing->captured = lRing->written = 0;
+	for (i = 0; i < lRing->slots; ++i)
+		if (!(lRing->frames[i] = malloc(aBurst->display->bytes)))
+			lError = 1;
+	if (!strcmp("-bmp24", aBurst->mode) && !(aBurst->bitmap = malloc(aBurst->display->size * 3)))
+		lError = 1;
+	if (aBurst->transform && !(aBurst->band = malloc(CONVERT_BAND_BYTES(aBurst->display->width, 3))))
+		lError = 1;
+	if (aBurst->compression && !(aBurst->packed = malloc(RawDumpPackBound(aBurst->header))))
+		lError = 1;
+	if (!strcmp("-delta", aBurst->mode)) {
+		/* Padded lines are recorded as extra columns, MotoMAGX and EZX framebuffers have none. */
+		const display_t *lDisplay = aBurst->display;
+		if (DeltaEncoderInit(&aBurst->delta, lDisplay->stride / lDisplay->bpp, lDisplay->height, lDisplay->format, aKeyInterval))
+			lError = 1;
+	}
+	if (lError) {
+		fprintf(stderr, "Cannot allocate %u frame buffers.\n", lRing->slots);
+		BurstFree(aBurst);
+		return 1;
+	}
+	if (!strcmp("-delta", aBurst->mode) && DeltaWriteHeader(&aBurst->delta, aBurst->stream_fd)) {
+		BurstFree(aBurst);
+		return ErrFile(aBurst->path, "write");
+	}
+	pthread_mutex_init(&lRing->lock, NULL);
+	pthread_cond_init(&lRing->cond, NULL);
+	if (pthread_create(&lWriter, NULL, BurstWriterThread, aBurst)) {
+		fprintf(stderr, "Cannot start the burst writer thread.\n");
+		pthread_cond_destroy(&lRing->cond);
+		pthread_mutex_destroy(&lRing->lock);
+		BurstFree(aBurst);
+		return 1;
+	}
+
+	aBurst->epoch_us = TimeRealtimeUs();
+	lStart = TimeMonotonicUs();
+	for (i = 0; i < aBurst->frames; ++i) {
+		uint64_t lDeadline = lStart + (uint64_t) i * aInterval * 1000;
+		uint64_t lNow = TimeMonotonicUs();
+		if (lNow < lDeadline) {
+			struct timespec lSleep;
+			lSleep.tv_sec = (lDeadline - lNow) / 1000000;
+			lSleep.tv_nsec = (lDeadline - lNow) % 1000000 * 1000;
+			nanosleep(&lSleep, NULL);
+		} else if (aInterval && lNow - lDeadline > (uint64_t) aInterval * 1000)
+			++lLate;
+
+		pthread_mutex_lock(&lRing->lock);
+		while (!aBurst->error && lRing->captured - lRing->written == lRing->slots)
+			pthread_cond_wait(&lRing->cond, &lRing->lock);
+		lError = aBurst->error;
+		pthread_mutex_unlock(&lRing->lock);
+		if (lError)
+			break;
+
+		lNow = StatsBegin(aStats);
+		GrabCapture(aGrab, lRing->frames[i % lRing->slots], aBurst->display->stride, aGrab->display.format, aBurst->rect);
+		StatsEnd(aStats, STATS_READ, lNow);
+		aStats->bytes_read += aBurst->display->bytes;
+		++aStats->frames;
+		lRing->times[i % lRing->slots] = (TimeMonotonicUs() - lStart) / 1000;
+
+		pthread_mutex_lock(&lRing->lock);
+		lRing->captured = i + 1;
+		pthread_cond_signal(&lRing->cond);
+		pthread_mutex_unlock(&lRing->lock);
+	}
+	pthread_join(lWriter, NULL);
+	StatsMerge(aStats, &aBurst->stats);
+
+	lStart = TimeMonotonicUs() - lStart;
+	fprintf(
+		stderr, "Burst: %u frames in %llu ms, %llu late.\n",
+		lRing->captured, (unsigned long long) (lStart / 1000), (unsigned long long) lLate
+	);
+
+	pthread_cond_destroy(&lRing->cond);
+	pthread_mutex_destroy(&lRing->lock);
+	BurstFree(aBurst);
+	return aBurst->error;
 }
 
 int main(int argc, char *argv[]) {
-	if (argc < 4 || argc > 5)
+	int32_t i;
+	if (argc < 4)
+		return ErrUsage();
+
+	const char *lMode = "", *lProfile = DEVICE_PROFILE, *lThumbPath = NULL, *lThumbSize = "1/4";
+	uint32_t lBurst = 0, lInterval = 0, lKeyInterval = 0;
+	int32_t lStream = 0, lStatsEnabled = 0, lHeader = 0, lChecksum = 0, lDirect = 0;
+	rawdump_compression_t lCompression = RAWDUMP_STORE;
+	grab_rect_t lRegion, *lRegionArg = NULL;
+	int32_t lDegrees = 0, lMirror = 0;
+	transform_t lTransform;
+	for (i = 4; i < argc; ++i) {
+		if (!strcmp("--device", argv[i]) && i + 1 < argc)
+			lProfile = argv[++i];
+		else if (!strcmp("--rotate", argv[i]) && i + 1 < argc)
+			lDegrees = atoi(argv[++i]);
+		else if (!strcmp("--mirror", argv[i]))
+			lMirror = 1;
+		else if (!strcmp("--rect", argv[i]) && i + 1 < argc) {
+			if (GrabParseRect(argv[++i], &lRegion))
+				return ErrUsage();
+			lRegionArg = &lRegion;
+		}
+		else if (!strcmp("--burst", argv[i]) && i + 1 < argc)
+			lBurst = atoi(argv[++i]);
+		else if (!strcmp("--interval", argv[i]) && i + 1 < argc)
+			lInterval = atoi(argv[++i]);
+		else if (!strcmp("--keyint", argv[i]) && i + 1 < argc)
+			lKeyInterval = atoi(argv[++i]);
+		else if (!strcmp("--stream", argv[i]))
+			lStream = 1;
+		else if (!strcmp("--header", argv[i]))
+			lHeader = 1;
+		else if (!strcmp("--crc", argv[i]))
+			lHeader = lChecksum = 1;
+		else if (!strcmp("--compress", argv[i]) && i + 1 < argc) {
+			++i;
+			if (!strcmp("rle", argv[i]))
+				lCompression = RAWDUMP_RLE;
+			else if (!strcmp("lz", argv[i]))
+				lCompression = RAWDUMP_LZ;
+			else
+				return ErrUsage();
+			lHeader = 1;
+		}
+		else if (!strcmp("--thumb", argv[i]) && i + 1 < argc)
+			lThumbPath = argv[++i];
+		else if (!strcmp("--thumb-size", argv[i]) && i + 1 < argc)
+			lThumbSize = argv[++i];
+		else if (!strcmp("--stats", argv[i]))
+			lStatsEnabled = 1;
+		else if (!strcmp("--direct", argv[i]))
+			lDirect = 1;
+		else if (
+			!lMode[0] &&
+			(!strcmp("-bmp16", argv[i]) || !strcmp("-bmp24", argv[i]) || !strcmp("-raw", argv[i]) || !strcmp("-rawcopy", argv[i]) ||
+			!strcmp("-delta", argv[i]))
+		)
+			lMode = argv[i];
+		else
+			return ErrUsage();
+	}
+	int32_t lReport = !strcmp("-raw", lMode) || !strcmp("-rawcopy", lMode);
+	if (lHeader && strcmp("", lMode) && !lReport)
+		return ErrUsage();
+	if (lThumbPath && (strcmp("-bmp24", lMode) || lBurst))
+		return ErrUsage();
+	if (ConvertGetTransform(lDegrees, lMirror, &lTransform) || (lTransform && strcmp("-bmp24", lMode)))
 		return ErrUsage();
+	/* The checksum and the packer need a frame that does not change under them, so they work on a copy. */
+	if ((lChecksum || lCompression) && strcmp("-rawcopy", lMode))
+		lMode = "-rawcopy";
 
-	display_t lScreen;
-	lScreen.width = SCR_WIDTH;
-	lScreen.height = SCR_HEIGHT;
-	lScreen.size = lScreen.height * lScreen.width;
-	lScreen.depth = atoi(argv[3]);
-	lScreen.bpp = lScreen.depth / 8;
-	lScreen.bytes = lScreen.size * lScreen.bpp;
+	stats_t lStats;
+	StatsInit(&lStats, "fbdump", lStatsEnabled);
+	uint64_t lBegin = StatsBegin(&lStats);
+	magxgrab_t lGrab;
+	int32_t lOpened = GrabOpen(&lGrab, argv[1], lProfile, atoi(argv[3]));
+	if (lOpened)
+		return ErrOpen(argv[1], lProfile, lOpened);
+	/* From here on lScreen is the dumped image, a rectangle comes out with packed rows. */
+	grab_rect_t lRect;
+	display_t lScreen = lGrab.display;
+	if (GrabRect(&lGrab, lRegionArg, &lRect))
+		return ErrRect(&lScreen);
+	if (lRegionArg)
+		DisplayCrop(&lScreen, lRect.width, lRect.height);
+	/* Zero-copy needs the rectangle to be one contiguous run of the framebuffer. */
+	if (lScreen.stride != lGrab.display.stride && (!strcmp("", lMode) || !strcmp("-raw", lMode)))
+		lMode = "-rawcopy";
+	int32_t lKnownFormat = !lGrab.raw_only;
+	lStats.device = lScreen.name;
+	StatsEnd(&lStats, STATS_OPEN, lBegin);
 
-	int32_t fb_fd = open(argv[1], O_RDONLY);
-	if (fb_fd == EXIT_FAILURE)
-		return ErrFile(argv[1], "read");
+	if (!strcmp("-bmp24", lMode) && !lKnownFormat)
+		return ErrDepth(&lScreen);
+	if (!strcmp("-bmp16", lMode) && (!lKnownFormat || lScreen.depth != 16))
+		return ErrDepth(&lScreen);
+	if (!strcmp("-delta", lMode)) {
+		if (!lBurst || !lKnownFormat)
+			return ErrUsage();
+		/* A recording is always a single file. */
+		lStream = 1;
+	}
 
-	uint8_t *fb_mmap = (uint8_t *) mmap(NULL, lScreen.bytes, PROT_READ, MAP_SHARED, fb_fd, 0);
-	if (fb_mmap == MAP_FAILED)
-		return ErrFile(argv[1], "mmap");
+	scale_t lThumb;
+	uint8_t *lThumbBitmap = NULL;
+	int32_t lThumbWidth, lThumbHeight;
+	if (lThumbPath) {
+		/* The thumbnail is made of the turned image. */
+		const int32_t lWidth = (TRANSFORM_TRANSPOSED(lTransform)) ? lScreen.height : lScreen.width;
+		const int32_t lHeight = (TRANSFORM_TRANSPOSED(lTransform)) ? lScreen.width : lScreen.height;
+		if (ScaleParseSize(lThumbSize, lWidth, lHeight, &lThumbWidth, &lThumbHeight))
+			return ErrUsage();
+		lThumbBitmap = malloc(lThumbWidth * lThumbHeight * 3);
+		if (!lThumbBitmap || ScaleInit(&lThumb, lWidth, lHeight, lThumbBitmap, lThumbWidth * 3, lThumbWidth, lThumbHeight))
+			return ErrFile(lThumbPath, "write");
+	}
 
-	uint8_t *lDump = CreateDumpFromFile(fb_mmap, &lScreen);
+	rawdump_header_t lRawHeader;
+	RawDumpHeaderInit(&lRawHeader, &lScreen, lKnownFormat, DeviceLayer(argv[1]), 0);
 
-	munmap(fb_mmap, lScreen.bytes);
-	close(fb_fd);
+	if (lBurst) {
+		char lName[FRAME_NAME_MAX];
+		if (!lStream && strchr(argv[2], '%') && FdFrameName(lName, FRAME_NAME_MAX, argv[2], 0))
+			return ErrUsage();
+		burst_t lBurstState;
+		memset(&lBurstState, 0, sizeof(burst_t));
+		lBurstState.display = &lScreen;
+		lBurstState.rect = &lRect;
+		lBurstState.transform = lTransform;
+		lBurstState.mode = lMode;
+		lBurstState.path = argv[2];
+		lBurstState.frames = lBurst;
+		lBurstState.stream_fd = -1;
+		lBurstState.header = (lHeader) ? &lRawHeader : NULL;
+		lBurstState.checksum = lChecksum;
+		lBurstState.compression = lCompression;
+		StatsInit(&lBurstState.stats, "fbdump", lStatsEnabled);
+		if (!strcmp("stdout", argv[2]))
+			lBurstState.stream_fd = STDOUT_FILENO;
+		else if (lStream && (lBurstState.stream_fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			return ErrFile(argv[2], "write");
+		int32_t lError = RunBurst(&lBurstState, &lGrab, lInterval, lKeyInterval, &lStats);
+		if (lBurstState.stream_fd >= STDOUT_FILENO)
+			StatsOutput(&lStats, lBurstState.stream_fd);
+		if (lBurstState.stream_fd > STDOUT_FILENO)
+			close(lBurstState.stream_fd);
+		GrabClose(&lGrab);
+		StatsPrint(&lStats, lError);
+		return (lError < 0) ? ErrFile(argv[2], "write") : lError;
+	}
 
 	FILE *lDumpFile = NULL;
 	if (!strcmp("stdout", argv[2]))
@@ -178,16 +590,112 @@ int main(int argc, char *argv[]) {
 	if (!lDumpFile)
 		return ErrFile(argv[2], "write");
 
-	if (argc == 5 && !strcmp("-bmp24", argv[4])) {
-		WriteBmpHeader(lDumpFile, &lScreen);
-		WriteBmpBitmap(lDumpFile, &lScreen, lDump);
-	} else if (argc == 5 && !strcmp("-bmp16", argv[4])) {
-		WriteBmpHeader16(lDumpFile, &lScreen);
-		WriteBmpBitmap16(lDumpFile, &lScreen, lDump);
-	} else
-		CreateDumpFromFb(lDumpFile, &lScreen, lDump);
-	free(lDump);
-	fclose(lDumpFile);
+	/* The BMP modes copy the rectangle out of the framebuffer in one burst first, unless --direct. */
+	magxgrab_t lSnapshot, *lSource = &lGrab;
+	const grab_rect_t *lSourceRect = &lRect;
+	if (GrabSetTransform(&lGrab, lTransform))
+		return ErrFile(argv[2], "write");
+	if (!lDirect && (!strcmp("-bmp24", lMode) || !strcmp("-bmp16", lMode))) {
+		if (GrabSnapshotInit(&lSnapshot, &lGrab, &lRect))
+			return ErrFile(argv[2], "write");
+		lSource = &lSnapshot;
+		lSourceRect = NULL;
+	}
 
-	return 0;
+	int32_t lError = 0;
+	const char *lMethod = "copy";
+	lBegin = StatsBegin(&lStats);
+	uint64_t lReadTime = TimeMonotonicUs();
+	lStats.bytes_read += lScreen.bytes;
+	lStats.frames = 1;
+	lRawHeader.time_us = TimeRealtimeUs();
+	if (!strcmp("", lMode) || !strcmp("-raw", lMode)) {
+		fflush(lDumpFile);
+		if (lHeader && RawDumpWrite(fileno(lDumpFile), &lRawHeader, NULL))
+			lMethod = NULL;
+		else
+			lMethod = WriteDumpFromFb(fileno(lDumpFile), lGrab.fd, lGrab.mmap, lRect.y * lScreen.stride, lScreen.bytes);
+		lReadTime = TimeMonotonicUs() - lReadTime;
+		StatsEnd(&lStats, STATS_WRITE, lBegin);
+		if (!lMethod)
+			lError = -1;
+	} else if (!strcmp("-bmp24", lMode)) {
+		/* Bands of the image are converted from the source straight into the file. */
+		grab_stream_t lStream;
+		GrabSnapshot(lSource);
+		StatsEnd(&lStats, STATS_READ, lBegin);
+		fflush(lDumpFile);
+		lBegin = StatsBegin(&lStats);
+		if (GrabStreamInit(&lStream, lSource, PIXEL_BGR888, lSourceRect, (lThumbPath) ? &lThumb : NULL))
+			lError = -1;
+		else
+			lError = GrabStreamBmp(&lStream, fileno(lDumpFile));
+		StatsEnd(&lStats, STATS_WRITE, lBegin);
+		StatsMove(&lStats, STATS_WRITE, STATS_CONVERT, lStream.convert_us);
+		GrabStreamFree(&lStream);
+	} else if (!strcmp("-bmp16", lMode)) {
+		/* The pixels are already in BMP order, the rows are written from the source. */
+		display_t lMapped = lScreen;
+		const uint8_t *lPixels = lSource->mmap;
+		lMapped.stride = lSource->display.stride;
+		if (lSourceRect)
+			lPixels += lRect.y * lMapped.stride + lRect.x * lMapped.bpp;
+		GrabSnapshot(lSource);
+		StatsEnd(&lStats, STATS_READ, lBegin);
+		fflush(lDumpFile);
+		lBegin = StatsBegin(&lStats);
+		lError = WriteBmpBitmap16(fileno(lDumpFile), &lMapped, lPixels);
+		StatsEnd(&lStats, STATS_WRITE, lBegin);
+	} else {
+		uint8_t *lDump = CreateDumpFromFile(&lGrab, &lScreen, &lRect);
+		lReadTime = TimeMonotonicUs() - lReadTime;
+		StatsEnd(&lStats, STATS_READ, lBegin);
+		fflush(lDumpFile);
+		lBegin = StatsBegin(&lStats);
+		if (!lDump)
+			lError = -1;
+		else if (lHeader) {
+			uint8_t *lPacked = (lCompression) ? malloc(RawDumpPackBound(&lRawHeader)) : NULL;
+			if (lCompression && !lPacked)
+				lError = -1;
+			else
+				lError = WriteRawRecord(fileno(lDumpFile), &lRawHeader, lDump, lChecksum, lCompression, lPacked, &lStats);
+			free(lPacked);
+		} else {
+			lError = CreateDumpFromFb(lDumpFile, &lScreen, lDump);
+			StatsEnd(&lStats, STATS_WRITE, lBegin);
+		}
+		free(lDump);
+	}
+	/* Under --stats the buffer holds the whole image, a short write only shows up here. */
+	if (StatsFlush(&lStats, lDumpFile) && !lError)
+		lError = -1;
+	if (fclose(lDumpFile) && !lError)
+		lError = -1;
+
+	if (lSource != &lGrab)
+		GrabClose(&lSnapshot);
+	GrabClose(&lGrab);
+
+	int32_t lThumbError = 0;
+	if (lThumbPath) {
+		int32_t lThumbFd = open(lThumbPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		lBegin = StatsBegin(&lStats);
+		lThumbError = lThumbFd < 0 || BmpWriteFd(lThumbFd, lThumbBitmap, lThumbWidth * 3, lThumbWidth, lThumbHeight, 24, NULL);
+		StatsEnd(&lStats, STATS_WRITE, lBegin);
+		if (lThumbFd >= 0) {
+			StatsOutput(&lStats, lThumbFd);
+			close(lThumbFd);
+		}
+		ScaleFree(&lThumb);
+		free(lThumbBitmap);
+	}
+
+	if (lReport && !lError)
+		fprintf(stderr, "Framebuffer read: %u bytes in %llu us (%s).\n", lScreen.bytes, (unsigned long long) lReadTime, lMethod);
+	StatsPrint(&lStats, lError || lThumbError);
+
+	if (lError)
+		return (lError < 0) ? ErrFile(argv[2], "write") : lError;
+	return (lThumbError) ? ErrFile(lThumbPath, "write") : 0;
 }
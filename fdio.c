@@ -0,0 +1,81 @@
+/* C */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+/* POSIX */
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* Local */
+#include "fdio.h"
+
+int32_t FdWriteAll(int32_t aFd, const void *aData, uint32_t aBytes) {
+	const uint8_t *lData = (const uint8_t *) aData;
+	while (aBytes > 0) {
+		ssize_t lResult = write(aFd, lData, aBytes);
+		if (lResult < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		lData += lResult;
+		aBytes -= lResult;
+	}
+	return 0;
+}
+
+int32_t FdReadAll(int32_t aFd, void *aData, uint32_t aBytes) {
+	uint8_t *lData = (uint8_t *) aData;
+	while (aBytes > 0) {
+		ssize_t lResult = read(aFd, lData, aBytes);
+		if (lResult < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (lResult == 0)
+			return -1;
+		lData += lResult;
+		aBytes -= lResult;
+	}
+	return 0;
+}
+
+int32_t FdWriteVector(int32_t aFd, struct iovec *aIov, int32_t aCount) {
+	while (aCount > 0) {
+		ssize_t lWritten = writev(aFd, aIov, aCount);
+		if (lWritten < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		/* Partial writes happen on pipes, skip what is done and retry the rest. */
+		while (aCount > 0 && (size_t) lWritten >= aIov->iov_len) {
+			lWritten -= aIov->iov_len;
+			++aIov;
+			--aCount;
+		}
+		if (aCount > 0) {
+			aIov->iov_base = (uint8_t *) aIov->iov_base + lWritten;
+			aIov->iov_len -= lWritten;
+		}
+	}
+	return 0;
+}
+
+int32_t FdFrameName(char *aName, uint32_t aSize, const char *aPattern, uint32_t aIndex) {
+	const char *lPercent = strchr(aPattern, '%'), *lEnd;
+	int32_t lWidth = 0;
+	if (!lPercent)
+		return -1;
+	lEnd = lPercent + 1;
+	if (*lEnd == '0')
+		while (*lEnd >= '0' && *lEnd <= '9' && lEnd - lPercent < 4)
+			lWidth = lWidth * 10 + *lEnd++ - '0';
+	if ((*lEnd != 'd' && *lEnd != 'u') || strchr(lEnd + 1, '%'))
+		return -1;
+	snprintf(aName, aSize, "%.*s%0*u%s", (int) (lPercent - aPattern), aPattern, lWidth, aIndex, lEnd + 1);
+	return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef FDIO_H
+#define FDIO_H
+
+/* C */
+#include <stdint.h>
+
+/* POSIX */
+#include <sys/uio.h>
+
+/* Defines */
+#define FDIO_IOV_MAX        (1024) /* Linux UIO_MAXIOV. */
+
+/* Loop over short transfers and EINTR, all of them return 0 on success and -1 on error or early end of file. */
+int32_t FdWriteAll(int32_t aFd, const void *aData, uint32_t aBytes);
+int32_t FdReadAll(int32_t aFd, void *aData, uint32_t aBytes);
+
+/* Modifies aIov while resuming partial writes, aCount must not exceed FDIO_IOV_MAX. */
+int32_t FdWriteVector(int32_t aFd, struct iovec *aIov, int32_t aCount);
+
+/*
+ * Numbered frame file names: aPattern may hold one "%d" or "%u", optionally zero padded like "%04d", which takes
+ * aIndex. It is never used as a printf format. Returns -1 for any other '%' in aPattern.
+ */
+int32_t FdFrameName(char *aName, uint32_t aSize, const char *aPattern, uint32_t aIndex);
+
+#endif /* !FDIO_H */
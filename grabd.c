@@ -0,0 +1,520 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+/* POSIX */
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "convert.h"
+#include "fdio.h"
+#include "jpegwrite.h"
+#include "magxgrab.h"
+#include "parallel.h"
+#include "pngpar.h"
+#include "pngwrite.h"
+#include "profile.h"
+#include "stats.h"
+
+/* Defines */
+#define GRABD_CLIENTS_MAX   (16)
+#define GRABD_QUEUE_MAX     (64)
+#define GRABD_FB_MAX        (4)
+#define GRABD_LINE_MAX      (512)
+#define GRABD_PATH_MAX      (256)
+
+typedef enum {
+	FORMAT_BMP,
+	FORMAT_PNG,
+	FORMAT_JPG,
+	FORMAT_RAW
+} grabd_format_t;
+
+/* A framebuffer stays open and mapped for the life of the daemon, the buffers are reused by every batch. */
+typedef struct {
+	char path[GRABD_PATH_MAX];
+	magxgrab_t grab;
+	uint8_t *snapshot;  /* Raw copy taken once per batch, every request of the batch sees the same frame. */
+	uint8_t *rgb;
+	uint8_t *bgr;
+	int32_t taken;
+	int32_t rgb_valid;
+	int32_t bgr_valid;
+} grabd_fb_t;
+
+typedef struct {
+	int32_t fd;
+	char line[GRABD_LINE_MAX];
+	uint32_t length;
+} grabd_client_t;
+
+typedef struct {
+	int32_t client;
+	grabd_fb_t *fb;
+	grabd_format_t format;
+	int32_t level;      /* PNG compression 0-9 or JPEG quality 0-100. */
+	int32_t x, y, width, height;
+	char out[GRABD_PATH_MAX];   /* "-" replies inline. */
+	const char *error;          /* Rejected requests stay queued so replies keep the request order. */
+} grabd_request_t;
+
+typedef struct {
+	const char *profile;
+	int32_t threads;
+	int32_t stats;
+	grabd_fb_t fbs[GRABD_FB_MAX];
+	int32_t fb_count;
+	grabd_client_t clients[GRABD_CLIENTS_MAX];
+	grabd_request_t queue[GRABD_QUEUE_MAX];
+	int32_t queued;
+	jpeg_encoder_t jpeg;    /* Warm compressor, only rebuilt when the size or the quality changes. */
+	int32_t jpeg_width, jpeg_height, jpeg_quality;
+} grabd_t;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void StopDaemon(int aSignal) {
+	(void) aSignal;
+	g_stop = 1;
+}
+
+static int32_t ErrUsage(void) {
+	fprintf(
+		stderr,
+		"Usage:\n"
+		"\t./grabd <socket> [--threads N] [--device profile] [--stats]\n\n"
+		"Profiles: " PROFILE_NAMES " (default " DEVICE_PROFILE ").\n"
+		"--stats prints stage times and counters of every batch to stderr as one JSON line.\n\n"
+		"Keeps framebuffers mapped and encoders allocated, and serves captures on a Unix stream socket until\n"
+		"SIGINT or SIGTERM. Every request is one line of optional key=value fields:\n"
+		"\tfb=/dev/fb/0           - framebuffer device (default), kept open after the first request\n"
+		"\tformat=png|jpg|bmp|raw - output format (default png), bmp is 24 bpp, raw is the framebuffer bytes\n"
+		"\tlevel=N                - PNG compression 0-9 (default 6) or JPEG quality 0-100 (default 85)\n"
+		"\trect=x,y,w,h           - capture region (default the whole screen)\n"
+		"\tout=path               - write the image to a file, \"-\" sends it back on the socket (default)\n"
+		"The reply is \"OK <bytes>\\n\", followed by the image for inline requests, or \"ERR <reason>\\n\".\n"
+		"Requests that arrive together are answered from one frame, converted once per pixel format.\n\n"
+		"Threads:\n"
+		"\t--threads N    - deflate PNG strips on N threads (default all online CPUs), 1 is a single libpng stream\n\n"
+		"Example:\n"
+		"\t./grabd /tmp/grabd.sock &\n"
+		"\techo \"format=png level=1 out=/tmp/screenshot.png\" | nc -U /tmp/grabd.sock\n"
+		"\techo \"fb=/dev/fb/1 format=jpg level=90 rect=0,0,240,160\" | nc -U /tmp/grabd.sock > reply.bin\n"
+	);
+	return 1;
+}
+
+static int32_t ErrFile(const char *aFileName, const char *aMode) {
+	fprintf(stderr, "Cannot open '%s' file for %s.\n", aFileName, aMode);
+	return 1;
+}
+
+static int32_t ErrProfile(const char *aProfile) {
+	fprintf(stderr, "Error: unknown or unsupported device profile '%s'!\n", aProfile);
+	return 1;
+}
+
+static void Reply(int32_t aFd, const char *aStatus, const char *aText) {
+	char lLine[GRABD_LINE_MAX];
+	int32_t lLength = snprintf(lLine, sizeof(lLine), "%s %s\n", aStatus, aText);
+	if (lLength > 0 && lLength < (int32_t) sizeof(lLine))
+		FdWriteAll(aFd, lLine, lLength);
+}
+
+static grabd_fb_t *OpenFramebuffer(grabd_t *aDaemon, const char *aPath) {
+	grabd_fb_t *lFb;
+	int32_t i;
+	for (i = 0; i < aDaemon->fb_count; ++i)
+		if (!strcmp(aDaemon->fbs[i].path, aPath))
+			return &aDaemon->fbs[i];
+	if (aDaemon->fb_count == GRABD_FB_MAX || strlen(aPath) >= GRABD_PATH_MAX)
+		return NULL;
+
+	lFb = &aDaemon->fbs[aDaemon->fb_count];
+	memset(lFb, 0, sizeof(grabd_fb_t));
+	if (GrabOpen(&lFb->grab, aPath, aDaemon->profile, 0))
+		return NULL;
+	lFb->snapshot = malloc(lFb->grab.display.bytes);
+	lFb->rgb = malloc(lFb->grab.display.size * 3);
+	lFb->bgr = malloc(lFb->grab.display.size * 3);
+	if (lFb->snapshot && lFb->rgb && lFb->bgr) {
+		strcpy(lFb->path, aPath);
+		++aDaemon->fb_count;
+		return lFb;
+	}
+	GrabClose(&lFb->grab);
+	free(lFb->snapshot);
+	free(lFb->rgb);
+	free(lFb->bgr);
+	return NULL;
+}
+
+static void CloseFramebuffers(grabd_t *aDaemon) {
+	int32_t i;
+	for (i = 0; i < aDaemon->fb_count; ++i) {
+		GrabClose(&aDaemon->fbs[i].grab);
+		free(aDaemon->fbs[i].snapshot);
+		free(aDaemon->fbs[i].rgb);
+		free(aDaemon->fbs[i].bgr);
+	}
+	aDaemon->fb_count = 0;
+}
+
+/* Returns NULL or the reason the request was rejected. */
+static const char *ParseRequest(grabd_t *aDaemon, char *aLine, grabd_request_t *aRequest) {
+	const char *lFb = "/dev/fb/0";
+	char *lField, *lSave = NULL;
+	int32_t lLevel = -1;
+	grab_rect_t lRect;
+
+	memset(aRequest, 0, sizeof(grabd_request_t));
+	aRequest->format = FORMAT_PNG;
+	aRequest->width = -1;
+	strcpy(aRequest->out, "-");
+	for (lField = strtok_r(aLine, " \t\r", &lSave); lField; lField = strtok_r(NULL, " \t\r", &lSave)) {
+		if (!strncmp("fb=", lField, 3))
+			lFb = lField + 3;
+		else if (!strcmp("format=png", lField))
+			aRequest->format = FORMAT_PNG;
+		else if (!strcmp("format=jpg", lField) || !strcmp("format=jpeg", lField))
+			aRequest->format = FORMAT_JPG;
+		else if (!strcmp("format=bmp", lField))
+			aRequest->format = FORMAT_BMP;
+		else if (!strcmp("format=raw", lField))
+			aRequest->format = FORMAT_RAW;
+		else if (!strncmp("level=", lField, 6))
+			lLevel = atoi(lField + 6);
+		else if (!strncmp("rect=", lField, 5)) {
+			if (sscanf(lField + 5, "%d,%d,%d,%d", &aRequest->x, &aRequest->y, &aRequest->width, &aRequest->height) != 4)
+				return "bad rect";
+		} else if (!strncmp("out=", lField, 4) && strlen(lField + 4) && strlen(lField + 4) < GRABD_PATH_MAX)
+			strcpy(aRequest->out, lField + 4);
+		else
+			return "bad field";
+	}
+
+	if (!(aRequest->fb = OpenFramebuffer(aDaemon, lFb)))
+		return "cannot open framebuffer";
+	if (aRequest->width < 0) {
+		aRequest->width = aRequest->fb->grab.display.width;
+		aRequest->height = aRequest->fb->grab.display.height;
+	}
+	lRect.x = aRequest->x;
+	lRect.y = aRequest->y;
+	lRect.width = aRequest->width;
+	lRect.height = aRequest->height;
+	if (GrabRect(&aRequest->fb->grab, &lRect, &lRect))
+		return "rect outside the screen";
+
+	if (aRequest->format == FORMAT_JPG)
+		aRequest->level = (lLevel < 0) ? 85 : lLevel;
+	else
+		aRequest->level = (lLevel < 0) ? 6 : lLevel;
+	if (aRequest->level > ((aRequest->format == FORMAT_JPG) ? 100 : 9))
+		return "bad level";
+	return NULL;
+}
+
+/* Converts the batch snapshot at most once per destination format. */
+static const uint8_t *FramePixels(grabd_fb_t *aFb, pixel_format_t aFormat, stats_t *aStats) {
+	uint64_t lBegin;
+	if (aFormat == PIXEL_BGR888 && !aFb->bgr_valid) {
+		lBegin = StatsBegin(aStats);
+		DisplayConvert(&aFb->grab.display, aFb->bgr, PIXEL_BGR888, aFb->snapshot);
+		StatsEnd(aStats, STATS_CONVERT, lBegin);
+		aFb->bgr_valid = 1;
+	} else if (aFormat == PIXEL_RGB888 && !aFb->rgb_valid) {
+		lBegin = StatsBegin(aStats);
+		DisplayConvert(&aFb->grab.display, aFb->rgb, PIXEL_RGB888, aFb->snapshot);
+		StatsEnd(aStats, STATS_CONVERT, lBegin);
+		aFb->rgb_valid = 1;
+	}
+	return (aFormat == PIXEL_BGR888) ? aFb->bgr : aFb->rgb;
+}
+
+/* Compressed formats are encoded into memory first, the reply header needs their size. */
+static int32_t EncodeImage(grabd_t *aDaemon, const grabd_request_t *aRequest, const uint8_t *aRgb, uint8_t **aData, uint32_t *aSize) {
+	const uint32_t lStride = aRequest->fb->grab.display.width * 3;
+	if (aRequest->format == FORMAT_JPG) {
+		if (
+			!aDaemon->jpeg.buffer || aDaemon->jpeg_width != aRequest->width || aDaemon->jpeg_height != aRequest->height ||
+			aDaemon->jpeg_quality != aRequest->level
+		) {
+			JpegEncoderFree(&aDaemon->jpeg);
+			if (JpegEncoderInit(&aDaemon->jpeg, aRequest->width, aRequest->height, aRequest->level))
+				return -1;
+			aDaemon->jpeg_width = aRequest->width;
+			aDaemon->jpeg_height = aRequest->height;
+			aDaemon->jpeg_quality = aRequest->level;
+		}
+		JpegEncodeFrame(&aDaemon->jpeg, aRgb, lStride);
+		*aData = aDaemon->jpeg.buffer;
+		*aSize = aDaemon->jpeg.size;
+		return 0;
+	} else {
+		char *lBuffer = NULL;
+		size_t lSize = 0;
+		int32_t lError;
+		FILE *lPngFile = open_memstream(&lBuffer, &lSize);
+		if (!lPngFile)
+			return -1;
+		if (aDaemon->threads > 1)
+			lError = PngWriteParallel(lPngFile, aRgb, lStride, aRequest->width, aRequest->height, aRequest->level, aDaemon->threads);
+		else
+			lError = PngWrite(lPngFile, aRgb, lStride, aRequest->width, aRequest->height, aRequest->level);
+		if (fclose(lPngFile))
+			lError = -1;
+		*aData = (uint8_t *) lBuffer;
+		*aSize = lSize;
+		return lError;
+	}
+}
+
+static int32_t WriteRaw(int32_t aFd, const grabd_request_t *aRequest) {
+	const display_t *lDisplay = &aRequest->fb->grab.display;
+	const uint8_t *lRow = aRequest->fb->snapshot + aRequest->y * lDisplay->stride + aRequest->x * lDisplay->bpp;
+	int32_t i;
+	if (aRequest->x == 0 && aRequest->width == lDisplay->width && lDisplay->stride == (uint32_t) lDisplay->width * lDisplay->bpp)
+		return FdWriteAll(aFd, lRow, aRequest->height * lDisplay->stride);
+	for (i = 0; i < aRequest->height; ++i, lRow += lDisplay->stride)
+		if (FdWriteAll(aFd, lRow, aRequest->width * lDisplay->bpp))
+			return -1;
+	return 0;
+}
+
+/* Returns -1 when the client socket failed and must be dropped. */
+static int32_t ServeRequest(grabd_t *aDaemon, const grabd_request_t *aRequest, stats_t *aStats) {
+	const int32_t lClient = aDaemon->clients[aRequest->client].fd;
+	const int32_t lInline = !strcmp("-", aRequest->out);
+	grabd_fb_t *lFb = aRequest->fb;
+	const uint32_t lOffset = aRequest->y * lFb->grab.display.width * 3 + aRequest->x * 3;
+	const uint8_t *lPixels = NULL;
+	uint8_t *lData = NULL;
+	uint32_t lSize;
+	int32_t lFd = lClient, lError = 0;
+	uint64_t lBegin;
+	char lText[32];
+
+	if (!lFb->taken) {
+		lBegin = StatsBegin(aStats);
+		GrabCapture(&lFb->grab, lFb->snapshot, lFb->grab.display.stride, lFb->grab.display.format, NULL);
+		StatsEnd(aStats, STATS_READ, lBegin);
+		aStats->bytes_read += lFb->grab.display.bytes;
+		lFb->taken = 1;
+		lFb->rgb_valid = lFb->bgr_valid = 0;
+	}
+	++aStats->frames;
+
+	if (aRequest->format == FORMAT_RAW)
+		lSize = aRequest->width * aRequest->height * lFb->grab.display.bpp;
+	else if (aRequest->format == FORMAT_BMP) {
+		lPixels = FramePixels(lFb, PIXEL_BGR888, aStats) + lOffset;
+		lSize = sizeof(bmp_header_t) + ((aRequest->width * 3 + 3) & ~3) * aRequest->height;
+	} else {
+		lPixels = FramePixels(lFb, PIXEL_RGB888, aStats) + lOffset;
+		lBegin = StatsBegin(aStats);
+		lError = EncodeImage(aDaemon, aRequest, lPixels, &lData, &lSize);
+		StatsEnd(aStats, STATS_ENCODE, lBegin);
+		if (lError) {
+			if (aRequest->format == FORMAT_PNG)
+				free(lData);
+			return FdWriteAll(lClient, "ERR encoder failed\n", 19);
+		}
+	}
+	snprintf(lText, sizeof(lText), "%u", lSize);
+
+	lBegin = StatsBegin(aStats);
+	if (!lInline && (lFd = open(aRequest->out, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+		Reply(lClient, "ERR", "cannot open output");
+	else {
+		if (lInline)
+			Reply(lClient, "OK", lText);
+		if (aRequest->format == FORMAT_RAW)
+			lError = WriteRaw(lFd, aRequest);
+		else if (aRequest->format == FORMAT_BMP)
+			lError = BmpWriteFd(lFd, lPixels, lFb->grab.display.width * 3, aRequest->width, aRequest->height, 24, NULL);
+		else
+			lError = FdWriteAll(lFd, lData, lSize);
+		if (!lInline) {
+			if (close(lFd))
+				lError = -1;
+			/* A failed file write leaves the socket usable. */
+			Reply(lClient, (lError) ? "ERR" : "OK", (lError) ? "write failed" : lText);
+			lError = 0;
+		}
+		aStats->bytes_written += lSize;
+	}
+	StatsEnd(aStats, STATS_WRITE, lBegin);
+	if (aRequest->format == FORMAT_PNG)
+		free(lData);
+	return lError;
+}
+
+static void DropClient(grabd_t *aDaemon, int32_t aClient) {
+	int32_t i;
+	close(aDaemon->clients[aClient].fd);
+	aDaemon->clients[aClient].fd = -1;
+	for (i = 0; i < aDaemon->queued; ++i)
+		if (aDaemon->queue[i].client == aClient)
+			aDaemon->queue[i].client = -1;
+}
+
+static void ServeBatch(grabd_t *aDaemon) {
+	stats_t lStats;
+	int32_t i, lError = 0;
+
+	StatsInit(&lStats, "grabd", aDaemon->stats);
+	for (i = 0; i < aDaemon->fb_count; ++i)
+		aDaemon->fbs[i].taken = 0;
+	for (i = 0; i < aDaemon->queued; ++i) {
+		const grabd_request_t *lRequest = &aDaemon->queue[i];
+		if (lRequest->client < 0)
+			continue;
+		if (lRequest->error) {
+			Reply(aDaemon->clients[lRequest->client].fd, "ERR", lRequest->error);
+			continue;
+		}
+		lStats.device = lRequest->fb->grab.display.name;
+		if (ServeRequest(aDaemon, lRequest, &lStats)) {
+			DropClient(aDaemon, lRequest->client);
+			lError = -1;
+		}
+	}
+	aDaemon->queued = 0;
+	StatsPrint(&lStats, lError);
+}
+
+/* Splits the received bytes into lines and queues them, a full queue is served on the spot. */
+static void ReadClient(grabd_t *aDaemon, int32_t aClient) {
+	grabd_client_t *lClient = &aDaemon->clients[aClient];
+	char *lEnd;
+	ssize_t lRead = read(lClient->fd, lClient->line + lClient->length, GRABD_LINE_MAX - 1 - lClient->length);
+	if (lRead <= 0) {
+		if (lRead < 0 && errno == EINTR)
+			return;
+		DropClient(aDaemon, aClient);
+		return;
+	}
+	lClient->length += lRead;
+	lClient->line[lClient->length] = '\0';
+	while ((lEnd = strchr(lClient->line, '\n'))) {
+		*lEnd = '\0';
+		if (aDaemon->queued == GRABD_QUEUE_MAX) {
+			ServeBatch(aDaemon);
+			if (lClient->fd < 0)
+				return;
+		}
+		aDaemon->queue[aDaemon->queued].error = ParseRequest(aDaemon, lClient->line, &aDaemon->queue[aDaemon->queued]);
+		aDaemon->queue[aDaemon->queued++].client = aClient;
+		lClient->length -= lEnd + 1 - lClient->line;
+		memmove(lClient->line, lEnd + 1, lClient->length + 1);
+	}
+	if (lClient->length == GRABD_LINE_MAX - 1) {
+		Reply(lClient->fd, "ERR", "line too long");
+		DropClient(aDaemon, aClient);
+	}
+}
+
+static int32_t RunDaemon(grabd_t *aDaemon, int32_t aListen) {
+	struct pollfd lPoll[GRABD_CLIENTS_MAX + 1];
+	int32_t lMap[GRABD_CLIENTS_MAX + 1], lCount, i;
+
+	while (!g_stop) {
+		lPoll[0].fd = aListen;
+		lPoll[0].events = POLLIN;
+		for (lCount = 1, i = 0; i < GRABD_CLIENTS_MAX; ++i)
+			if (aDaemon->clients[i].fd >= 0) {
+				lPoll[lCount].fd = aDaemon->clients[i].fd;
+				lPoll[lCount].events = POLLIN;
+				lMap[lCount++] = i;
+			}
+		if (poll(lPoll, lCount, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		/* Everything readable now forms one batch. */
+		for (i = 1; i < lCount; ++i)
+			if (lPoll[i].revents & (POLLIN | POLLHUP | POLLERR))
+				ReadClient(aDaemon, lMap[i]);
+		if (lPoll[0].revents & POLLIN) {
+			int32_t lFd = accept(aListen, NULL, NULL);
+			for (i = 0; lFd >= 0 && i < GRABD_CLIENTS_MAX && aDaemon->clients[i].fd >= 0; ++i)
+				;
+			if (lFd >= 0 && i == GRABD_CLIENTS_MAX) {
+				Reply(lFd, "ERR", "too many clients");
+				close(lFd);
+			} else if (lFd >= 0) {
+				aDaemon->clients[i].fd = lFd;
+				aDaemon->clients[i].length = 0;
+			}
+		}
+		if (aDaemon->queued)
+			ServeBatch(aDaemon);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	int32_t i;
+	if (argc < 2)
+		return ErrUsage();
+
+	grabd_t lDaemon;
+	memset(&lDaemon, 0, sizeof(grabd_t));
+	lDaemon.profile = DEVICE_PROFILE;
+	lDaemon.threads = ParallelCpus();
+	for (i = 2; i < argc; ++i) {
+		if (!strcmp("--device", argv[i]) && i + 1 < argc)
+			lDaemon.profile = argv[++i];
+		else if (!strcmp("--threads", argv[i]) && i + 1 < argc)
+			lDaemon.threads = atoi(argv[++i]);
+		else if (!strcmp("--stats", argv[i]))
+			lDaemon.stats = 1;
+		else
+			return ErrUsage();
+	}
+	for (i = 0; i < GRABD_CLIENTS_MAX; ++i)
+		lDaemon.clients[i].fd = -1;
+
+	display_t lCheck;
+	if (ProfileLoad(&lCheck, lDaemon.profile, -1) && strcmp("auto", lDaemon.profile))
+		return ErrProfile(lDaemon.profile);
+
+	struct sockaddr_un lAddress;
+	memset(&lAddress, 0, sizeof(lAddress));
+	lAddress.sun_family = AF_UNIX;
+	if (strlen(argv[1]) >= sizeof(lAddress.sun_path))
+		return ErrFile(argv[1], "listen");
+	strcpy(lAddress.sun_path, argv[1]);
+	int32_t lListen = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(argv[1]);
+	if (lListen < 0 || bind(lListen, (struct sockaddr *) &lAddress, sizeof(lAddress)) || listen(lListen, GRABD_CLIENTS_MAX))
+		return ErrFile(argv[1], "listen");
+
+	signal(SIGINT, StopDaemon);
+	signal(SIGTERM, StopDaemon);
+	/* A client that hangs up early must not kill the daemon. */
+	signal(SIGPIPE, SIG_IGN);
+
+	int32_t lError = RunDaemon(&lDaemon, lListen);
+
+	for (i = 0; i < GRABD_CLIENTS_MAX; ++i)
+		if (lDaemon.clients[i].fd >= 0)
+			close(lDaemon.clients[i].fd);
+	close(lListen);
+	unlink(argv[1]);
+	JpegEncoderFree(&lDaemon.jpeg);
+	CloseFramebuffers(&lDaemon);
+	return (lError) ? ErrFile(argv[1], "listen") : 0;
+}
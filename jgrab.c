@@ -3,40 +3,63 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <signal.h>
+#include <time.h>
 
 /* POSIX */
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/mman.h>
-#include <sys/ioctl.h>
 
-/* JPEG */
-#include <jpeglib.h>
+/* Local */
+#include "avi.h"
+#include "convert.h"
+#include "fdio.h"
+#include "jpegwrite.h"
+#include "magxgrab.h"
+#include "parallel.h"
+#include "profile.h"
+#include "scale.h"
+#include "stats.h"
+#include "timing.h"
 
 /* Defines */
-#define SCR_WIDTH           (240)
-#define SCR_HEIGHT          (320)
-#define SCR_DEPTH           (24)
-#define RGB666_TO_RGB888(c) ((((c) & (0x3F << 0)) <<  2) | (((c) & (0x3F <<  6)) << 4) | (((c) & (0x3F << 12)) <<  6))
-
-typedef struct {
-	int32_t width;
-	int32_t height;
-	uint32_t size;
-	uint32_t depth;
-	uint8_t bpp;
-	uint32_t bytes;
-} display_t;
+#define RECORD_FPS          (10)
 
 static int32_t ErrUsage(void) {
 	fprintf(
 		stderr,
 		"Usage:\n"
-		"\t./jgrab <device> <JPEG image file> <quality 0-100>\n\n"
+		"\t./jgrab <device> <JPEG image file> <quality 0-100> [--threads N] [--rect x,y,w,h] [--rotate degrees]\n"
+		"\t      [--mirror] [--thumb file] [--thumb-size size] [--direct] [--device profile] [--stats]\n"
+		"\t./jgrab <device> <AVI or MJPEG video file> <quality 0-100> --record <seconds> [--fps N] [--rect x,y,w,h]\n"
+		"\t      [--rotate degrees] [--mirror] [--direct] [--device profile] [--stats]\n\n"
+		"Profiles: " PROFILE_NAMES " (default " DEVICE_PROFILE ").\n"
+		"--stats prints stage times and counters to stderr as one JSON line, read_us is the snapshot.\n"
+		"--direct converts straight from the framebuffer instead of a snapshot copied out first, for the smallest heap.\n\n"
+		"Record:\n"
+		"\t--record seconds - encode frames continuously, 0 is until SIGINT or SIGTERM\n"
+		"\t--fps N          - target frame rate (default %d), frames are dropped when encoding falls behind\n"
+		"\tA file name ending with \".avi\" gets a Motion JPEG AVI, anything else a raw MJPEG stream.\n\n"
+		"Threads:\n"
+		"\t--threads N      - encode bands of the image on N threads (default all online CPUs), 1 is a single libjpeg pass\n\n"
+		"Region:\n"
+		"\t--rect x,y,w,h   - capture only this rectangle, also every frame of a recording\n\n"
+		"Orientation:\n"
+		"\t--rotate degrees - turn the image clockwise by 90, 180 or 270 degrees while it is converted\n"
+		"\t--mirror         - mirror it left to right after the turn, --rect is given in screen coordinates\n\n"
+		"Thumbnail:\n"
+		"\t--thumb file      - also write a reduced JPEG image of the same quality, made in the same pass as the full one\n"
+		"\t--thumb-size size - 1/N of the screen or WxH, a 0 side keeps the aspect ratio (default 1/4)\n\n"
 		"Example:\n"
 		"\t./jgrab /dev/fb/0 screenshot1.jpeg 100\n"
 		"\t./jgrab /dev/fb/1 screenshot2.jpeg 85\n"
 		"\t./jgrab /dev/fb/0 stdout 65 > screenshot3.jpeg\n"
+		"\t./jgrab /dev/fb/0 screenshot4.jpeg 90 --thumb thumbnail4.jpeg --thumb-size 1/2\n"
+		"\t./jgrab /dev/fb/0 video.avi 75 --record 30 --fps 15\n"
+		"\t./jgrab /dev/fb/0 game.avi 75 --record 60 --rotate 270\n"
+		"\t./jgrab /dev/fb/0 statusbar.avi 80 --record 10 --rect 0,0,240,24\n"
+		"\t./jgrab /dev/fb/0 stdout 60 --record 0 > video.mjpeg\n",
+		RECORD_FPS
 	);
 	return 1;
 }
@@ -46,78 +69,272 @@ static int32_t ErrFile(const char *aFileName, const char *aMode) {
 	return 1;
 }
 
-static uint8_t *CreateBitmapFromFile(uint8_t *a_fb_mmap, const display_t *aDisplay) {
-	int32_t y, x;
-	uint8_t *lBitmapRgb888 = malloc(aDisplay->bytes);
-	for (y = 0; y < aDisplay->height; ++y)
-		for (x = 0; x < aDisplay->width; ++x) {
-			uint32_t lPixelRgb666 = 0x000000;
-			uint8_t r = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t g = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t b = *a_fb_mmap; ++a_fb_mmap;
-			lPixelRgb666 = (b << 16) | (g << 8) | r;
-			lPixelRgb666 = RGB666_TO_RGB888(lPixelRgb666);
-			int z = (x + y * aDisplay->width) * aDisplay->bpp;
-			lBitmapRgb888[z] = (uint8_t) (lPixelRgb666 >> 16) & 0xFF;
-			lBitmapRgb888[z + 1] = (uint8_t) (lPixelRgb666 >> 8) & 0xFF;
-			lBitmapRgb888[z + 2] = (uint8_t) (lPixelRgb666 >> 0) & 0xFF;
-		}
+static int32_t ErrRect(const display_t *aDisplay) {
+	fprintf(stderr, "Error: the rectangle must lie inside the %dx%d screen!\n", aDisplay->width, aDisplay->height);
+	return 1;
+}
+
+static int32_t ErrProfile(const char *aProfile) {
+	fprintf(stderr, "Error: unknown or unsupported device profile '%s'!\n", aProfile);
+	return 1;
+}
+
+static int32_t ErrOpen(const char *aDevice, const char *aProfile, int32_t aError) {
+	if (aError == GRAB_ERROR_PROFILE)
+		return ErrProfile(aProfile);
+	return ErrFile(aDevice, (aError == GRAB_ERROR_MMAP) ? "mmap" : "read");
+}
+
+/*
+ * Parallel bands need the whole image: only the framebuffer rows and columns of aRect are read into aImage, the
+ * GrabImage() geometry, aThumb, if any, gets its thumbnail in the same pass.
+ */
+static uint8_t *CreateBitmapFromFile(const magxgrab_t *aGrab, const grab_rect_t *aRect, const display_t *aImage, scale_t *aThumb) {
+	uint8_t *lBitmapRgb888 = malloc(aImage->size * 3);
+	int32_t lError = 0;
+	if (lBitmapRgb888 && aThumb)
+		lError = GrabCaptureScaled(aGrab, lBitmapRgb888, aImage->width * 3, PIXEL_RGB888, aRect, aThumb);
+	else if (lBitmapRgb888)
+		lError = GrabCapture(aGrab, lBitmapRgb888, aImage->width * 3, PIXEL_RGB888, aRect);
+	if (lError) {
+		free(lBitmapRgb888);
+		return NULL;
+	}
 	return lBitmapRgb888;
 }
 
-/* https://github.com/Tinker-S/libjpeg-sample/blob/master/jpeg_sample.c */
-static void CreateJpegFromBitmap(FILE *aOutPutJpegFile, const display_t *aDisplay, uint8_t *aBitmap, int32_t aQuality) {
-	struct jpeg_compress_struct cinfo;
-	struct jpeg_error_mgr jerr;
+static int32_t WriteThumbnail(const char *aFileName, const scale_t *aThumb, int32_t aQuality, stats_t *aStats) {
+	uint64_t lBegin;
+	int32_t lError = 0;
+	FILE *lJpegFile = fopen(aFileName, "wb");
+	if (!lJpegFile)
+		return -1;
+	StatsBuffer(aStats, lJpegFile, aThumb->width * aThumb->height * 3);
+	lBegin = StatsBegin(aStats);
+	JpegWrite(lJpegFile, aThumb->dst, aThumb->dst_stride, aThumb->width, aThumb->height, aQuality);
+	StatsEnd(aStats, STATS_ENCODE, lBegin);
+	if (StatsFlush(aStats, lJpegFile))
+		lError = -1;
+	return (fclose(lJpegFile)) ? -1 : lError;
+}
 
-	JSAMPROW row_pointer[1];
+static volatile sig_atomic_t g_stop = 0;
 
-	cinfo.err = jpeg_std_error(&jerr);
-	jpeg_create_compress(&cinfo);
-	jpeg_stdio_dest(&cinfo, aOutPutJpegFile);
+static void StopRecording(int aSignal) {
+	(void) aSignal;
+	g_stop = 1;
+}
 
-	cinfo.image_width = aDisplay->width;
-	cinfo.image_height = aDisplay->height;
-	cinfo.input_components = aDisplay->bpp;
-	cinfo.in_color_space = JCS_RGB;
+/*
+ * Frames are due every 1/aFps seconds from the start. When capturing and encoding a frame took longer than that,
+ * the missed slots are dropped: nothing is written to a MJPEG stream, an empty chunk to an AVI to keep the timeline.
+ * A snapshot aGrab is copied again for every frame.
+ */
+static int32_t RecordVideo(
+	int32_t aFd, avi_writer_t *aAvi, magxgrab_t *aGrab, const grab_rect_t *aRect, const display_t *aImage,
+	int32_t aQuality, uint32_t aSeconds, uint32_t aFps, stats_t *aStats
+) {
+	const uint64_t lPeriod = 1000000 / aFps;
+	const uint32_t lTotal = aSeconds * aFps;
+	uint32_t lSlot = 0, lEncoded = 0, lDropped = 0;
+	uint64_t lStart;
+	int32_t lError = 0;
 
-	jpeg_set_defaults(&cinfo);
-	jpeg_set_quality(&cinfo, aQuality, TRUE);
-	jpeg_start_compress(&cinfo, TRUE);
+	/* Every frame is converted band by band while libjpeg takes the rows. */
+	jpeg_encoder_t lEncoder;
+	grab_stream_t lStream;
+	if (GrabStreamInit(&lStream, aGrab, PIXEL_RGB888, aRect, NULL) || JpegEncoderInit(&lEncoder, aImage->width, aImage->height, aQuality)) {
+		GrabStreamFree(&lStream);
+		fprintf(stderr, "Cannot allocate frame buffers.\n");
+		return 1;
+	}
+	signal(SIGINT, StopRecording);
+	signal(SIGTERM, StopRecording);
 
-	while (cinfo.next_scanline < cinfo.image_height) {
-		row_pointer[0] = &aBitmap[cinfo.next_scanline * cinfo.image_width * cinfo.input_components];
-		jpeg_write_scanlines(&cinfo, row_pointer, 1);
+	lStart = TimeMonotonicUs();
+	while (!g_stop && !lError && (!lTotal || lSlot < lTotal)) {
+		uint64_t lDeadline = lStart + lSlot * lPeriod;
+		uint64_t lNow = TimeMonotonicUs();
+		if (lNow < lDeadline) {
+			struct timespec lSleep;
+			lSleep.tv_sec = (lDeadline - lNow) / 1000000;
+			lSleep.tv_nsec = (lDeadline - lNow) % 1000000 * 1000;
+			if (nanosleep(&lSleep, NULL))
+				continue;
+		} else {
+			uint32_t lMissed = (lNow - lDeadline) / lPeriod;
+			if (lTotal && lSlot + lMissed > lTotal)
+				lMissed = lTotal - lSlot;
+			lDropped += lMissed;
+			for (; lMissed && !lError; --lMissed, ++lSlot)
+				lError = aAvi && AviWriteFrame(aAvi, NULL, 0);
+			if (lError || (lTotal && lSlot == lTotal))
+				break;
+		}
+
+		lNow = StatsBegin(aStats);
+		GrabSnapshot(aGrab);
+		StatsEnd(aStats, STATS_READ, lNow);
+		lNow = StatsBegin(aStats);
+		lError = JpegEncodeFrameRows(&lEncoder, GrabStreamRows, &lStream);
+		StatsEnd(aStats, STATS_ENCODE, lNow);
+		if (lError)
+			break;
+		lNow = StatsBegin(aStats);
+		if (aAvi)
+			lError = AviWriteFrame(aAvi, lEncoder.buffer, lEncoder.size);
+		else
+			lError = FdWriteAll(aFd, lEncoder.buffer, lEncoder.size);
+		StatsEnd(aStats, STATS_WRITE, lNow);
+		aStats->bytes_read += aImage->bytes;
+		++aStats->frames;
+		++lEncoded;
+		++lSlot;
 	}
 
-	jpeg_finish_compress(&cinfo);
-	jpeg_destroy_compress(&cinfo);
+	fprintf(
+		stderr, "Recording: %u frames in %llu ms, %u dropped.\n",
+		lEncoded, (unsigned long long) ((TimeMonotonicUs() - lStart) / 1000), lDropped
+	);
+	StatsMove(aStats, STATS_ENCODE, STATS_CONVERT, lStream.convert_us);
+	JpegEncoderFree(&lEncoder);
+	GrabStreamFree(&lStream);
+	return (lError) ? -1 : 0;
 }
 
 int main(int argc, char *argv[]) {
-	if (argc != 4)
+	int32_t i;
+	if (argc < 4)
 		return ErrUsage();
 
+	const char *lProfile = DEVICE_PROFILE, *lThumbPath = NULL, *lThumbSize = "1/4";
+	int32_t lRecord = 0;
+	uint32_t lSeconds = 0, lFps = RECORD_FPS;
+	int32_t lThreads = ParallelCpus(), lStatsEnabled = 0, lDirect = 0;
+	grab_rect_t lRegion, *lRegionArg = NULL;
+	int32_t lDegrees = 0, lMirror = 0;
+	transform_t lTransform;
+	for (i = 4; i < argc; ++i) {
+		if (!strcmp("--device", argv[i]) && i + 1 < argc)
+			lProfile = argv[++i];
+		else if (!strcmp("--rotate", argv[i]) && i + 1 < argc)
+			lDegrees = atoi(argv[++i]);
+		else if (!strcmp("--mirror", argv[i]))
+			lMirror = 1;
+		else if (!strcmp("--rect", argv[i]) && i + 1 < argc) {
+			if (GrabParseRect(argv[++i], &lRegion))
+				return ErrUsage();
+			lRegionArg = &lRegion;
+		} else if (!strcmp("--record", argv[i]) && i + 1 < argc) {
+			lRecord = 1;
+			lSeconds = atoi(argv[++i]);
+		} else if (!strcmp("--fps", argv[i]) && i + 1 < argc)
+			lFps = atoi(argv[++i]);
+		else if (!strcmp("--threads", argv[i]) && i + 1 < argc)
+			lThreads = atoi(argv[++i]);
+		else if (!strcmp("--thumb", argv[i]) && i + 1 < argc)
+			lThumbPath = argv[++i];
+		else if (!strcmp("--thumb-size", argv[i]) && i + 1 < argc)
+			lThumbSize = argv[++i];
+		else if (!strcmp("--stats", argv[i]))
+			lStatsEnabled = 1;
+		else if (!strcmp("--direct", argv[i]))
+			lDirect = 1;
+		else
+			return ErrUsage();
+	}
+	if (!lFps || lFps > 1000 || (lRecord && lThumbPath))
+		return ErrUsage();
+	if (ConvertGetTransform(lDegrees, lMirror, &lTransform))
+		return ErrUsage();
+
+	stats_t lStats;
+	StatsInit(&lStats, "jgrab", lStatsEnabled);
+	uint64_t lBegin = StatsBegin(&lStats);
+	magxgrab_t lGrab;
+	int32_t lOpened = GrabOpen(&lGrab, argv[1], lProfile, 0);
+	if (lOpened)
+		return ErrOpen(argv[1], lProfile, lOpened);
+	/* From here on lScreen is the captured image, cropped and turned with packed rows. */
+	grab_rect_t lRect;
 	display_t lScreen;
-	lScreen.width = SCR_WIDTH;
-	lScreen.height = SCR_HEIGHT;
-	lScreen.size = lScreen.height * lScreen.width;
-	lScreen.depth = SCR_DEPTH;
-	lScreen.bpp = SCR_DEPTH / 8;
-	lScreen.bytes = lScreen.size * lScreen.bpp;
+	if (GrabRect(&lGrab, lRegionArg, &lRect))
+		return ErrRect(&lGrab.display);
+	if (GrabSetTransform(&lGrab, lTransform))
+		return ErrFile(argv[2], "write");
+	GrabImage(&lGrab, &lRect, &lScreen);
+	lStats.device = lScreen.name;
+	StatsEnd(&lStats, STATS_OPEN, lBegin);
+
+	/* The rectangle is copied out of the framebuffer in one burst, unless --direct converts from the mapping. */
+	magxgrab_t lSnapshot, *lSource = &lGrab;
+	const grab_rect_t *lSourceRect = &lRect;
+	if (!lDirect) {
+		if (GrabSnapshotInit(&lSnapshot, &lGrab, &lRect))
+			return ErrFile(argv[2], "write");
+		lSource = &lSnapshot;
+		lSourceRect = NULL;
+	}
+
+	if (lRecord) {
+		const char *lExtension = strrchr(argv[2], '.');
+		int32_t lVideoFd = STDOUT_FILENO, lError;
+		avi_writer_t lAvi;
+		avi_writer_t *lAviWriter = NULL;
+		if (strcmp("stdout", argv[2]) && (lVideoFd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			return ErrFile(argv[2], "write");
+		/* AVI headers are patched on close, a pipe always gets the raw MJPEG stream. */
+		if (lVideoFd != STDOUT_FILENO && lExtension && (!strcmp(".avi", lExtension) || !strcmp(".AVI", lExtension))) {
+			if (AviWriterInit(&lAvi, lVideoFd, lScreen.width, lScreen.height, lFps))
+				return ErrFile(argv[2], "write");
+			lAviWriter = &lAvi;
+		}
 
-	int32_t fb_fd = open(argv[1], O_RDONLY);
-	if (fb_fd == EXIT_FAILURE)
-		return ErrFile(argv[1], "read");
+		lError = RecordVideo(lVideoFd, lAviWriter, lSource, lSourceRect, &lScreen, atoi(argv[3]), lSeconds, lFps, &lStats);
+		lBegin = StatsBegin(&lStats);
+		if (lAviWriter && AviWriterClose(lAviWriter) && !lError)
+			lError = -1;
+		StatsEnd(&lStats, STATS_WRITE, lBegin);
+		StatsOutput(&lStats, lVideoFd);
 
-	uint8_t *fb_mmap = (uint8_t *) mmap(NULL, lScreen.bytes, PROT_READ, MAP_SHARED, fb_fd, 0);
-	if (fb_mmap == MAP_FAILED)
-		return ErrFile(argv[1], "mmap");
+		if (lVideoFd != STDOUT_FILENO)
+			close(lVideoFd);
+		if (!lDirect)
+			GrabClose(&lSnapshot);
+		GrabClose(&lGrab);
+		StatsPrint(&lStats, lError);
+		return (lError < 0) ? ErrFile(argv[2], "write") : lError;
+	}
 
-	uint8_t *lBitmap = CreateBitmapFromFile(fb_mmap, &lScreen);
+	scale_t lThumb;
+	uint8_t *lThumbBitmap = NULL;
+	int32_t lThumbWidth, lThumbHeight;
+	if (lThumbPath) {
+		if (ScaleParseSize(lThumbSize, lScreen.width, lScreen.height, &lThumbWidth, &lThumbHeight))
+			return ErrUsage();
+		lThumbBitmap = malloc(lThumbWidth * lThumbHeight * 3);
+		if (!lThumbBitmap || ScaleInit(&lThumb, lScreen.width, lScreen.height, lThumbBitmap, lThumbWidth * 3, lThumbWidth, lThumbHeight))
+			return ErrFile(lThumbPath, "write");
+	}
 
-	munmap(fb_mmap, lScreen.bytes);
-	close(fb_fd);
+	lBegin = StatsBegin(&lStats);
+	GrabSnapshot(lSource);
+	StatsEnd(&lStats, STATS_READ, lBegin);
+
+	/* A single libjpeg pass takes the rows band by band from the source. */
+	int32_t lError = 0;
+	uint8_t *lBitmap = NULL;
+	grab_stream_t lStream;
+	if (lThreads > 1) {
+		lBegin = StatsBegin(&lStats);
+		lBitmap = CreateBitmapFromFile(lSource, lSourceRect, &lScreen, (lThumbPath) ? &lThumb : NULL);
+		StatsEnd(&lStats, STATS_CONVERT, lBegin);
+		if (!lBitmap)
+			return ErrFile(argv[2], "write");
+	} else if (GrabStreamInit(&lStream, lSource, PIXEL_RGB888, lSourceRect, (lThumbPath) ? &lThumb : NULL))
+		return ErrFile(argv[2], "write");
+	lStats.bytes_read += lScreen.bytes;
+	lStats.frames = 1;
 
 	FILE *lJpegFile = NULL;
 	if (!strcmp("stdout", argv[2]))
@@ -126,11 +343,37 @@ int main(int argc, char *argv[]) {
 		lJpegFile = fopen(argv[2], "wb");
 	if (!lJpegFile)
 		return ErrFile(argv[2], "write");
+	StatsBuffer(&lStats, lJpegFile, lScreen.size * 3);
 
-	CreateJpegFromBitmap(lJpegFile, &lScreen, lBitmap, atoi(argv[3]));
+	lBegin = StatsBegin(&lStats);
+	if (lBitmap)
+		lError = JpegWriteParallel(lJpegFile, lBitmap, lScreen.width * 3, lScreen.width, lScreen.height, atoi(argv[3]), lThreads);
+	else
+		lError = JpegWriteRows(lJpegFile, GrabStreamRows, &lStream, lScreen.width, lScreen.height, atoi(argv[3]));
+	StatsEnd(&lStats, STATS_ENCODE, lBegin);
+	if (!lBitmap) {
+		StatsMove(&lStats, STATS_ENCODE, STATS_CONVERT, lStream.convert_us);
+		GrabStreamFree(&lStream);
+	}
+	if (StatsFlush(&lStats, lJpegFile))
+		lError = -1;
 
+	if (!lDirect)
+		GrabClose(&lSnapshot);
+	GrabClose(&lGrab);
 	free(lBitmap);
-	fclose(lJpegFile);
+	if (fclose(lJpegFile))
+		lError = -1;
+
+	int32_t lThumbError = 0;
+	if (lThumbPath) {
+		lThumbError = WriteThumbnail(lThumbPath, &lThumb, atoi(argv[3]), &lStats);
+		ScaleFree(&lThumb);
+		free(lThumbBitmap);
+	}
 
-	return 0;
+	StatsPrint(&lStats, lError || lThumbError);
+	if (lError)
+		return ErrFile(argv[2], "write");
+	return (lThumbError) ? ErrFile(lThumbPath, "write") : 0;
 }
@@ -0,0 +1,280 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* JPEG */
+#include <jpeglib.h>
+#include <jerror.h>
+
+/* Local */
+#include "jpegwrite.h"
+#include "parallel.h"
+
+static void SetupCompressor(struct jpeg_compress_struct *cinfo, int32_t aWidth, int32_t aHeight, int32_t aQuality) {
+	cinfo->image_width = aWidth;
+	cinfo->image_height = aHeight;
+	cinfo->input_components = 3;
+	cinfo->in_color_space = JCS_RGB;
+
+	jpeg_set_defaults(cinfo);
+	jpeg_set_quality(cinfo, aQuality, TRUE);
+}
+
+/* Whole images have aRgb888 rows aStride apart, streamed ones come from aRows in bands of packed rows. */
+static int32_t WriteScanlines(
+	struct jpeg_compress_struct *cinfo, const uint8_t *aRgb888, uint32_t aStride, jpeg_rows_t aRows, void *aContext
+) {
+	JSAMPROW row_pointer[JPEG_BAND_ROWS];
+	const uint8_t *lBand;
+	JDIMENSION lCount, i;
+
+	if (aRows)
+		aStride = cinfo->image_width * 3;
+	jpeg_start_compress(cinfo, TRUE);
+	while (cinfo->next_scanline < cinfo->image_height) {
+		lCount = cinfo->image_height - cinfo->next_scanline;
+		if (lCount > JPEG_BAND_ROWS)
+			lCount = JPEG_BAND_ROWS;
+		if (aRows)
+			lBand = aRows(aContext, cinfo->next_scanline, lCount);
+		else
+			lBand = aRgb888 + cinfo->next_scanline * aStride;
+		if (!lBand) {
+			jpeg_abort_compress(cinfo);
+			return -1;
+		}
+		for (i = 0; i < lCount; ++i)
+			row_pointer[i] = (JSAMPROW) (lBand + i * aStride);
+		jpeg_write_scanlines(cinfo, row_pointer, lCount);
+	}
+	jpeg_finish_compress(cinfo);
+	return 0;
+}
+
+/* https://github.com/Tinker-S/libjpeg-sample/blob/master/jpeg_sample.c */
+void JpegWrite(FILE *aJpegFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aQuality) {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, aJpegFile);
+
+	SetupCompressor(&cinfo, aWidth, aHeight, aQuality);
+	WriteScanlines(&cinfo, aRgb888, aStride, NULL, NULL);
+
+	jpeg_destroy_compress(&cinfo);
+}
+
+int32_t JpegWriteRows(FILE *aJpegFile, jpeg_rows_t aRows, void *aContext, int32_t aWidth, int32_t aHeight, int32_t aQuality) {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	int32_t lError;
+
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	jpeg_stdio_dest(&cinfo, aJpegFile);
+
+	SetupCompressor(&cinfo, aWidth, aHeight, aQuality);
+	lError = WriteScanlines(&cinfo, NULL, 0, aRows, aContext);
+
+	jpeg_destroy_compress(&cinfo);
+	return lError;
+}
+
+typedef struct {
+	jpeg_encoder_t encoder;
+	const uint8_t *rgb;
+	uint32_t stride;
+	int32_t width;
+	int32_t rows;
+	int32_t quality;
+	uint32_t restart_interval;
+	int32_t error;
+	uint32_t scan;     /* Offset of the entropy-coded segment in the encoded band. */
+	uint32_t height;   /* Offset of the SOF0 height field. */
+} jpeg_band_t;
+
+static void *EncodeBand(void *aBand) {
+	jpeg_band_t *lBand = (jpeg_band_t *) aBand;
+	if (JpegEncoderInit(&lBand->encoder, lBand->width, lBand->rows, lBand->quality)) {
+		lBand->error = 1;
+		return NULL;
+	}
+	lBand->encoder.cinfo.restart_interval = lBand->restart_interval;
+	JpegEncodeFrame(&lBand->encoder, lBand->rgb, lBand->stride);
+	return NULL;
+}
+
+/* Walks the marker segments up to SOS, libjpeg writes no padding or APPn data between them that needs skipping. */
+static int32_t FindScan(jpeg_band_t *aBand) {
+	const uint8_t *lData = aBand->encoder.buffer;
+	const uint32_t lSize = aBand->encoder.size;
+	uint32_t lPosition = 2;
+	while (lPosition + 4 <= lSize && lData[lPosition] == 0xFF) {
+		uint32_t lLength = (lData[lPosition + 2] << 8) | lData[lPosition + 3];
+		if (lData[lPosition + 1] == 0xC0)
+			aBand->height = lPosition + 5;
+		if (lData[lPosition + 1] == 0xDA) {
+			aBand->scan = lPosition + 2 + lLength;
+			/* The segment must end with EOI. */
+			return (aBand->height && aBand->scan + 2 <= lSize && lData[lSize - 2] == 0xFF && lData[lSize - 1] == 0xD9) ? 0 : -1;
+		}
+		lPosition += 2 + lLength;
+	}
+	return -1;
+}
+
+/* Byte stuffing leaves 0xFF followed by 0xD0-0xD7 only in restart markers. */
+static uint32_t RenumberRestarts(uint8_t *aData, uint32_t aSize, uint32_t aNext) {
+	uint32_t i;
+	for (i = 0; i + 1 < aSize; ++i)
+		if (aData[i] == 0xFF && (aData[i + 1] & 0xF8) == 0xD0) {
+			aData[i + 1] = 0xD0 | (aNext++ & 7);
+			++i;
+		}
+	return aNext;
+}
+
+static int32_t StitchBands(FILE *aJpegFile, jpeg_band_t *aBands, int32_t aCount, int32_t aHeight) {
+	static const uint8_t lEnd[2] = { 0xFF, 0xD9 };
+	uint8_t *lHeader = aBands[0].encoder.buffer, lRestart[2];
+	uint32_t lNext = 0;
+	int32_t i;
+
+	for (i = 0; i < aCount; ++i)
+		if (aBands[i].error || FindScan(&aBands[i]))
+			return -1;
+	lHeader[aBands[0].height] = aHeight >> 8;
+	lHeader[aBands[0].height + 1] = aHeight;
+	if (fwrite(lHeader, aBands[0].scan, 1, aJpegFile) != 1)
+		return -1;
+	for (i = 0; i < aCount; ++i) {
+		uint8_t *lScan = aBands[i].encoder.buffer + aBands[i].scan;
+		uint32_t lSize = aBands[i].encoder.size - 2 - aBands[i].scan;
+		if (i) {
+			lRestart[0] = 0xFF;
+			lRestart[1] = 0xD0 | (lNext++ & 7);
+			if (fwrite(lRestart, sizeof(lRestart), 1, aJpegFile) != 1)
+				return -1;
+		}
+		lNext = RenumberRestarts(lScan, lSize, lNext);
+		if (lSize && fwrite(lScan, lSize, 1, aJpegFile) != 1)
+			return -1;
+	}
+	return (fwrite(lEnd, sizeof(lEnd), 1, aJpegFile) != 1) ? -1 : 0;
+}
+
+int32_t JpegWriteParallel(
+	FILE *aJpegFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aQuality, int32_t aThreads
+) {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	int32_t lMcuWidth = 0, lMcuHeight = 0, lMcuRows, lBandMcuRows, lCount, lError, i;
+	uint32_t lRestart;
+
+	/* The MCU size follows the sampling factors jpeg_set_defaults() picks, 16x16 for 4:2:0 YCbCr. */
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+	SetupCompressor(&cinfo, aWidth, aHeight, aQuality);
+	for (i = 0; i < cinfo.num_components; ++i) {
+		if (lMcuWidth < cinfo.comp_info[i].h_samp_factor * DCTSIZE)
+			lMcuWidth = cinfo.comp_info[i].h_samp_factor * DCTSIZE;
+		if (lMcuHeight < cinfo.comp_info[i].v_samp_factor * DCTSIZE)
+			lMcuHeight = cinfo.comp_info[i].v_samp_factor * DCTSIZE;
+	}
+	jpeg_destroy_compress(&cinfo);
+
+	if (aThreads < 1)
+		aThreads = ParallelCpus();
+	lMcuRows = (aHeight + lMcuHeight - 1) / lMcuHeight;
+	lBandMcuRows = (lMcuRows + aThreads - 1) / aThreads;
+	lCount = (lMcuRows + lBandMcuRows - 1) / lBandMcuRows;
+	if (lCount < 2) {
+		JpegWrite(aJpegFile, aRgb888, aStride, aWidth, aHeight, aQuality);
+		return 0;
+	}
+	/* DRI holds 16 bits, very wide bands restart on every MCU row and the extra markers get renumbered. */
+	lRestart = (aWidth + lMcuWidth - 1) / lMcuWidth;
+	if (lRestart * lBandMcuRows <= 0xFFFF)
+		lRestart *= lBandMcuRows;
+
+	jpeg_band_t lBands[lCount];
+	memset(lBands, 0, sizeof(lBands));
+	for (i = 0; i < lCount; ++i) {
+		int32_t lFirst = i * lBandMcuRows * lMcuHeight;
+		lBands[i].rgb = aRgb888 + lFirst * aStride;
+		lBands[i].stride = aStride;
+		lBands[i].width = aWidth;
+		lBands[i].rows = (aHeight - lFirst < lBandMcuRows * lMcuHeight) ? aHeight - lFirst : lBandMcuRows * lMcuHeight;
+		lBands[i].quality = aQuality;
+		lBands[i].restart_interval = lRestart;
+	}
+	ParallelRun(lBands, sizeof(jpeg_band_t), lCount, EncodeBand);
+
+	lError = StitchBands(aJpegFile, lBands, lCount, aHeight);
+	for (i = 0; i < lCount; ++i)
+		JpegEncoderFree(&lBands[i].encoder);
+	return lError;
+}
+
+/* libjpeg 6b has no jpeg_mem_dest(), a tiny destination manager writes into aEncoder->buffer instead. */
+static void MemoryDestInit(j_compress_ptr cinfo) {
+	jpeg_encoder_t *lEncoder = (jpeg_encoder_t *) cinfo->client_data;
+	lEncoder->dest.next_output_byte = lEncoder->buffer;
+	lEncoder->dest.free_in_buffer = lEncoder->capacity;
+}
+
+/* Called only when the whole buffer is full. */
+static boolean MemoryDestGrow(j_compress_ptr cinfo) {
+	jpeg_encoder_t *lEncoder = (jpeg_encoder_t *) cinfo->client_data;
+	uint8_t *lBuffer = realloc(lEncoder->buffer, lEncoder->capacity * 2);
+	if (!lBuffer)
+		ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+	lEncoder->dest.next_output_byte = lBuffer + lEncoder->capacity;
+	lEncoder->dest.free_in_buffer = lEncoder->capacity;
+	lEncoder->buffer = lBuffer;
+	lEncoder->capacity *= 2;
+	return TRUE;
+}
+
+static void MemoryDestTerm(j_compress_ptr cinfo) {
+	jpeg_encoder_t *lEncoder = (jpeg_encoder_t *) cinfo->client_data;
+	lEncoder->size = lEncoder->capacity - lEncoder->dest.free_in_buffer;
+}
+
+int32_t JpegEncoderInit(jpeg_encoder_t *aEncoder, int32_t aWidth, int32_t aHeight, int32_t aQuality) {
+	memset(aEncoder, 0, sizeof(jpeg_encoder_t));
+	/* A screen shot at quality 100 is usually below one byte per pixel. */
+	aEncoder->capacity = aWidth * aHeight;
+	if (!(aEncoder->buffer = malloc(aEncoder->capacity)))
+		return -1;
+
+	aEncoder->cinfo.err = jpeg_std_error(&aEncoder->jerr);
+	jpeg_create_compress(&aEncoder->cinfo);
+	aEncoder->cinfo.client_data = aEncoder;
+	aEncoder->dest.init_destination = MemoryDestInit;
+	aEncoder->dest.empty_output_buffer = MemoryDestGrow;
+	aEncoder->dest.term_destination = MemoryDestTerm;
+	aEncoder->cinfo.dest = &aEncoder->dest;
+
+	SetupCompressor(&aEncoder->cinfo, aWidth, aHeight, aQuality);
+	return 0;
+}
+
+void JpegEncodeFrame(jpeg_encoder_t *aEncoder, const uint8_t *aRgb888, uint32_t aStride) {
+	WriteScanlines(&aEncoder->cinfo, aRgb888, aStride, NULL, NULL);
+}
+
+int32_t JpegEncodeFrameRows(jpeg_encoder_t *aEncoder, jpeg_rows_t aRows, void *aContext) {
+	return WriteScanlines(&aEncoder->cinfo, NULL, 0, aRows, aContext);
+}
+
+void JpegEncoderFree(jpeg_encoder_t *aEncoder) {
+	if (aEncoder->buffer)
+		jpeg_destroy_compress(&aEncoder->cinfo);
+	free(aEncoder->buffer);
+	aEncoder->buffer = NULL;
+}
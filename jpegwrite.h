@@ -0,0 +1,49 @@
+#ifndef JPEGWRITE_H
+#define JPEGWRITE_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/* JPEG */
+#include <jpeglib.h>
+
+/* One compressor kept alive between frames, every frame is encoded into a growing memory buffer. */
+typedef struct {
+	struct jpeg_compress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	struct jpeg_destination_mgr dest;
+	uint8_t *buffer;
+	uint32_t capacity;
+	uint32_t size; /* Bytes of the last encoded frame. */
+} jpeg_encoder_t;
+
+/* Writes a baseline JPEG image of RGB888 pixels, aQuality is 0-100. libjpeg errors exit the process. */
+void JpegWrite(FILE *aJpegFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aQuality);
+
+/* Returns aCount packed RGB888 rows of the image from aRow on, at most JPEG_BAND_ROWS, or NULL to abort it. */
+typedef const uint8_t *(*jpeg_rows_t)(void *aContext, int32_t aRow, int32_t aCount);
+
+#define JPEG_BAND_ROWS      (16)    /* One MCU row of 4:2:0, libjpeg keeps no more than that itself. */
+
+/* JpegWrite() of an image that is produced band by band and never whole in memory. Returns 0 or -1. */
+int32_t JpegWriteRows(FILE *aJpegFile, jpeg_rows_t aRows, void *aContext, int32_t aWidth, int32_t aHeight, int32_t aQuality);
+
+/*
+ * Splits the image into up to aThreads bands of whole MCU rows (0 is one per CPU) and encodes each band on its own
+ * thread. The restart interval is one band, so the entropy-coded segments are stitched after the tables of the
+ * first band with RSTn markers renumbered in sequence. The result is a single baseline JPEG. Returns 0 or -1.
+ */
+int32_t JpegWriteParallel(
+	FILE *aJpegFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aQuality, int32_t aThreads
+);
+
+/* Returns 0 or -1 if out of memory. */
+int32_t JpegEncoderInit(jpeg_encoder_t *aEncoder, int32_t aWidth, int32_t aHeight, int32_t aQuality);
+/* Encodes one frame into aEncoder->buffer, aEncoder->size is set to its length. Reallocates only if the image grows. */
+void JpegEncodeFrame(jpeg_encoder_t *aEncoder, const uint8_t *aRgb888, uint32_t aStride);
+/* The same with the rows taken from aRows band by band. Returns 0 or -1 when aRows fails. */
+int32_t JpegEncodeFrameRows(jpeg_encoder_t *aEncoder, jpeg_rows_t aRows, void *aContext);
+void JpegEncoderFree(jpeg_encoder_t *aEncoder);
+
+#endif /* !JPEGWRITE_H */
@@ -0,0 +1,367 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* POSIX */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "convert.h"
+#include "magxgrab.h"
+#include "profile.h"
+#include "scale.h"
+#include "timing.h"
+
+int32_t GrabOpen(magxgrab_t *aGrab, const char *aDevice, const char *aProfile, uint32_t aDepth) {
+	memset(aGrab, 0, sizeof(magxgrab_t));
+	if ((aGrab->fd = open(aDevice, O_RDONLY)) < 0)
+		return GRAB_ERROR_OPEN;
+	if (ProfileLoad(&aGrab->display, aProfile, aGrab->fd)) {
+		close(aGrab->fd);
+		return GRAB_ERROR_PROFILE;
+	}
+	if (aDepth)
+		aGrab->raw_only = ProfileSetDepth(&aGrab->display, aDepth) != 0;
+	aGrab->mmap = (uint8_t *) mmap(NULL, aGrab->display.bytes, PROT_READ, MAP_SHARED, aGrab->fd, 0);
+	if (aGrab->mmap == MAP_FAILED) {
+		aGrab->mmap = NULL;
+		close(aGrab->fd);
+		return GRAB_ERROR_MMAP;
+	}
+	return GRAB_OK;
+}
+
+void GrabClose(magxgrab_t *aGrab) {
+	free(aGrab->band);
+	aGrab->band = NULL;
+	if (aGrab->source)
+		free(aGrab->mmap);
+	else {
+		if (aGrab->mmap)
+			munmap(aGrab->mmap, aGrab->display.bytes);
+		close(aGrab->fd);
+	}
+	aGrab->mmap = NULL;
+	aGrab->fd = -1;
+}
+
+int32_t GrabSetTransform(magxgrab_t *aGrab, transform_t aTransform) {
+	free(aGrab->band);
+	aGrab->band = NULL;
+	aGrab->transform = aTransform;
+	/* Wide enough for any rectangle in any destination format. */
+	if (aTransform && !(aGrab->band = malloc(CONVERT_BAND_BYTES(aGrab->display.width, 4)))) {
+		aGrab->transform = TRANSFORM_NONE;
+		return -1;
+	}
+	return 0;
+}
+
+int32_t GrabParseRect(const char *aText, grab_rect_t *aRect) {
+	char lEnd;
+	return (sscanf(aText, "%d,%d,%d,%d%c", &aRect->x, &aRect->y, &aRect->width, &aRect->height, &lEnd) == 4) ? 0 : -1;
+}
+
+int32_t GrabRect(const magxgrab_t *aGrab, const grab_rect_t *aRect, grab_rect_t *aResult) {
+	if (!aRect) {
+		aResult->x = aResult->y = 0;
+		aResult->width = aGrab->display.width;
+		aResult->height = aGrab->display.height;
+		return 0;
+	}
+	*aResult = *aRect;
+	return (
+		aRect->x < 0 || aRect->y < 0 || aRect->width <= 0 || aRect->height <= 0 ||
+		aRect->width > aGrab->display.width - aRect->x || aRect->height > aGrab->display.height - aRect->y
+	) ? -1 : 0;
+}
+
+uint32_t GrabBytes(const magxgrab_t *aGrab, const grab_rect_t *aRect, pixel_format_t aFormat) {
+	grab_rect_t lRect;
+	uint32_t lBytes = (aFormat == aGrab->display.format) ? aGrab->display.bpp : PixelFormatBytes(aFormat);
+	if (GrabRect(aGrab, aRect, &lRect))
+		return 0;
+	return lRect.width * lRect.height * lBytes;
+}
+
+void GrabImage(const magxgrab_t *aGrab, const grab_rect_t *aRect, display_t *aImage) {
+	*aImage = aGrab->display;
+	if (TRANSFORM_TRANSPOSED(aGrab->transform))
+		DisplayCrop(aImage, aRect->height, aRect->width);
+	else if (aGrab->transform || aRect->width != aImage->width || aRect->height != aImage->height)
+		DisplayCrop(aImage, aRect->width, aRect->height);
+}
+
+int32_t GrabCapture(const magxgrab_t *aGrab, uint8_t *aDst, uint32_t aDstStride, pixel_format_t aFormat, const grab_rect_t *aRect) {
+	const display_t *lDisplay = &aGrab->display;
+	const uint8_t *lSrc;
+	grab_rect_t lRect;
+	int32_t lWhole;
+
+	if (GrabRect(aGrab, aRect, &lRect))
+		return -1;
+	lWhole = lRect.width == lDisplay->width && lRect.height == lDisplay->height;
+	lSrc = aGrab->mmap + lRect.y * lDisplay->stride + lRect.x * lDisplay->bpp;
+
+	/* Raw copies also work when the forced depth left no known pixel format. */
+	if (aFormat == lDisplay->format || aGrab->raw_only) {
+		if (aFormat != lDisplay->format)
+			return -1;
+		ConvertCopy(aDst, aDstStride, lSrc, lDisplay->stride, lRect.width * lDisplay->bpp, lRect.height);
+		return 0;
+	}
+
+	if (!ConvertGetRow(lDisplay->format, aFormat) || (aGrab->transform && !aGrab->band))
+		return -1;
+	if (aGrab->transform)
+		return ConvertTransform(
+			aDst, aDstStride, aFormat, lSrc, lDisplay->stride, lDisplay->format, lRect.width, lRect.height, aGrab->transform,
+			aGrab->band
+		);
+	if (lWhole && aDstStride == lDisplay->width * PixelFormatBytes(aFormat)) {
+		DisplayConvert(lDisplay, aDst, aFormat, lSrc);
+		return 0;
+	}
+	return ConvertFrame(aDst, aDstStride, aFormat, lSrc, lDisplay->stride, lDisplay->format, lRect.width, lRect.height);
+}
+
+int32_t GrabSnapshotInit(magxgrab_t *aSnapshot, const magxgrab_t *aGrab, const grab_rect_t *aRect) {
+	grab_rect_t lRect;
+	if (GrabRect(aGrab, aRect, &lRect))
+		return -1;
+	*aSnapshot = *aGrab;
+	aSnapshot->fd = -1;
+	aSnapshot->band = NULL;
+	aSnapshot->source = aGrab->mmap + lRect.y * aGrab->display.stride + lRect.x * aGrab->display.bpp;
+	aSnapshot->source_stride = aGrab->display.stride;
+	/* The whole screen keeps the framebuffer layout and is copied in one run. */
+	if (lRect.width != aGrab->display.width || lRect.height != aGrab->display.height)
+		DisplayCrop(&aSnapshot->display, lRect.width, lRect.height);
+	if (!(aSnapshot->mmap = malloc(aSnapshot->display.bytes))) {
+		aSnapshot->source = NULL;
+		return -1;
+	}
+	if (GrabSetTransform(aSnapshot, aGrab->transform)) {
+		GrabClose(aSnapshot);
+		return -1;
+	}
+	return 0;
+}
+
+void GrabSnapshot(magxgrab_t *aSnapshot) {
+	const display_t *lDisplay = &aSnapshot->display;
+	if (!aSnapshot->source)
+		return;
+	ConvertCopy(
+		aSnapshot->mmap, lDisplay->stride, aSnapshot->source, aSnapshot->source_stride,
+		(lDisplay->stride == aSnapshot->source_stride) ? lDisplay->stride : (uint32_t) lDisplay->width * lDisplay->bpp, lDisplay->height
+	);
+}
+
+/* Both layers must be RGB666 mappings of the same geometry. */
+static int32_t OverlayLayersMatch(const magxgrab_t *aOverlay, const magxgrab_t *aUnder) {
+	const display_t *lDisplay = &aUnder->display;
+	return
+		lDisplay->format == PIXEL_RGB666 && aOverlay->display.format == PIXEL_RGB666 && !aOverlay->raw_only && !aUnder->raw_only &&
+		aOverlay->display.width == lDisplay->width && aOverlay->display.height == lDisplay->height &&
+		aOverlay->display.stride == lDisplay->stride;
+}
+
+int32_t GrabCaptureOverlay(
+	const magxgrab_t *aOverlay, const magxgrab_t *aUnder, uint8_t *aDst, uint32_t aDstStride, const overlay_t *aParams,
+	const grab_rect_t *aRect
+) {
+	const display_t *lDisplay = &aUnder->display;
+	grab_rect_t lRect;
+	uint32_t lOffset;
+	if (!OverlayLayersMatch(aOverlay, aUnder) || GrabRect(aUnder, aRect, &lRect) || (aUnder->transform && !aUnder->band))
+		return -1;
+	lOffset = lRect.y * lDisplay->stride + lRect.x * lDisplay->bpp;
+	ConvertOverlayTransform(
+		aDst, aDstStride, aOverlay->mmap + lOffset, aUnder->mmap + lOffset, lDisplay->stride, lRect.width, lRect.height, aParams,
+		aUnder->transform, aUnder->band
+	);
+	return 0;
+}
+
+/* A thumbnail of a transformed capture needs the turned size. */
+static int32_t ScaleMatches(const magxgrab_t *aGrab, const grab_rect_t *aRect, const scale_t *aScale) {
+	display_t lImage;
+	GrabImage(aGrab, aRect, &lImage);
+	return aScale->src_width == lImage.width && aScale->src_height == lImage.height;
+}
+
+int32_t GrabCaptureScaled(
+	const magxgrab_t *aGrab, uint8_t *aDst, uint32_t aDstStride, pixel_format_t aFormat, const grab_rect_t *aRect, scale_t *aScale
+) {
+	const display_t *lDisplay = &aGrab->display;
+	grab_rect_t lRect;
+	if (aGrab->raw_only || GrabRect(aGrab, aRect, &lRect) || !ScaleMatches(aGrab, &lRect, aScale))
+		return -1;
+	if (aGrab->transform) {
+		if (GrabCapture(aGrab, aDst, aDstStride, aFormat, &lRect))
+			return -1;
+		ScaleRows(aScale, aDst, aDstStride, aScale->src_height);
+		return 0;
+	}
+	return ScaleConvertFrame(
+		aScale, aDst, aDstStride, aFormat, aGrab->mmap + lRect.y * lDisplay->stride + lRect.x * lDisplay->bpp, lDisplay->stride,
+		lDisplay->format
+	);
+}
+
+int32_t GrabCaptureOverlayScaled(
+	const magxgrab_t *aOverlay, const magxgrab_t *aUnder, uint8_t *aDst, uint32_t aDstStride, const overlay_t *aParams,
+	const grab_rect_t *aRect, scale_t *aScale
+) {
+	const display_t *lDisplay = &aUnder->display;
+	const uint8_t *lOverlay, *lUnder;
+	grab_rect_t lRect;
+	int32_t y, lRows;
+	if (
+		!OverlayLayersMatch(aOverlay, aUnder) || GrabRect(aUnder, aRect, &lRect) || !ScaleMatches(aUnder, &lRect, aScale)
+	)
+		return -1;
+	if (aUnder->transform) {
+		if (GrabCaptureOverlay(aOverlay, aUnder, aDst, aDstStride, aParams, &lRect))
+			return -1;
+		ScaleRows(aScale, aDst, aDstStride, aScale->src_height);
+		return 0;
+	}
+	lOverlay = aOverlay->mmap + lRect.y * lDisplay->stride + lRect.x * lDisplay->bpp;
+	lUnder = aUnder->mmap + lRect.y * lDisplay->stride + lRect.x * lDisplay->bpp;
+	for (y = 0; y < lRect.height; y += SCALE_BAND) {
+		lRows = (lRect.height - y < SCALE_BAND) ? lRect.height - y : SCALE_BAND;
+		ConvertOverlay(
+			aDst + y * aDstStride, aDstStride, lOverlay + y * lDisplay->stride, lUnder + y * lDisplay->stride,
+			lDisplay->stride, lRect.width, lRows, aParams
+		);
+		ScaleRows(aScale, aDst + y * aDstStride, aDstStride, lRows);
+	}
+	return 0;
+}
+
+int32_t GrabStreamInit(grab_stream_t *aStream, const magxgrab_t *aGrab, pixel_format_t aFormat, const grab_rect_t *aRect, scale_t *aScale) {
+	memset(aStream, 0, sizeof(grab_stream_t));
+	if (aGrab->raw_only || GrabRect(aGrab, aRect, &aStream->rect) || !ConvertGetRow(aGrab->display.format, aFormat))
+		return -1;
+	if (aScale && !ScaleMatches(aGrab, &aStream->rect, aScale))
+		return -1;
+	GrabImage(aGrab, &aStream->rect, &aStream->image);
+	aStream->grab = aGrab;
+	aStream->format = aFormat;
+	aStream->stride = aStream->image.width * PixelFormatBytes(aFormat);
+	aStream->scale = aScale;
+	aStream->rows = malloc(aStream->stride * GRAB_STREAM_ROWS);
+	return (aStream->rows) ? 0 : -1;
+}
+
+int32_t GrabStreamInitOverlay(
+	grab_stream_t *aStream, const magxgrab_t *aOverlay, const magxgrab_t *aUnder, const overlay_t *aParams, const grab_rect_t *aRect,
+	scale_t *aScale
+) {
+	if (!OverlayLayersMatch(aOverlay, aUnder)) {
+		memset(aStream, 0, sizeof(grab_stream_t));
+		return -1;
+	}
+	/* The transform of aUnder applies, as in GrabCaptureOverlay(). */
+	if (GrabStreamInit(aStream, aUnder, PIXEL_BGR888, aRect, aScale))
+		return -1;
+	aStream->overlay = aOverlay;
+	aStream->params = aParams;
+	return 0;
+}
+
+const uint8_t *GrabStreamRows(void *aStream, int32_t aRow, int32_t aCount) {
+	grab_stream_t *lStream = (grab_stream_t *) aStream;
+	const transform_t lTransform = lStream->grab->transform;
+	const uint64_t lBegin = TimeMonotonicUs();
+	grab_rect_t lBand = lStream->rect;
+	int32_t lFirst, lError;
+
+	if (aRow < 0 || aCount < 1 || aCount > GRAB_STREAM_ROWS || aCount > lStream->image.height - aRow)
+		return NULL;
+	/* The screen lines the band turns from, image rows run backwards over them at 180 and 270 degrees. */
+	lFirst = (TRANSFORM_REVERSED(lTransform)) ? lStream->image.height - aRow - aCount : aRow;
+	if (TRANSFORM_TRANSPOSED(lTransform)) {
+		lBand.x += lFirst;
+		lBand.width = aCount;
+	} else {
+		lBand.y += lFirst;
+		lBand.height = aCount;
+	}
+	if (lStream->overlay)
+		lError = GrabCaptureOverlay(lStream->overlay, lStream->grab, lStream->rows, lStream->stride, lStream->params, &lBand);
+	else
+		lError = GrabCapture(lStream->grab, lStream->rows, lStream->stride, lStream->format, &lBand);
+	if (!lError && lStream->scale)
+		ScaleRows(lStream->scale, lStream->rows, lStream->stride, aCount);
+	lStream->convert_us += TimeMonotonicUs() - lBegin;
+	return (lError) ? NULL : lStream->rows;
+}
+
+int32_t GrabStreamBmp(grab_stream_t *aStream, int32_t aFd) {
+	const display_t *lImage = &aStream->image;
+	const uint8_t *lRows;
+	int32_t y, lCount;
+
+	if (aStream->format != PIXEL_BGR888 || BmpWriteHeaderFd(aFd, lImage->width, lImage->height, 24, NULL))
+		return -1;
+	if (aStream->scale)
+		ScaleBottomUp(aStream->scale);
+	for (y = lImage->height; y > 0; y -= lCount) {
+		lCount = (y < GRAB_STREAM_ROWS) ? y : GRAB_STREAM_ROWS;
+		lRows = GrabStreamRows(aStream, y - lCount, lCount);
+		if (!lRows || BmpWriteRowsFd(aFd, lRows, aStream->stride, lImage->width, lCount, 24))
+			return -1;
+	}
+	return 0;
+}
+
+void GrabStreamFree(grab_stream_t *aStream) {
+	free(aStream->rows);
+	aStream->rows = NULL;
+}
+
+void GrabSinkInit(grab_sink_t *aSink, uint8_t *aBuffer, uint32_t aCapacity) {
+	aSink->data = aBuffer;
+	aSink->capacity = aCapacity;
+	aSink->size = 0;
+}
+
+int32_t GrabSinkWrite(void *aSink, const uint8_t *aData, uint32_t aBytes) {
+	grab_sink_t *lSink = (grab_sink_t *) aSink;
+	if (aBytes > lSink->capacity - lSink->size)
+		return -1;
+	memcpy(lSink->data + lSink->size, aData, aBytes);
+	lSink->size += aBytes;
+	return 0;
+}
+
+uint32_t GrabBmpBytes(int32_t aWidth, int32_t aHeight) {
+	return sizeof(bmp_header_t) + ((aWidth * 3 + 3) & ~3) * aHeight;
+}
+
+int32_t GrabEncodeBmp(grab_sink_t *aSink, const uint8_t *aBgr888, uint32_t aStride, int32_t aWidth, int32_t aHeight) {
+	const uint32_t lRowBytes = aWidth * 3, lPadded = (lRowBytes + 3) & ~3;
+	bmp_header_t lHeader;
+	uint8_t *lRow;
+	int32_t y;
+
+	if (GrabBmpBytes(aWidth, aHeight) > aSink->capacity - aSink->size)
+		return -1;
+	BmpHeaderInit(&lHeader, aWidth, aHeight, 24, 0);
+	GrabSinkWrite(aSink, (const uint8_t *) &lHeader, sizeof(bmp_header_t));
+	for (y = aHeight - 1; y >= 0; --y) {
+		lRow = aSink->data + aSink->size;
+		memcpy(lRow, aBgr888 + y * aStride, lRowBytes);
+		memset(lRow + lRowBytes, 0, lPadded - lRowBytes);
+		aSink->size += lPadded;
+	}
+	return 0;
+}
@@ -0,0 +1,167 @@
+#ifndef MAGXGRAB_H
+#define MAGXGRAB_H
+
+/* C */
+#include <stdint.h>
+
+/* Local */
+#include "convert.h"
+#include "profile.h"
+#include "scale.h"
+
+/*
+ * libmagxgrab: framebuffer capture for the command line tools and for programs that take screenshots in process.
+ * A handle keeps the framebuffer open and mapped. Captures and BMP encoding write into caller buffers and never
+ * allocate, streams hold only a band of rows for the encoders that take them row by row. Compressed images go into a sink through the encoders the tools use:
+ *   PNG:  PngWriteCallback(GrabSinkWrite, &lSink, ...), libpng allocates its state for every image.
+ *         PngWriteFastCallback(GrabSinkWrite, &lSink, ...) is the built-in encoder without libpng and zlib.
+ *   JPEG: JpegEncodeFrame(&lEncoder, ...) with a compressor kept between captures, then
+ *         GrabSinkWrite(&lSink, lEncoder.buffer, lEncoder.size).
+ */
+
+/* GrabOpen() results. */
+#define GRAB_OK             (0)
+#define GRAB_ERROR_OPEN     (-1)
+#define GRAB_ERROR_PROFILE  (-2)
+#define GRAB_ERROR_MMAP     (-3)
+
+typedef struct {
+	display_t display;
+	int32_t fd;
+	uint8_t *mmap;
+	int32_t raw_only;   /* The forced depth has no known pixel format, only raw copies work. */
+	transform_t transform;   /* Orientation of converted captures, set by GrabSetTransform(), raw copies ignore it. */
+	uint8_t *band;           /* ConvertTransform() band of transformed captures, NULL without a transform. */
+	const uint8_t *source;   /* Snapshots: the first byte of their rectangle in the mapping, NULL after GrabOpen(). */
+	uint32_t source_stride;
+} magxgrab_t;
+
+typedef struct {
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+} grab_rect_t;
+
+/* Encoded images are appended to a caller buffer, a write that does not fit fails and leaves size unchanged. */
+typedef struct {
+	uint8_t *data;
+	uint32_t capacity;
+	uint32_t size;
+} grab_sink_t;
+
+/*
+ * Opens aDevice read-only, loads the aProfile device profile ("auto" asks the driver) and maps the framebuffer.
+ * A non-zero aDepth switches to the profile of the same geometry with that depth, like the fbdump <bpp> argument.
+ */
+int32_t GrabOpen(magxgrab_t *aGrab, const char *aDevice, const char *aProfile, uint32_t aDepth);
+/* Unmaps and closes a handle of GrabOpen(), or frees a snapshot. */
+void GrabClose(magxgrab_t *aGrab);
+/*
+ * Turns converted captures by aTransform, TRANSFORM_NONE after GrabOpen(). A transform allocates the band its
+ * captures are turned through once here. Returns 0 or -1 if out of memory.
+ */
+int32_t GrabSetTransform(magxgrab_t *aGrab, transform_t aTransform);
+
+/* Parses "x,y,w,h" as given to --rect. Returns 0 or -1 for bad syntax, the screen is checked by GrabRect(). */
+int32_t GrabParseRect(const char *aText, grab_rect_t *aRect);
+/* Copies aRect into aResult, NULL is the whole screen. Returns -1 unless the rectangle lies inside the screen. */
+int32_t GrabRect(const magxgrab_t *aGrab, const grab_rect_t *aRect, grab_rect_t *aResult);
+/* Bytes of a capture of aRect in aFormat with packed rows, 0 for a bad rectangle. */
+uint32_t GrabBytes(const magxgrab_t *aGrab, const grab_rect_t *aRect, pixel_format_t aFormat);
+/*
+ * The geometry of a converted capture of the checked aRect: the screen cropped to it and turned by the transform,
+ * with packed rows. The whole screen without a transform keeps the framebuffer layout.
+ */
+void GrabImage(const magxgrab_t *aGrab, const grab_rect_t *aRect, display_t *aImage);
+
+/*
+ * Captures aRect (NULL is the whole screen) into aDst rows of aDstStride bytes. aFormat equal to the framebuffer
+ * format copies the raw bytes with ConvertCopy(), any other one is converted on the way, whole screens through the converters compiled
+ * for their geometry and transformed captures through ConvertTransform(), aDst then holds the turned rectangle.
+ * Returns 0 or -1 for a bad rectangle or an unsupported conversion.
+ */
+int32_t GrabCapture(const magxgrab_t *aGrab, uint8_t *aDst, uint32_t aDstStride, pixel_format_t aFormat, const grab_rect_t *aRect);
+/*
+ * ograb composition of aRect (NULL is the whole screen) of the aOverlay layer over aUnder into BGR888 rows, both
+ * must be RGB666 of the same geometry. The transform of aUnder applies.
+ */
+int32_t GrabCaptureOverlay(
+	const magxgrab_t *aOverlay, const magxgrab_t *aUnder, uint8_t *aDst, uint32_t aDstStride, const overlay_t *aParams,
+	const grab_rect_t *aRect
+);
+
+/*
+ * Captures into RGB888 or BGR888 that also fill the thumbnail of aScale, initialized for the GrabImage() size.
+ * Bands of SCALE_BAND rows are scaled right after their conversion, while they are still in the cache. Transformed
+ * captures are scaled once they are complete, as their rows are only finished by the last band.
+ */
+int32_t GrabCaptureScaled(
+	const magxgrab_t *aGrab, uint8_t *aDst, uint32_t aDstStride, pixel_format_t aFormat, const grab_rect_t *aRect, scale_t *aScale
+);
+int32_t GrabCaptureOverlayScaled(
+	const magxgrab_t *aOverlay, const magxgrab_t *aUnder, uint8_t *aDst, uint32_t aDstStride, const overlay_t *aParams,
+	const grab_rect_t *aRect, scale_t *aScale
+);
+
+/*
+ * Snapshots keep the uncached framebuffer read window short: GrabSnapshot() copies aRect out of the mapping in one
+ * burst of wide loads, which also leaves the application less time to tear the frame, and the conversion reads the
+ * copy from the cache afterwards. A snapshot is a handle of its own with the rectangle as its screen and the
+ * transform of aGrab, captures and streams take it with a NULL rectangle. GrabClose() frees it, before aGrab.
+ */
+/* Returns 0 or -1 for a bad rectangle or out of memory. */
+int32_t GrabSnapshotInit(magxgrab_t *aSnapshot, const magxgrab_t *aGrab, const grab_rect_t *aRect);
+/* Copies the framebuffer rectangle again, for every frame of a recording. Does nothing for a handle of GrabOpen(). */
+void GrabSnapshot(magxgrab_t *aSnapshot);
+
+/*
+ * Streaming captures keep the memory flat whatever the screen size. GrabStreamRows() converts a band of at most
+ * GRAB_STREAM_ROWS rows of the GrabImage() into the rows of the stream, where an encoder takes them before it asks
+ * for the next band. Only the framebuffer rows of aRect a band comes from are read, or its columns when transposed.
+ */
+#define GRAB_STREAM_ROWS    (16)
+
+typedef struct {
+	const magxgrab_t *grab;
+	const magxgrab_t *overlay;   /* The ograb layer composed over grab, NULL for plain captures. */
+	const overlay_t *params;
+	grab_rect_t rect;
+	display_t image;             /* GrabImage() of rect. */
+	pixel_format_t format;
+	uint32_t stride;             /* Packed rows of image.width pixels. */
+	uint8_t *rows;               /* GRAB_STREAM_ROWS of them. */
+	scale_t *scale;              /* Thumbnail fed with every band, NULL for none. */
+	uint64_t convert_us;         /* Time spent in GrabStreamRows(), for --stats. */
+} grab_stream_t;
+
+/*
+ * Prepares a stream of aRect (NULL is the whole screen) converted to aFormat, raw copies are not streamed. aScale,
+ * if any, is initialized for the GrabImage() size. Returns 0 or -1 for a bad rectangle, an unsupported conversion
+ * or out of memory.
+ */
+int32_t GrabStreamInit(grab_stream_t *aStream, const magxgrab_t *aGrab, pixel_format_t aFormat, const grab_rect_t *aRect, scale_t *aScale);
+/* The same for the ograb composition of aOverlay over aUnder into BGR888 rows, see GrabCaptureOverlay(). */
+int32_t GrabStreamInitOverlay(
+	grab_stream_t *aStream, const magxgrab_t *aOverlay, const magxgrab_t *aUnder, const overlay_t *aParams, const grab_rect_t *aRect,
+	scale_t *aScale
+);
+/*
+ * Converts the image rows from aRow on, aCount of at most GRAB_STREAM_ROWS, into aStream->rows and returns them,
+ * NULL on error. aStream is a grab_stream_t, so this is a png_rows_t and jpeg_rows_t callback. Bands of a stream
+ * with a thumbnail must come in order from the top, or from the bottom after ScaleBottomUp().
+ */
+const uint8_t *GrabStreamRows(void *aStream, int32_t aRow, int32_t aCount);
+/* Writes a BGR888 stream as a 24 bpp BMP image, from the bottom band up as the format stores rows. Returns 0 or -1. */
+int32_t GrabStreamBmp(grab_stream_t *aStream, int32_t aFd);
+void GrabStreamFree(grab_stream_t *aStream);
+
+void GrabSinkInit(grab_sink_t *aSink, uint8_t *aBuffer, uint32_t aCapacity);
+/* A png_write_t for PngWriteCallback(), aSink is a grab_sink_t. Returns 0 or -1 when aBytes do not fit. */
+int32_t GrabSinkWrite(void *aSink, const uint8_t *aData, uint32_t aBytes);
+
+/* Size of a 24 bpp BMP image, and its encoding from BGR888 rows. Returns 0 or -1 when the sink is too small. */
+uint32_t GrabBmpBytes(int32_t aWidth, int32_t aHeight);
+int32_t GrabEncodeBmp(grab_sink_t *aSink, const uint8_t *aBgr888, uint32_t aStride, int32_t aWidth, int32_t aHeight);
+
+#endif /* !MAGXGRAB_H */
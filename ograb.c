@@ -7,57 +7,47 @@
 /* POSIX */
 #include <fcntl.h>
 #include <unistd.h>
-#include <sys/mman.h>
-#include <sys/ioctl.h>
+
+/* Local */
+#include "bmpwrite.h"
+#include "convert.h"
+#include "magxgrab.h"
+#include "profile.h"
+#include "scale.h"
+#include "stats.h"
 
 /* Defines */
 #define MXC_FB_0            "/dev/fb/0"
 #define MXC_FB_1            "/dev/fb/1"
-#define SCR_WIDTH           (240)
-#define SCR_HEIGHT          (320)
-#define SCR_DEPTH           (24)
-#define RGB666_TO_RGB888(c) ((((c) & (0x3F << 0)) <<  2) | (((c) & (0x3F <<  6)) << 4) | (((c) & (0x3F << 12)) <<  6))
-
-typedef struct {
-	int32_t width;
-	int32_t height;
-	uint32_t size;
-	uint32_t depth;
-	uint8_t bpp;
-	uint32_t bytes;
-} display_t;
-
-/* See: https://en.wikipedia.org/wiki/BMP_file_format */
-#pragma pack(push, 1)
-typedef struct {
-	/* Bitmap file header */
-	uint16_t file_magic;
-	uint32_t file_size;
-	uint32_t bytes_reserved;
-	uint32_t bitmap_start;
-	/* DIB header (bitmap information header) */
-	uint32_t dib_header_size;
-	int32_t bitmap_width;
-	int32_t bitmap_height;
-	uint16_t color_planes;
-	uint16_t bitmap_bpp;
-	uint32_t compression_method;
-	uint32_t bitmap_size;
-	int32_t bitmap_width_ppm;
-	int32_t bitmap_height_ppm;
-	uint32_t num_of_colors;
-	uint32_t num_of_important_colors;
-} bmp_header_t;
-#pragma pack(pop)
 
 static int32_t ErrUsage(void) {
 	fprintf(
 		stderr,
 		"Usage:\n"
-		"\t./ograb <BMP image file>\n\n"
+		"\t./ograb <BMP image file> [--key RRGGBB] [--alpha 0-255] [--rect x,y,w,h] [--rotate degrees] [--mirror]\n"
+		"\t        [--thumb file] [--thumb-size size] [--direct] [--device profile] [--stats]\n\n"
+		"Overlay:\n"
+		"\t--key RRGGBB  - " MXC_FB_0 " pixels of this color show " MXC_FB_1 ", others are drawn on top\n"
+		"\t                without it pixels with any zero byte are transparent (default)\n"
+		"\t--alpha 0-255 - opacity of the drawn " MXC_FB_0 " pixels (default 255)\n\n"
+		"Region:\n"
+		"\t--rect x,y,w,h    - compose only this rectangle, the rest of both layers is not read\n\n"
+		"Orientation:\n"
+		"\t--rotate degrees  - turn the image clockwise by 90, 180 or 270 degrees while it is converted\n"
+		"\t--mirror          - mirror it left to right after the turn, --rect is given in screen coordinates\n\n"
+		"Thumbnail:\n"
+		"\t--thumb file      - also write a reduced BMP image, made in the same pass as the full one\n"
+		"\t--thumb-size size - 1/N of the screen or WxH, a 0 side keeps the aspect ratio (default 1/4)\n\n"
+		"Profiles: RGB666 ones of " PROFILE_NAMES " (default " DEVICE_PROFILE ").\n"
+		"--stats prints stage times and counters to stderr as one JSON line, read_us is the snapshot.\n"
+		"--direct composes straight from the framebuffers instead of snapshots copied out first, for the smallest heap.\n\n"
 		"Example:\n"
 		"\t./ograb screenshot1.bmp\n"
 		"\t./ograb stdout > screenshot2.bmp\n"
+		"\t./ograb screenshot3.bmp --key 000000 --alpha 192\n"
+		"\t./ograb screenshot4.bmp --thumb thumbnail4.bmp --thumb-size 1/2\n"
+		"\t./ograb statusbar.bmp --rect 0,0,240,24\n"
+		"\t./ograb landscape.bmp --rotate 270\n"
 	);
 	return 1;
 }
@@ -67,106 +57,169 @@ static int32_t ErrFile(const char *aFileName, const char *aMode) {
 	return 1;
 }
 
-static uint32_t *OverlayBitmapFromMemory(uint8_t *a_fb_mmap, uint32_t *aBitmapRgb888, const display_t *aDisplay) {
-	int32_t y, x;
-	for (y = 0; y < aDisplay->height; ++y)
-		for (x = 0; x < aDisplay->width; ++x) {
-			uint32_t lPixelRgb666 = 0x000000;
-			uint8_t r = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t g = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t b = *a_fb_mmap; ++a_fb_mmap;
-			if (r != 0x00 && g != 0x00 && b != 0x00) {
-				lPixelRgb666 = (b << 16) | (g << 8) | r;
-				aBitmapRgb888[x + y * aDisplay->width] = RGB666_TO_RGB888(lPixelRgb666);
-			}
-		}
-	return aBitmapRgb888;
+static int32_t ErrRect(const display_t *aDisplay) {
+	fprintf(stderr, "Error: the rectangle must lie inside the %dx%d screen!\n", aDisplay->width, aDisplay->height);
+	return 1;
 }
 
-static uint32_t *CreateBitmapFromFile(uint8_t *a_fb_mmap, const display_t *aDisplay) {
-	int32_t y, x;
-	uint32_t *lBitmapRgb888 = malloc(aDisplay->size * sizeof(uint32_t));
-	for (y = 0; y < aDisplay->height; ++y)
-		for (x = 0; x < aDisplay->width; ++x) {
-			uint32_t lPixelRgb666 = 0x000000;
-			uint8_t r = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t g = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t b = *a_fb_mmap; ++a_fb_mmap;
-			lPixelRgb666 = (b << 16) | (g << 8) | r;
-			lBitmapRgb888[x + y * aDisplay->width] = RGB666_TO_RGB888(lPixelRgb666);
-		}
-	return lBitmapRgb888;
+static int32_t ErrProfile(const char *aProfile) {
+	fprintf(stderr, "Error: unknown or unsupported device profile '%s'!\n", aProfile);
+	return 1;
 }
 
-static void WriteBmpHeader(FILE *aWriteFile, const display_t *aDisplay) {
-	bmp_header_t lBmpHeader;
-	memset(&lBmpHeader, 0, sizeof(bmp_header_t));
-	lBmpHeader.file_magic = 0x4D42;
-	lBmpHeader.file_size = aDisplay->bytes + 14 + 40; /* RGB888/24/3, BMP header, DIB header. */
-	lBmpHeader.bitmap_start = 0x00000036;
-	lBmpHeader.dib_header_size = 0x00000028;
-	lBmpHeader.bitmap_width = aDisplay->width;
-	lBmpHeader.bitmap_height = aDisplay->height;
-	lBmpHeader.color_planes = 0x0001;
-	lBmpHeader.bitmap_bpp = aDisplay->depth;
-	lBmpHeader.bitmap_size = aDisplay->bytes; /* RGB888/24/3. */
-	fwrite(&lBmpHeader, sizeof(bmp_header_t), 1, aWriteFile);
+static int32_t ErrOpen(const char *aDevice, const char *aProfile, int32_t aError) {
+	if (aError == GRAB_ERROR_PROFILE)
+		return ErrProfile(aProfile);
+	return ErrFile(aDevice, (aError == GRAB_ERROR_MMAP) ? "mmap" : "read");
 }
 
-static void WriteBmpBitmap(FILE *aWriteFile, const display_t *aDisplay, const uint32_t *aBitmap) {
-	int32_t y, x;
-	for (y = aDisplay->height - 1; y >= 0; --y)
-		for (x = 0; x < aDisplay->width; ++x) {
-			uint32_t lPixelRgb888 = aBitmap[x + y * aDisplay->width];
-			fwrite(&lPixelRgb888, aDisplay->bpp, 1, aWriteFile);
-		}
+static int32_t WriteThumbnail(const char *aFileName, const scale_t *aThumb, stats_t *aStats) {
+	uint64_t lBegin = StatsBegin(aStats);
+	int32_t lError;
+	FILE *lBmpFile = fopen(aFileName, "wb");
+	if (!lBmpFile)
+		return -1;
+	lError = BmpWrite(lBmpFile, aThumb->dst, aThumb->dst_stride, aThumb->width, aThumb->height, 24, NULL);
+	StatsEnd(aStats, STATS_WRITE, lBegin);
+	if (StatsFlush(aStats, lBmpFile))
+		lError = -1;
+	return (fclose(lBmpFile)) ? -1 : lError;
 }
 
 int main(int argc, char *argv[]) {
-	if (argc != 2)
+	int32_t i;
+	if (argc < 2)
 		return ErrUsage();
 
-	display_t lScreen;
-	lScreen.width = SCR_WIDTH;
-	lScreen.height = SCR_HEIGHT;
-	lScreen.size = lScreen.height * lScreen.width;
-	lScreen.depth = SCR_DEPTH;
-	lScreen.bpp = lScreen.depth / 8;
-	lScreen.bytes = lScreen.size * lScreen.bpp;
-
-	int32_t fb_fd_0 = open(MXC_FB_0, O_RDONLY);
-	if (fb_fd_0 == EXIT_FAILURE)
-		return ErrFile(MXC_FB_0, "read");
-	int32_t fb_fd_1 = open(MXC_FB_1, O_RDONLY);
-	if (fb_fd_1 == EXIT_FAILURE)
-		return ErrFile(MXC_FB_1, "read");
-
-	uint8_t *fb_mmap_0 = (uint8_t *) mmap(NULL, lScreen.bytes, PROT_READ, MAP_SHARED, fb_fd_0, 0);
-	if (fb_mmap_0 == MAP_FAILED)
-		return ErrFile(MXC_FB_0, "mmap");
-	uint8_t *fb_mmap_1 = (uint8_t *) mmap(NULL, lScreen.bytes, PROT_READ, MAP_SHARED, fb_fd_1, 0);
-	if (fb_mmap_1 == MAP_FAILED)
-		return ErrFile(MXC_FB_1, "mmap");
-
-	uint32_t *lBitmap = CreateBitmapFromFile(fb_mmap_1, &lScreen);
-	lBitmap = OverlayBitmapFromMemory(fb_mmap_0, lBitmap, &lScreen);
-
-	munmap(fb_mmap_1, lScreen.bytes);
-	munmap(fb_mmap_0, lScreen.bytes);
-	close(fb_fd_1);
-	close(fb_fd_0);
-
-	FILE *lBmpFile = NULL;
-	if (!strcmp("stdout", argv[1]))
-		lBmpFile = stdout;
-	else
-		lBmpFile = fopen(argv[1], "wb");
-	if (!lBmpFile)
+	const char *lProfile = DEVICE_PROFILE, *lThumbPath = NULL, *lThumbSize = "1/4";
+	overlay_t lOverlay;
+	lOverlay.keyed = 0;
+	lOverlay.key = 0x000000;
+	lOverlay.alpha = 255;
+	int32_t lStatsEnabled = 0, lDirect = 0;
+	grab_rect_t lRegion, *lRegionArg = NULL;
+	int32_t lDegrees = 0, lMirror = 0;
+	transform_t lTransform;
+	for (i = 2; i < argc; ++i) {
+		if (!strcmp("--device", argv[i]) && i + 1 < argc)
+			lProfile = argv[++i];
+		else if (!strcmp("--rotate", argv[i]) && i + 1 < argc)
+			lDegrees = atoi(argv[++i]);
+		else if (!strcmp("--mirror", argv[i]))
+			lMirror = 1;
+		else if (!strcmp("--rect", argv[i]) && i + 1 < argc) {
+			if (GrabParseRect(argv[++i], &lRegion))
+				return ErrUsage();
+			lRegionArg = &lRegion;
+		} else if (!strcmp("--key", argv[i]) && i + 1 < argc) {
+			lOverlay.keyed = 1;
+			lOverlay.key = strtoul(argv[++i], NULL, 16) & 0xFFFFFF;
+		} else if (!strcmp("--alpha", argv[i]) && i + 1 < argc) {
+			int32_t lAlpha = atoi(argv[++i]);
+			if (lAlpha < 0 || lAlpha > 255)
+				return ErrUsage();
+			lOverlay.alpha = lAlpha;
+		} else if (!strcmp("--thumb", argv[i]) && i + 1 < argc)
+			lThumbPath = argv[++i];
+		else if (!strcmp("--thumb-size", argv[i]) && i + 1 < argc)
+			lThumbSize = argv[++i];
+		else if (!strcmp("--stats", argv[i]))
+			lStatsEnabled = 1;
+		else if (!strcmp("--direct", argv[i]))
+			lDirect = 1;
+		else
+			return ErrUsage();
+	}
+	if (ConvertGetTransform(lDegrees, lMirror, &lTransform))
+		return ErrUsage();
+
+	stats_t lStats;
+	StatsInit(&lStats, "ograb", lStatsEnabled);
+	uint64_t lBegin = StatsBegin(&lStats);
+	magxgrab_t lLayer0, lLayer1;
+	int32_t lError = GrabOpen(&lLayer0, MXC_FB_0, lProfile, 0);
+	if (lError)
+		return ErrOpen(MXC_FB_0, lProfile, lError);
+	if ((lError = GrabOpen(&lLayer1, MXC_FB_1, lProfile, 0)))
+		return ErrOpen(MXC_FB_1, lProfile, lError);
+
+	/* The overlay key below only makes sense for the RGB666 MotoMAGX framebuffers. */
+	display_t lScreen = lLayer1.display;
+	if (lScreen.format != PIXEL_RGB666)
+		return ErrProfile(lProfile);
+	/* From here on lScreen is the composed image, cropped and turned with packed rows. */
+	grab_rect_t lRect;
+	if (GrabRect(&lLayer1, lRegionArg, &lRect))
+		return ErrRect(&lScreen);
+	if (GrabSetTransform(&lLayer1, lTransform))
+		return ErrFile(argv[1], "write");
+	GrabImage(&lLayer1, &lRect, &lScreen);
+	lStats.device = lScreen.name;
+	StatsEnd(&lStats, STATS_OPEN, lBegin);
+
+	scale_t lThumb;
+	uint8_t *lThumbBitmap = NULL;
+	int32_t lThumbWidth, lThumbHeight;
+	if (lThumbPath) {
+		if (ScaleParseSize(lThumbSize, lScreen.width, lScreen.height, &lThumbWidth, &lThumbHeight))
+			return ErrUsage();
+		lThumbBitmap = malloc(lThumbWidth * lThumbHeight * 3);
+		if (!lThumbBitmap || ScaleInit(&lThumb, lScreen.width, lScreen.height, lThumbBitmap, lThumbWidth * 3, lThumbWidth, lThumbHeight))
+			return ErrFile(lThumbPath, "write");
+	}
+
+	/* Both layers are copied out one right after the other, so they show the same moment, unless --direct. */
+	magxgrab_t lSnapshot0, lSnapshot1, *lSource0 = &lLayer0, *lSource1 = &lLayer1;
+	const grab_rect_t *lSourceRect = &lRect;
+	if (!lDirect) {
+		if (GrabSnapshotInit(&lSnapshot0, &lLayer0, &lRect))
+			return ErrFile(argv[1], "write");
+		if (GrabSnapshotInit(&lSnapshot1, &lLayer1, &lRect))
+			return ErrFile(argv[1], "write");
+		lSource0 = &lSnapshot0;
+		lSource1 = &lSnapshot1;
+		lSourceRect = NULL;
+	}
+	lBegin = StatsBegin(&lStats);
+	GrabSnapshot(lSource0);
+	GrabSnapshot(lSource1);
+	StatsEnd(&lStats, STATS_READ, lBegin);
+
+	/* The rectangle of both layers is read once, band by band, and composed straight into the BMP pixel order. */
+	grab_stream_t lStream;
+	if (GrabStreamInitOverlay(&lStream, lSource0, lSource1, &lOverlay, lSourceRect, (lThumbPath) ? &lThumb : NULL))
+		return ErrProfile(lProfile);
+	int32_t lBmpFd = STDOUT_FILENO;
+	if (strcmp("stdout", argv[1]) && (lBmpFd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
 		return ErrFile(argv[1], "write");
-	WriteBmpHeader(lBmpFile, &lScreen);
-	WriteBmpBitmap(lBmpFile, &lScreen, lBitmap);
-	free(lBitmap);
-	fclose(lBmpFile);
 
-	return 0;
+	lBegin = StatsBegin(&lStats);
+	lError = GrabStreamBmp(&lStream, lBmpFd);
+	StatsEnd(&lStats, STATS_WRITE, lBegin);
+	StatsMove(&lStats, STATS_WRITE, STATS_CONVERT, lStream.convert_us);
+	StatsOutput(&lStats, lBmpFd);
+	lStats.bytes_read += lScreen.bytes * 2;
+	lStats.frames = 1;
+
+	GrabStreamFree(&lStream);
+	if (!lDirect) {
+		GrabClose(&lSnapshot1);
+		GrabClose(&lSnapshot0);
+	}
+	GrabClose(&lLayer1);
+	GrabClose(&lLayer0);
+	if (lBmpFd != STDOUT_FILENO && close(lBmpFd))
+		lError = -1;
+
+	int32_t lThumbError = 0;
+	if (lThumbPath) {
+		lThumbError = WriteThumbnail(lThumbPath, &lThumb, &lStats);
+		ScaleFree(&lThumb);
+		free(lThumbBitmap);
+	}
+
+	StatsPrint(&lStats, lError || lThumbError);
+	if (lError)
+		return ErrFile(argv[1], "write");
+	return (lThumbError) ? ErrFile(lThumbPath, "write") : 0;
 }
@@ -0,0 +1,30 @@
+/* C */
+#include <stdint.h>
+
+/* POSIX */
+#include <pthread.h>
+#include <unistd.h>
+
+/* Local */
+#include "parallel.h"
+
+int32_t ParallelCpus(void) {
+	long lCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return (lCpus > 0) ? (int32_t) lCpus : 1;
+}
+
+void ParallelRun(void *aJobs, uint32_t aJobSize, int32_t aCount, void *(*aWorker)(void *)) {
+	uint8_t *lJobs = (uint8_t *) aJobs;
+	pthread_t lThreads[aCount];
+	int32_t lStarted[aCount];
+	int32_t i;
+	for (i = 1; i < aCount; ++i) {
+		lStarted[i] = !pthread_create(&lThreads[i], NULL, aWorker, lJobs + i * aJobSize);
+		if (!lStarted[i])
+			aWorker(lJobs + i * aJobSize);
+	}
+	aWorker(lJobs);
+	for (i = 1; i < aCount; ++i)
+		if (lStarted[i])
+			pthread_join(lThreads[i], NULL);
+}
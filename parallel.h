@@ -0,0 +1,15 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+/* C */
+#include <stdint.h>
+
+/* Number of online CPUs, at least 1. */
+int32_t ParallelCpus(void);
+/*
+ * Calls aWorker on each of aCount jobs of aJobSize bytes, one thread per job and job 0 on the calling thread.
+ * A job whose thread cannot be started runs on the calling thread too. Returns when every job is done.
+ */
+void ParallelRun(void *aJobs, uint32_t aJobSize, int32_t aCount, void *(*aWorker)(void *));
+
+#endif /* !PARALLEL_H */
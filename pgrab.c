@@ -3,40 +3,60 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-/* POSIX */
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/mman.h>
-#include <sys/ioctl.h>
-
-/* PNG */
-#include <png.h>
+/* Local */
+#include "apngwrite.h"
+#include "convert.h"
+#include "magxgrab.h"
+#include "parallel.h"
+#include "pngfast.h"
+#include "pngpar.h"
+#include "pngwrite.h"
+#include "profile.h"
+#include "scale.h"
+#include "stats.h"
+#include "timing.h"
 
 /* Defines */
-#define SCR_WIDTH           (240)
-#define SCR_HEIGHT          (320)
-#define SCR_DEPTH           (24)
-#define RGB666_TO_RGB888(c) ((((c) & (0x3F << 0)) <<  2) | (((c) & (0x3F <<  6)) << 4) | (((c) & (0x3F << 12)) <<  6))
-
-typedef struct {
-	int32_t width;
-	int32_t height;
-	uint32_t size;
-	uint32_t depth;
-	uint8_t bpp;
-	uint32_t bytes;
-} display_t;
+#define APNG_INTERVAL       (100)
 
 static int32_t ErrUsage(void) {
 	fprintf(
 		stderr,
 		"Usage:\n"
-		"\t./pgrab <device> <PNG image file> <compression 0-9>\n\n"
+		"\t./pgrab <device> <PNG image file> <compression 0-9> [--apng N] [--interval ms] [--threads N] [--palette] [--fast]\n"
+		"\t      [--rect x,y,w,h] [--rotate degrees] [--mirror] [--thumb file] [--thumb-size size] [--direct]\n"
+		"\t      [--device profile] [--stats]\n\n"
+		"Profiles: " PROFILE_NAMES " (default " DEVICE_PROFILE ").\n"
+		"--stats prints stage times and counters to stderr as one JSON line, read_us is the snapshot.\n"
+		"--direct converts straight from the framebuffer instead of a snapshot copied out first, for the smallest heap.\n\n"
+		"Animation:\n"
+		"\t--apng N       - capture N frames into one animated PNG, frames are cropped to the changed pixels\n"
+		"\t--interval ms  - time between frame starts (default %d), 0 is as fast as possible\n\n"
+		"Threads:\n"
+		"\t--threads N    - deflate strips of the image on N threads (default all online CPUs), 1 is a single libpng stream\n\n"
+		"Encoder:\n"
+		"\t--palette      - write a 1, 2, 4 or 8-bit indexed PNG when the screen has at most 256 colors, RGB otherwise\n"
+		"\t--fast         - built-in single pass encoder instead of libpng, the compression level is ignored\n\n"
+		"Region:\n"
+		"\t--rect x,y,w,h - capture only this rectangle, also every frame of an animation\n\n"
+		"Orientation:\n"
+		"\t--rotate degrees - turn the image clockwise by 90, 180 or 270 degrees while it is converted\n"
+		"\t--mirror         - mirror it left to right after the turn, --rect is given in screen coordinates\n\n"
+		"Thumbnail:\n"
+		"\t--thumb file      - also write a reduced RGB PNG image with the same encoder, made in the same pass as the full one\n"
+		"\t--thumb-size size - 1/N of the screen or WxH, a 0 side keeps the aspect ratio (default 1/4)\n\n"
 		"Example:\n"
 		"\t./pgrab /dev/fb/0 screenshot1.png 6\n"
 		"\t./pgrab /dev/fb/1 screenshot2.png 0\n"
 		"\t./pgrab /dev/fb/0 stdout 2 > screenshot3.png\n"
+		"\t./pgrab /dev/fb/0 screenshot4.png 0 --fast\n"
+		"\t./pgrab /dev/fb/0 screenshot5.png 6 --thumb thumbnail5.png --thumb-size 80x0\n"
+		"\t./pgrab /dev/fb/0 transition.png 6 --apng 50 --interval 40\n"
+		"\t./pgrab /dev/fb/0 statusbar.png 6 --rect 0,0,240,24 --palette\n"
+		"\t./pgrab /dev/fb/0 landscape.png 6 --rotate 90 --fast\n",
+		APNG_INTERVAL
 	);
 	return 1;
 }
@@ -46,81 +66,288 @@ static int32_t ErrFile(const char *aFileName, const char *aMode) {
 	return 1;
 }
 
-static uint8_t *CreateBitmapFromFile(uint8_t *a_fb_mmap, const display_t *aDisplay) {
-	int32_t y, x;
-	uint8_t *lBitmapRgb888 = malloc(aDisplay->bytes);
-	for (y = 0; y < aDisplay->height; ++y)
-		for (x = 0; x < aDisplay->width; ++x) {
-			uint32_t lPixelRgb666 = 0x000000;
-			uint8_t r = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t g = *a_fb_mmap; ++a_fb_mmap;
-			uint8_t b = *a_fb_mmap; ++a_fb_mmap;
-			lPixelRgb666 = (b << 16) | (g << 8) | r;
-			lPixelRgb666 = RGB666_TO_RGB888(lPixelRgb666);
-			int z = (x + y * aDisplay->width) * aDisplay->bpp;
-			lBitmapRgb888[z] = (uint8_t) (lPixelRgb666 >> 16) & 0xFF;
-			lBitmapRgb888[z + 1] = (uint8_t) (lPixelRgb666 >> 8) & 0xFF;
-			lBitmapRgb888[z + 2] = (uint8_t) (lPixelRgb666 >> 0) & 0xFF;
-		}
+static int32_t ErrRect(const display_t *aDisplay) {
+	fprintf(stderr, "Error: the rectangle must lie inside the %dx%d screen!\n", aDisplay->width, aDisplay->height);
+	return 1;
+}
+
+static int32_t ErrProfile(const char *aProfile) {
+	fprintf(stderr, "Error: unknown or unsupported device profile '%s'!\n", aProfile);
+	return 1;
+}
+
+static int32_t ErrOpen(const char *aDevice, const char *aProfile, int32_t aError) {
+	if (aError == GRAB_ERROR_PROFILE)
+		return ErrProfile(aProfile);
+	return ErrFile(aDevice, (aError == GRAB_ERROR_MMAP) ? "mmap" : "read");
+}
+
+/*
+ * Parallel strips need the whole image: only the framebuffer rows and columns of aRect are read into aImage, the
+ * GrabImage() geometry, aThumb, if any, gets its thumbnail in the same pass.
+ */
+static uint8_t *CreateBitmapFromFile(const magxgrab_t *aGrab, const grab_rect_t *aRect, const display_t *aImage, scale_t *aThumb) {
+	uint8_t *lBitmapRgb888 = malloc(aImage->size * 3);
+	int32_t lError = 0;
+	if (lBitmapRgb888 && aThumb)
+		lError = GrabCaptureScaled(aGrab, lBitmapRgb888, aImage->width * 3, PIXEL_RGB888, aRect, aThumb);
+	else if (lBitmapRgb888)
+		lError = GrabCapture(aGrab, lBitmapRgb888, aImage->width * 3, PIXEL_RGB888, aRect);
+	if (lError) {
+		free(lBitmapRgb888);
+		return NULL;
+	}
 	return lBitmapRgb888;
 }
 
-/* http://zarb.org/~gc/html/libpng.html */
-static void CreatePngFromBitmap(FILE *aPngFile, const display_t *aDisplay, uint8_t *aBitmap, int32_t aCompression) {
-	int i;
-	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-	png_infop info_ptr = png_create_info_struct(png_ptr);
-	png_init_io(png_ptr, aPngFile);
-
-	png_set_compression_level(png_ptr, aCompression);
-
-	png_set_IHDR(
-		png_ptr,
-		info_ptr,
-		aDisplay->width,
-		aDisplay->height,
-		aDisplay->depth / aDisplay->bpp,
-		PNG_COLOR_TYPE_RGB,
-		PNG_INTERLACE_NONE,
-		PNG_COMPRESSION_TYPE_BASE,
-		PNG_FILTER_TYPE_BASE
-	);
-	png_write_info(png_ptr, info_ptr);
+/*
+ * The palette has to be known before the first row, so indexed images keep one byte per pixel instead of three: bands
+ * of the image are turned into indices as they are converted. Returns the indices or NULL when there are more than
+ * 256 colors, aThumb has to start over then.
+ */
+static uint8_t *CreateIndicesFromFile(
+	const magxgrab_t *aGrab, const grab_rect_t *aRect, const display_t *aImage, png_palette_t *aPalette, scale_t *aThumb
+) {
+	grab_stream_t lStream;
+	const uint8_t *lRows;
+	int32_t y, lCount;
+	uint8_t *lIndices = malloc(aImage->size);
+	if (!lIndices || GrabStreamInit(&lStream, aGrab, PIXEL_RGB888, aRect, aThumb)) {
+		free(lIndices);
+		return NULL;
+	}
+	PngPaletteInit(aPalette);
+	for (y = 0; y < aImage->height && lIndices; y += lCount) {
+		lCount = (aImage->height - y < GRAB_STREAM_ROWS) ? aImage->height - y : GRAB_STREAM_ROWS;
+		lRows = GrabStreamRows(&lStream, y, lCount);
+		if (!lRows || PngPaletteAdd(aPalette, lIndices + y * aImage->width, lRows, lStream.stride, aImage->width, lCount)) {
+			free(lIndices);
+			lIndices = NULL;
+		}
+	}
+	GrabStreamFree(&lStream);
+	return lIndices;
+}
+
+/* Thumbnails are small, a single stream of the main image encoder is enough. */
+static int32_t WriteThumbnail(const char *aFileName, const scale_t *aThumb, int32_t aCompression, int32_t aFast, stats_t *aStats) {
+	uint64_t lBegin;
+	int32_t lError;
+	FILE *lPngFile = fopen(aFileName, "wb");
+	if (!lPngFile)
+		return -1;
+	StatsBuffer(aStats, lPngFile, aThumb->width * aThumb->height * 3);
+	lBegin = StatsBegin(aStats);
+	if (aFast)
+		lError = PngWriteFast(lPngFile, aThumb->dst, aThumb->dst_stride, aThumb->width, aThumb->height);
+	else
+		lError = PngWrite(lPngFile, aThumb->dst, aThumb->dst_stride, aThumb->width, aThumb->height, aCompression);
+	StatsEnd(aStats, STATS_ENCODE, lBegin);
+	if (StatsFlush(aStats, lPngFile))
+		lError = -1;
+	return (fclose(lPngFile)) ? -1 : lError;
+}
 
-	uint8_t *rowPointers[SCR_HEIGHT];
-	uint32_t bytesPerLine = SCR_WIDTH * aDisplay->bpp;
-	for (i = 0; i < SCR_HEIGHT; ++i, aBitmap += bytesPerLine)
-		rowPointers[i] = aBitmap;
+/*
+ * Frame times in the file are the measured capture times, late frames only stretch the previous delay. A snapshot
+ * aGrab is copied again for every frame.
+ */
+static int32_t CaptureApng(
+	FILE *aPngFile, magxgrab_t *aGrab, const grab_rect_t *aRect, const display_t *aImage,
+	int32_t aCompression, uint32_t aFrames, uint32_t aInterval, stats_t *aStats
+) {
+	const uint32_t lStride = aImage->width * 3;
+	apng_writer_t lWriter;
+	uint64_t lStart, lLate = 0, lBegin;
+	uint32_t i;
+	int32_t lError = 0;
 
-	png_write_image(png_ptr, rowPointers);
+	uint8_t *lBitmap = malloc(aImage->size * 3);
+	if (!lBitmap || ApngWriterInit(&lWriter, aPngFile, aImage->width, aImage->height, aFrames, aCompression)) {
+		free(lBitmap);
+		return -1;
+	}
 
-	png_write_end(png_ptr, NULL);
+	lStart = TimeMonotonicUs();
+	for (i = 0; i < aFrames && !lError; ++i) {
+		uint64_t lDeadline = lStart + (uint64_t) i * aInterval * 1000;
+		uint64_t lNow = TimeMonotonicUs();
+		if (lNow < lDeadline) {
+			struct timespec lSleep;
+			lSleep.tv_sec = (lDeadline - lNow) / 1000000;
+			lSleep.tv_nsec = (lDeadline - lNow) % 1000000 * 1000;
+			nanosleep(&lSleep, NULL);
+		} else if (aInterval && lNow - lDeadline > (uint64_t) aInterval * 1000)
+			++lLate;
+
+		lNow = StatsBegin(aStats);
+		GrabSnapshot(aGrab);
+		StatsEnd(aStats, STATS_READ, lNow);
+		lNow = StatsBegin(aStats);
+		lError = GrabCapture(aGrab, lBitmap, lStride, PIXEL_RGB888, aRect);
+		StatsEnd(aStats, STATS_CONVERT, lNow);
+		if (lError)
+			break;
+		lNow = StatsBegin(aStats);
+		lError = ApngAddFrame(&lWriter, lBitmap, lStride, (TimeMonotonicUs() - lStart) / 1000);
+		StatsEnd(aStats, STATS_ENCODE, lNow);
+		aStats->bytes_read += aImage->bytes;
+		++aStats->frames;
+	}
+	lBegin = StatsBegin(aStats);
+	if (ApngWriterClose(&lWriter, aInterval))
+		lError = -1;
+	StatsEnd(aStats, STATS_ENCODE, lBegin);
+
+	lStart = TimeMonotonicUs() - lStart;
+	fprintf(
+		stderr, "APNG: %u frames in %llu ms, %llu late.\n",
+		i, (unsigned long long) (lStart / 1000), (unsigned long long) lLate
+	);
+	free(lBitmap);
+	return lError;
 }
 
 int main(int argc, char *argv[]) {
-	if (argc != 4)
+	int32_t i;
+	if (argc < 4)
 		return ErrUsage();
 
+	const char *lProfile = DEVICE_PROFILE, *lThumbPath = NULL, *lThumbSize = "1/4";
+	uint32_t lFrames = 0, lInterval = APNG_INTERVAL;
+	int32_t lThreads = ParallelCpus(), lPalette = 0, lFast = 0, lStatsEnabled = 0, lDirect = 0;
+	grab_rect_t lRegion, *lRegionArg = NULL;
+	int32_t lDegrees = 0, lMirror = 0;
+	transform_t lTransform;
+	for (i = 4; i < argc; ++i) {
+		if (!strcmp("--device", argv[i]) && i + 1 < argc)
+			lProfile = argv[++i];
+		else if (!strcmp("--rotate", argv[i]) && i + 1 < argc)
+			lDegrees = atoi(argv[++i]);
+		else if (!strcmp("--mirror", argv[i]))
+			lMirror = 1;
+		else if (!strcmp("--rect", argv[i]) && i + 1 < argc) {
+			if (GrabParseRect(argv[++i], &lRegion))
+				return ErrUsage();
+			lRegionArg = &lRegion;
+		} else if (!strcmp("--apng", argv[i]) && i + 1 < argc)
+			lFrames = atoi(argv[++i]);
+		else if (!strcmp("--interval", argv[i]) && i + 1 < argc)
+			lInterval = atoi(argv[++i]);
+		else if (!strcmp("--threads", argv[i]) && i + 1 < argc)
+			lThreads = atoi(argv[++i]);
+		else if (!strcmp("--palette", argv[i]))
+			lPalette = 1;
+		else if (!strcmp("--fast", argv[i]))
+			lFast = 1;
+		else if (!strcmp("--thumb", argv[i]) && i + 1 < argc)
+			lThumbPath = argv[++i];
+		else if (!strcmp("--thumb-size", argv[i]) && i + 1 < argc)
+			lThumbSize = argv[++i];
+		else if (!strcmp("--stats", argv[i]))
+			lStatsEnabled = 1;
+		else if (!strcmp("--direct", argv[i]))
+			lDirect = 1;
+		else
+			return ErrUsage();
+	}
+	if (lFrames && (lPalette || lFast || lThumbPath))
+		return ErrUsage();
+	if (ConvertGetTransform(lDegrees, lMirror, &lTransform))
+		return ErrUsage();
+
+	stats_t lStats;
+	StatsInit(&lStats, "pgrab", lStatsEnabled);
+	uint64_t lBegin = StatsBegin(&lStats);
+	magxgrab_t lGrab;
+	int32_t lOpened = GrabOpen(&lGrab, argv[1], lProfile, 0);
+	if (lOpened)
+		return ErrOpen(argv[1], lProfile, lOpened);
+	/* From here on lScreen is the captured image, cropped and turned with packed rows. */
+	grab_rect_t lRect;
 	display_t lScreen;
-	lScreen.width = SCR_WIDTH;
-	lScreen.height = SCR_HEIGHT;
-	lScreen.size = lScreen.height * lScreen.width;
-	lScreen.depth = SCR_DEPTH;
-	lScreen.bpp = SCR_DEPTH / 8;
-	lScreen.bytes = lScreen.size * lScreen.bpp;
+	if (GrabRect(&lGrab, lRegionArg, &lRect))
+		return ErrRect(&lGrab.display);
+	if (GrabSetTransform(&lGrab, lTransform))
+		return ErrFile(argv[2], "write");
+	GrabImage(&lGrab, &lRect, &lScreen);
+	lStats.device = lScreen.name;
+	StatsEnd(&lStats, STATS_OPEN, lBegin);
 
-	int32_t fb_fd = open(argv[1], O_RDONLY);
-	if (fb_fd == EXIT_FAILURE)
-		return ErrFile(argv[1], "read");
+	/* The rectangle is copied out of the framebuffer in one burst, unless --direct converts from the mapping. */
+	magxgrab_t lSnapshot, *lSource = &lGrab;
+	const grab_rect_t *lSourceRect = &lRect;
+	if (!lDirect) {
+		if (GrabSnapshotInit(&lSnapshot, &lGrab, &lRect))
+			return ErrFile(argv[2], "write");
+		lSource = &lSnapshot;
+		lSourceRect = NULL;
+	}
 
-	uint8_t *fb_mmap = (uint8_t *) mmap(NULL, lScreen.bytes, PROT_READ, MAP_SHARED, fb_fd, 0);
-	if (fb_mmap == MAP_FAILED)
-		return ErrFile(argv[1], "mmap");
+	if (lFrames) {
+		FILE *lApngFile = NULL;
+		if (!strcmp("stdout", argv[2]))
+			lApngFile = stdout;
+		else
+			lApngFile = fopen(argv[2], "wb");
+		if (!lApngFile)
+			return ErrFile(argv[2], "write");
+		StatsBuffer(&lStats, lApngFile, lScreen.size * 3);
 
-	uint8_t *lBitmap = CreateBitmapFromFile(fb_mmap, &lScreen);
+		int32_t lError = CaptureApng(lApngFile, lSource, lSourceRect, &lScreen, atoi(argv[3]), lFrames, lInterval, &lStats);
 
-	munmap(fb_mmap, lScreen.bytes);
-	close(fb_fd);
+		if (!lDirect)
+			GrabClose(&lSnapshot);
+		GrabClose(&lGrab);
+		if (StatsFlush(&lStats, lApngFile) || fclose(lApngFile))
+			lError = -1;
+		StatsPrint(&lStats, lError);
+		return (lError) ? ErrFile(argv[2], "write") : 0;
+	}
+
+	scale_t lThumb;
+	uint8_t *lThumbBitmap = NULL;
+	int32_t lThumbWidth, lThumbHeight;
+	if (lThumbPath) {
+		if (ScaleParseSize(lThumbSize, lScreen.width, lScreen.height, &lThumbWidth, &lThumbHeight))
+			return ErrUsage();
+		lThumbBitmap = malloc(lThumbWidth * lThumbHeight * 3);
+		if (!lThumbBitmap || ScaleInit(&lThumb, lScreen.width, lScreen.height, lThumbBitmap, lThumbWidth * 3, lThumbWidth, lThumbHeight))
+			return ErrFile(lThumbPath, "write");
+	}
+
+	lBegin = StatsBegin(&lStats);
+	GrabSnapshot(lSource);
+	StatsEnd(&lStats, STATS_READ, lBegin);
+
+	/* An RGB image after too many colors is converted from the same snapshot, only --direct reads the screen again. */
+	png_palette_t lColors;
+	uint8_t *lIndices = NULL;
+	if (lPalette) {
+		lBegin = StatsBegin(&lStats);
+		lIndices = CreateIndicesFromFile(lSource, lSourceRect, &lScreen, &lColors, (lThumbPath) ? &lThumb : NULL);
+		StatsEnd(&lStats, STATS_CONVERT, lBegin);
+		lStats.bytes_read += lScreen.bytes;
+		if (!lIndices && lThumbPath) {
+			ScaleFree(&lThumb);
+			if (ScaleInit(&lThumb, lScreen.width, lScreen.height, lThumbBitmap, lThumbWidth * 3, lThumbWidth, lThumbHeight))
+				return ErrFile(lThumbPath, "write");
+		}
+	}
+	/* RGB images are converted band by band while the encoder takes the rows, only parallel strips need them all. */
+	uint8_t *lBitmap = NULL;
+	grab_stream_t lStream;
+	if (!lIndices && !lFast && lThreads > 1) {
+		lBegin = StatsBegin(&lStats);
+		lBitmap = CreateBitmapFromFile(lSource, lSourceRect, &lScreen, (lThumbPath) ? &lThumb : NULL);
+		StatsEnd(&lStats, STATS_CONVERT, lBegin);
+		if (!lBitmap)
+			return ErrFile(argv[2], "write");
+	} else if (!lIndices && GrabStreamInit(&lStream, lSource, PIXEL_RGB888, lSourceRect, (lThumbPath) ? &lThumb : NULL))
+		return ErrFile(argv[2], "write");
+	if (!lIndices && (lDirect || !lPalette))
+		lStats.bytes_read += lScreen.bytes;
+	lStats.frames = 1;
 
 	FILE *lPngFile = NULL;
 	if (!strcmp("stdout", argv[2]))
@@ -129,11 +356,43 @@ int main(int argc, char *argv[]) {
 		lPngFile = fopen(argv[2], "wb");
 	if (!lPngFile)
 		return ErrFile(argv[2], "write");
+	StatsBuffer(&lStats, lPngFile, lScreen.size * 3);
 
-	CreatePngFromBitmap(lPngFile, &lScreen, lBitmap, atoi(argv[3]));
+	int32_t lError;
+	lBegin = StatsBegin(&lStats);
+	if (lIndices)
+		lError = PngWriteIndexed(lPngFile, &lColors, lIndices, lScreen.width, lScreen.height, atoi(argv[3]));
+	else if (lBitmap)
+		lError = PngWriteParallel(lPngFile, lBitmap, lScreen.width * 3, lScreen.width, lScreen.height, atoi(argv[3]), lThreads);
+	else if (lFast)
+		lError = PngWriteFastRows(lPngFile, GrabStreamRows, &lStream, lScreen.width, lScreen.height);
+	else
+		lError = PngWriteRows(lPngFile, GrabStreamRows, &lStream, lScreen.width, lScreen.height, atoi(argv[3]));
+	StatsEnd(&lStats, STATS_ENCODE, lBegin);
+	if (!lIndices && !lBitmap) {
+		StatsMove(&lStats, STATS_ENCODE, STATS_CONVERT, lStream.convert_us);
+		GrabStreamFree(&lStream);
+	}
+	if (StatsFlush(&lStats, lPngFile))
+		lError = -1;
 
+	if (!lDirect)
+		GrabClose(&lSnapshot);
+	GrabClose(&lGrab);
+	free(lIndices);
 	free(lBitmap);
-	fclose(lPngFile);
+	if (fclose(lPngFile))
+		lError = -1;
 
-	return 0;
+	int32_t lThumbError = 0;
+	if (lThumbPath) {
+		lThumbError = WriteThumbnail(lThumbPath, &lThumb, atoi(argv[3]), lFast, &lStats);
+		ScaleFree(&lThumb);
+		free(lThumbBitmap);
+	}
+
+	StatsPrint(&lStats, lError || lThumbError);
+	if (lError)
+		return ErrFile(argv[2], "write");
+	return (lThumbError) ? ErrFile(lThumbPath, "write") : 0;
 }
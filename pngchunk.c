@@ -0,0 +1,95 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* ZLIB */
+#include <zlib.h>
+
+/* Local */
+#include "pngchunk.h"
+
+const uint8_t g_png_signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+void PngPutU32(uint8_t *aDst, uint32_t aValue) {
+	aDst[0] = aValue >> 24;
+	aDst[1] = aValue >> 16;
+	aDst[2] = aValue >> 8;
+	aDst[3] = aValue;
+}
+
+void PngPutU16(uint8_t *aDst, uint16_t aValue) {
+	aDst[0] = aValue >> 8;
+	aDst[1] = aValue;
+}
+
+void PngHeaderRgb(uint8_t aHeader[13], uint32_t aWidth, uint32_t aHeight) {
+	PngPutU32(aHeader + 0, aWidth);
+	PngPutU32(aHeader + 4, aHeight);
+	aHeader[8] = 8;    /* Bit depth. */
+	aHeader[9] = 2;    /* Color type, RGB. */
+	aHeader[10] = 0;   /* Compression method. */
+	aHeader[11] = 0;   /* Filter method. */
+	aHeader[12] = 0;   /* Interlace method. */
+}
+
+int32_t PngWriteChunk(
+	FILE *aFile, const char *aType, const uint8_t *aHead, uint32_t aHeadSize, const uint8_t *aData, uint32_t aDataSize
+) {
+	uint8_t lLength[4], lCrc[4];
+	uLong lSum = crc32(0L, Z_NULL, 0);
+	lSum = crc32(lSum, (const Bytef *) aType, 4);
+	/* crc32() restarts from its initial value on a NULL buffer. */
+	if (aHeadSize)
+		lSum = crc32(lSum, aHead, aHeadSize);
+	if (aDataSize)
+		lSum = crc32(lSum, aData, aDataSize);
+	PngPutU32(lLength, aHeadSize + aDataSize);
+	PngPutU32(lCrc, lSum);
+	if (
+		fwrite(lLength, sizeof(lLength), 1, aFile) != 1 || fwrite(aType, 4, 1, aFile) != 1 ||
+		(aHeadSize && fwrite(aHead, aHeadSize, 1, aFile) != 1) ||
+		(aDataSize && fwrite(aData, aDataSize, 1, aFile) != 1) ||
+		fwrite(lCrc, sizeof(lCrc), 1, aFile) != 1
+	)
+		return -1;
+	return 0;
+}
+
+static uint8_t Paeth(uint8_t a, uint8_t b, uint8_t c) {
+	int32_t p = a + b - c;
+	int32_t pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	return (pb <= pc) ? b : c;
+}
+
+const uint8_t *PngFilterRow(uint8_t *aScratch, const uint8_t *aRow, const uint8_t *aPrior, uint32_t aBytes) {
+	const uint8_t *lBest = NULL;
+	uint32_t lBestSum = 0xFFFFFFFF;
+	uint32_t f, i;
+	for (f = 0; f < 5; ++f) {
+		uint8_t *lOut = aScratch + f * (aBytes + 1);
+		uint32_t lSum = 0;
+		lOut[0] = f;
+		for (i = 0; i < aBytes; ++i) {
+			uint8_t a = (i >= PNGCHUNK_BPP) ? aRow[i - PNGCHUNK_BPP] : 0;
+			uint8_t b = (aPrior) ? aPrior[i] : 0;
+			uint8_t c = (aPrior && i >= PNGCHUNK_BPP) ? aPrior[i - PNGCHUNK_BPP] : 0;
+			uint8_t v = aRow[i];
+			switch (f) {
+				case 1: v -= a; break;
+				case 2: v -= b; break;
+				case 3: v -= (a + b) >> 1; break;
+				case 4: v -= Paeth(a, b, c); break;
+			}
+			lOut[i + 1] = v;
+			lSum += (v < 128) ? v : 256 - v;
+		}
+		if (lSum < lBestSum) {
+			lBestSum = lSum;
+			lBest = lOut;
+		}
+	}
+	return lBest;
+}
@@ -0,0 +1,30 @@
+#ifndef PNGCHUNK_H
+#define PNGCHUNK_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Shared pieces of the PNG writers that do not go through libpng: big-endian fields, chunks and row filtering
+ * of 8-bit RGB rows. See: https://www.w3.org/TR/PNG/
+ */
+#define PNGCHUNK_BPP        (3)
+
+extern const uint8_t g_png_signature[8];
+
+void PngPutU32(uint8_t *aDst, uint32_t aValue);
+void PngPutU16(uint8_t *aDst, uint16_t aValue);
+/* Fills the 13-byte IHDR data of an 8-bit RGB non-interlaced image. */
+void PngHeaderRgb(uint8_t aHeader[13], uint32_t aWidth, uint32_t aHeight);
+/* aHead goes right after the chunk type, fdAT uses it for the sequence number in front of the deflated data. */
+int32_t PngWriteChunk(
+	FILE *aFile, const char *aType, const uint8_t *aHead, uint32_t aHeadSize, const uint8_t *aData, uint32_t aDataSize
+);
+/*
+ * Tries all five PNG filters on the row and returns the one with the smallest sum of absolute values, like libpng.
+ * aScratch holds 5 * (aBytes + 1) bytes, aPrior is NULL on the first row.
+ */
+const uint8_t *PngFilterRow(uint8_t *aScratch, const uint8_t *aRow, const uint8_t *aPrior, uint32_t aBytes);
+
+#endif /* !PNGCHUNK_H */
@@ -0,0 +1,576 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Local */
+#include "pngfast.h"
+
+/*
+ * Deflate: https://www.rfc-editor.org/rfc/rfc1951, zlib: https://www.rfc-editor.org/rfc/rfc1950.
+ * The chunk helpers of pngchunk.c are not used, they take the CRC-32 from zlib.
+ */
+
+/* Defines */
+#define PNGFAST_MIN_MATCH   (4)
+#define PNGFAST_MAX_MATCH   (258)
+#define PNGFAST_MATCH       (0x80000000)
+#define PNGFAST_IDAT        (65536)
+#define PNGFAST_ADLER_BASE  (65521)
+#define PNGFAST_ADLER_NMAX  (5552)    /* Most bytes before the 32-bit sums can overflow. */
+#define PNGFAST_LITERALS    (286)
+#define PNGFAST_DISTANCES   (30)
+#define PNGFAST_CODE_LENGTHS (19)
+
+static const uint8_t g_signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+static const uint16_t g_length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t g_length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t g_distance_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+	1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t g_distance_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+/* Order of the code length code lengths in a dynamic block header. */
+static const uint8_t g_code_length_order[PNGFAST_CODE_LENGTHS] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static void PutU32(uint8_t *aDst, uint32_t aValue) {
+	aDst[0] = aValue >> 24;
+	aDst[1] = aValue >> 16;
+	aDst[2] = aValue >> 8;
+	aDst[3] = aValue;
+}
+
+static uint32_t Read32(const uint8_t *aSrc) {
+	uint32_t lValue;
+	memcpy(&lValue, aSrc, sizeof(lValue));
+	return lValue;
+}
+
+static uint32_t Crc32(const png_fast_t *aPng, uint32_t aCrc, const uint8_t *aData, uint32_t aBytes) {
+	uint32_t i;
+	for (i = 0; i < aBytes; ++i)
+		aCrc = aPng->crc_table[(aCrc ^ aData[i]) & 0xFF] ^ (aCrc >> 8);
+	return aCrc;
+}
+
+static void AdlerUpdate(png_fast_t *aPng, const uint8_t *aData, uint32_t aBytes) {
+	uint32_t lA = aPng->adler_a, lB = aPng->adler_b, lChunk;
+	while (aBytes) {
+		lChunk = (aBytes < PNGFAST_ADLER_NMAX) ? aBytes : PNGFAST_ADLER_NMAX;
+		aBytes -= lChunk;
+		while (lChunk--) {
+			lA += *aData++;
+			lB += lA;
+		}
+		lA %= PNGFAST_ADLER_BASE;
+		lB %= PNGFAST_ADLER_BASE;
+	}
+	aPng->adler_a = lA;
+	aPng->adler_b = lB;
+}
+
+/* Same as aBytes zeros. */
+static void AdlerZeros(png_fast_t *aPng, uint32_t aBytes) {
+	aPng->adler_b = (aPng->adler_b + (uint64_t) aPng->adler_a * aBytes) % PNGFAST_ADLER_BASE;
+}
+
+static void WriteChunk(png_fast_t *aPng, const char *aType, const uint8_t *aData, uint32_t aBytes) {
+	uint8_t lHead[8], lCrc[4];
+	if (aPng->error)
+		return;
+	PutU32(lHead, aBytes);
+	memcpy(lHead + 4, aType, 4);
+	PutU32(lCrc, ~Crc32(aPng, Crc32(aPng, 0xFFFFFFFF, lHead + 4, 4), aData, aBytes));
+	if (
+		aPng->write(aPng->context, lHead, sizeof(lHead)) ||
+		(aBytes && aPng->write(aPng->context, aData, aBytes)) ||
+		aPng->write(aPng->context, lCrc, sizeof(lCrc))
+	)
+		aPng->error = 1;
+}
+
+static void FlushIdat(png_fast_t *aPng) {
+	if (aPng->out_size)
+		WriteChunk(aPng, "IDAT", aPng->out, aPng->out_size);
+	aPng->out_size = 0;
+}
+
+/* Deflate bits go out least significant first. */
+static void PutBits(png_fast_t *aPng, uint32_t aValue, uint32_t aCount) {
+	aPng->bits |= (uint64_t) aValue << aPng->bit_count;
+	aPng->bit_count += aCount;
+	if (aPng->bit_count >= 32) {
+		uint8_t *lOut = aPng->out + aPng->out_size;
+		lOut[0] = aPng->bits;
+		lOut[1] = aPng->bits >> 8;
+		lOut[2] = aPng->bits >> 16;
+		lOut[3] = aPng->bits >> 24;
+		aPng->bits >>= 32;
+		aPng->bit_count -= 32;
+		aPng->out_size += 4;
+		if (aPng->out_size >= PNGFAST_IDAT)
+			FlushIdat(aPng);
+	}
+}
+
+static void PutAlign(png_fast_t *aPng) {
+	for (; aPng->bit_count; aPng->bit_count = (aPng->bit_count > 8) ? aPng->bit_count - 8 : 0) {
+		aPng->out[aPng->out_size++] = aPng->bits;
+		aPng->bits >>= 8;
+	}
+	aPng->bits = 0;
+	if (aPng->out_size >= PNGFAST_IDAT)
+		FlushIdat(aPng);
+}
+
+/* Byte aligned data only. */
+static void PutBytes(png_fast_t *aPng, const uint8_t *aData, uint32_t aBytes) {
+	uint32_t lChunk;
+	while (aBytes) {
+		lChunk = PNGFAST_IDAT - aPng->out_size;
+		if (lChunk > aBytes)
+			lChunk = aBytes;
+		memcpy(aPng->out + aPng->out_size, aData, lChunk);
+		aPng->out_size += lChunk;
+		aData += lChunk;
+		aBytes -= lChunk;
+		if (aPng->out_size >= PNGFAST_IDAT)
+			FlushIdat(aPng);
+	}
+}
+
+static int CompareKeys(const void *aLeft, const void *aRight) {
+	const uint32_t lLeft = *(const uint32_t *) aLeft, lRight = *(const uint32_t *) aRight;
+	return (lLeft > lRight) - (lLeft < lRight);
+}
+
+/*
+ * Huffman code lengths of at most aLimit bits. The tree is built with two queues over the symbols sorted by count,
+ * too long codes are then shortened as in miniz by moving leaves up until the Kraft sum is exact again.
+ */
+static void BuildLengths(const uint32_t *aCounts, uint32_t aSymbols, uint32_t aLimit, uint8_t *aLengths) {
+	uint32_t lKeys[PNGFAST_LITERALS], lWeights[PNGFAST_LITERALS * 2], lParents[PNGFAST_LITERALS * 2];
+	uint32_t lDepths[PNGFAST_LITERALS * 2], lLengthCounts[PNGFAST_LITERALS + 1];
+	uint32_t lUsed = 0, lLeaf = 0, lInner, lNext, lTotal = 0, i, k;
+
+	memset(aLengths, 0, aSymbols);
+	for (i = 0; i < aSymbols; ++i)
+		if (aCounts[i])
+			lKeys[lUsed++] = (aCounts[i] << 9) | i;
+	/* Deflate wants two codes at least, an unused one is free. */
+	if (!lUsed) {
+		aLengths[0] = aLengths[1] = 1;
+		return;
+	}
+	if (lUsed == 1) {
+		aLengths[lKeys[0] & 0x1FF] = 1;
+		aLengths[(lKeys[0] & 0x1FF) ? 0 : 1] = 1;
+		return;
+	}
+	qsort(lKeys, lUsed, sizeof(uint32_t), CompareKeys);
+
+	for (i = 0; i < lUsed; ++i)
+		lWeights[i] = lKeys[i] >> 9;
+	for (lNext = lInner = lUsed; lNext < lUsed * 2 - 1; ++lNext) {
+		for (lWeights[lNext] = 0, k = 0; k < 2; ++k) {
+			uint32_t lPick = (lLeaf < lUsed && (lInner == lNext || lWeights[lLeaf] <= lWeights[lInner])) ? lLeaf++ : lInner++;
+			lWeights[lNext] += lWeights[lPick];
+			lParents[lPick] = lNext;
+		}
+	}
+	/* Parents come after their children, so depths fill from the root down. */
+	lDepths[lUsed * 2 - 2] = 0;
+	for (i = lUsed * 2 - 2; i-- > 0; )
+		lDepths[i] = lDepths[lParents[i]] + 1;
+
+	memset(lLengthCounts, 0, sizeof(lLengthCounts));
+	for (i = 0; i < lUsed; ++i)
+		++lLengthCounts[(lDepths[i] < aLimit) ? lDepths[i] : aLimit];
+	for (i = aLimit; i > 0; --i)
+		lTotal += lLengthCounts[i] << (aLimit - i);
+	while (lTotal != (1U << aLimit)) {
+		--lLengthCounts[aLimit];
+		for (i = aLimit - 1; i > 0; --i)
+			if (lLengthCounts[i]) {
+				--lLengthCounts[i];
+				lLengthCounts[i + 1] += 2;
+				break;
+			}
+		--lTotal;
+	}
+	/* The rarest symbols get the longest codes. */
+	for (k = 0, i = aLimit; i > 0; --i)
+		for (lNext = lLengthCounts[i]; lNext; --lNext)
+			aLengths[lKeys[k++] & 0x1FF] = i;
+}
+
+/* Canonical codes, bit reversed for PutBits(). */
+static void BuildCodes(const uint8_t *aLengths, uint32_t aSymbols, uint16_t *aCodes) {
+	uint32_t lCounts[16], lNext[16], lCode = 0, i, b;
+	memset(lCounts, 0, sizeof(lCounts));
+	for (i = 0; i < aSymbols; ++i)
+		++lCounts[aLengths[i]];
+	lCounts[0] = 0;
+	for (b = 1; b < 16; ++b) {
+		lCode = (lCode + lCounts[b - 1]) << 1;
+		lNext[b] = lCode;
+	}
+	for (i = 0; i < aSymbols; ++i) {
+		uint32_t lValue, lReversed = 0;
+		if (!aLengths[i])
+			continue;
+		lValue = lNext[aLengths[i]]++;
+		for (b = 0; b < aLengths[i]; ++b, lValue >>= 1)
+			lReversed = (lReversed << 1) | (lValue & 1);
+		aCodes[i] = lReversed;
+	}
+}
+
+static uint32_t DistanceCode(const png_fast_t *aPng, uint32_t aDistance) {
+	return (aDistance < 256) ? aPng->distance_codes[aDistance] : aPng->distance_codes[256 + (aDistance >> 7)];
+}
+
+/* Writes the tokens of window[block, aEnd) as a dynamic Huffman block, or a stored one when that is smaller. */
+static void FlushBlock(png_fast_t *aPng, uint32_t aEnd, int32_t aFinal) {
+	const uint32_t lBytes = aEnd - aPng->block;
+	uint8_t lLiteralLengths[PNGFAST_LITERALS], lDistanceLengths[PNGFAST_DISTANCES], lLengths[PNGFAST_LITERALS + PNGFAST_DISTANCES];
+	uint8_t lCodeLengthLengths[PNGFAST_CODE_LENGTHS];
+	uint16_t lLiteralCodes[PNGFAST_LITERALS], lDistanceCodes[PNGFAST_DISTANCES], lCodeLengthCodes[PNGFAST_CODE_LENGTHS];
+	uint16_t lItems[PNGFAST_LITERALS + PNGFAST_DISTANCES];
+	uint32_t lCodeLengthCounts[PNGFAST_CODE_LENGTHS];
+	uint32_t lLiterals = 257, lDistances = 1, lCodeLengths = 4, lItemCount = 0, lRun, lLeft, i;
+	uint64_t lCost;
+
+	aPng->literal_counts[256] = 1;
+	BuildLengths(aPng->literal_counts, PNGFAST_LITERALS, 15, lLiteralLengths);
+	BuildLengths(aPng->distance_counts, PNGFAST_DISTANCES, 15, lDistanceLengths);
+	for (i = 257; i < PNGFAST_LITERALS; ++i)
+		if (lLiteralLengths[i])
+			lLiterals = i + 1;
+	for (i = 1; i < PNGFAST_DISTANCES; ++i)
+		if (lDistanceLengths[i])
+			lDistances = i + 1;
+
+	/* Both length lists as one sequence, runs as codes 16 (repeat the last 3-6 times), 17 and 18 (3-10, 11-138 zeros). */
+	memcpy(lLengths, lLiteralLengths, lLiterals);
+	memcpy(lLengths + lLiterals, lDistanceLengths, lDistances);
+	memset(lCodeLengthCounts, 0, sizeof(lCodeLengthCounts));
+	for (i = 0; i < lLiterals + lDistances; i += lRun) {
+		const uint8_t lValue = lLengths[i];
+		for (lRun = 1; i + lRun < lLiterals + lDistances && lLengths[i + lRun] == lValue; ++lRun)
+			;
+		lLeft = lRun;
+		if (!lValue) {
+			for (; lLeft >= 11; lLeft -= (lLeft < 138) ? lLeft : 138)
+				lItems[lItemCount++] = 18 | ((((lLeft < 138) ? lLeft : 138) - 11) << 5);
+			if (lLeft >= 3) {
+				lItems[lItemCount++] = 17 | ((lLeft - 3) << 5);
+				lLeft = 0;
+			}
+		} else {
+			lItems[lItemCount++] = lValue;
+			for (--lLeft; lLeft >= 3; lLeft -= (lLeft < 6) ? lLeft : 6)
+				lItems[lItemCount++] = 16 | ((((lLeft < 6) ? lLeft : 6) - 3) << 5);
+		}
+		while (lLeft--)
+			lItems[lItemCount++] = lValue;
+	}
+	for (i = 0; i < lItemCount; ++i)
+		++lCodeLengthCounts[lItems[i] & 0x1F];
+	BuildLengths(lCodeLengthCounts, PNGFAST_CODE_LENGTHS, 7, lCodeLengthLengths);
+	for (i = 4; i < PNGFAST_CODE_LENGTHS; ++i)
+		if (lCodeLengthLengths[g_code_length_order[i]])
+			lCodeLengths = i + 1;
+
+	lCost = 3 + 14 + lCodeLengths * 3;
+	for (i = 0; i < PNGFAST_CODE_LENGTHS; ++i)
+		lCost += (uint64_t) lCodeLengthCounts[i] * (lCodeLengthLengths[i] + ((i == 16) ? 2 : (i == 17) ? 3 : (i == 18) ? 7 : 0));
+	for (i = 0; i < PNGFAST_LITERALS; ++i)
+		lCost += (uint64_t) aPng->literal_counts[i] * (lLiteralLengths[i] + ((i > 256) ? g_length_extra[i - 257] : 0));
+	for (i = 0; i < PNGFAST_DISTANCES; ++i)
+		lCost += (uint64_t) aPng->distance_counts[i] * (lDistanceLengths[i] + g_distance_extra[i]);
+
+	if (lCost >= 3 + 7 + 32 + (uint64_t) lBytes * 8) {
+		PutBits(aPng, aFinal, 3);
+		PutAlign(aPng);
+		PutBits(aPng, lBytes | ((~lBytes & 0xFFFF) << 16), 32);
+		PutBytes(aPng, aPng->window + aPng->block, lBytes);
+	} else {
+		BuildCodes(lLiteralLengths, PNGFAST_LITERALS, lLiteralCodes);
+		BuildCodes(lDistanceLengths, PNGFAST_DISTANCES, lDistanceCodes);
+		BuildCodes(lCodeLengthLengths, PNGFAST_CODE_LENGTHS, lCodeLengthCodes);
+		PutBits(aPng, aFinal | (2 << 1), 3);
+		PutBits(aPng, (lLiterals - 257) | ((lDistances - 1) << 5) | ((lCodeLengths - 4) << 10), 14);
+		for (i = 0; i < lCodeLengths; ++i)
+			PutBits(aPng, lCodeLengthLengths[g_code_length_order[i]], 3);
+		for (i = 0; i < lItemCount; ++i) {
+			const uint32_t lSymbol = lItems[i] & 0x1F;
+			PutBits(aPng, lCodeLengthCodes[lSymbol], lCodeLengthLengths[lSymbol]);
+			if (lSymbol >= 16)
+				PutBits(aPng, lItems[i] >> 5, (lSymbol == 16) ? 2 : (lSymbol == 17) ? 3 : 7);
+		}
+		for (i = 0; i < aPng->token_count; ++i) {
+			const uint32_t lToken = aPng->tokens[i];
+			if (lToken & PNGFAST_MATCH) {
+				const uint32_t lLength = lToken & 0xFF, lDistance = (lToken >> 8) & 0x7FFF;
+				const uint32_t lLengthCode = aPng->length_codes[lLength], lDistanceCode = DistanceCode(aPng, lDistance);
+				PutBits(aPng, lLiteralCodes[257 + lLengthCode], lLiteralLengths[257 + lLengthCode]);
+				PutBits(aPng, lLength + 3 - g_length_base[lLengthCode], g_length_extra[lLengthCode]);
+				PutBits(aPng, lDistanceCodes[lDistanceCode], lDistanceLengths[lDistanceCode]);
+				PutBits(aPng, lDistance + 1 - g_distance_base[lDistanceCode], g_distance_extra[lDistanceCode]);
+			} else
+				PutBits(aPng, lLiteralCodes[lToken], lLiteralLengths[lToken]);
+		}
+		PutBits(aPng, lLiteralCodes[256], lLiteralLengths[256]);
+	}
+
+	memset(aPng->literal_counts, 0, sizeof(aPng->literal_counts));
+	memset(aPng->distance_counts, 0, sizeof(aPng->distance_counts));
+	aPng->token_count = 0;
+	aPng->block = aEnd;
+}
+
+/*
+ * Greedy matching up to aLimit, matches may reach the end of the window. A run of equal bytes, which is what flat
+ * areas filter to, is taken at distance 1 without a hash lookup.
+ */
+static void Compress(png_fast_t *aPng, uint32_t aLimit) {
+	const uint8_t *lWindow = aPng->window;
+	uint32_t lPosition = aPng->position, lLength, lMax, lCandidate, lStream;
+
+	while (lPosition < aLimit) {
+		lLength = 0;
+		if (lPosition + PNGFAST_MIN_MATCH <= aPng->end) {
+			const uint32_t lSequence = Read32(lWindow + lPosition);
+			uint32_t *lSlot = aPng->hash + ((lSequence * 2654435761U) >> (32 - PNGFAST_HASH_BITS));
+			lStream = aPng->window_base + lPosition;
+			lCandidate = *lSlot;
+			*lSlot = lStream;
+			if (lPosition && Read32(lWindow + lPosition - 1) == lSequence)
+				lCandidate = lStream - 1;
+			else if (
+				lCandidate >= lStream || lCandidate < aPng->window_base || lStream - lCandidate > PNGFAST_WINDOW ||
+				Read32(lWindow + lCandidate - aPng->window_base) != lSequence
+			)
+				lCandidate = lStream;
+			if (lCandidate != lStream) {
+				const uint8_t *lRef = lWindow + lCandidate - aPng->window_base;
+				lMax = aPng->end - lPosition;
+				if (lMax > PNGFAST_MAX_MATCH)
+					lMax = PNGFAST_MAX_MATCH;
+				for (lLength = PNGFAST_MIN_MATCH; lLength + 4 <= lMax && Read32(lRef + lLength) == Read32(lWindow + lPosition + lLength); lLength += 4)
+					;
+				for (; lLength < lMax && lRef[lLength] == lWindow[lPosition + lLength]; ++lLength)
+					;
+			}
+		}
+		if (lLength) {
+			aPng->tokens[aPng->token_count++] = PNGFAST_MATCH | ((lStream - lCandidate - 1) << 8) | (lLength - 3);
+			++aPng->literal_counts[257 + aPng->length_codes[lLength - 3]];
+			++aPng->distance_counts[DistanceCode(aPng, lStream - lCandidate - 1)];
+			lPosition += lLength;
+		} else {
+			aPng->tokens[aPng->token_count++] = lWindow[lPosition];
+			++aPng->literal_counts[lWindow[lPosition]];
+			++lPosition;
+		}
+		if (aPng->token_count == PNGFAST_BLOCK || lPosition - aPng->block >= PNGFAST_BLOCK)
+			FlushBlock(aPng, lPosition, 0);
+	}
+	aPng->position = lPosition;
+}
+
+/* Keeps the match history and the pending block, drops everything older. */
+static void ShiftWindow(png_fast_t *aPng) {
+	uint32_t lKeep = (aPng->position > PNGFAST_WINDOW) ? aPng->position - PNGFAST_WINDOW : 0;
+	if (lKeep > aPng->block)
+		lKeep = aPng->block;
+	memmove(aPng->window, aPng->window + lKeep, aPng->end - lKeep);
+	aPng->window_base += lKeep;
+	aPng->block -= lKeep;
+	aPng->position -= lKeep;
+	aPng->end -= lKeep;
+}
+
+static void FreeState(png_fast_t *aPng) {
+	free(aPng->prior);
+	free(aPng->window);
+	free(aPng->hash);
+	free(aPng->tokens);
+	free(aPng->out);
+	aPng->prior = aPng->window = aPng->out = NULL;
+	aPng->hash = aPng->tokens = NULL;
+}
+
+int32_t PngFastInit(png_fast_t *aPng, png_write_t aWrite, void *aContext, int32_t aWidth, int32_t aHeight) {
+	uint8_t lHeader[13];
+	uint32_t lCode, i, k;
+
+	memset(aPng, 0, sizeof(png_fast_t));
+	aPng->write = aWrite;
+	aPng->context = aContext;
+	aPng->width = aWidth;
+	aPng->height = aHeight;
+	aPng->row_bytes = aWidth * 3 + 1;
+	aPng->window_capacity = PNGFAST_WINDOW + PNGFAST_BLOCK + PNGFAST_MAX_MATCH + aPng->row_bytes;
+	aPng->prior = calloc(aPng->row_bytes, 1);
+	aPng->window = malloc(aPng->window_capacity);
+	aPng->hash = calloc(1 << PNGFAST_HASH_BITS, sizeof(uint32_t));
+	aPng->tokens = malloc(PNGFAST_BLOCK * sizeof(uint32_t));
+	aPng->out = malloc(PNGFAST_IDAT + 8);
+	if (!aPng->prior || !aPng->window || !aPng->hash || !aPng->tokens || !aPng->out) {
+		FreeState(aPng);
+		return -1;
+	}
+
+	for (i = 0; i < 256; ++i) {
+		for (lCode = i, k = 0; k < 8; ++k)
+			lCode = (lCode & 1) ? 0xEDB88320 ^ (lCode >> 1) : lCode >> 1;
+		aPng->crc_table[i] = lCode;
+	}
+	for (lCode = 0; lCode < 28; ++lCode)
+		for (i = 0; i < (1U << g_length_extra[lCode]); ++i)
+			aPng->length_codes[g_length_base[lCode] - 3 + i] = lCode;
+	aPng->length_codes[255] = 28;
+	for (lCode = 0; lCode < PNGFAST_DISTANCES; ++lCode)
+		for (i = 0; i < (1U << g_distance_extra[lCode]); ++i) {
+			k = g_distance_base[lCode] - 1 + i;
+			aPng->distance_codes[(k < 256) ? k : 256 + (k >> 7)] = lCode;
+		}
+	aPng->adler_a = 1;
+
+	PutU32(lHeader + 0, aWidth);
+	PutU32(lHeader + 4, aHeight);
+	lHeader[8] = 8;    /* Bit depth. */
+	lHeader[9] = 2;    /* Color type, RGB. */
+	lHeader[10] = 0;   /* Compression method. */
+	lHeader[11] = 0;   /* Filter method. */
+	lHeader[12] = 0;   /* Interlace method. */
+	if (aWrite(aContext, g_signature, sizeof(g_signature)))
+		aPng->error = 1;
+	WriteChunk(aPng, "IHDR", lHeader, sizeof(lHeader));
+	if (aPng->error) {
+		FreeState(aPng);
+		return -1;
+	}
+	/* zlib header: deflate with a 32 KiB window, fastest level. */
+	aPng->out[0] = 0x78;
+	aPng->out[1] = 0x01;
+	aPng->out_size = 2;
+	return 0;
+}
+
+int32_t PngFastRow(png_fast_t *aPng, const uint8_t *aRgb888) {
+	const uint32_t lBytes = aPng->row_bytes - 1;
+	const uint8_t *lPrior = aPng->prior + 1;
+	uint32_t lSub = 0, lUp = 0, i;
+	uint8_t *lOut;
+
+	if (aPng->error || aPng->rows == aPng->height)
+		return -1;
+	if (aPng->end + aPng->row_bytes > aPng->window_capacity)
+		ShiftWindow(aPng);
+	lOut = aPng->window + aPng->end;
+	/* A row equal to the one above, common in UI screens, is all zeros with Up. */
+	if (!memcmp(aRgb888, lPrior, lBytes)) {
+		lOut[0] = 2;
+		memset(lOut + 1, 0, lBytes);
+		AdlerUpdate(aPng, lOut, 1);
+		AdlerZeros(aPng, lBytes);
+	} else {
+		/* Sub or Up, by the smaller sum of residuals taken as signed bytes. The first row has a zero prior, Up is None. */
+		for (i = 0; i < lBytes; ++i) {
+			const int32_t lUpValue = (int8_t) (aRgb888[i] - lPrior[i]);
+			lUp += (lUpValue < 0) ? -lUpValue : lUpValue;
+		}
+		for (i = 0; i < 3 && i < lBytes; ++i)
+			lSub += (aRgb888[i] < 128) ? aRgb888[i] : 256 - aRgb888[i];
+		for (; i < lBytes; ++i) {
+			const int32_t lSubValue = (int8_t) (aRgb888[i] - aRgb888[i - 3]);
+			lSub += (lSubValue < 0) ? -lSubValue : lSubValue;
+		}
+		if (lUp <= lSub) {
+			lOut[0] = 2;
+			for (i = 0; i < lBytes; ++i)
+				lOut[i + 1] = aRgb888[i] - lPrior[i];
+		} else {
+			lOut[0] = 1;
+			for (i = 0; i < 3 && i < lBytes; ++i)
+				lOut[i + 1] = aRgb888[i];
+			for (; i < lBytes; ++i)
+				lOut[i + 1] = aRgb888[i] - aRgb888[i - 3];
+		}
+		memcpy(aPng->prior + 1, aRgb888, lBytes);
+		AdlerUpdate(aPng, lOut, aPng->row_bytes);
+	}
+	aPng->end += aPng->row_bytes;
+	++aPng->rows;
+
+	/* The last PNGFAST_MAX_MATCH bytes wait for the next row, so matches can run across rows. */
+	if (aPng->end > PNGFAST_MAX_MATCH)
+		Compress(aPng, aPng->end - PNGFAST_MAX_MATCH);
+	return (aPng->error) ? -1 : 0;
+}
+
+int32_t PngFastFinish(png_fast_t *aPng) {
+	uint8_t lAdler[4];
+	int32_t lError;
+
+	if (!aPng->error && aPng->rows == aPng->height) {
+		Compress(aPng, aPng->end);
+		FlushBlock(aPng, aPng->position, 1);
+		PutAlign(aPng);
+		PutU32(lAdler, (aPng->adler_b << 16) | aPng->adler_a);
+		PutBytes(aPng, lAdler, sizeof(lAdler));
+		FlushIdat(aPng);
+		WriteChunk(aPng, "IEND", NULL, 0);
+	}
+	lError = aPng->error || aPng->rows != aPng->height;
+	FreeState(aPng);
+	return (lError) ? -1 : 0;
+}
+
+int32_t PngWriteFastCallback(png_write_t aWrite, void *aContext, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight) {
+	png_fast_t lPng;
+	int32_t y;
+	if (PngFastInit(&lPng, aWrite, aContext, aWidth, aHeight))
+		return -1;
+	for (y = 0; y < aHeight; ++y)
+		PngFastRow(&lPng, aRgb888 + y * aStride);
+	return PngFastFinish(&lPng);
+}
+
+static int32_t WriteFile(void *aFile, const uint8_t *aData, uint32_t aBytes) {
+	return (fwrite(aData, aBytes, 1, (FILE *) aFile) != 1) ? -1 : 0;
+}
+
+int32_t PngWriteFast(FILE *aPngFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight) {
+	return PngWriteFastCallback(WriteFile, aPngFile, aRgb888, aStride, aWidth, aHeight);
+}
+
+int32_t PngWriteFastRows(FILE *aPngFile, png_rows_t aRows, void *aContext, int32_t aWidth, int32_t aHeight) {
+	png_fast_t lPng;
+	const uint8_t *lBand;
+	int32_t y, i, lCount;
+	if (PngFastInit(&lPng, WriteFile, aPngFile, aWidth, aHeight))
+		return -1;
+	/* A failed band leaves rows missing, PngFastFinish() reports that. */
+	for (y = 0; y < aHeight; y += lCount) {
+		lCount = (aHeight - y < PNG_BAND_ROWS) ? aHeight - y : PNG_BAND_ROWS;
+		if (!(lBand = aRows(aContext, y, lCount)))
+			break;
+		for (i = 0; i < lCount; ++i)
+			PngFastRow(&lPng, lBand + i * aWidth * 3);
+	}
+	return PngFastFinish(&lPng);
+}
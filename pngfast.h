@@ -0,0 +1,72 @@
+#ifndef PNGFAST_H
+#define PNGFAST_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/* Local */
+#include "pngwrite.h"
+
+/*
+ * Self-contained PNG encoder for screenshots, it needs neither libpng nor zlib. Every row gets the Sub or the Up
+ * filter, whichever leaves the smaller residuals, so flat UI areas turn into long runs of zeros. The deflate stream
+ * is made of greedy matches found through a hash of 4 bytes, with dynamic Huffman blocks of at most
+ * PNGFAST_BLOCK input bytes that fall back to stored blocks when they do not shrink. CRC-32 and Adler-32 are
+ * computed on the way. The result is a standard 8-bit RGB PNG, on screenshots usually between libpng level 1 and
+ * level 6 in size.
+ *
+ * Rows are fed one by one, so a caller can encode while it converts:
+ *   PngFastInit(&lPng, write, context, width, height);
+ *   for every row: PngFastRow(&lPng, lRgb888Row);
+ *   PngFastFinish(&lPng);
+ */
+#define PNGFAST_WINDOW      (32768)
+#define PNGFAST_BLOCK       (32768)
+#define PNGFAST_HASH_BITS   (14)
+
+typedef struct {
+	png_write_t write;
+	void *context;
+	int32_t width;
+	int32_t height;
+	int32_t rows;
+	int32_t error;
+	uint32_t row_bytes;          /* Filter byte and RGB888 pixels. */
+	uint8_t *prior;              /* Previous unfiltered row. */
+	uint8_t *window;             /* Filtered bytes: the last PNGFAST_WINDOW of history, then the pending block. */
+	uint32_t window_capacity;
+	uint32_t window_base;        /* Stream position of window[0]. */
+	uint32_t block;              /* Start of the pending block in window. */
+	uint32_t position;           /* Next byte to match in window. */
+	uint32_t end;                /* Filtered bytes in window. */
+	uint32_t *hash;              /* Stream positions of the last 4-byte sequences. */
+	uint32_t *tokens;            /* Literal bytes or PNGFAST_MATCH | distance - 1 << 8 | length - 3. */
+	uint32_t token_count;
+	uint32_t literal_counts[286];
+	uint32_t distance_counts[30];
+	uint8_t length_codes[256];   /* Length - 3 to its code - 257. */
+	uint8_t distance_codes[512]; /* Distance - 1 to its code, (distance - 1) >> 7 from 256 up. */
+	uint64_t bits;
+	uint32_t bit_count;
+	uint8_t *out;                /* IDAT data not written yet. */
+	uint32_t out_size;
+	uint32_t crc_table[256];
+	uint32_t adler_a;
+	uint32_t adler_b;
+} png_fast_t;
+
+/* Writes the signature and IHDR. Returns 0 or -1 if out of memory or the write fails, the state is freed then. */
+int32_t PngFastInit(png_fast_t *aPng, png_write_t aWrite, void *aContext, int32_t aWidth, int32_t aHeight);
+/* Encodes the next row of aWidth RGB888 pixels. Returns 0 or -1 after a failed write. */
+int32_t PngFastRow(png_fast_t *aPng, const uint8_t *aRgb888);
+/* Ends the image after the last row and frees the state. Returns 0 or -1 when any write failed or rows are missing. */
+int32_t PngFastFinish(png_fast_t *aPng);
+
+/* Whole images through the row encoder, the same arguments as PngWrite() and PngWriteCallback() without a level. */
+int32_t PngWriteFast(FILE *aPngFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight);
+int32_t PngWriteFastCallback(png_write_t aWrite, void *aContext, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight);
+/* PngWriteRows() without libpng. */
+int32_t PngWriteFastRows(FILE *aPngFile, png_rows_t aRows, void *aContext, int32_t aWidth, int32_t aHeight);
+
+#endif /* !PNGFAST_H */
@@ -0,0 +1,179 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ZLIB */
+#include <zlib.h>
+
+/* Local */
+#include "parallel.h"
+#include "pngchunk.h"
+#include "pngpar.h"
+
+#define PNGPAR_WINDOW       (32768)
+
+typedef struct {
+	const uint8_t *rgb;
+	uint32_t stride;
+	uint32_t row_bytes;
+	int32_t first;
+	int32_t rows;
+	int32_t level;
+	int32_t last;
+	int32_t error;
+	uint8_t *filtered;         /* Filter type byte and filtered row, for every row of the strip. */
+	uint32_t filtered_size;
+	const uint8_t *dictionary; /* Tail of the previous strip's filtered rows. */
+	uint32_t dictionary_size;
+	uint8_t *deflated;         /* Raw deflate data, no zlib header or trailer. */
+	uint32_t deflated_size;
+	uLong adler;
+	uLong crc;
+} png_strip_t;
+
+static void *FilterStrip(void *aStrip) {
+	png_strip_t *lStrip = (png_strip_t *) aStrip;
+	const uint8_t *lPrior = (lStrip->first) ? lStrip->rgb + (lStrip->first - 1) * lStrip->stride : NULL;
+	uint8_t *lScratch = malloc((lStrip->row_bytes + 1) * 5);
+	uint8_t *lOut = lStrip->filtered;
+	int32_t y;
+
+	if (!lScratch) {
+		lStrip->error = 1;
+		return NULL;
+	}
+	for (y = lStrip->first; y < lStrip->first + lStrip->rows; ++y, lOut += lStrip->row_bytes + 1) {
+		const uint8_t *lRow = lStrip->rgb + y * lStrip->stride;
+		memcpy(lOut, PngFilterRow(lScratch, lRow, lPrior, lStrip->row_bytes), lStrip->row_bytes + 1);
+		lPrior = lRow;
+	}
+	lStrip->adler = adler32(adler32(0L, Z_NULL, 0), lStrip->filtered, lStrip->filtered_size);
+	free(lScratch);
+	return NULL;
+}
+
+static void *DeflateStrip(void *aStrip) {
+	png_strip_t *lStrip = (png_strip_t *) aStrip;
+	z_stream lStream;
+	uint32_t lCapacity;
+
+	memset(&lStream, 0, sizeof(z_stream));
+	if (deflateInit2(&lStream, lStrip->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		lStrip->error = 1;
+		return NULL;
+	}
+	/* The bound is for a finished stream, a sync flush adds an empty stored block of at most 5 bytes more. */
+	lCapacity = deflateBound(&lStream, lStrip->filtered_size) + 16;
+	lStrip->deflated = malloc(lCapacity);
+	if (
+		!lStrip->deflated ||
+		(lStrip->dictionary_size && deflateSetDictionary(&lStream, lStrip->dictionary, lStrip->dictionary_size) != Z_OK)
+	) {
+		deflateEnd(&lStream);
+		lStrip->error = 1;
+		return NULL;
+	}
+	lStream.next_in = lStrip->filtered;
+	lStream.avail_in = lStrip->filtered_size;
+	lStream.next_out = lStrip->deflated;
+	lStream.avail_out = lCapacity;
+	if (lStrip->last)
+		lStrip->error = deflate(&lStream, Z_FINISH) != Z_STREAM_END;
+	else
+		lStrip->error = deflate(&lStream, Z_SYNC_FLUSH) != Z_OK || lStream.avail_in || !lStream.avail_out;
+	lStrip->deflated_size = lCapacity - lStream.avail_out;
+	lStrip->crc = crc32(crc32(0L, Z_NULL, 0), lStrip->deflated, lStrip->deflated_size);
+	deflateEnd(&lStream);
+	return NULL;
+}
+
+static int32_t WriteImageData(FILE *aFile, const png_strip_t *aStrips, int32_t aCount, int32_t aLevel) {
+	uint8_t lHead[10], lTail[8];
+	uLong lAdler = adler32(0L, Z_NULL, 0), lCrc;
+	uint32_t lSize = 2 + 4;
+	int32_t i;
+
+	/* zlib header: deflate with a 32 KiB window and the FLEVEL zlib itself would write for this level. */
+	lHead[8] = 0x78;
+	lHead[9] = ((aLevel < 2) ? 0 : (aLevel < 6) ? 1 : (aLevel == 6) ? 2 : 3) << 6;
+	lHead[9] += 31 - ((lHead[8] << 8) | lHead[9]) % 31;
+	for (i = 0; i < aCount; ++i) {
+		lSize += aStrips[i].deflated_size;
+		lAdler = adler32_combine(lAdler, aStrips[i].adler, aStrips[i].filtered_size);
+	}
+	PngPutU32(lHead, lSize);
+	memcpy(lHead + 4, "IDAT", 4);
+	PngPutU32(lTail, lAdler);
+
+	lCrc = crc32(crc32(0L, Z_NULL, 0), lHead + 4, 6);
+	for (i = 0; i < aCount; ++i)
+		lCrc = crc32_combine(lCrc, aStrips[i].crc, aStrips[i].deflated_size);
+	lCrc = crc32(lCrc, lTail, 4);
+	PngPutU32(lTail + 4, lCrc);
+
+	if (fwrite(lHead, sizeof(lHead), 1, aFile) != 1)
+		return -1;
+	for (i = 0; i < aCount; ++i)
+		if (aStrips[i].deflated_size && fwrite(aStrips[i].deflated, aStrips[i].deflated_size, 1, aFile) != 1)
+			return -1;
+	return (fwrite(lTail, sizeof(lTail), 1, aFile) != 1) ? -1 : 0;
+}
+
+int32_t PngWriteParallel(
+	FILE *aPngFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aCompression, int32_t aThreads
+) {
+	const uint32_t lRowBytes = aWidth * PNGCHUNK_BPP;
+	int32_t lCount = aHeight / PNGPAR_MIN_ROWS, lError = 0, i;
+	uint8_t lHeader[13];
+
+	if (aThreads < 1)
+		aThreads = ParallelCpus();
+	if (lCount > aThreads)
+		lCount = aThreads;
+	if (lCount < 1)
+		lCount = 1;
+
+	png_strip_t lStrips[lCount];
+	uint8_t *lFiltered = malloc((lRowBytes + 1) * aHeight);
+	if (!lFiltered)
+		return -1;
+	memset(lStrips, 0, sizeof(lStrips));
+	for (i = 0; i < lCount; ++i) {
+		png_strip_t *lStrip = &lStrips[i];
+		lStrip->rgb = aRgb888;
+		lStrip->stride = aStride;
+		lStrip->row_bytes = lRowBytes;
+		lStrip->first = aHeight * i / lCount;
+		lStrip->rows = aHeight * (i + 1) / lCount - lStrip->first;
+		lStrip->level = aCompression;
+		lStrip->last = i == lCount - 1;
+		lStrip->filtered = lFiltered + lStrip->first * (lRowBytes + 1);
+		lStrip->filtered_size = lStrip->rows * (lRowBytes + 1);
+		if (i) {
+			lStrip->dictionary_size = (lStrips[i - 1].filtered_size < PNGPAR_WINDOW) ? lStrips[i - 1].filtered_size : PNGPAR_WINDOW;
+			lStrip->dictionary = lStrip->filtered - lStrip->dictionary_size;
+		}
+	}
+
+	/* Dictionaries are the filtered rows of the neighbour strip, so all filtering is done before any deflating. */
+	ParallelRun(lStrips, sizeof(png_strip_t), lCount, FilterStrip);
+	ParallelRun(lStrips, sizeof(png_strip_t), lCount, DeflateStrip);
+	for (i = 0; i < lCount; ++i)
+		lError |= lStrips[i].error;
+
+	PngHeaderRgb(lHeader, aWidth, aHeight);
+	if (
+		lError || fwrite(g_png_signature, sizeof(g_png_signature), 1, aPngFile) != 1 ||
+		PngWriteChunk(aPngFile, "IHDR", lHeader, sizeof(lHeader), NULL, 0) ||
+		WriteImageData(aPngFile, lStrips, lCount, aCompression) ||
+		PngWriteChunk(aPngFile, "IEND", NULL, 0, NULL, 0)
+	)
+		lError = 1;
+
+	for (i = 0; i < lCount; ++i)
+		free(lStrips[i].deflated);
+	free(lFiltered);
+	return (lError) ? -1 : 0;
+}
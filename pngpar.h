@@ -0,0 +1,21 @@
+#ifndef PNGPAR_H
+#define PNGPAR_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * Multithreaded PNG writer in the style of pigz. The rows are split into strips which are filtered and deflated
+ * on their own threads, every strip but the first starts from the last 32 KiB of the previous one as a preset
+ * dictionary and every strip but the last ends on a sync flush, so the raw deflate streams concatenate into one
+ * zlib stream. The Adler-32 and the IDAT CRC-32 are combined from the per-strip sums.
+ */
+#define PNGPAR_MIN_ROWS     (16)
+
+/* Writes an 8-bit RGB888 PNG with up to aThreads strips (0 is one per CPU), aCompression is the zlib level 0-9. Returns 0 or -1. */
+int32_t PngWriteParallel(
+	FILE *aPngFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aCompression, int32_t aThreads
+);
+
+#endif /* !PNGPAR_H */
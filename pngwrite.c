@@ -0,0 +1,193 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <setjmp.h>
+
+/* PNG */
+#include <png.h>
+
+/* Local */
+#include "pngwrite.h"
+
+/* Defines */
+#define PALETTE_HASH_BITS   (10)    /* log2 of PNG_PALETTE_HASH. */
+
+typedef struct {
+	png_write_t write;
+	void *context;
+} png_callback_t;
+
+static void WriteCallback(png_structp png_ptr, png_bytep aData, png_size_t aBytes) {
+	png_callback_t *lCallback = (png_callback_t *) png_get_io_ptr(png_ptr);
+	if (lCallback->write(lCallback->context, aData, aBytes))
+		png_error(png_ptr, "write callback failed");
+}
+
+static void FlushCallback(png_structp png_ptr) {
+	(void) png_ptr;
+}
+
+/* http://zarb.org/~gc/html/libpng.html, streamed images take their rows from aRows instead of aRgb888. */
+static int32_t WritePng(
+	FILE *aPngFile, png_callback_t *aCallback, const uint8_t *aRgb888, uint32_t aStride, png_rows_t aRows, void *aContext,
+	int32_t aWidth, int32_t aHeight, int32_t aCompression
+) {
+	const uint32_t lStride = (aRows) ? (uint32_t) aWidth * 3 : aStride;
+	const uint8_t *lBand;
+	int32_t y, i, lCount;
+	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	if (!png_ptr || !info_ptr) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return -1;
+	}
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return -1;
+	}
+	if (aCallback)
+		png_set_write_fn(png_ptr, aCallback, WriteCallback, FlushCallback);
+	else
+		png_init_io(png_ptr, aPngFile);
+
+	png_set_compression_level(png_ptr, aCompression);
+
+	png_set_IHDR(
+		png_ptr,
+		info_ptr,
+		aWidth,
+		aHeight,
+		8,
+		PNG_COLOR_TYPE_RGB,
+		PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_BASE,
+		PNG_FILTER_TYPE_BASE
+	);
+	png_write_info(png_ptr, info_ptr);
+
+	for (y = 0; y < aHeight; y += lCount) {
+		lCount = (aRows && aHeight - y > PNG_BAND_ROWS) ? PNG_BAND_ROWS : aHeight - y;
+		lBand = (aRows) ? aRows(aContext, y, lCount) : aRgb888 + y * lStride;
+		if (!lBand)
+			png_error(png_ptr, "row source failed");
+		for (i = 0; i < lCount; ++i)
+			png_write_row(png_ptr, (png_bytep) (lBand + i * lStride));
+	}
+
+	png_write_end(png_ptr, NULL);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	return 0;
+}
+
+int32_t PngWrite(FILE *aPngFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aCompression) {
+	return WritePng(aPngFile, NULL, aRgb888, aStride, NULL, NULL, aWidth, aHeight, aCompression);
+}
+
+int32_t PngWriteCallback(
+	png_write_t aWrite, void *aContext, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aCompression
+) {
+	png_callback_t lCallback;
+	lCallback.write = aWrite;
+	lCallback.context = aContext;
+	return WritePng(NULL, &lCallback, aRgb888, aStride, NULL, NULL, aWidth, aHeight, aCompression);
+}
+
+int32_t PngWriteRows(FILE *aPngFile, png_rows_t aRows, void *aContext, int32_t aWidth, int32_t aHeight, int32_t aCompression) {
+	return WritePng(aPngFile, NULL, NULL, 0, aRows, aContext, aWidth, aHeight, aCompression);
+}
+
+static uint32_t PaletteHash(uint32_t aColor) {
+	return (aColor * 2654435761U) >> (32 - PALETTE_HASH_BITS);
+}
+
+void PngPaletteInit(png_palette_t *aPalette) {
+	memset(aPalette->keys, 0, sizeof(aPalette->keys));
+	aPalette->count = 0;
+	aPalette->depth = 1;
+}
+
+int32_t PngPaletteAdd(png_palette_t *aPalette, uint8_t *aIndices, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight) {
+	uint32_t *lKeys = aPalette->keys;
+	uint8_t *lValues = aPalette->values;
+	uint32_t lLast = 0xFFFFFFFF, lColor, lSlot;
+	uint8_t lIndex = 0;
+	int32_t x, y;
+
+	for (y = 0; y < aHeight; ++y) {
+		const uint8_t *lRow = aRgb888 + y * aStride;
+		for (x = 0; x < aWidth; ++x, lRow += 3) {
+			lColor = (lRow[0] << 16) | (lRow[1] << 8) | lRow[2];
+			/* Flat UI areas repeat the previous pixel and skip the lookup. */
+			if (lColor != lLast) {
+				for (lSlot = PaletteHash(lColor); lKeys[lSlot] && lKeys[lSlot] != lColor + 1; lSlot = (lSlot + 1) & (PNG_PALETTE_HASH - 1))
+					;
+				if (!lKeys[lSlot]) {
+					if (aPalette->count == PNG_PALETTE_MAX)
+						return -1;
+					lKeys[lSlot] = lColor + 1;
+					lValues[lSlot] = aPalette->count;
+					memcpy(aPalette->colors + aPalette->count * 3, lRow, 3);
+					++aPalette->count;
+				}
+				lIndex = lValues[lSlot];
+				lLast = lColor;
+			}
+			*aIndices++ = lIndex;
+		}
+	}
+	aPalette->depth = (aPalette->count <= 2) ? 1 : (aPalette->count <= 4) ? 2 : (aPalette->count <= 16) ? 4 : 8;
+	return 0;
+}
+
+int32_t PngPaletteBuild(png_palette_t *aPalette, uint8_t *aIndices, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight) {
+	PngPaletteInit(aPalette);
+	return PngPaletteAdd(aPalette, aIndices, aRgb888, aStride, aWidth, aHeight);
+}
+
+int32_t PngWriteIndexed(FILE *aPngFile, const png_palette_t *aPalette, const uint8_t *aIndices, int32_t aWidth, int32_t aHeight, int32_t aCompression) {
+	png_color lColors[PNG_PALETTE_MAX];
+	uint32_t i;
+	int32_t y;
+	png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info_ptr = png_create_info_struct(png_ptr);
+	if (!png_ptr || !info_ptr) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return -1;
+	}
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_write_struct(&png_ptr, &info_ptr);
+		return -1;
+	}
+	png_init_io(png_ptr, aPngFile);
+	png_set_compression_level(png_ptr, aCompression);
+
+	png_set_IHDR(
+		png_ptr,
+		info_ptr,
+		aWidth,
+		aHeight,
+		aPalette->depth,
+		PNG_COLOR_TYPE_PALETTE,
+		PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_BASE,
+		PNG_FILTER_TYPE_BASE
+	);
+	for (i = 0; i < aPalette->count; ++i) {
+		lColors[i].red = aPalette->colors[i * 3];
+		lColors[i].green = aPalette->colors[i * 3 + 1];
+		lColors[i].blue = aPalette->colors[i * 3 + 2];
+	}
+	png_set_PLTE(png_ptr, info_ptr, lColors, aPalette->count);
+	png_write_info(png_ptr, info_ptr);
+	/* Rows hold one index per byte. */
+	if (aPalette->depth < 8)
+		png_set_packing(png_ptr);
+
+	for (y = 0; y < aHeight; ++y)
+		png_write_row(png_ptr, (png_bytep) (aIndices + y * aWidth));
+
+	png_write_end(png_ptr, NULL);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
+	return 0;
+}
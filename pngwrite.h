@@ -0,0 +1,50 @@
+#ifndef PNGWRITE_H
+#define PNGWRITE_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/* Writes an 8-bit RGB888 PNG through libpng, aCompression is the zlib level 0-9. Returns 0 or -1 on libpng error. */
+int32_t PngWrite(FILE *aPngFile, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aCompression);
+
+/* Returns 0 or -1 to abort the image. */
+typedef int32_t (*png_write_t)(void *aContext, const uint8_t *aData, uint32_t aBytes);
+
+/* Same as PngWrite() with the encoded bytes passed to aWrite instead of a FILE. */
+int32_t PngWriteCallback(
+	png_write_t aWrite, void *aContext, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight, int32_t aCompression
+);
+
+/* Returns aCount packed RGB888 rows of the image from aRow on, at most PNG_BAND_ROWS, or NULL to abort it. */
+typedef const uint8_t *(*png_rows_t)(void *aContext, int32_t aRow, int32_t aCount);
+
+#define PNG_BAND_ROWS       (16)
+
+/* PngWrite() of an image that is produced band by band and never whole in memory. Returns 0 or -1. */
+int32_t PngWriteRows(FILE *aPngFile, png_rows_t aRows, void *aContext, int32_t aWidth, int32_t aHeight, int32_t aCompression);
+
+/* Defines */
+#define PNG_PALETTE_MAX     (256)
+#define PNG_PALETTE_HASH    (1024)  /* At most a quarter full. */
+
+typedef struct {
+	uint8_t colors[PNG_PALETTE_MAX * 3];   /* RGB888 in order of first appearance. */
+	uint32_t count;
+	uint8_t depth;                         /* Index bits: 1, 2, 4 or 8. */
+	uint32_t keys[PNG_PALETTE_HASH];       /* Hash set of the colors + 1, 0 marks an empty slot. */
+	uint8_t values[PNG_PALETTE_HASH];      /* Their indices. */
+} png_palette_t;
+
+/*
+ * Collects the distinct colors of the image in a small hash set and writes one palette index per pixel into
+ * aIndices of aWidth * aHeight bytes. Returns 0 or -1 as soon as there are more than 256 colors.
+ */
+int32_t PngPaletteBuild(png_palette_t *aPalette, uint8_t *aIndices, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight);
+/* The same for an image fed in bands: PngPaletteInit(), then PngPaletteAdd() with the indices of every band. */
+void PngPaletteInit(png_palette_t *aPalette);
+int32_t PngPaletteAdd(png_palette_t *aPalette, uint8_t *aIndices, const uint8_t *aRgb888, uint32_t aStride, int32_t aWidth, int32_t aHeight);
+/* Writes an indexed PNG of aIndices rows of aWidth bytes, libpng packs them to the palette depth. Returns 0 or -1. */
+int32_t PngWriteIndexed(FILE *aPngFile, const png_palette_t *aPalette, const uint8_t *aIndices, int32_t aWidth, int32_t aHeight, int32_t aCompression);
+
+#endif /* !PNGWRITE_H */
@@ -0,0 +1,138 @@
+/* C */
+#include <stdint.h>
+#include <string.h>
+
+/* POSIX */
+#include <sys/ioctl.h>
+
+/* Linux */
+#include <linux/fb.h>
+
+/* Local */
+#include "convert.h"
+#include "profile.h"
+
+typedef struct {
+	const char *name;
+	int32_t width;
+	int32_t height;
+	pixel_format_t format;
+} device_profile_t;
+
+static const device_profile_t g_profiles[] = {
+	{ "zn5",  SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, PIXEL_RGB666 },
+	{ "e8",   SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, PIXEL_RGB666 },
+	{ "em30", SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, PIXEL_RGB666 },
+	{ "e680", SCREEN_QVGA_WIDTH, SCREEN_QVGA_HEIGHT, PIXEL_RGB565 },
+	{ "e398", SCREEN_E398_WIDTH, SCREEN_E398_HEIGHT, PIXEL_RGB555 }
+};
+
+#define PROFILE_COUNT       (sizeof(g_profiles) / sizeof(g_profiles[0]))
+
+static void SetGeometry(display_t *aDisplay, int32_t aWidth, int32_t aHeight, uint32_t aDepth, uint32_t aStride) {
+	uint32_t i;
+	aDisplay->width = aWidth;
+	aDisplay->height = aHeight;
+	aDisplay->size = aWidth * aHeight;
+	aDisplay->depth = aDepth;
+	aDisplay->bpp = aDepth / 8;
+	aDisplay->stride = (aStride) ? aStride : (uint32_t) aWidth * aDisplay->bpp;
+	aDisplay->bytes = aDisplay->stride * aHeight;
+	for (i = 0; i < 3; ++i)
+		aDisplay->frames[i] = ConvertGetFrame(aDisplay->format, PIXEL_RGB888 + i, aWidth, aHeight, aDisplay->stride);
+}
+
+/* RGB666 is stored in 3 bytes, so its depth is 24 like the old SCR_DEPTH. */
+static uint32_t FormatDepth(pixel_format_t aFormat) {
+	return PixelFormatBytes(aFormat) * 8;
+}
+
+/* Only the layouts convert.c can read are accepted, the channel lengths tell RGB666, RGB565 and RGB555 apart. */
+static int32_t ProfileFromFb(display_t *aDisplay, int32_t aFd) {
+	struct fb_var_screeninfo lVar;
+	struct fb_fix_screeninfo lFix;
+	if (ioctl(aFd, FBIOGET_VSCREENINFO, &lVar) < 0)
+		return -1;
+	if (ioctl(aFd, FBIOGET_FSCREENINFO, &lFix) < 0)
+		lFix.line_length = 0;
+
+	if ((lVar.bits_per_pixel == 18 || lVar.bits_per_pixel == 24) && lVar.green.length == 6)
+		aDisplay->format = PIXEL_RGB666;
+	else if (lVar.bits_per_pixel == 16 && lVar.green.length == 6)
+		aDisplay->format = PIXEL_RGB565;
+	else if (lVar.bits_per_pixel == 16 && lVar.green.length == 5)
+		aDisplay->format = PIXEL_RGB555;
+	else
+		return -1;
+	aDisplay->name = "auto";
+	SetGeometry(aDisplay, lVar.xres, lVar.yres, FormatDepth(aDisplay->format), lFix.line_length);
+	return 0;
+}
+
+int32_t ProfileLoad(display_t *aDisplay, const char *aName, int32_t aFd) {
+	uint32_t i;
+	memset(aDisplay, 0, sizeof(display_t));
+	if (!strcmp("auto", aName))
+		return ProfileFromFb(aDisplay, aFd);
+	for (i = 0; i < PROFILE_COUNT; ++i)
+		if (!strcmp(g_profiles[i].name, aName)) {
+			aDisplay->name = g_profiles[i].name;
+			aDisplay->format = g_profiles[i].format;
+			SetGeometry(aDisplay, g_profiles[i].width, g_profiles[i].height, FormatDepth(aDisplay->format), 0);
+			return 0;
+		}
+	return -1;
+}
+
+int32_t ProfileSetDepth(display_t *aDisplay, uint32_t aDepth) {
+	uint32_t i;
+	if (aDepth == aDisplay->depth)
+		return 0;
+	for (i = 0; i < PROFILE_COUNT; ++i)
+		if (
+			g_profiles[i].width == aDisplay->width && g_profiles[i].height == aDisplay->height &&
+			FormatDepth(g_profiles[i].format) == aDepth
+		) {
+			aDisplay->name = g_profiles[i].name;
+			aDisplay->format = g_profiles[i].format;
+			SetGeometry(aDisplay, aDisplay->width, aDisplay->height, aDepth, 0);
+			return 0;
+		}
+	SetGeometry(aDisplay, aDisplay->width, aDisplay->height, aDepth, 0);
+	return -1;
+}
+
+int32_t ProfileFromLayout(display_t *aDisplay, int32_t aWidth, int32_t aHeight, pixel_format_t aFormat, uint32_t aStride) {
+	uint32_t i;
+	memset(aDisplay, 0, sizeof(display_t));
+	if (
+		aFormat > PIXEL_RGB555 || aWidth <= 0 || aHeight <= 0 || aStride < aWidth * PixelFormatBytes(aFormat) ||
+		!ConvertGetRow(aFormat, PIXEL_BGR888)
+	)
+		return -1;
+	aDisplay->name = "raw";
+	for (i = 0; i < PROFILE_COUNT; ++i)
+		if (g_profiles[i].width == aWidth && g_profiles[i].height == aHeight && g_profiles[i].format == aFormat) {
+			aDisplay->name = g_profiles[i].name;
+			break;
+		}
+	aDisplay->format = aFormat;
+	SetGeometry(aDisplay, aWidth, aHeight, FormatDepth(aFormat), aStride);
+	return 0;
+}
+
+void DisplayCrop(display_t *aDisplay, int32_t aWidth, int32_t aHeight) {
+	SetGeometry(aDisplay, aWidth, aHeight, aDisplay->depth, 0);
+}
+
+void DisplayConvert(const display_t *aDisplay, uint8_t *aDst, pixel_format_t aDstFormat, const uint8_t *aSrc) {
+	convert_frame_t lConvert = aDisplay->frames[aDstFormat - PIXEL_RGB888];
+	if (lConvert)
+		lConvert(aDst, aSrc);
+	else
+		ConvertFrame(
+			aDst, aDisplay->width * PixelFormatBytes(aDstFormat), aDstFormat,
+			aSrc, aDisplay->stride, aDisplay->format,
+			aDisplay->width, aDisplay->height
+		);
+}
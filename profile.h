@@ -0,0 +1,54 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* C */
+#include <stdint.h>
+
+/* Local */
+#include "convert.h"
+
+/*
+ * Build default for the device profile, the E398 Makefile sets it to "e398".
+ * Every tool can override it with "--device <name>", "auto" asks the framebuffer driver.
+ */
+#ifndef DEVICE_PROFILE
+#define DEVICE_PROFILE      "zn5"
+#endif
+
+#define PROFILE_NAMES       "zn5, e8, em30, e680, e398 or auto"
+
+typedef struct {
+	const char *name;
+	int32_t width;
+	int32_t height;
+	uint32_t size;
+	uint32_t depth;
+	uint8_t bpp;
+	uint32_t stride;            /* Bytes per framebuffer line. */
+	uint32_t bytes;
+	pixel_format_t format;
+	convert_frame_t frames[3];  /* Specialized RGB888, BGR888 and XRGB8888 converters or NULL. */
+} display_t;
+
+/* Fills aDisplay from a profile name, aFd is only used by "auto". Returns 0 or -1 for unknown or unsupported. */
+int32_t ProfileLoad(display_t *aDisplay, const char *aName, int32_t aFd);
+
+/*
+ * Switches to the profile with the same geometry and aDepth, it is how the fbdump <bpp> argument picks E680 RGB565
+ * on a MotoMAGX build. The geometry is always updated, returns -1 if no pixel format is known for aDepth.
+ */
+int32_t ProfileSetDepth(display_t *aDisplay, uint32_t aDepth);
+
+/*
+ * Fills aDisplay from a recorded layout, for dumps read back on another machine. The name is the first profile of
+ * that geometry and format or "raw". Returns -1 for a format convert.c cannot read or a stride shorter than a line.
+ */
+int32_t ProfileFromLayout(display_t *aDisplay, int32_t aWidth, int32_t aHeight, pixel_format_t aFormat, uint32_t aStride);
+
+/* Narrows aDisplay to packed aWidth x aHeight rows of its format, the layout of a raw GrabCapture() of a rectangle. */
+void DisplayCrop(display_t *aDisplay, int32_t aWidth, int32_t aHeight);
+
+/* Converts a whole framebuffer into packed aDstFormat rows through the specialized converter when there is one. */
+void DisplayConvert(const display_t *aDisplay, uint8_t *aDst, pixel_format_t aDstFormat, const uint8_t *aSrc);
+
+#endif /* !PROFILE_H */
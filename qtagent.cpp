@@ -0,0 +1,199 @@
+// C
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+
+// POSIX
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Qt
+#include <qfileinfo.h>
+#include <qobject.h>
+
+// Local
+#include "qtagent.h"
+
+static volatile sig_atomic_t g_grab = 0;
+static volatile sig_atomic_t g_stop = 0;
+
+static void GrabSignal(int aSignal) {
+	(void) aSignal;
+	g_grab = 1;
+}
+
+static void StopSignal(int aSignal) {
+	(void) aSignal;
+	g_stop = 1;
+}
+
+static void ReplyPath(char *aPath, const char *aFifo, int aPid) {
+	snprintf(aPath, AGENT_PATH_MAX, "%s.%d", aFifo, aPid);
+}
+
+// Only a pipe the client still holds open for reading is written, anything else is left alone.
+static void Reply(const char *aFifo, int aPid, bool aOk) {
+	char lPath[AGENT_PATH_MAX];
+	struct stat lStat;
+	ReplyPath(lPath, aFifo, aPid);
+	int lReply = open(lPath, O_WRONLY | O_NONBLOCK);
+	if (lReply < 0)
+		return;
+	if (!fstat(lReply, &lStat) && S_ISFIFO(lStat.st_mode))
+		write(lReply, (aOk) ? "OK\n" : "ERR\n", (aOk) ? 3 : 4);
+	close(lReply);
+}
+
+// Polls the pipe and the signal flags from timerEvent(), so there are no slots and no moc step.
+class Agent : public QObject {
+public:
+	Agent(
+		QApplication *aApp, const char *aPath, int aFifo, AgentGrab aGrab, void *aContext, QPixmap *aPixmap, const char *aSignalFile,
+		int aQuality
+	)
+		: mApp(aApp), mPath(aPath), mFifo(aFifo), mGrab(aGrab), mContext(aContext), mPixmap(aPixmap), mSignalFile(aSignalFile),
+		mQuality(aQuality), mLength(0) {
+		startTimer(AGENT_POLL_MS);
+	}
+
+protected:
+	void timerEvent(QTimerEvent *) {
+		bool lGrabbed = false, lOk = false;
+		char *lEnd;
+
+		if (g_stop) {
+			mApp->quit();
+			return;
+		}
+		if (g_grab) {
+			g_grab = 0;
+			lGrabbed = true;
+			lOk = mGrab(mPixmap, mContext);
+			if (mSignalFile && !(lOk && AgentSave(*mPixmap, mSignalFile, mQuality)))
+				fprintf(stderr, "Cannot open '%s' file for write.\n", mSignalFile);
+		}
+
+		ssize_t lRead = read(mFifo, mLine + mLength, sizeof(mLine) - 1 - mLength);
+		if (lRead <= 0)
+			return;
+		mLength += lRead;
+		mLine[mLength] = '\0';
+		while ((lEnd = strchr(mLine, '\n'))) {
+			int lQuality, lPid, lName = 0;
+			*lEnd = '\0';
+			if (sscanf(mLine, "%d %d %n", &lQuality, &lPid, &lName) == 2 && lName && lPid > 0) {
+				if (!lGrabbed) {
+					lGrabbed = true;
+					lOk = mGrab(mPixmap, mContext);
+				}
+				Reply(mPath, lPid, lOk && AgentSave(*mPixmap, mLine + lName, lQuality));
+			}
+			mLength -= lEnd + 1 - mLine;
+			memmove(mLine, lEnd + 1, mLength + 1);
+		}
+		// A line that can never end is dropped.
+		if (mLength == sizeof(mLine) - 1)
+			mLength = 0;
+	}
+
+private:
+	QApplication *mApp;
+	const char *mPath;
+	int mFifo;
+	AgentGrab mGrab;
+	void *mContext;
+	QPixmap *mPixmap;
+	const char *mSignalFile;
+	int mQuality;
+	char mLine[AGENT_LINE_MAX];
+	unsigned mLength;
+};
+
+bool AgentSave(const QPixmap &aPixmap, const char *aFile, int aQuality) {
+	QString lFormat = QFileInfo(aFile).extension(FALSE).upper();
+	if (lFormat == "JPG")
+		lFormat = "JPEG";
+	return aPixmap.save(aFile, lFormat, aQuality);
+}
+
+int AgentRun(QApplication *aApp, const char *aFifo, AgentGrab aGrab, void *aContext, QPixmap *aPixmap, const char *aSignalFile, int aQuality) {
+	// An open for writing only succeeds while some agent reads the pipe.
+	int lFifo = open(aFifo, O_WRONLY | O_NONBLOCK);
+	if (lFifo >= 0) {
+		close(lFifo);
+		fprintf(stderr, "Error: an agent already reads '%s'!\n", aFifo);
+		return 1;
+	}
+	unlink(aFifo);
+	if (mkfifo(aFifo, 0666) || (lFifo = open(aFifo, O_RDONLY | O_NONBLOCK)) < 0) {
+		fprintf(stderr, "Cannot open '%s' file for read.\n", aFifo);
+		return 1;
+	}
+	// Holding a writer keeps read() from reporting end of file between clients.
+	int lKeep = open(aFifo, O_WRONLY | O_NONBLOCK);
+
+	signal(SIGUSR1, GrabSignal);
+	// A client that closes its reply pipe while the answer is written must not stop the agent.
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, StopSignal);
+	signal(SIGTERM, StopSignal);
+
+	Agent lAgent(aApp, aFifo, lFifo, aGrab, aContext, aPixmap, aSignalFile, aQuality);
+	int lResult = aApp->exec();
+
+	close(lKeep);
+	close(lFifo);
+	unlink(aFifo);
+	return lResult;
+}
+
+int AgentRequest(const char *aFifo, const char *aFile, int aQuality) {
+	char lLine[AGENT_LINE_MAX], lCwd[AGENT_LINE_MAX], lPath[AGENT_PATH_MAX], lAnswer[8];
+	struct pollfd lPoll;
+	int lLength, lReady, lResult = 1;
+
+	int lFifo = open(aFifo, O_WRONLY | O_NONBLOCK);
+	if (lFifo < 0)
+		return -1;
+
+	// The agent runs elsewhere, relative names are resolved here.
+	if (aFile[0] == '/' || !getcwd(lCwd, sizeof(lCwd)))
+		lCwd[0] = '\0';
+	lLength = snprintf(lLine, sizeof(lLine), "%d %d %s%s%s\n", aQuality, (int) getpid(), lCwd, (lCwd[0]) ? "/" : "", aFile);
+	if (lLength <= 0 || lLength >= (int) sizeof(lLine)) {
+		close(lFifo);
+		return 1;
+	}
+
+	// The reply pipe exists with a reader before the request is sent, our own writer keeps poll() from seeing a hangup.
+	ReplyPath(lPath, aFifo, (int) getpid());
+	unlink(lPath);
+	if (mkfifo(lPath, 0666)) {
+		close(lFifo);
+		return 1;
+	}
+	lPoll.fd = open(lPath, O_RDONLY | O_NONBLOCK);
+	int lKeep = (lPoll.fd >= 0) ? open(lPath, O_WRONLY | O_NONBLOCK) : -1;
+	lPoll.events = POLLIN;
+	if (lKeep >= 0 && write(lFifo, lLine, lLength) == lLength) {
+		while ((lReady = poll(&lPoll, 1, AGENT_REPLY_MS)) < 0 && errno == EINTR)
+			;
+		if (lReady > 0 && (lLength = read(lPoll.fd, lAnswer, sizeof(lAnswer) - 1)) > 0) {
+			lAnswer[lLength] = '\0';
+			lResult = (strcmp("OK\n", lAnswer)) ? 1 : 0;
+		}
+	}
+	// Once the pipe is gone a late reply finds nothing to open.
+	unlink(lPath);
+	if (lKeep >= 0)
+		close(lKeep);
+	if (lPoll.fd >= 0)
+		close(lPoll.fd);
+	close(lFifo);
+	return lResult;
+}
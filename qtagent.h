@@ -0,0 +1,32 @@
+#ifndef QTAGENT_H
+#define QTAGENT_H
+
+// Qt
+#include <qapplication.h>
+#include <qpixmap.h>
+
+// Defines
+#define AGENT_POLL_MS       (20)
+#define AGENT_REPLY_MS      (5000)
+#define AGENT_LINE_MAX      (512)   // Below PIPE_BUF, so requests from several clients never interleave.
+#define AGENT_PATH_MAX      (256)
+
+// Fills the preallocated aPixmap with the screen, returns false on failure.
+typedef bool (*AgentGrab)(QPixmap *aPixmap, void *aContext);
+
+/*
+ * Resident mode: the caller initializes Qt once and aPixmap is reused for every capture. Clients create the reply
+ * pipe "<aFifo>.<pid>", write lines "<quality> <pid> <absolute file>" to the aFifo named pipe and read "OK" when the
+ * image is saved or "ERR" on failure from their reply pipe. Nothing is sent once the client has removed it, so no
+ * other process is ever touched. Requests read in the same poll share one grab. SIGUSR1 sent to the agent saves to aSignalFile if given,
+ * SIGINT and SIGTERM stop it. Returns the exit code.
+ */
+int AgentRun(QApplication *aApp, const char *aFifo, AgentGrab aGrab, void *aContext, QPixmap *aPixmap, const char *aSignalFile, int aQuality);
+
+// Returns 0 when the agent saved aFile, 1 when it failed or timed out, -1 when no agent reads aFifo.
+int AgentRequest(const char *aFifo, const char *aFile, int aQuality);
+
+// Saves in the format named by the aFile extension, aQuality -1 is the Qt default.
+bool AgentSave(const QPixmap &aPixmap, const char *aFile, int aQuality);
+
+#endif // !QTAGENT_H
@@ -0,0 +1,145 @@
+/* C */
+#include <stdint.h>
+#include <string.h>
+
+/* POSIX */
+#include <unistd.h>
+#include <sys/uio.h>
+
+/* Local */
+#include "fdio.h"
+#include "profile.h"
+#include "rawdump.h"
+#include "rawpack.h"
+
+/*
+ * Records are written in host byte order, every MotoMAGX, EZX and x86 emulator target is little-endian.
+ * The checksum uses a nibble table instead of zlib, fbdump does not link it on the handsets.
+ */
+
+static const uint32_t g_crc_nibbles[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+void RawDumpHeaderInit(rawdump_header_t *aHeader, const display_t *aDisplay, int32_t aKnownFormat, uint16_t aLayer, uint64_t aTimeUs) {
+	memset(aHeader, 0, sizeof(rawdump_header_t));
+	memcpy(aHeader->magic, RAWDUMP_MAGIC, sizeof(aHeader->magic));
+	aHeader->version = RAWDUMP_VERSION;
+	aHeader->header_size = sizeof(rawdump_header_t);
+	aHeader->width = aDisplay->width;
+	aHeader->height = aDisplay->height;
+	aHeader->stride = aDisplay->stride;
+	aHeader->bytes = aHeader->stored = aDisplay->bytes;
+	aHeader->pixel_format = (aKnownFormat) ? aDisplay->format : RAWDUMP_FORMAT_UNKNOWN;
+	aHeader->depth = aDisplay->depth;
+	aHeader->bytes_per_pixel = aDisplay->bpp;
+	aHeader->layer = aLayer;
+	aHeader->time_us = aTimeUs;
+}
+
+uint32_t RawDumpCrc32(uint32_t aCrc, const uint8_t *aData, uint32_t aBytes) {
+	uint32_t i;
+	aCrc = ~aCrc;
+	for (i = 0; i < aBytes; ++i) {
+		aCrc ^= aData[i];
+		aCrc = (aCrc >> 4) ^ g_crc_nibbles[aCrc & 0x0F];
+		aCrc = (aCrc >> 4) ^ g_crc_nibbles[aCrc & 0x0F];
+	}
+	return ~aCrc;
+}
+
+void RawDumpSetChecksum(rawdump_header_t *aHeader, const uint8_t *aPayload) {
+	aHeader->flags |= RAWDUMP_FLAG_CRC32;
+	aHeader->checksum = RawDumpCrc32(0, aPayload, aHeader->bytes);
+}
+
+uint32_t RawDumpPackBound(const rawdump_header_t *aHeader) {
+	return RawPackBound(aHeader->bytes);
+}
+
+const uint8_t *RawDumpPack(rawdump_header_t *aHeader, const uint8_t *aPayload, uint8_t *aScratch, rawdump_compression_t aCompression) {
+	const uint32_t lBpp = aHeader->bytes_per_pixel;
+	uint32_t lPacked = aHeader->bytes;
+	if (aCompression == RAWDUMP_LZ)
+		lPacked = RawPackLz(aScratch, aPayload, aHeader->bytes);
+	else if (aCompression == RAWDUMP_RLE && (lBpp == 2 || lBpp == 3) && !(aHeader->bytes % lBpp))
+		lPacked = RawPackRle(aScratch, aPayload, aHeader->bytes, lBpp);
+	if (lPacked >= aHeader->bytes) {
+		aHeader->compression = RAWDUMP_STORE;
+		aHeader->stored = aHeader->bytes;
+		return aPayload;
+	}
+	aHeader->compression = aCompression;
+	aHeader->stored = lPacked;
+	return aScratch;
+}
+
+int32_t RawDumpWrite(int32_t aFd, const rawdump_header_t *aHeader, const uint8_t *aData) {
+	struct iovec lIov[2];
+	lIov[0].iov_base = (void *) aHeader;
+	lIov[0].iov_len = sizeof(rawdump_header_t);
+	lIov[1].iov_base = (void *) aData;
+	lIov[1].iov_len = aHeader->stored;
+	return FdWriteVector(aFd, lIov, (aData) ? 2 : 1);
+}
+
+int32_t RawDumpReadHeader(int32_t aFd, rawdump_header_t *aHeader) {
+	const uint32_t lFixed = sizeof(aHeader->magic) + sizeof(aHeader->version) + sizeof(aHeader->header_size);
+	uint8_t lSkip[64];
+	uint32_t lKnown, lExtra;
+	ssize_t lRead;
+
+	/* A clean end of file may only fall between records. */
+	memset(aHeader, 0, sizeof(rawdump_header_t));
+	lRead = read(aFd, aHeader, sizeof(aHeader->magic));
+	if (lRead == 0)
+		return 0;
+	if (lRead != sizeof(aHeader->magic) || FdReadAll(aFd, (uint8_t *) aHeader + lRead, lFixed - lRead))
+		return -1;
+	if (memcmp(aHeader->magic, RAWDUMP_MAGIC, sizeof(aHeader->magic)) || !aHeader->version || aHeader->header_size < RAWDUMP_V1_SIZE)
+		return -1;
+	lKnown = (aHeader->header_size < sizeof(rawdump_header_t)) ? aHeader->header_size : sizeof(rawdump_header_t);
+	if (FdReadAll(aFd, (uint8_t *) aHeader + lFixed, lKnown - lFixed))
+		return -1;
+	for (lExtra = aHeader->header_size - lKnown; lExtra; lExtra -= lRead) {
+		lRead = (lExtra < sizeof(lSkip)) ? lExtra : sizeof(lSkip);
+		if (FdReadAll(aFd, lSkip, lRead))
+			return -1;
+	}
+	if (lKnown == RAWDUMP_V1_SIZE)
+		aHeader->stored = aHeader->bytes;
+	/* The limits keep stride * height and its pack bound far from 32-bit wrap, the product is checked in 64 bits anyway. */
+	if (
+		!aHeader->width || !aHeader->height || aHeader->height > RAWDUMP_HEIGHT_MAX ||
+		!aHeader->bytes_per_pixel || aHeader->bytes_per_pixel > RAWDUMP_BPP_MAX || aHeader->stride > RAWDUMP_STRIDE_MAX ||
+		aHeader->stride < (uint32_t) aHeader->width * aHeader->bytes_per_pixel ||
+		(uint64_t) aHeader->stride * aHeader->height != aHeader->bytes || aHeader->compression > RAWDUMP_LZ ||
+		(aHeader->compression == RAWDUMP_STORE && aHeader->stored != aHeader->bytes) ||
+		aHeader->stored > RawPackBound(aHeader->bytes)
+	)
+		return -1;
+	return 1;
+}
+
+int32_t RawDumpReadPayload(int32_t aFd, const rawdump_header_t *aHeader, uint8_t *aPayload, uint8_t *aScratch) {
+	if (aHeader->compression == RAWDUMP_STORE)
+		return FdReadAll(aFd, aPayload, aHeader->bytes);
+	if (FdReadAll(aFd, aScratch, aHeader->stored))
+		return -1;
+	if (aHeader->compression == RAWDUMP_LZ)
+		return RawUnpackLz(aPayload, aHeader->bytes, aScratch, aHeader->stored);
+	return RawUnpackRle(aPayload, aHeader->bytes, aScratch, aHeader->stored, aHeader->bytes_per_pixel);
+}
+
+int32_t RawDumpVerify(const rawdump_header_t *aHeader, const uint8_t *aPayload) {
+	if (!(aHeader->flags & RAWDUMP_FLAG_CRC32))
+		return 0;
+	return (RawDumpCrc32(0, aPayload, aHeader->bytes) == aHeader->checksum) ? 0 : -1;
+}
+
+int32_t RawDumpDisplay(const rawdump_header_t *aHeader, display_t *aDisplay) {
+	if (aHeader->pixel_format == RAWDUMP_FORMAT_UNKNOWN || PixelFormatBytes((pixel_format_t) aHeader->pixel_format) != aHeader->bytes_per_pixel)
+		return -1;
+	return ProfileFromLayout(aDisplay, aHeader->width, aHeader->height, (pixel_format_t) aHeader->pixel_format, aHeader->stride);
+}
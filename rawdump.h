@@ -0,0 +1,83 @@
+#ifndef RAWDUMP_H
+#define RAWDUMP_H
+
+/* C */
+#include <stdint.h>
+
+/* Local */
+#include "profile.h"
+
+/*
+ * Self-describing raw dump: a header followed by the framebuffer bytes as mapped or packed. A "--stream" burst is
+ * a sequence of such records. All fields are little-endian.
+ *
+ *   rawdump_header_t    header_size bytes, readers skip fields added after their version
+ *   payload             stored bytes: height rows of stride bytes, packed by the rawpack.h codec if compression is set
+ *   rawdump_header_t    next frame of a stream
+ *   ...
+ */
+#define RAWDUMP_MAGIC           "MGXR"
+#define RAWDUMP_VERSION         (2)
+#define RAWDUMP_V1_SIZE         (44)      /* Version 1 headers end before stored and are never compressed. */
+#define RAWDUMP_FORMAT_UNKNOWN  (0xFFFF)  /* A forced depth without a known pixel format, the payload is still valid. */
+#define RAWDUMP_LAYER_UNKNOWN   (0xFFFF)
+#define RAWDUMP_HEIGHT_MAX      (4096)    /* Limits of headers read back, dumps come off handsets and are not trusted. */
+#define RAWDUMP_STRIDE_MAX      (65536)
+#define RAWDUMP_BPP_MAX         (4)
+#define RAWDUMP_FLAG_CRC32      (1)       /* checksum holds the CRC-32 of the unpacked payload. */
+
+typedef enum {
+	RAWDUMP_STORE,
+	RAWDUMP_RLE,
+	RAWDUMP_LZ
+} rawdump_compression_t;
+
+#pragma pack(push, 1)
+typedef struct {
+	char magic[4];
+	uint16_t version;
+	uint16_t header_size;
+	uint16_t width;
+	uint16_t height;
+	uint32_t stride;
+	uint32_t bytes;           /* Unpacked payload, stride * height. */
+	uint16_t pixel_format;    /* pixel_format_t or RAWDUMP_FORMAT_UNKNOWN. */
+	uint16_t depth;
+	uint16_t bytes_per_pixel;
+	uint16_t layer;           /* 0 for /dev/fb/0, 1 for /dev/fb/1. */
+	uint16_t flags;
+	uint16_t compression;     /* rawdump_compression_t. */
+	uint64_t time_us;         /* CLOCK_REALTIME of the capture. */
+	uint32_t checksum;
+	uint32_t stored;          /* Payload bytes in the file. Version 2. */
+} rawdump_header_t;
+#pragma pack(pop)
+
+/* aKnownFormat 0 stores RAWDUMP_FORMAT_UNKNOWN, aTimeUs is wall clock time. No checksum is set. */
+void RawDumpHeaderInit(rawdump_header_t *aHeader, const display_t *aDisplay, int32_t aKnownFormat, uint16_t aLayer, uint64_t aTimeUs);
+/* Continues aCrc (0 to start) over aBytes, the zlib and PNG CRC-32. */
+uint32_t RawDumpCrc32(uint32_t aCrc, const uint8_t *aData, uint32_t aBytes);
+/* Sets RAWDUMP_FLAG_CRC32 and the checksum of aPayload. */
+void RawDumpSetChecksum(rawdump_header_t *aHeader, const uint8_t *aPayload);
+/*
+ * Packs aPayload into aScratch of RawDumpPackBound() bytes and sets compression and stored. Frames that do not
+ * shrink are stored as they are. Returns the bytes to write, aScratch or aPayload.
+ */
+uint32_t RawDumpPackBound(const rawdump_header_t *aHeader);
+const uint8_t *RawDumpPack(rawdump_header_t *aHeader, const uint8_t *aPayload, uint8_t *aScratch, rawdump_compression_t aCompression);
+/* Writes the header and stored bytes of aData in one writev(), aData NULL writes the header only. Returns 0 or -1. */
+int32_t RawDumpWrite(int32_t aFd, const rawdump_header_t *aHeader, const uint8_t *aData);
+
+/* Reads and checks the next header, unknown trailing fields are skipped. Returns 1, 0 at the end of the file or -1. */
+int32_t RawDumpReadHeader(int32_t aFd, rawdump_header_t *aHeader);
+/* Reads the stored payload into aPayload of bytes, packed ones through aScratch of stored bytes. Returns 0 or -1. */
+int32_t RawDumpReadPayload(int32_t aFd, const rawdump_header_t *aHeader, uint8_t *aPayload, uint8_t *aScratch);
+/* Returns 0 when the payload matches the checksum or there is none, -1 otherwise. */
+int32_t RawDumpVerify(const rawdump_header_t *aHeader, const uint8_t *aPayload);
+/*
+ * Describes the payload as a display: the profile geometry with the recorded stride and format, so the frame
+ * converters of known devices are used. Returns -1 for RAWDUMP_FORMAT_UNKNOWN or a format that cannot be converted.
+ */
+int32_t RawDumpDisplay(const rawdump_header_t *aHeader, display_t *aDisplay);
+
+#endif /* !RAWDUMP_H */
@@ -0,0 +1,226 @@
+/* C */
+#include <stdint.h>
+#include <string.h>
+
+/* Local */
+#include "rawpack.h"
+
+/* Defines */
+#define LZ_HASH_BITS        (12)
+#define LZ_MIN_MATCH        (4)
+#define LZ_MAX_OFFSET       (65535)
+#define LZ_LAST_LITERALS    (5)     /* LZ4 block rules: a block ends with at least 5 literals, */
+#define LZ_MATCH_LIMIT      (12)    /* and the last match starts 12 bytes before its end. */
+#define RLE_LITERALS_MAX    (128)
+#define RLE_RUN_MIN         (2)
+#define RLE_RUN_MAX         (129)
+
+uint32_t RawPackBound(uint32_t aBytes) {
+	/* LZ4 worst case, above the RLE one of a control byte per 128 literal pixels. */
+	return aBytes + aBytes / 255 + 16;
+}
+
+static uint32_t Read32(const uint8_t *aSrc) {
+	uint32_t lValue;
+	memcpy(&lValue, aSrc, sizeof(lValue));
+	return lValue;
+}
+
+static uint32_t LzHash(uint32_t aSequence) {
+	return (aSequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *LzPutLength(uint8_t *aOut, uint32_t aLength) {
+	for (; aLength >= 255; aLength -= 255)
+		*aOut++ = 255;
+	*aOut++ = aLength;
+	return aOut;
+}
+
+/* Literals from aAnchor to aMatch and a match of aLength bytes at aOffset, aLength 0 ends the block. */
+static uint8_t *LzPutSequence(uint8_t *aOut, const uint8_t *aAnchor, const uint8_t *aMatch, uint32_t aOffset, uint32_t aLength) {
+	const uint32_t lLiterals = aMatch - aAnchor;
+	uint8_t *lToken = aOut++;
+	*lToken = ((lLiterals < 15) ? lLiterals : 15) << 4;
+	if (lLiterals >= 15)
+		aOut = LzPutLength(aOut, lLiterals - 15);
+	memcpy(aOut, aAnchor, lLiterals);
+	aOut += lLiterals;
+	if (!aLength)
+		return aOut;
+	*aOut++ = aOffset;
+	*aOut++ = aOffset >> 8;
+	aLength -= LZ_MIN_MATCH;
+	*lToken |= (aLength < 15) ? aLength : 15;
+	if (aLength >= 15)
+		aOut = LzPutLength(aOut, aLength - 15);
+	return aOut;
+}
+
+uint32_t RawPackLz(uint8_t *aDst, const uint8_t *aSrc, uint32_t aBytes) {
+	uint32_t lTable[1 << LZ_HASH_BITS];
+	const uint8_t *lIn = aSrc, *lAnchor = aSrc, *lEnd = aSrc + aBytes;
+	const uint8_t *lRef, *lMatchEnd;
+	uint8_t *lOut = aDst;
+	uint32_t lSequence, lHash, lMisses = 0;
+
+	if (aBytes > LZ_MATCH_LIMIT) {
+		const uint8_t *lMatchLimit = lEnd - LZ_MATCH_LIMIT, *lLiteralsLimit = lEnd - LZ_LAST_LITERALS;
+		memset(lTable, 0, sizeof(lTable));
+		while (lIn < lMatchLimit) {
+			lSequence = Read32(lIn);
+			lHash = LzHash(lSequence);
+			lRef = aSrc + lTable[lHash];
+			lTable[lHash] = lIn - aSrc;
+			if (lRef >= lIn || lIn - lRef > LZ_MAX_OFFSET || Read32(lRef) != lSequence) {
+				/* Noise is skipped faster the longer nothing matches. */
+				lIn += 1 + (lMisses++ >> 6);
+				continue;
+			}
+			lMisses = 0;
+			while (lIn > lAnchor && lRef > aSrc && lIn[-1] == lRef[-1]) {
+				--lIn;
+				--lRef;
+			}
+			lMatchEnd = lIn + LZ_MIN_MATCH;
+			lRef += LZ_MIN_MATCH;
+			while (lMatchEnd + 4 <= lLiteralsLimit && Read32(lMatchEnd) == Read32(lRef)) {
+				lMatchEnd += 4;
+				lRef += 4;
+			}
+			while (lMatchEnd < lLiteralsLimit && *lMatchEnd == *lRef) {
+				++lMatchEnd;
+				++lRef;
+			}
+			lOut = LzPutSequence(lOut, lAnchor, lIn, lMatchEnd - lRef, lMatchEnd - lIn);
+			lIn = lAnchor = lMatchEnd;
+		}
+	}
+	lOut = LzPutSequence(lOut, lAnchor, lEnd, 0, 0);
+	return lOut - aDst;
+}
+
+static int32_t LzGetLength(const uint8_t **aIn, const uint8_t *aEnd, uint32_t *aLength) {
+	uint8_t lByte;
+	do {
+		if (*aIn == aEnd)
+			return -1;
+		lByte = *(*aIn)++;
+		*aLength += lByte;
+	} while (lByte == 255);
+	return 0;
+}
+
+int32_t RawUnpackLz(uint8_t *aDst, uint32_t aBytes, const uint8_t *aSrc, uint32_t aPacked) {
+	const uint8_t *lIn = aSrc, *lInEnd = aSrc + aPacked;
+	uint8_t *lOut = aDst, *lOutEnd = aDst + aBytes;
+	uint32_t lToken, lLength, lOffset;
+
+	while (lIn < lInEnd) {
+		lToken = *lIn++;
+		lLength = lToken >> 4;
+		if (lLength == 15 && LzGetLength(&lIn, lInEnd, &lLength))
+			return -1;
+		if (lLength > (uint32_t) (lInEnd - lIn) || lLength > (uint32_t) (lOutEnd - lOut))
+			return -1;
+		memcpy(lOut, lIn, lLength);
+		lOut += lLength;
+		lIn += lLength;
+		if (lIn == lInEnd)
+			break;
+
+		if (lInEnd - lIn < 2)
+			return -1;
+		lOffset = lIn[0] | (lIn[1] << 8);
+		lIn += 2;
+		lLength = lToken & 15;
+		if (lLength == 15 && LzGetLength(&lIn, lInEnd, &lLength))
+			return -1;
+		lLength += LZ_MIN_MATCH;
+		if (!lOffset || lOffset > (uint32_t) (lOut - aDst) || lLength > (uint32_t) (lOutEnd - lOut))
+			return -1;
+		/* Overlapping matches repeat the last lOffset bytes, they must be copied forward byte by byte. */
+		if (lOffset >= lLength)
+			memcpy(lOut, lOut - lOffset, lLength);
+		else {
+			const uint8_t *lRef = lOut - lOffset;
+			uint32_t i;
+			for (i = 0; i < lLength; ++i)
+				lOut[i] = lRef[i];
+		}
+		lOut += lLength;
+	}
+	return (lOut == lOutEnd) ? 0 : -1;
+}
+
+static int32_t PixelEqual(const uint8_t *aLeft, const uint8_t *aRight, uint32_t aBpp) {
+	return aLeft[0] == aRight[0] && aLeft[1] == aRight[1] && (aBpp == 2 || aLeft[2] == aRight[2]);
+}
+
+/* Pixels equal to the first one, at most aMax: in a run every byte equals the one a pixel further. */
+static uint32_t RleRun(const uint8_t *aPixel, uint32_t aMax, uint32_t aBpp) {
+	const uint32_t lBytes = (aMax - 1) * aBpp;
+	uint32_t i = 0;
+	while (i + 4 <= lBytes && Read32(aPixel + i) == Read32(aPixel + i + aBpp))
+		i += 4;
+	while (i < lBytes && aPixel[i] == aPixel[i + aBpp])
+		++i;
+	return i / aBpp + 1;
+}
+
+uint32_t RawPackRle(uint8_t *aDst, const uint8_t *aSrc, uint32_t aBytes, uint32_t aBpp) {
+	const uint32_t lPixels = aBytes / aBpp;
+	uint8_t *lOut = aDst;
+	uint32_t i = 0, lCount;
+
+	while (i < lPixels) {
+		const uint8_t *lPixel = aSrc + i * aBpp;
+		lCount = RleRun(lPixel, (lPixels - i < RLE_RUN_MAX) ? lPixels - i : RLE_RUN_MAX, aBpp);
+		if (lCount >= RLE_RUN_MIN) {
+			*lOut++ = 0x80 + lCount - RLE_RUN_MIN;
+			memcpy(lOut, lPixel, aBpp);
+			lOut += aBpp;
+			i += lCount;
+			continue;
+		}
+		/* Literals stop where the next run starts. */
+		for (
+			lCount = 1;
+			i + lCount < lPixels && lCount < RLE_LITERALS_MAX &&
+			!(i + lCount + 1 < lPixels && PixelEqual(lPixel + lCount * aBpp, lPixel + (lCount + 1) * aBpp, aBpp));
+			++lCount
+		)
+			;
+		*lOut++ = lCount - 1;
+		memcpy(lOut, lPixel, lCount * aBpp);
+		lOut += lCount * aBpp;
+		i += lCount;
+	}
+	return lOut - aDst;
+}
+
+int32_t RawUnpackRle(uint8_t *aDst, uint32_t aBytes, const uint8_t *aSrc, uint32_t aPacked, uint32_t aBpp) {
+	const uint8_t *lIn = aSrc, *lInEnd = aSrc + aPacked;
+	uint8_t *lOut = aDst, *lOutEnd = aDst + aBytes;
+	uint32_t lCount, i;
+
+	while (lIn < lInEnd) {
+		lCount = *lIn++;
+		if (lCount < 0x80) {
+			lCount = (lCount + 1) * aBpp;
+			if (lCount > (uint32_t) (lInEnd - lIn) || lCount > (uint32_t) (lOutEnd - lOut))
+				return -1;
+			memcpy(lOut, lIn, lCount);
+			lIn += lCount;
+			lOut += lCount;
+			continue;
+		}
+		lCount = lCount - 0x80 + RLE_RUN_MIN;
+		if (aBpp > (uint32_t) (lInEnd - lIn) || lCount * aBpp > (uint32_t) (lOutEnd - lOut))
+			return -1;
+		for (i = 0; i < lCount; ++i, lOut += aBpp)
+			memcpy(lOut, lIn, aBpp);
+		lIn += aBpp;
+	}
+	return (lOut == lOutEnd) ? 0 : -1;
+}
@@ -0,0 +1,25 @@
+#ifndef RAWPACK_H
+#define RAWPACK_H
+
+/* C */
+#include <stdint.h>
+
+/*
+ * Fast lossless codecs for raw dumps, cheap enough on the handset that the flash write stays the bottleneck.
+ *
+ *   LZ   LZ4 block format: greedy matches found through a hash of 4 bytes, no entropy coding.
+ *   RLE  pixel runs for the flat areas of the UI: a control byte below 0x80 is followed by control + 1 literal
+ *        pixels, 0x80 and above by one pixel repeated control - 0x7E times. aBpp is 2 or 3 bytes.
+ *
+ * The packers write at most RawPackBound() bytes and return the packed size. The unpackers check every length and
+ * offset against both buffers and return 0 only when exactly aBytes were rebuilt.
+ */
+uint32_t RawPackBound(uint32_t aBytes);
+
+uint32_t RawPackLz(uint8_t *aDst, const uint8_t *aSrc, uint32_t aBytes);
+int32_t RawUnpackLz(uint8_t *aDst, uint32_t aBytes, const uint8_t *aSrc, uint32_t aPacked);
+
+uint32_t RawPackRle(uint8_t *aDst, const uint8_t *aSrc, uint32_t aBytes, uint32_t aBpp);
+int32_t RawUnpackRle(uint8_t *aDst, uint32_t aBytes, const uint8_t *aSrc, uint32_t aPacked, uint32_t aBpp);
+
+#endif /* !RAWPACK_H */
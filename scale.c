@@ -0,0 +1,273 @@
+/* C */
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+/* SIMD */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/* Local */
+#include "convert.h"
+#include "scale.h"
+
+/* Defines */
+#define SCALE_DIVISOR_MAX   (0xFFFFFFFFU / 256) /* Output sums of 255 * divisor and the rounding stay in 32 bits. */
+
+static uint32_t Gcd(uint32_t aLeft, uint32_t aRight) {
+	while (aRight) {
+		const uint32_t lRest = aLeft % aRight;
+		aLeft = aRight;
+		aRight = lRest;
+	}
+	return aLeft;
+}
+
+/*
+ * Rounded aSum / divisor without a division, ARM11 has none. Powers of two, the 1/2^N sizes, are a shift, otherwise
+ * the estimate by the inverse is at most one too small.
+ */
+static inline uint8_t ScaleMean(const scale_t *aScale, uint32_t aSum) {
+	uint32_t lMean;
+	aSum += aScale->divisor / 2;
+	if (aScale->shift)
+		return aSum >> aScale->shift;
+	lMean = ((uint64_t) aSum * aScale->inverse) >> 32;
+	if ((lMean + 1) * aScale->divisor <= aSum)
+		++lMean;
+	return lMean;
+}
+
+/* Unit weights of the integer factors, 16 bytes widened into 16 column sums per step. */
+static void AddRow(uint32_t *aSums, const uint8_t *aRow, int32_t aCount) {
+	int32_t i = 0;
+#if defined(__SSE2__)
+	const __m128i lZero = _mm_setzero_si128();
+	for (; i + 16 <= aCount; i += 16) {
+		const __m128i lBytes = _mm_loadu_si128((const __m128i *) (aRow + i));
+		const __m128i lLow = _mm_unpacklo_epi8(lBytes, lZero), lHigh = _mm_unpackhi_epi8(lBytes, lZero);
+		__m128i *lSums = (__m128i *) (aSums + i);
+		_mm_storeu_si128(lSums + 0, _mm_add_epi32(_mm_loadu_si128(lSums + 0), _mm_unpacklo_epi16(lLow, lZero)));
+		_mm_storeu_si128(lSums + 1, _mm_add_epi32(_mm_loadu_si128(lSums + 1), _mm_unpackhi_epi16(lLow, lZero)));
+		_mm_storeu_si128(lSums + 2, _mm_add_epi32(_mm_loadu_si128(lSums + 2), _mm_unpacklo_epi16(lHigh, lZero)));
+		_mm_storeu_si128(lSums + 3, _mm_add_epi32(_mm_loadu_si128(lSums + 3), _mm_unpackhi_epi16(lHigh, lZero)));
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	for (; i + 16 <= aCount; i += 16) {
+		const uint8x16_t lBytes = vld1q_u8(aRow + i);
+		const uint16x8_t lLow = vmovl_u8(vget_low_u8(lBytes)), lHigh = vmovl_u8(vget_high_u8(lBytes));
+		vst1q_u32(aSums + i + 0, vaddw_u16(vld1q_u32(aSums + i + 0), vget_low_u16(lLow)));
+		vst1q_u32(aSums + i + 4, vaddw_u16(vld1q_u32(aSums + i + 4), vget_high_u16(lLow)));
+		vst1q_u32(aSums + i + 8, vaddw_u16(vld1q_u32(aSums + i + 8), vget_low_u16(lHigh)));
+		vst1q_u32(aSums + i + 12, vaddw_u16(vld1q_u32(aSums + i + 12), vget_high_u16(lHigh)));
+	}
+#endif
+	for (; i < aCount; ++i)
+		aSums[i] += aRow[i];
+}
+
+/* Partly covered rows of the other sizes, widening 16-bit multiplies while the weight fits. */
+static void AddRowWeighted(uint32_t *aSums, const uint8_t *aRow, int32_t aCount, uint32_t aWeight) {
+	int32_t i = 0;
+#if defined(__SSE2__)
+	const __m128i lZero = _mm_setzero_si128(), lWeight = _mm_set1_epi16(aWeight);
+	for (; aWeight <= 0xFFFF && i + 16 <= aCount; i += 16) {
+		const __m128i lBytes = _mm_loadu_si128((const __m128i *) (aRow + i));
+		const __m128i lLow = _mm_unpacklo_epi8(lBytes, lZero), lHigh = _mm_unpackhi_epi8(lBytes, lZero);
+		const __m128i lLowLo = _mm_mullo_epi16(lLow, lWeight), lLowHi = _mm_mulhi_epu16(lLow, lWeight);
+		const __m128i lHighLo = _mm_mullo_epi16(lHigh, lWeight), lHighHi = _mm_mulhi_epu16(lHigh, lWeight);
+		__m128i *lSums = (__m128i *) (aSums + i);
+		_mm_storeu_si128(lSums + 0, _mm_add_epi32(_mm_loadu_si128(lSums + 0), _mm_unpacklo_epi16(lLowLo, lLowHi)));
+		_mm_storeu_si128(lSums + 1, _mm_add_epi32(_mm_loadu_si128(lSums + 1), _mm_unpackhi_epi16(lLowLo, lLowHi)));
+		_mm_storeu_si128(lSums + 2, _mm_add_epi32(_mm_loadu_si128(lSums + 2), _mm_unpacklo_epi16(lHighLo, lHighHi)));
+		_mm_storeu_si128(lSums + 3, _mm_add_epi32(_mm_loadu_si128(lSums + 3), _mm_unpackhi_epi16(lHighLo, lHighHi)));
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	for (; aWeight <= 0xFFFF && i + 16 <= aCount; i += 16) {
+		const uint8x16_t lBytes = vld1q_u8(aRow + i);
+		const uint16x8_t lLow = vmovl_u8(vget_low_u8(lBytes)), lHigh = vmovl_u8(vget_high_u8(lBytes));
+		vst1q_u32(aSums + i + 0, vmlal_n_u16(vld1q_u32(aSums + i + 0), vget_low_u16(lLow), aWeight));
+		vst1q_u32(aSums + i + 4, vmlal_n_u16(vld1q_u32(aSums + i + 4), vget_high_u16(lLow), aWeight));
+		vst1q_u32(aSums + i + 8, vmlal_n_u16(vld1q_u32(aSums + i + 8), vget_low_u16(lHigh), aWeight));
+		vst1q_u32(aSums + i + 12, vmlal_n_u16(vld1q_u32(aSums + i + 12), vget_high_u16(lHigh), aWeight));
+	}
+#endif
+	for (; i < aCount; ++i)
+		aSums[i] += aRow[i] * aWeight;
+}
+
+/* Folds the column sums of a complete output row into its pixels, by the same coverage rule as the rows. */
+static void EmitRow(scale_t *aScale, const uint32_t *aSums) {
+	/* A local copy, the byte stores could alias the fields otherwise and ScaleMean() would reload them every time. */
+	const scale_t lScale = *aScale;
+	const int32_t lRow = (aScale->bottom_up) ? aScale->height - 1 - aScale->out_rows : aScale->out_rows;
+	uint8_t *lOut = aScale->dst + lRow * aScale->dst_stride;
+	uint32_t lFilled = 0, lWeight, lRest, lRed = 0, lGreen = 0, lBlue = 0;
+	int32_t x;
+	if (lScale.x_in == 1) {
+		/* Integer factors sum whole columns. */
+		for (x = 0; x < lScale.width; ++x) {
+			lRed = lGreen = lBlue = 0;
+			for (lWeight = 0; lWeight < lScale.x_out; ++lWeight, aSums += 3) {
+				lRed += aSums[0];
+				lGreen += aSums[1];
+				lBlue += aSums[2];
+			}
+			*lOut++ = ScaleMean(&lScale, lRed);
+			*lOut++ = ScaleMean(&lScale, lGreen);
+			*lOut++ = ScaleMean(&lScale, lBlue);
+		}
+		++aScale->out_rows;
+		return;
+	}
+	for (x = 0; x < lScale.src_width; ++x, aSums += 3) {
+		lWeight = lScale.x_out - lFilled;
+		if (lWeight > lScale.x_in)
+			lWeight = lScale.x_in;
+		lRed += aSums[0] * lWeight;
+		lGreen += aSums[1] * lWeight;
+		lBlue += aSums[2] * lWeight;
+		lFilled += lWeight;
+		if (lFilled == lScale.x_out) {
+			*lOut++ = ScaleMean(&lScale, lRed);
+			*lOut++ = ScaleMean(&lScale, lGreen);
+			*lOut++ = ScaleMean(&lScale, lBlue);
+			lRest = lScale.x_in - lWeight;
+			lRed = aSums[0] * lRest;
+			lGreen = aSums[1] * lRest;
+			lBlue = aSums[2] * lRest;
+			lFilled = lRest;
+		}
+	}
+	++aScale->out_rows;
+}
+
+int32_t ScaleParseSize(const char *aSize, int32_t aSrcWidth, int32_t aSrcHeight, int32_t *aWidth, int32_t *aHeight) {
+	char *lEnd;
+	long lFirst = strtol(aSize, &lEnd, 10), lSecond;
+	if (lEnd == aSize)
+		return -1;
+	if (*lEnd == '/' && lFirst == 1) {
+		lSecond = strtol(lEnd + 1, &lEnd, 10);
+		if (*lEnd || lSecond < 1)
+			return -1;
+		*aWidth = aSrcWidth / lSecond;
+		*aHeight = aSrcHeight / lSecond;
+	} else if (*lEnd == 'x') {
+		lSecond = strtol(lEnd + 1, &lEnd, 10);
+		if (*lEnd || lFirst < 0 || lSecond < 0 || lFirst > aSrcWidth || lSecond > aSrcHeight || (!lFirst && !lSecond))
+			return -1;
+		*aWidth = (lFirst) ? lFirst : (aSrcWidth * lSecond + aSrcHeight / 2) / aSrcHeight;
+		*aHeight = (lSecond) ? lSecond : (aSrcHeight * lFirst + aSrcWidth / 2) / aSrcWidth;
+	} else
+		return -1;
+	return (*aWidth < 1 || *aHeight < 1 || *aWidth > aSrcWidth || *aHeight > aSrcHeight) ? -1 : 0;
+}
+
+int32_t ScaleInit(
+	scale_t *aScale, int32_t aSrcWidth, int32_t aSrcHeight, uint8_t *aDst, uint32_t aDstStride, int32_t aWidth, int32_t aHeight
+) {
+	uint32_t lGcd;
+	memset(aScale, 0, sizeof(scale_t));
+	if (aWidth < 1 || aHeight < 1 || aWidth > aSrcWidth || aHeight > aSrcHeight)
+		return -1;
+	aScale->src_width = aSrcWidth;
+	aScale->src_height = aSrcHeight;
+	aScale->width = aWidth;
+	aScale->height = aHeight;
+	aScale->dst = aDst;
+	aScale->dst_stride = aDstStride;
+
+	/* A source column is aWidth units wide and an output one aSrcWidth, so both tile the same span. */
+	lGcd = Gcd(aSrcWidth, aWidth);
+	aScale->x_in = aWidth / lGcd;
+	aScale->x_out = aSrcWidth / lGcd;
+	lGcd = Gcd(aSrcHeight, aHeight);
+	aScale->y_in = aHeight / lGcd;
+	aScale->y_out = aSrcHeight / lGcd;
+	if ((uint64_t) aScale->x_out * aScale->y_out > SCALE_DIVISOR_MAX)
+		return -1;
+	aScale->divisor = aScale->x_out * aScale->y_out;
+	aScale->inverse = 0xFFFFFFFFU / aScale->divisor;
+	if (!(aScale->divisor & (aScale->divisor - 1)))
+		while ((1U << aScale->shift) < aScale->divisor)
+			++aScale->shift;
+
+	aScale->sums[0] = calloc(aSrcWidth * 3 * 2, sizeof(uint32_t));
+	if (!aScale->sums[0])
+		return -1;
+	aScale->sums[1] = aScale->sums[0] + aSrcWidth * 3;
+	return 0;
+}
+
+void ScaleRows(scale_t *aScale, const uint8_t *aSrc, uint32_t aSrcStride, int32_t aCount) {
+	const int32_t lValues = aScale->src_width * 3;
+	uint32_t lWeight, lRest, *lSums;
+	const uint8_t *lRow;
+	int32_t i;
+	for (i = 0; i < aCount && aScale->rows < aScale->src_height; ++i, ++aScale->rows) {
+		lRow = aSrc + ((aScale->bottom_up) ? aCount - 1 - i : i) * aSrcStride;
+		/* Downscaling, a source row is never split over more than two output rows. */
+		lWeight = aScale->y_out - aScale->filled;
+		if (lWeight > aScale->y_in)
+			lWeight = aScale->y_in;
+		lRest = aScale->y_in - lWeight;
+		if (lWeight == 1)
+			AddRow(aScale->sums[0], lRow, lValues);
+		else
+			AddRowWeighted(aScale->sums[0], lRow, lValues, lWeight);
+		if (lRest)
+			AddRowWeighted(aScale->sums[1], lRow, lValues, lRest);
+		aScale->filled += lWeight;
+		if (aScale->filled == aScale->y_out) {
+			EmitRow(aScale, aScale->sums[0]);
+			lSums = aScale->sums[0];
+			aScale->sums[0] = aScale->sums[1];
+			aScale->sums[1] = lSums;
+			memset(lSums, 0, lValues * sizeof(uint32_t));
+			aScale->filled = lRest;
+		}
+	}
+}
+
+void ScaleFree(scale_t *aScale) {
+	/* The two sum rows are one allocation, sums[0] is not always its start after the swaps. */
+	free((aScale->sums[0] < aScale->sums[1]) ? aScale->sums[0] : aScale->sums[1]);
+	aScale->sums[0] = aScale->sums[1] = NULL;
+}
+
+void ScaleBottomUp(scale_t *aScale) {
+	aScale->bottom_up = 1;
+}
+
+int32_t ScaleConvertFrame(
+	scale_t *aScale, uint8_t *aDst, uint32_t aDstStride, pixel_format_t aDstFormat,
+	const uint8_t *aSrc, uint32_t aSrcStride, pixel_format_t aSrcFormat
+) {
+	int32_t y, lRows;
+	if (PixelFormatBytes(aDstFormat) != 3 || !ConvertGetRow(aSrcFormat, aDstFormat))
+		return -1;
+	for (y = 0; y < aScale->src_height; y += SCALE_BAND) {
+		lRows = (aScale->src_height - y < SCALE_BAND) ? aScale->src_height - y : SCALE_BAND;
+		ConvertFrame(
+			aDst + y * aDstStride, aDstStride, aDstFormat, aSrc + y * aSrcStride, aSrcStride, aSrcFormat, aScale->src_width, lRows
+		);
+		ScaleRows(aScale, aDst + y * aDstStride, aDstStride, lRows);
+	}
+	return 0;
+}
+
+int32_t ScaleImage(
+	const uint8_t *aSrc, uint32_t aSrcStride, int32_t aSrcWidth, int32_t aSrcHeight,
+	uint8_t *aDst, uint32_t aDstStride, int32_t aWidth, int32_t aHeight
+) {
+	scale_t lScale;
+	if (ScaleInit(&lScale, aSrcWidth, aSrcHeight, aDst, aDstStride, aWidth, aHeight))
+		return -1;
+	ScaleRows(&lScale, aSrc, aSrcStride, aSrcHeight);
+	ScaleFree(&lScale);
+	return 0;
+}
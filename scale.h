@@ -0,0 +1,76 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+/* C */
+#include <stdint.h>
+
+/* Local */
+#include "convert.h"
+
+/*
+ * Thumbnails by an area (box) filter over 3-byte pixels, RGB888 or BGR888 alike, for any size not above the source.
+ * Every output pixel is the mean of the source area it covers, partly covered edge pixels count by their share, so
+ * 1/2 and 1/4 are plain 2x2 and 4x4 averages and odd sizes stay exact. Source rows are fed in order and added into
+ * column sums by SSE2 or NEON kernels, with a weight when they straddle two output rows, and an output row is only
+ * folded horizontally once it is complete. ScaleConvertFrame() feeds the rows while a conversion writes them, so the
+ * thumbnail costs no second pass over the full image.
+ */
+#define SCALE_BAND          (8)     /* Rows converted before they are scaled, with the column sums it stays in L1. */
+
+typedef struct {
+	int32_t src_width;
+	int32_t src_height;
+	int32_t width;
+	int32_t height;
+	uint8_t *dst;
+	uint32_t dst_stride;
+	uint32_t x_in;       /* Widths of a source and an output column in common units, reduced by their gcd. */
+	uint32_t x_out;
+	uint32_t y_in;       /* The same for the rows. */
+	uint32_t y_out;
+	uint32_t divisor;    /* x_out * y_out, the weight of one output pixel. */
+	uint32_t inverse;    /* (2^32 - 1) / divisor. */
+	uint32_t shift;      /* log2 of a power of two divisor, 0 when it is none or 1. */
+	uint32_t *sums[2];   /* Column sums of the current and the next output row, src_width * 3 each. */
+	uint32_t filled;     /* Units of the current output row covered. */
+	int32_t rows;        /* Source rows fed. */
+	int32_t out_rows;    /* Output rows written. */
+	int32_t bottom_up;   /* Rows come from the bottom of the image up, see ScaleBottomUp(). */
+} scale_t;
+
+/*
+ * Parses a thumbnail size for a aSrcWidth x aSrcHeight source: "1/N" or "WxH", a 0 side keeps the aspect ratio.
+ * Returns 0 or -1 for a bad size or one larger than the source.
+ */
+int32_t ScaleParseSize(const char *aSize, int32_t aSrcWidth, int32_t aSrcHeight, int32_t *aWidth, int32_t *aHeight);
+
+/* Prepares scaling into aDst rows of aDstStride bytes. Returns 0 or -1 for a bad size or out of memory. */
+int32_t ScaleInit(
+	scale_t *aScale, int32_t aSrcWidth, int32_t aSrcHeight, uint8_t *aDst, uint32_t aDstStride, int32_t aWidth, int32_t aHeight
+);
+/* Feeds the next aCount source rows, output rows are written as soon as they are complete. */
+void ScaleRows(scale_t *aScale, const uint8_t *aSrc, uint32_t aSrcStride, int32_t aCount);
+void ScaleFree(scale_t *aScale);
+/*
+ * Switches a fresh aScale to rows fed from the bottom of the image up, as BMP streams produce them. ScaleRows() then
+ * takes the aCount top-down rows of a band last first and output rows are written from the last one up, so dst
+ * still gets the same top-down thumbnail, the box filter is symmetric.
+ */
+void ScaleBottomUp(scale_t *aScale);
+
+/*
+ * ConvertFrame() of a whole aScale source into RGB888 or BGR888, in bands of SCALE_BAND rows which are scaled right
+ * after their conversion. Returns 0 or -1 if the conversion is not supported.
+ */
+int32_t ScaleConvertFrame(
+	scale_t *aScale, uint8_t *aDst, uint32_t aDstStride, pixel_format_t aDstFormat,
+	const uint8_t *aSrc, uint32_t aSrcStride, pixel_format_t aSrcFormat
+);
+
+/* ScaleInit() and ScaleRows() of a whole image at once, for images that are already converted. */
+int32_t ScaleImage(
+	const uint8_t *aSrc, uint32_t aSrcStride, int32_t aSrcWidth, int32_t aSrcHeight,
+	uint8_t *aDst, uint32_t aDstStride, int32_t aWidth, int32_t aHeight
+);
+
+#endif /* !SCALE_H */
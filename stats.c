@@ -0,0 +1,118 @@
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <malloc.h>
+
+/* POSIX */
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Local */
+#include "stats.h"
+#include "timing.h"
+
+static const char *g_stage_names[STATS_STAGES] = { "open", "read", "convert", "encode", "write" };
+
+static uint64_t HeapInUse(void) {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 lInfo = mallinfo2();
+#else
+	struct mallinfo lInfo = mallinfo();
+#endif
+	return (uint64_t) lInfo.uordblks + lInfo.hblkhd;
+}
+
+/* VmHWM also covers the touched framebuffer pages and libpng or libjpeg buffers freed between samples. */
+static uint32_t PeakResidentKb(void) {
+	FILE *lStatus = fopen("/proc/self/status", "r");
+	char lLine[128];
+	unsigned long lKb = 0;
+	if (!lStatus)
+		return 0;
+	while (fgets(lLine, sizeof(lLine), lStatus))
+		if (sscanf(lLine, "VmHWM: %lu kB", &lKb) == 1)
+			break;
+	fclose(lStatus);
+	return lKb;
+}
+
+void StatsInit(stats_t *aStats, const char *aTool, int32_t aEnabled) {
+	memset(aStats, 0, sizeof(stats_t));
+	aStats->enabled = aEnabled;
+	aStats->tool = aTool;
+	aStats->device = "";
+	if (aEnabled)
+		aStats->start = TimeMonotonicUs();
+}
+
+uint64_t StatsBegin(const stats_t *aStats) {
+	return (aStats->enabled) ? TimeMonotonicUs() : 0;
+}
+
+void StatsEnd(stats_t *aStats, stats_stage_t aStage, uint64_t aBegin) {
+	uint64_t lHeap;
+	if (!aStats->enabled)
+		return;
+	aStats->stages[aStage] += TimeMonotonicUs() - aBegin;
+	lHeap = HeapInUse();
+	if (lHeap > aStats->heap_peak)
+		aStats->heap_peak = lHeap;
+}
+
+void StatsBuffer(const stats_t *aStats, FILE *aFile, uint32_t aBytes) {
+	if (aStats->enabled)
+		setvbuf(aFile, NULL, _IOFBF, aBytes);
+}
+
+int32_t StatsFlush(stats_t *aStats, FILE *aFile) {
+	uint64_t lBegin = StatsBegin(aStats);
+	int32_t lResult = fflush(aFile);
+	StatsEnd(aStats, STATS_WRITE, lBegin);
+	StatsOutput(aStats, fileno(aFile));
+	return (lResult) ? -1 : 0;
+}
+
+void StatsOutput(stats_t *aStats, int32_t aFd) {
+	struct stat lStat;
+	if (!aStats->enabled)
+		return;
+	if (fstat(aFd, &lStat) || !S_ISREG(lStat.st_mode))
+		aStats->written_unknown = 1;
+	else
+		aStats->bytes_written += lStat.st_size;
+}
+
+void StatsMove(stats_t *aStats, stats_stage_t aFrom, stats_stage_t aTo, uint64_t aMicroseconds) {
+	if (aMicroseconds > aStats->stages[aFrom])
+		aMicroseconds = aStats->stages[aFrom];
+	aStats->stages[aFrom] -= aMicroseconds;
+	aStats->stages[aTo] += aMicroseconds;
+}
+
+void StatsMerge(stats_t *aStats, const stats_t *aOther) {
+	int32_t i;
+	for (i = 0; i < STATS_STAGES; ++i)
+		aStats->stages[i] += aOther->stages[i];
+	aStats->bytes_read += aOther->bytes_read;
+	aStats->bytes_written += aOther->bytes_written;
+	aStats->written_unknown |= aOther->written_unknown;
+	aStats->frames += aOther->frames;
+	if (aOther->heap_peak > aStats->heap_peak)
+		aStats->heap_peak = aOther->heap_peak;
+}
+
+void StatsPrint(stats_t *aStats, int32_t aError) {
+	int32_t i;
+	if (!aStats->enabled)
+		return;
+	fprintf(stderr, "{\"tool\":\"%s\",\"device\":\"%s\",\"error\":%d,\"frames\":%u", aStats->tool, aStats->device, (aError) ? 1 : 0, aStats->frames);
+	for (i = 0; i < STATS_STAGES; ++i)
+		fprintf(stderr, ",\"%s_us\":%llu", g_stage_names[i], (unsigned long long) aStats->stages[i]);
+	fprintf(stderr, ",\"total_us\":%llu,\"bytes_read\":%llu,", (unsigned long long) (TimeMonotonicUs() - aStats->start), (unsigned long long) aStats->bytes_read);
+	if (aStats->written_unknown)
+		fprintf(stderr, "\"bytes_written\":null,");
+	else
+		fprintf(stderr, "\"bytes_written\":%llu,", (unsigned long long) aStats->bytes_written);
+	fprintf(stderr, "\"heap_peak\":%llu,\"rss_peak_kb\":%u}\n", (unsigned long long) aStats->heap_peak, PeakResidentKb());
+}
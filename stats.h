@@ -0,0 +1,57 @@
+#ifndef STATS_H
+#define STATS_H
+
+/* C */
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * "--stats" instrumentation: monotonic stage times, byte counters and peak memory of one run, printed to stderr
+ * as a single JSON line. Timing calls are no-ops unless enabled. A stats_t belongs to one thread, worker threads
+ * keep their own and StatsMerge() them after joining.
+ *
+ * Tools copy the framebuffer into a snapshot first and report the copy as read, with --direct they convert straight
+ * from the mapping and read it during the convert stage. Zero-copy raw dumps move the pages straight to the output and count as write.
+ * Under --stats the output FILE gets a buffer for the whole image, so encoders only fill memory and the write stage
+ * is the flush to the device. Streamed images are converted band by band inside the encode or write stage, the
+ * conversion time is moved out of it with StatsMove().
+ */
+typedef enum {
+	STATS_OPEN,     /* Device open, profile and mapping, see GrabOpen(). */
+	STATS_READ,
+	STATS_CONVERT,
+	STATS_ENCODE,
+	STATS_WRITE,
+	STATS_STAGES
+} stats_stage_t;
+
+typedef struct {
+	int32_t enabled;
+	const char *tool;
+	const char *device;
+	uint64_t start;
+	uint64_t stages[STATS_STAGES];   /* Microseconds. */
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	int32_t written_unknown;         /* Some output could not be measured, a pipe. */
+	uint32_t frames;
+	uint64_t heap_peak;              /* Bytes in use, sampled at the end of every stage. */
+} stats_t;
+
+void StatsInit(stats_t *aStats, const char *aTool, int32_t aEnabled);
+/* Returns the timestamp for StatsEnd(), 0 when disabled. */
+uint64_t StatsBegin(const stats_t *aStats);
+void StatsEnd(stats_t *aStats, stats_stage_t aStage, uint64_t aBegin);
+/* Gives aFile a buffer of aBytes when enabled, must come before the first write to aFile. */
+void StatsBuffer(const stats_t *aStats, FILE *aFile, uint32_t aBytes);
+/* Flushes aFile as the write stage and counts its size. Returns 0 or -1 like fflush(). */
+int32_t StatsFlush(stats_t *aStats, FILE *aFile);
+/* Adds the size of the output file aFd to bytes_written, pipes and devices make it unknown. */
+void StatsOutput(stats_t *aStats, int32_t aFd);
+/* Moves aMicroseconds of stage aFrom to aTo, for stages that interleave like the conversion of a streamed image. */
+void StatsMove(stats_t *aStats, stats_stage_t aFrom, stats_stage_t aTo, uint64_t aMicroseconds);
+void StatsMerge(stats_t *aStats, const stats_t *aOther);
+/* Prints the JSON line if enabled. */
+void StatsPrint(stats_t *aStats, int32_t aError);
+
+#endif /* !STATS_H */
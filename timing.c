@@ -0,0 +1,19 @@
+/* C */
+#include <stdint.h>
+#include <time.h>
+
+/* Local */
+#include "timing.h"
+
+/* clock_gettime() lives in librt on the MotoMAGX glibc, link with -lrt. */
+uint64_t TimeMonotonicUs(void) {
+	struct timespec lTime;
+	clock_gettime(CLOCK_MONOTONIC, &lTime);
+	return (uint64_t) lTime.tv_sec * 1000000 + lTime.tv_nsec / 1000;
+}
+
+uint64_t TimeRealtimeUs(void) {
+	struct timespec lTime;
+	clock_gettime(CLOCK_REALTIME, &lTime);
+	return (uint64_t) lTime.tv_sec * 1000000 + lTime.tv_nsec / 1000;
+}
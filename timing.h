@@ -0,0 +1,12 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/* C */
+#include <stdint.h>
+
+/* Monotonic clock in microseconds, only differences between two calls are meaningful. */
+uint64_t TimeMonotonicUs(void);
+/* Wall clock in microseconds since the epoch, for timestamps stored in files. */
+uint64_t TimeRealtimeUs(void);
+
+#endif /* !TIMING_H */
@@ -1,22 +1,53 @@
 // C
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // Qt
 #include <qapplication.h>
 #include <qpixmap.h>
 #include <qwidget.h>
 
+// Local
+#include "qtagent.h"
+
 // Defines
 #define SCR_WIDTH  240
 #define SCR_HEIGHT 320
+#define ZGRAB_FIFO "/tmp/zgrab.fifo"
+
+static void SetupWidget(QWidget *aWidget) {
+	aWidget->setFocusPolicy(QWidget::NoFocus);
+	aWidget->setBackgroundMode(QWidget::NoBackground);
+	aWidget->setFixedSize(SCR_WIDTH, SCR_HEIGHT);
+}
+
+// The widget is only shown for the grab, a resident one on top would take the input of the screen under it.
+static bool GrabWidget(QPixmap *aPixmap, void *aWidget) {
+	QWidget *widget = (QWidget *) aWidget;
+	widget->show();
+	bitBlt(aPixmap, 0, 0, widget, 0, 0, SCR_WIDTH, SCR_HEIGHT, Qt::CopyROP, true);
+	widget->hide();
+	return true;
+}
 
 int main(int argc, char *argv[]) {
+	if (argc >= 2 && argc <= 4 && !strcmp("--agent", argv[1])) {
+		QApplication app(argc, argv);
+		QWidget fullScreenWidget(0);
+		SetupWidget(&fullScreenWidget);
+		QPixmap fullScreenPixmap(SCR_WIDTH, SCR_HEIGHT, -1, QPixmap::BestOptim);
+		return AgentRun(
+			&app, ZGRAB_FIFO, GrabWidget, &fullScreenWidget, &fullScreenPixmap, (argc >= 3) ? argv[2] : NULL, (argc == 4) ? atoi(argv[3]) : -1
+		);
+	}
 	if (argc >= 2 && argc <= 3) {
+		int result = AgentRequest(ZGRAB_FIFO, argv[1], (argc == 3) ? atoi(argv[2]) : -1);
+		if (result >= 0)
+			return result;
 		QApplication app(argc, argv);
 		QWidget fullScreenWidget(0);
-		fullScreenWidget.setFocusPolicy(QWidget::NoFocus);
-		fullScreenWidget.setBackgroundMode(QWidget::NoBackground);
-		fullScreenWidget.setFixedSize(SCR_WIDTH, SCR_HEIGHT);
+		SetupWidget(&fullScreenWidget);
 		fullScreenWidget.show();
 		QPixmap fullScreenPixmap(SCR_WIDTH, SCR_HEIGHT, -1, QPixmap::BestOptim);
 		bitBlt(&fullScreenPixmap, 0, 0, &fullScreenWidget, 0, 0, SCR_WIDTH, SCR_HEIGHT, Qt::CopyROP, true);
@@ -28,12 +59,18 @@ int main(int argc, char *argv[]) {
 		fprintf(
 			stderr,
 			"Usage:\n"
-			"\tzgrab screenshot.<format> <quality 0-100>\n\n"
+			"\tzgrab screenshot.<format> <quality 0-100>\n"
+			"\tzgrab --agent [screenshot.<format> [quality 0-100]]\n\n"
+			"Agent:\n"
+			"\t--agent keeps Qt running and takes screenshots on demand. While it runs, \"zgrab screenshot.<format>\"\n"
+			"\tasks it through " ZGRAB_FIFO " instead of starting Qt, SIGUSR1 saves to the file given to --agent.\n"
+			"\tSIGINT or SIGTERM stops it.\n\n"
 			"Example:\n"
 			"\tzgrab screenshot.png\n"
 			"\tzgrab screenshot.bmp\n"
 			"\tzgrab screenshot.jpeg 100\n"
 			"\tzgrab screenshot.jpeg 25\n"
+			"\tzgrab --agent /tmp/last.png &\n"
 		);
 	return 0;
 }